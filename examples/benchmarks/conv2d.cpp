@@ -0,0 +1,100 @@
+/*
+    Copyright (c) 2016, Taiga Nomi
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+// compares the convolution algorithms of the tiny_dnn backend.
+// "fprop" runs inference on a batch, "train" runs one fit() pass over it
+// (forward + both gradients + update).
+
+#include <iostream>
+#include <vector>
+
+#include "tiny_dnn/tiny_dnn.h"
+
+using namespace tiny_dnn;
+using namespace std;
+
+struct conv_shape {
+    cnn_size_t size, window, in_channels, out_channels;
+};
+
+void run(const conv_shape& s, conv_algorithm algorithm, int batch,
+         int iterations) {
+    typedef convolutional_layer<relu> conv_t;
+
+    network<sequential> nn;
+    nn << conv_t(s.size, s.size, s.window, s.in_channels, s.out_channels,
+                 padding::same, true, 1, 1, core::backend_t::tiny_dnn);
+    nn.at<conv_t>(0).set_algorithm(algorithm);
+    nn.init_weight();
+
+    tensor_t in(batch, vec_t(nn.in_data_size()));
+    std::vector<vec_t> t(batch, vec_t(nn.out_data_size()));
+    for (auto& v : in) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+
+    nn.set_netphase(net_phase::test);
+    nn.predict_bound(in);
+    timer fprop;
+    for (int i = 0; i < iterations; i++) nn.predict_bound(in);
+    const double fprop_ms = fprop.elapsed() * 1000 / iterations;
+
+    nn.set_netphase(net_phase::train);
+    gradient_descent opt;
+    std::vector<vec_t> in_vec(in.begin(), in.end());
+    timer train;
+    for (int i = 0; i < iterations; i++) {
+        nn.fit<mse>(opt, in_vec, t, batch, 1);
+    }
+    const double train_ms = train.elapsed() * 1000 / iterations;
+
+    cout << "\t" << fprop_ms << "\t" << train_ms;
+}
+
+int main(int argc, char** argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 5;
+    const int batch = argc > 2 ? atoi(argv[2]) : 16;
+    const conv_shape shapes[] = {
+        { 32, 5,  3,  32 },
+        { 32, 3,  3,  16 },
+        { 32, 3,  8,   8 },
+        { 32, 3, 32,  32 },
+        { 16, 3, 64,  64 },
+        {  8, 3, 128, 128 },
+    };
+
+    cout << "batch: " << batch << ", iterations: " << iterations << endl;
+    cout << "shape\tdirect fprop(ms)\tdirect train(ms)"
+         << "\tgemm fprop(ms)\tgemm train(ms)"
+         << "\twinograd fprop(ms)\twinograd train(ms)" << endl;
+
+    for (const auto& s : shapes) {
+        cout << s.size << "x" << s.size << "x" << s.in_channels
+             << " k" << s.window << " -> " << s.out_channels;
+        run(s, conv_algorithm::direct, batch, iterations);
+        run(s, conv_algorithm::gemm, batch, iterations);
+        run(s, conv_algorithm::winograd, batch, iterations);
+        cout << endl;
+    }
+}
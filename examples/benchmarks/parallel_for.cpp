@@ -0,0 +1,98 @@
+/*
+    Copyright (c) 2016, Taiga Nomi
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// micro-benchmark of per-dispatch overhead of parallel_for.
+//
+// "async" reproduces the former default backend, which launched
+// hardware_concurrency() threads by std::async on every call.
+// "parallel_for" dispatches into the persistent tiny_dnn::thread_pool.
+
+#include <iostream>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "tiny_dnn/tiny_dnn.h"
+
+using namespace tiny_dnn;
+using namespace std;
+
+template <typename Func>
+void async_parallel_for(int start, int end, const Func &f) {
+    int nthreads = std::thread::hardware_concurrency();
+    int blockSize = (end - start) / nthreads;
+    if (blockSize*nthreads < end - start)
+        blockSize++;
+
+    std::vector<std::future<void>> futures;
+
+    int blockStart = start;
+    int blockEnd = blockStart + blockSize;
+    if (blockEnd > end) blockEnd = end;
+
+    for (int i = 0; i < nthreads; i++) {
+        futures.push_back(std::async(std::launch::async, [blockStart, blockEnd, &f] {
+            f(blocked_range(blockStart, blockEnd));
+        }));
+
+        blockStart += blockSize;
+        blockEnd = blockStart + blockSize;
+        if (blockStart >= end) break;
+        if (blockEnd > end) blockEnd = end;
+    }
+
+    for (auto &future : futures)
+        future.wait();
+}
+
+template <typename Dispatch>
+double us_per_dispatch(Dispatch dispatch, int iterations) {
+    timer t;
+    for (int i = 0; i < iterations; i++) dispatch();
+    return t.elapsed() * 1e6 / iterations;
+}
+
+int main(int argc, char** argv) {
+    const int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    const int sizes[] = { 8, 64, 1024, 65536 };
+
+    vec_t data(65536, float_t(1));
+
+    auto body = [&](const blocked_range& r) {
+        for (int i = r.begin(); i < r.end(); i++) data[i] = data[i] * float_t(0.5) + float_t(0.5);
+    };
+
+    cout << "threads: " << std::thread::hardware_concurrency()
+         << ", iterations: " << iterations << endl;
+    cout << "size\tasync(us)\tparallel_for(us)" << endl;
+
+    for (int n : sizes) {
+        double before = us_per_dispatch([&] { async_parallel_for(0, n, body); }, iterations);
+        double after  = us_per_dispatch([&] { parallel_for(0, n, body, 1); }, iterations);
+        cout << n << "\t" << before << "\t" << after << endl;
+    }
+}
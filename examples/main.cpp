@@ -378,7 +378,7 @@ void sample5_unbalanced_training_data(const string& data_dir) {
     // - note that it does not learn the classes 0-4
     nn_standard.train<mse>(optimizer, train_images, train_labels,
                            minibatch_size, 20, on_enumerate_data,
-                           on_enumerate_epoch, true, CNN_TASK_SIZE);
+                           on_enumerate_epoch, true, 0);
 
     // then train another network, now with explicitly
     // supplied target costs (aim: a more balanced predictor)
@@ -388,7 +388,7 @@ void sample5_unbalanced_training_data(const string& data_dir) {
     const auto target_cost = create_balanced_target_cost(train_labels, 0.8);
     nn_balanced.train<mse>(optimizer, train_images, train_labels,
                            minibatch_size, 20, on_enumerate_data,
-                           on_enumerate_epoch, true, CNN_TASK_SIZE,
+                           on_enumerate_epoch, true, 0,
                            target_cost);
 
     // test and show results
@@ -36,6 +36,13 @@ using namespace tiny_dnn::activation;
 #include "test_serialization.h"
 #endif
 #include "test_network.h"
+#include "test_optimizers.h"
+#include "test_parallel_for.h"
+#include "test_batch_tensor.h"
+#include "test_memory_pool.h"
+#include "test_activation_function.h"
+#include "test_blocked_layout.h"
+#include "test_bfloat16.h"
 #include "test_average_pooling_layer.h"
 // TODO(yida): fix broken test
 //#include "test_average_unpooling_layer.h"
@@ -0,0 +1,203 @@
+/*
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY 
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY 
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include "gtest/gtest.h"
+#include "testhelper.h"
+#include "tiny_dnn/tiny_dnn.h"
+
+namespace tiny_dnn {
+
+#if (defined(CNN_USE_SSE) || defined(CNN_USE_AVX)) && !defined(CNN_USE_DOUBLE)
+
+// distance in units in the last place between two finite floats
+inline int64_t ulp_distance(float a, float b) {
+    auto ordered = [](float f) {
+        int32_t i;
+        std::memcpy(&i, &f, sizeof(i));
+        return i < 0 ? int64_t(INT32_MIN) - i : int64_t(i);
+    };
+    const int64_t d = ordered(a) - ordered(b);
+    return d < 0 ? -d : d;
+}
+
+// max ulp error of f against ref (evaluated in double) on [lo, hi]
+template <typename F, typename Ref>
+int64_t max_ulp_error(F f, Ref ref, float lo, float hi) {
+    const size_t n = 200001;
+    std::vector<float> x(n), y(n);
+    for (size_t i = 0; i < n; i++) x[i] = lo + (hi - lo) * i / (n - 1);
+    f(&x[0], &y[0], n);
+
+    int64_t err = 0;
+    for (size_t i = 0; i < n; i++) {
+        const float expected = static_cast<float>(ref(double(x[i])));
+        err = std::max(err, ulp_distance(y[i], expected));
+    }
+    return err;
+}
+
+TEST(activation, simd_exp_ulp) {
+    auto f = [](const float* x, float* y, size_t n) { vectorize::exp(x, y, n); };
+    auto ref = [](double x) { return std::exp(x); };
+    EXPECT_LE(max_ulp_error(f, ref, -87.3f, 88.7f), 1);
+    EXPECT_LE(max_ulp_error(f, ref, -1.0f, 1.0f), 1);
+}
+
+TEST(activation, simd_sigmoid_ulp) {
+    auto f = [](const float* x, float* y, size_t n) { vectorize::sigmoid(x, y, n); };
+    auto ref = [](double x) { return 1.0 / (1.0 + std::exp(-x)); };
+    EXPECT_LE(max_ulp_error(f, ref, -87.0f, 30.0f), 3);
+    EXPECT_LE(max_ulp_error(f, ref, -2.0f, 2.0f), 3);
+}
+
+TEST(activation, simd_tanh_ulp) {
+    auto f = [](const float* x, float* y, size_t n) { vectorize::tanh(x, y, n); };
+    auto ref = [](double x) { return std::tanh(x); };
+    EXPECT_LE(max_ulp_error(f, ref, -20.0f, 20.0f), 1);
+    EXPECT_LE(max_ulp_error(f, ref, -1.0f, 1.0f), 1);
+    EXPECT_LE(max_ulp_error(f, ref, -1e-3f, 1e-3f), 3);
+}
+
+TEST(activation, simd_pow) {
+    // as used by lrn_layer: (1 + alpha / size * sum(x^2))^-beta
+    const size_t n = 100001;
+    std::vector<float> x(n), y(n);
+    for (size_t i = 0; i < n; i++) x[i] = 1.0f + 40000.0f * i / (n - 1);
+
+    for (float p : { -0.75f, -0.5f, 2.0f }) {
+        vectorize::pow(&x[0], p, &y[0], n);
+        for (size_t i = 0; i < n; i++) {
+            const double expected = std::pow(double(x[i]), double(p));
+            if (p > 0 && expected > 1e30) continue;
+            ASSERT_NEAR(1.0, y[i] / expected, 2e-6) << x[i] << "^" << p;
+        }
+    }
+
+    // mantissas on both sides of sqrt(1/2)
+    const float small[] = { 0.7f, 0.71f, 1e-30f, 3e30f };
+    float out[4];
+    vectorize::pow(small, -0.75f, out, 4);
+    for (size_t i = 0; i < 4; i++) {
+        EXPECT_NEAR(1.0, out[i] / std::pow(double(small[i]), -0.75), 2e-6);
+    }
+}
+
+TEST(activation, simd_exp_range) {
+    const float x[] = { -1000.0f, -88.0f, 0.0f, 88.7f, 1000.0f };
+    float y[5];
+    vectorize::exp(x, y, 5);
+    EXPECT_EQ(0.0f, y[0]);
+    EXPECT_EQ(0.0f, y[1]);
+    EXPECT_EQ(1.0f, y[2]);
+    EXPECT_TRUE(std::isfinite(y[3]));
+    EXPECT_TRUE(std::isinf(y[4]));
+    EXPECT_GT(y[4], 0.0f);
+}
+
+#endif
+
+// batch f/df of each activation against its per-element definition
+template <typename Activation>
+void check_batch_activation(float_t tolerance) {
+    Activation h;
+    const activation::function& base = h;
+
+    // odd size, leaves a partial vector
+    const cnn_size_t n = 37;
+    vec_t x(n), y(n), dy(n), dx(n);
+    uniform_rand(x.begin(), x.end(), -4.0, 4.0);
+    uniform_rand(dy.begin(), dy.end(), -1.0, 1.0);
+    x[3] = float_t(0);
+
+    base.f(&x[0], &y[0], n);
+    for (cnn_size_t i = 0; i < n; i++) {
+        EXPECT_NEAR(h.f(x, i), y[i], tolerance);
+    }
+
+    base.df(&y[0], &dy[0], &dx[0], n);
+    for (cnn_size_t i = 0; i < n; i++) {
+        float_t expected = float_t(0);
+        if (h.one_hot()) {
+            expected = dy[i] * h.df(y[i]);
+        } else {
+            const vec_t d = h.df(y, i);
+            for (cnn_size_t j = 0; j < n; j++) expected += dy[j] * d[j];
+        }
+        EXPECT_NEAR(expected, dx[i], tolerance);
+    }
+}
+
+TEST(activation, batch) {
+    check_batch_activation<activation::identity>(1e-6);
+    check_batch_activation<activation::sigmoid>(1e-6);
+    check_batch_activation<activation::relu>(1e-6);
+    check_batch_activation<activation::leaky_relu>(1e-6);
+    check_batch_activation<activation::elu>(1e-6);
+    check_batch_activation<activation::softmax>(1e-6);
+    check_batch_activation<activation::tan_h>(1e-6);
+    check_batch_activation<activation::tan_hp1m2>(1e-6);
+}
+
+TEST(activation, softmax_batch_large_input) {
+    activation::softmax h;
+    const activation::function& base = h;
+    const cnn_size_t n = 1000;
+    vec_t x(n), y(n), dy(n, float_t(1)), dx(n);
+    for (cnn_size_t i = 0; i < n; i++) x[i] = float_t(1000) + float_t(i % 7);
+
+    base.f(&x[0], &y[0], n);
+    float_t sum = float_t(0);
+    for (auto v : y) {
+        EXPECT_TRUE(std::isfinite(v));
+        sum += v;
+    }
+    EXPECT_NEAR(float_t(1), sum, 1e-4);
+    EXPECT_NEAR(y[6] / y[0], std::exp(float_t(6)), 1e-2);
+
+    // softmax is invariant to a constant shift, so J*1 = 0
+    base.df(&y[0], &dy[0], &dx[0], n);
+    for (auto v : dx) EXPECT_NEAR(float_t(0), v, 1e-6);
+}
+
+// activations which don't override the batch entry points
+class cube : public activation::function {
+ public:
+    using activation::function::df;
+    float_t f(const vec_t& v, cnn_size_t i) const override { return v[i] * v[i] * v[i]; }
+    float_t df(float_t y) const override { return 3 * std::cbrt(y * y); }
+    std::pair<float_t, float_t> scale() const override {
+        return std::make_pair(float_t(-0.8), float_t(0.8));
+    }
+};
+
+TEST(activation, batch_default) {
+    check_batch_activation<cube>(1e-4);
+}
+
+} // namespace tiny_dnn
@@ -90,6 +90,20 @@ TEST(ave_pool, gradient_check4) { // padding-same
     EXPECT_TRUE(nn.gradient_check<loss_func>(test_data.first, test_data.second, epsilon<float_t>(), GRAD_CHECK_ALL));
 }
 
+TEST(ave_pool, gradient_check5) { // overlapping windows summed by sliding
+    typedef cross_entropy loss_func;
+    typedef activation::sigmoid activation;
+    typedef network<sequential> network;
+
+    network nn;
+    nn  << average_pooling_layer<activation>(8, 4, 2, 4, 4, 1, 1); // 8x4x2 => 5x1x2
+
+    const auto test_data = generate_gradient_check_data(nn.in_data_size());
+    nn.init_weight();
+
+    EXPECT_TRUE(nn.gradient_check<loss_func>(test_data.first, test_data.second, epsilon<float_t>(), GRAD_CHECK_ALL));
+}
+
 TEST(ave_pool, forward) {
     average_pooling_layer<identity> l(4, 4, 1, 2);
     vec_t in = {
@@ -142,6 +156,34 @@ TEST(ave_pool, forward_stride) {
     }
 }
 
+TEST(ave_pool, forward_sliding) {
+    const cnn_size_t w = 12, h = 8, pool = 4;
+    average_pooling_layer<identity> l(w, h, 2, pool, pool, 1, 1);
+    vec_t in(w * h * 2);
+    uniform_rand(in.begin(), in.end(), -1.0, 1.0);
+
+    l.weight_init(weight_init::constant(1.0));
+    l.bias_init(weight_init::constant(0.5));
+    l.init_weight();
+
+    vec_t res = l.forward({ { in } })[0][0];
+
+    const cnn_size_t ow = w - pool + 1, oh = h - pool + 1;
+    ASSERT_EQ(res.size(), size_t(ow * oh * 2));
+    for (cnn_size_t c = 0; c < 2; c++) {
+        for (cnn_size_t y = 0; y < oh; y++) {
+            for (cnn_size_t x = 0; x < ow; x++) {
+                float_t sum = 0;
+                for (cnn_size_t dy = 0; dy < pool; dy++)
+                    for (cnn_size_t dx = 0; dx < pool; dx++)
+                        sum += in[(c * h + y + dy) * w + x + dx];
+                EXPECT_NEAR(sum / (pool * pool) + 0.5,
+                            res[(c * oh + y) * ow + x], 1e-5);
+            }
+        }
+    }
+}
+
 TEST(ave_pool, read_write) {
     average_pooling_layer<tan_h> l1(100, 100, 5, 2);
     average_pooling_layer<tan_h> l2(100, 100, 5, 2);
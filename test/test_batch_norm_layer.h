@@ -231,6 +231,38 @@ TEST(batchnorm, forward) {
     }
 }
 
+TEST(batchnorm, forward_large_offset) {
+    // one-pass statistics must not lose the variance to a large mean
+    const size_t num = 5, spatial = 37, channels = 3;
+    batch_normalization_layer bn(spatial, channels);
+
+    tensor_t in(num, vec_t(spatial * channels));
+    for (auto& v : in) {
+        uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+        for (size_t i = 0; i < v.size(); i++) v[i] += 1000 * (i / spatial + 1);
+    }
+
+    const tensor_t out = bn.forward({ in })[0];
+
+    for (size_t c = 0; c < channels; c++) {
+        double mean = 0, var = 0;
+        for (size_t i = 0; i < num; i++)
+            for (size_t k = 0; k < spatial; k++) mean += in[i][c * spatial + k];
+        mean /= num * spatial;
+        for (size_t i = 0; i < num; i++)
+            for (size_t k = 0; k < spatial; k++)
+                var += (in[i][c * spatial + k] - mean) * (in[i][c * spatial + k] - mean);
+        var /= num * spatial - 1;
+
+        for (size_t i = 0; i < num; i++) {
+            for (size_t k = 0; k < spatial; k++) {
+                const double expected = (in[i][c * spatial + k] - mean) / std::sqrt(var + 1e-5);
+                EXPECT_NEAR(expected, out[i][c * spatial + k], 2e-3);
+            }
+        }
+    }
+}
+
 TEST(batchnorm, read_write) {
     batch_normalization_layer l1(100, 100);
     batch_normalization_layer l2(100, 100);
@@ -241,4 +273,101 @@ TEST(batchnorm, read_write) {
     serialization_test(l1, l2);
 }
 
+// moving statistics as if trained
+inline void set_batchnorm_stats(batch_normalization_layer* bn, size_t channels) {
+    vec_t mean(channels), variance(channels);
+    uniform_rand(mean.begin(), mean.end(), -1.0, 1.0);
+    uniform_rand(variance.begin(), variance.end(), 0.1, 2.0);
+    bn->set_mean(mean);
+    bn->set_variance(variance);
+}
+
+TEST(batchnorm, fold_sequential) {
+    network<sequential> net;
+    net << convolutional_layer<identity>(6, 6, 3, 2, 4)   // 6x6x2 => 4x4x4
+        << batch_normalization_layer(16, 4)
+        << fully_connected_layer<identity>(64, 10)
+        << batch_normalization_layer(10, 1)
+        << fully_connected_layer<tan_h>(10, 3);
+    net.init_weight();
+    set_batchnorm_stats(&net.at<batch_normalization_layer>(1), 4);
+    set_batchnorm_stats(&net.at<batch_normalization_layer>(3), 1);
+
+    vec_t in(6 * 6 * 2);
+    uniform_rand(in.begin(), in.end(), -1.0, 1.0);
+    net.set_netphase(net_phase::test);
+    const vec_t expected = net.predict(in);
+
+    EXPECT_EQ(2u, net.fold_batch_normalization());
+    EXPECT_EQ(3u, net.layer_size());
+    EXPECT_EQ("conv", net[0]->layer_type());
+    EXPECT_EQ("fully-connected", net[1]->layer_type());
+
+    const vec_t actual = net.predict(in);
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_NEAR(expected[i], actual[i], 1e-5);
+    }
+}
+
+TEST(batchnorm, fold_undone_on_mismatch) {
+    network<sequential> net;
+    net << fully_connected_layer<identity>(8, 6)
+        << batch_normalization_layer(6, 1)
+        << fully_connected_layer<tan_h>(6, 2);
+    net.init_weight();
+    set_batchnorm_stats(&net.at<batch_normalization_layer>(1), 1);
+
+    vec_t in(8);
+    uniform_rand(in.begin(), in.end(), -1.0, 1.0);
+    net.set_netphase(net_phase::test);
+    const vec_t expected = net.predict(in);
+
+    // no fold passes a negative tolerance, the network is restored
+    EXPECT_EQ(0u, net.fold_batch_normalization(-1));
+    EXPECT_EQ(3u, net.layer_size());
+    EXPECT_EQ("batch-norm", net[1]->layer_type());
+
+    const vec_t actual = net.predict(in);
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_FLOAT_EQ(expected[i], actual[i]);
+    }
+}
+
+TEST(batchnorm, fold_skips_nonlinear_producer) {
+    network<sequential> net;
+    net << fully_connected_layer<relu>(8, 6)
+        << batch_normalization_layer(6, 1)
+        << fully_connected_layer<identity>(6, 2, false)
+        << batch_normalization_layer(2, 1);
+    net.init_weight();
+
+    // relu can't absorb the scale, the fc without bias can't absorb the shift
+    EXPECT_EQ(0u, net.fold_batch_normalization());
+    EXPECT_EQ(4u, net.layer_size());
+}
+
+TEST(batchnorm, fold_graph_output) {
+    fully_connected_layer<identity> fc(5, 4);
+    batch_normalization_layer bn(4, 1);
+    fc << bn;
+
+    network<graph> net;
+    construct_graph(net, { &fc }, { &bn });
+    net.init_weight();
+    set_batchnorm_stats(&bn, 1);
+
+    vec_t in(5);
+    uniform_rand(in.begin(), in.end(), -1.0, 1.0);
+    net.set_netphase(net_phase::test);
+    const vec_t expected = net.predict(in);
+
+    EXPECT_EQ(1u, net.fold_batch_normalization());
+    EXPECT_EQ(1u, net.layer_size());
+
+    const vec_t actual = net.predict(in);
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_NEAR(expected[i], actual[i], 1e-5);
+    }
+}
+
 } // namespace tiny-dnn
@@ -0,0 +1,135 @@
+/*
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY 
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY 
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include "gtest/gtest.h"
+#include "testhelper.h"
+#include "tiny_dnn/tiny_dnn.h"
+
+namespace tiny_dnn {
+
+TEST(batch_tensor, shape_and_strides) {
+    batch_tensor t(3, 2, 5, 7);  // N, C, H, W
+
+    EXPECT_EQ(3u, t.num());
+    EXPECT_EQ(2u, t.channels());
+    EXPECT_EQ(5u, t.height());
+    EXPECT_EQ(7u, t.width());
+    EXPECT_EQ(70u, t.sample_size());
+    EXPECT_GE(t.sample_stride(), t.sample_size());
+    EXPECT_EQ(0u, t.sample_stride() * sizeof(float_t) % 64);
+    EXPECT_EQ(35u, t.stride(1));
+    EXPECT_EQ(7u, t.stride(2));
+    EXPECT_EQ(1u, t.stride(3));
+
+    for (cnn_size_t n = 0; n < t.num(); n++) {
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(t.sample(n)) % 64);
+    }
+
+    t.at(2, 1, 4, 6) = float_t(1);
+    EXPECT_EQ(float_t(1), t[2][69]);
+    EXPECT_EQ(t.sample(2) + 69, &t.at(2, 1, 4, 6));
+}
+
+TEST(batch_tensor, tensor_roundtrip) {
+    tensor_t src(4, vec_t(10));
+    for (size_t n = 0; n < src.size(); n++)
+        for (size_t i = 0; i < src[n].size(); i++)
+            src[n][i] = static_cast<float_t>(n * 100 + i);
+
+    batch_tensor t(0, shape3d(10, 1, 1));
+    t.from_tensor(src);
+    EXPECT_EQ(4u, t.num());
+
+    float_t sum = 0;
+    for (auto v : t[3]) sum += v;
+    EXPECT_EQ(float_t(3 * 100 * 10 + 45), sum);
+
+    tensor_t dst;
+    t.to_tensor(dst);
+    ASSERT_EQ(src.size(), dst.size());
+    for (size_t n = 0; n < src.size(); n++) {
+        EXPECT_TRUE(src[n] == dst[n]);
+    }
+
+    tensor_t bad(1, vec_t(9));
+    EXPECT_THROW(t.from_tensor(bad), nn_error);
+}
+
+TEST(batch_tensor, resize_keeps_samples) {
+    batch_tensor t(2, shape3d(3, 1, 1));
+    t.fill(float_t(2));
+    t.resize(4);
+
+    EXPECT_EQ(float_t(2), t[1][2]);
+    EXPECT_EQ(float_t(0), t[3][0]);
+}
+
+TEST(batch_tensor, reshape_keeps_buffer) {
+    batch_tensor t(3, shape3d(20, 1, 1));
+    t.fill(float_t(1));
+    const float_t* buf = t.data();
+
+    t.reshape(2, shape3d(5, 2, 1));
+    EXPECT_EQ(2u, t.num());
+    EXPECT_EQ(10u, t.sample_size());
+    EXPECT_EQ(buf, t.data());  // smaller, buffer kept
+
+    // samples are not cleared, the padding is
+    for (cnn_size_t n = 0; n < t.num(); n++) {
+        for (cnn_size_t i = t.sample_size(); i < t.sample_stride(); i++) {
+            EXPECT_EQ(float_t(0), t.sample(n)[i]);
+        }
+    }
+}
+
+TEST(batch_scratch, nested_buffers) {
+    const float_t* outer_buf;
+    {
+        batch_scratch outer(4, shape3d(16, 1, 1));
+        outer.get().fill(float_t(1));
+        outer_buf = outer.get().data();
+
+        // a scratch taken while another is alive (e.g. by a task run
+        // while waiting in for_i) gets its own buffer
+        {
+            batch_scratch inner(4, shape3d(16, 1, 1));
+            EXPECT_NE(outer_buf, inner.get().data());
+            inner.get().fill(float_t(2));
+        }
+        for (cnn_size_t i = 0; i < 16; i++) {
+            EXPECT_EQ(float_t(1), outer.get().sample(3)[i]);
+        }
+    }
+
+    // released buffers are reused
+    batch_scratch again(4, shape3d(16, 1, 1));
+    batch_scratch again2(4, shape3d(16, 1, 1));
+    EXPECT_TRUE(again.get().data() == outer_buf ||
+                again2.get().data() == outer_buf);
+}
+
+} // namespace tiny-dnn
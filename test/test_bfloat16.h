@@ -0,0 +1,307 @@
+/*
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY 
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY 
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include "gtest/gtest.h"
+#include "testhelper.h"
+#include "tiny_dnn/tiny_dnn.h"
+
+#include <cstring>
+#include <limits>
+
+namespace tiny_dnn {
+
+inline uint32_t bfloat16_input_bits(float x) {
+    uint32_t u;
+    std::memcpy(&u, &x, sizeof(u));
+    return u;
+}
+
+inline float bfloat16_input_float(uint32_t u) {
+    float x;
+    std::memcpy(&x, &u, sizeof(x));
+    return x;
+}
+
+// conv (gemm) -> conv (winograd) -> pool -> fc network and inputs for
+// the accuracy tests
+inline void bfloat16_test_net(network<sequential>* net, tensor_t* in) {
+    *net << conv<relu>(10, 10, 3, 3, 8, padding::same, true, 1, 1,
+                       core::backend_t::tiny_dnn)
+         << conv<relu>(10, 10, 3, 8, 8, padding::same, true, 1, 1,
+                       core::backend_t::tiny_dnn)
+         << max_pool<identity>(10, 10, 8, 2)
+         << fc<tan_h>(5 * 5 * 8, 40)
+         << fc<identity>(40, 10);
+    net->init_weight();
+
+    *in = tensor_t(5, vec_t(10 * 10 * 3));
+    for (auto& v : *in) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+}
+
+TEST(bfloat16, rounding) {
+    EXPECT_EQ(0x3f80, to_bfloat16(1.0f).bits);
+    EXPECT_EQ(0xc000, to_bfloat16(-2.0f).bits);
+    EXPECT_EQ(0x0000, to_bfloat16(0.0f).bits);
+    EXPECT_EQ(0x8000, to_bfloat16(-0.0f).bits);
+
+    // to nearest, ties to even
+    EXPECT_EQ(0x3f80, to_bfloat16(bfloat16_input_float(0x3f807fffu)).bits);
+    EXPECT_EQ(0x3f80, to_bfloat16(bfloat16_input_float(0x3f808000u)).bits);
+    EXPECT_EQ(0x3f81, to_bfloat16(bfloat16_input_float(0x3f808001u)).bits);
+    EXPECT_EQ(0x3f82, to_bfloat16(bfloat16_input_float(0x3f818000u)).bits);
+
+    // overflow, infinity and NaN
+    const float inf = std::numeric_limits<float>::infinity();
+    EXPECT_EQ(0x7f80, to_bfloat16(std::numeric_limits<float>::max()).bits);
+    EXPECT_EQ(0x7f80, to_bfloat16(inf).bits);
+    EXPECT_EQ(0xff80, to_bfloat16(-inf).bits);
+    EXPECT_TRUE(std::isnan(to_float(to_bfloat16(bfloat16_input_float(0x7f800001u)))));
+    EXPECT_TRUE(std::isnan(to_float(to_bfloat16(bfloat16_input_float(0xffffffffu)))));
+
+    // relative error within half a step
+    for (float x : { 3.14159265f, -1e-20f, 12345.678f, 1e30f }) {
+        EXPECT_NEAR(x, to_float(to_bfloat16(x)), std::abs(x) * (1.0f / 512));
+    }
+}
+
+TEST(bfloat16, bulk_conversion) {
+    const size_t n = 37;  // vector body and tail
+    std::vector<float> x(n);
+    for (size_t i = 0; i < n; i++) {
+        x[i] = (static_cast<float>(i) - 17.3f) * 0.731f;
+    }
+
+    std::vector<bfloat16> b(n);
+    to_bfloat16(x.data(), b.data(), n);
+    std::vector<float> f(n);
+    from_bfloat16(b.data(), f.data(), n);
+    std::vector<double> d(n);
+    from_bfloat16(b.data(), d.data(), n);
+
+    for (size_t i = 0; i < n; i++) {
+        EXPECT_EQ(to_bfloat16(x[i]).bits, b[i].bits);
+        EXPECT_EQ(bfloat16_input_bits(to_float(b[i])), bfloat16_input_bits(f[i]));
+        EXPECT_EQ(static_cast<double>(f[i]), d[i]);
+    }
+}
+
+TEST(bfloat16, network_exact_weights) {
+    network<sequential> net;
+    tensor_t in;
+    bfloat16_test_net(&net, &in);
+
+    // weights which are representable in bfloat16 give the float_t result
+    for (size_t i = 0; i < net.depth(); i++) {
+        for (vec_t* w : net[i]->weights()) {
+            for (auto& e : *w) {
+                e = to_float(to_bfloat16(static_cast<float>(e)));
+            }
+        }
+    }
+
+    net.set_netphase(net_phase::test);
+    std::vector<vec_t> expected;
+    for (auto& v : in) expected.push_back(net.predict(v));
+
+    net.set_bf16_weights(true);
+    for (size_t i = 0; i < net.depth(); i++) {
+        EXPECT_EQ(net[i]->supports_bf16_weights(),
+                  net[i]->bf16_weights() != nullptr);
+    }
+    EXPECT_TRUE(net[0]->supports_bf16_weights());  // gemm
+    EXPECT_TRUE(net[1]->supports_bf16_weights());  // winograd
+    for (size_t i = 0; i < in.size(); i++) {
+        const vec_t actual = net.predict(in[i]);
+        for (size_t j = 0; j < actual.size(); j++) {
+            EXPECT_NEAR(expected[i][j], actual[j], 1e-5);
+        }
+    }
+}
+
+TEST(bfloat16, network_accuracy) {
+    network<sequential> net;
+    tensor_t in;
+    bfloat16_test_net(&net, &in);
+
+    net.set_netphase(net_phase::test);
+    std::vector<vec_t> expected;
+    for (auto& v : in) expected.push_back(net.predict(v));
+
+    // within a few bfloat16 steps of the output range
+    net.set_bf16_weights(true);
+    float_t max_err = float_t(0);
+    for (size_t i = 0; i < in.size(); i++) {
+        const vec_t actual = net.predict(in[i]);
+        float_t range = float_t(0);
+        for (auto e : expected[i]) range = std::max(range, std::abs(e));
+        for (size_t j = 0; j < actual.size(); j++) {
+            const float_t err = std::abs(expected[i][j] - actual[j]);
+            EXPECT_LE(err, range * float_t(2e-2));
+            max_err = std::max(max_err, err);
+        }
+    }
+    EXPECT_GT(max_err, float_t(0));  // bfloat16 weights were used
+
+    // train phase uses the float_t weights
+    net.set_netphase(net_phase::train);
+    for (size_t i = 0; i < net.depth(); i++) {
+        EXPECT_EQ(nullptr, net[i]->bf16_weights());
+    }
+    net.set_netphase(net_phase::test);
+    net.set_bf16_weights(false);
+    for (size_t i = 0; i < in.size(); i++) {
+        const vec_t actual = net.predict(in[i]);
+        for (size_t j = 0; j < actual.size(); j++) {
+            EXPECT_EQ(expected[i][j], actual[j]);
+        }
+    }
+}
+
+TEST(bfloat16, release_float_weights) {
+    network<sequential> net;
+    tensor_t in;
+    bfloat16_test_net(&net, &in);
+    const auto weight_size = [&](size_t i) {
+        return (*net[i]->inputs()[1]->get_data())[0].size();
+    };
+
+    net.set_netphase(net_phase::test);
+    net.set_bf16_weights(true);
+    std::vector<vec_t> expected;
+    for (auto& v : in) expected.push_back(net.predict(v));
+
+    // inference only: float_t weights of the layers using bfloat16 are
+    // released, the result doesn't change
+    net.set_bf16_weights(true, false);
+    for (size_t i = 0; i < in.size(); i++) {
+        EXPECT_EQ(expected[i], net.predict(in[i]));
+    }
+    for (size_t i = 0; i < net.depth(); i++) {
+        if (!net[i]->supports_bf16_weights()) continue;
+        ASSERT_NE(nullptr, net[i]->bf16_weights());
+        EXPECT_EQ(0u, weight_size(i));
+    }
+
+    // weights() (also used by save) widens them back, rounded to bfloat16.
+    // the next forward releases them again
+    const layer* first = net[0];
+    const vec_t w = *first->weights()[0];
+    ASSERT_EQ(net[0]->bf16_weights()->size(), w.size());
+    for (auto e : w) {
+        EXPECT_EQ(e, to_float(to_bfloat16(static_cast<float>(e))));
+    }
+    std::stringstream ss;
+    net.save(ss);
+    EXPECT_NE(0u, weight_size(0));
+    EXPECT_EQ(expected[0], net.predict(in[0]));
+    EXPECT_EQ(0u, weight_size(0));
+
+    // train phase brings the float_t weights back
+    net.set_netphase(net_phase::train);
+    for (size_t i = 0; i < net.depth(); i++) {
+        EXPECT_EQ(nullptr, net[i]->bf16_weights());
+        if (net[i]->supports_bf16_weights()) {
+            EXPECT_NE(0u, weight_size(i));
+        }
+    }
+}
+
+// text serialization keeps 6 digits
+inline void expect_near_vec(const vec_t& expected, const vec_t& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_NEAR(expected[i], actual[i], 1e-3);
+    }
+}
+
+TEST(bfloat16, weights_changed_in_test_phase) {
+    network<sequential> net, other;
+    tensor_t in;
+    bfloat16_test_net(&net, &in);
+    bfloat16_test_net(&other, &in);
+
+    net.set_netphase(net_phase::test);
+    net.set_bf16_weights(true);
+    net.predict(in[0]);
+
+    // loading weights in test phase is picked up by the next forward
+    std::stringstream ss;
+    other.save(ss);
+    net.load(ss);
+    other.set_netphase(net_phase::test);
+    other.set_bf16_weights(true);
+    expect_near_vec(other.predict(in[0]), net.predict(in[0]));
+
+    // and so are direct writes
+    for (size_t i = 0; i < net.depth(); i++) {
+        for (vec_t* w : net[i]->weights()) {
+            for (auto& e : *w) e = -e;
+        }
+        for (vec_t* w : other[i]->weights()) {
+            for (auto& e : *w) e = -e;
+        }
+    }
+    expect_near_vec(other.predict(in[0]), net.predict(in[0]));
+    for (size_t i = 0; i < net.depth(); i++) {
+        const std::vector<bfloat16>* w = net[i]->bf16_weights();
+        if (!w) continue;
+        const layer* l = net[i];
+        const vec_t& master = *l->weights()[0];
+        EXPECT_EQ(to_bfloat16(static_cast<float>(master[0])).bits, (*w)[0].bits);
+    }
+}
+
+TEST(bfloat16, conv_connection_table) {
+    static const bool connection[] = {
+        true, false, true, false,
+        true, true, false, true
+    };
+    for (auto algorithm : { conv_algorithm::gemm, conv_algorithm::winograd }) {
+        conv<tan_h> l(7, 7, 3, 2, 4, connection_table(connection, 2, 4),
+                      padding::same, true, 1, 1, core::backend_t::tiny_dnn);
+        l.set_algorithm(algorithm);
+        l.init_weight();
+        for (vec_t* w : l.weights()) {
+            for (auto& e : *w) e = to_float(to_bfloat16(static_cast<float>(e)));
+        }
+
+        tensor_t in(2, vec_t(7 * 7 * 2));
+        for (auto& v : in) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+        const tensor_t expected = l.forward({ in })[0];
+
+        l.set_bf16_weights(true);
+        ASSERT_NE(nullptr, l.bf16_weights());
+        const tensor_t actual = l.forward({ in })[0];
+        for (size_t s = 0; s < in.size(); s++) {
+            for (size_t i = 0; i < expected[s].size(); i++) {
+                EXPECT_NEAR(expected[s][i], actual[s][i], 1e-5);
+            }
+        }
+    }
+}
+
+}  // namespace tiny_dnn
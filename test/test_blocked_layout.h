@@ -0,0 +1,220 @@
+/*
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY 
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY 
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include "gtest/gtest.h"
+#include "testhelper.h"
+#include "tiny_dnn/tiny_dnn.h"
+
+namespace tiny_dnn {
+
+inline tensor_t blocked_layout_input(cnn_size_t samples, const shape3d& shape) {
+    tensor_t in(samples, vec_t(shape.size()));
+    for (auto& v : in) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+    return in;
+}
+
+inline void expect_near_tensor(const tensor_t& expected, const tensor_t& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        ASSERT_EQ(expected[i].size(), actual[i].size());
+        for (size_t j = 0; j < expected[i].size(); j++) {
+            EXPECT_NEAR(expected[i][j], actual[i][j], 1e-4);
+        }
+    }
+}
+
+// forward in every blocked layout gives the same (planar) output as nchw
+inline void check_blocked_layer(layer& l, const tensor_t& in) {
+    const tensor_t expected = l.forward({ in })[0];
+
+    for (auto layout : { data_layout::nchw8c, data_layout::nchw16c }) {
+        l.set_layout(layout);
+        expect_near_tensor(expected, l.forward({ in })[0]);
+    }
+    l.set_layout(data_layout::nchw);
+}
+
+TEST(blocked_layout, reorder) {
+    const shape3d shape(5, 3, 11);
+    const tensor_t in = blocked_layout_input(2, shape);
+
+    EXPECT_EQ(16u * 15u, layout_size(shape, data_layout::nchw8c));
+    EXPECT_EQ(16u * 15u, layout_size(shape, data_layout::nchw16c));
+    EXPECT_EQ(shape.size(), layout_size(shape, data_layout::nchw));
+
+    for (auto layout : { data_layout::nchw8c, data_layout::nchw16c }) {
+        tensor_t blocked, planar;
+        reorder_layout(shape, in, data_layout::nchw, blocked, layout);
+        ASSERT_EQ(layout_size(shape, layout), blocked[0].size());
+
+        for (cnn_size_t s = 0; s < in.size(); s++) {
+            for (cnn_size_t c = 0; c < 16; c++) {
+                for (cnn_size_t y = 0; y < shape.height_; y++) {
+                    for (cnn_size_t x = 0; x < shape.width_; x++) {
+                        const float_t v = blocked[s][layout_index(shape, layout, x, y, c)];
+                        if (c < shape.depth_) {
+                            EXPECT_EQ(in[s][shape.get_index(x, y, c)], v);
+                        } else {
+                            EXPECT_EQ(float_t(0), v);  // padded channel
+                        }
+                    }
+                }
+            }
+        }
+
+        reorder_layout(shape, blocked, layout, planar, data_layout::nchw);
+        EXPECT_EQ(in, planar);
+    }
+}
+
+TEST(blocked_layout, conv) {
+    // channels not a multiple of the block, width not a multiple of the tile
+    convolutional_layer<relu> same(11, 9, 3, 5, 10, padding::same);
+    check_blocked_layer(same, blocked_layout_input(3, shape3d(11, 9, 5)));
+
+    convolutional_layer<tan_h> strided(13, 13, 5, 3, 17, padding::valid,
+                                       true, 2, 2);
+    check_blocked_layer(strided, blocked_layout_input(2, shape3d(13, 13, 3)));
+
+    convolutional_layer<sigmoid> rect_stride(9, 9, 3, 9, 8, padding::same,
+                                             true, 2, 1);
+    check_blocked_layer(rect_stride, blocked_layout_input(2, shape3d(9, 9, 9)));
+
+    // [in channel][out channel]
+    static const bool tbl[] = {
+        true,  false, true,  true,
+        false, true,  true,  false,
+        true,  true,  false, false
+    };
+    convolutional_layer<identity> table(8, 8, 3, 3, 4,
+                                        connection_table(tbl, 3, 4));
+    check_blocked_layer(table, blocked_layout_input(2, shape3d(8, 8, 3)));
+}
+
+TEST(blocked_layout, pooling) {
+    max_pooling_layer<relu> maxpool(10, 10, 12, 2);
+    check_blocked_layer(maxpool, blocked_layout_input(3, shape3d(10, 10, 12)));
+
+    max_pooling_layer<identity> overlapped(9, 9, 3, 3, 2);
+    check_blocked_layer(overlapped, blocked_layout_input(2, shape3d(9, 9, 3)));
+
+    average_pooling_layer<tan_h> avepool(8, 8, 20, 2);
+    avepool.init_weight();
+    check_blocked_layer(avepool, blocked_layout_input(3, shape3d(8, 8, 20)));
+}
+
+TEST(blocked_layout, batch_norm) {
+    batch_normalization_layer bn(7 * 5, 9);
+    vec_t mean(9), variance(9);
+    uniform_rand(mean.begin(), mean.end(), -1.0, 1.0);
+    uniform_rand(variance.begin(), variance.end(), 0.5, 2.0);
+    bn.set_mean(mean);
+    bn.set_variance(variance);
+
+    // statistics are only fixed in test phase
+    EXPECT_FALSE(bn.supports_blocked_layout());
+    bn.set_context(net_phase::test);
+    EXPECT_TRUE(bn.supports_blocked_layout());
+    check_blocked_layer(bn, blocked_layout_input(3, shape3d(7 * 5, 1, 9)));
+}
+
+TEST(blocked_layout, sequential) {
+    network<sequential> net;
+    net << conv<relu>(12, 12, 3, 3, 6, padding::same)
+        << batch_norm(12 * 12, 6)
+        << max_pool<tan_h>(12, 12, 6, 2)
+        << conv<relu>(6, 6, 3, 6, 10, padding::same)
+        << ave_pool<identity>(6, 6, 10, 2)
+        << fc<softmax>(3 * 3 * 10, 4);
+    net.init_weight();
+
+    const tensor_t in = blocked_layout_input(4, shape3d(12, 12, 3));
+    net.set_netphase(net_phase::test);
+    std::vector<vec_t> expected;
+    for (auto& v : in) expected.push_back(net.predict(v));
+
+    net.set_blocked_layout(true);
+    net.set_memory_planning(true);
+    const data_layout blocked = native_blocked_layout();
+    for (size_t i = 0; i < 5; i++) {
+        EXPECT_EQ(blocked, net[i]->layout());
+        EXPECT_EQ(i < 4 ? blocked : data_layout::nchw,
+                  net[i]->outputs()[0]->layout());
+    }
+    EXPECT_EQ(data_layout::nchw, net[5]->layout());  // softmax isn't elementwise
+
+    for (size_t i = 0; i < in.size(); i++) {
+        expect_near_tensor({ expected[i] }, { net.predict(in[i]) });
+    }
+
+    // train phase runs in nchw
+    net.set_netphase(net_phase::train);
+    for (size_t i = 0; i < net.depth(); i++) {
+        EXPECT_EQ(data_layout::nchw, net[i]->layout());
+        EXPECT_EQ(data_layout::nchw, net[i]->outputs()[0]->layout());
+    }
+}
+
+TEST(blocked_layout, graph) {
+    input_layer in(shape3d(8, 8, 3));
+    conv<relu> c1(8, 8, 3, 3, 9, padding::same);
+    conv<tan_h> c2(8, 8, 3, 9, 4, padding::same);
+    conv<tan_h> c3(8, 8, 1, 9, 4);
+    add added(2, 8 * 8 * 4);
+    max_pool<relu> pool(8, 8, 4, 2);
+
+    in << c1;
+    c1 << c2;
+    c1 << c3;
+    (c2, c3) << added;
+    added << pool;
+
+    network<graph> net;
+    construct_graph(net, { &in }, { &pool });
+    net.init_weight();
+
+    const tensor_t x = blocked_layout_input(3, shape3d(8, 8, 3));
+    net.set_netphase(net_phase::test);
+    std::vector<vec_t> expected;
+    for (auto& v : x) expected.push_back(net.predict(v));
+
+    net.set_blocked_layout(true);
+    const data_layout blocked = native_blocked_layout();
+    // c1 feeds two blocked layers, c2/c3 feed add which needs nchw,
+    // and the output of the network stays nchw
+    EXPECT_EQ(blocked, c1.outputs()[0]->layout());
+    EXPECT_EQ(data_layout::nchw, c2.outputs()[0]->layout());
+    EXPECT_EQ(data_layout::nchw, c3.outputs()[0]->layout());
+    EXPECT_EQ(blocked, pool.layout());
+    EXPECT_EQ(data_layout::nchw, pool.outputs()[0]->layout());
+
+    for (size_t i = 0; i < x.size(); i++) {
+        expect_near_tensor({ expected[i] }, { net.predict(x[i]) });
+    }
+}
+
+} // namespace tiny_dnn
@@ -488,6 +488,59 @@ TEST(convolutional, bprop_avx_wstride) {
     }
 }
 
+TEST(convolutional, fprop_avx_pad_same) {
+    // border pixels are computed with the clipped window
+    for (cnn_size_t stride = 1; stride <= 2; stride++) {
+        convolutional_layer<sigmoid> l(11, 9, 5, 2, 3, padding::same,
+                                       true, stride, stride);
+        l.set_algorithm(conv_algorithm::direct);
+
+        tensor_buf buf(l), buf2(l);
+
+        l.set_backend_type(tiny_dnn::core::backend_t::tiny_dnn);
+
+        l.forward_propagation(buf.in_buf(), buf.out_buf());
+
+        l.set_backend_type(tiny_dnn::core::backend_t::avx);
+
+        l.forward_propagation(buf.in_buf(), buf2.out_buf());
+
+        vec_t& out_avx = buf2.out_at(0)[0];
+        vec_t& out_noavx = buf.out_at(0)[0];
+
+        for (size_t i = 0; i < out_avx.size(); i++) {
+            EXPECT_NEAR(out_avx[i], out_noavx[i], 1E-5);
+        }
+    }
+}
+
+TEST(convolutional, bprop_avx_pad_same) {
+
+    convolutional_layer<sigmoid> l(11, 9, 5, 2, 3, padding::same);
+    l.set_algorithm(conv_algorithm::direct);
+
+    tensor_buf data(l), grad1(l);
+    tensor_buf grad2(grad1);
+
+    l.set_backend_type(tiny_dnn::core::backend_t::tiny_dnn);
+
+    l.forward_propagation(data.in_buf(), data.out_buf());
+    l.back_propagation(data.in_buf(), data.out_buf(), grad1.out_buf(), grad1.in_buf());
+
+    l.set_backend_type(tiny_dnn::core::backend_t::avx);
+
+    l.forward_propagation(data.in_buf(), data.out_buf());
+    l.back_propagation(data.in_buf(), data.out_buf(), grad2.out_buf(), grad2.in_buf());
+
+    for (size_t i = 0; i < l.in_shape().size(); i++) {
+        vec_t& out_noavx = grad1.in_at(i)[0];
+        vec_t& out_avx = grad2.in_at(i)[0];
+        for (size_t j = 0; j < out_avx.size(); j++) {
+            EXPECT_NEAR(out_avx[j], out_noavx[j], 1E-4);
+        }
+    }
+}
+
 #endif // CNN_USE_AVX
 
 #ifdef CNN_USE_NNPACK
@@ -702,6 +755,245 @@ TEST(convolutional, gradient_check11_connection_tbl) { // sigmoid - mse - has co
         epsilon<float_t>(), GRAD_CHECK_ALL));
 }
 
+// train the same 2-layer net with the direct and the given algorithm,
+// and compare outputs and updated weights. the upper layer is the one
+// under test, its delta is checked through the weights of the lower layer
+inline void check_conv_algorithm(conv_algorithm algorithm,
+                                 cnn_size_t in_size, cnn_size_t window,
+                                 cnn_size_t in_channels,
+                                 cnn_size_t out_channels,
+                                 padding pad, cnn_size_t w_stride,
+                                 cnn_size_t h_stride,
+                                 const connection_table& tbl = connection_table()) {
+    typedef convolutional_layer<tan_h> conv_t;
+    network<sequential> nn[2];
+    for (int i = 0; i < 2; i++) {
+        nn[i] << conv_t(in_size, in_size, 1, 2, in_channels, padding::valid,
+                        true, 1, 1, core::backend_t::tiny_dnn)
+              << conv_t(in_size, in_size, window, window, in_channels,
+                        out_channels, tbl, pad, true, w_stride, h_stride,
+                        core::backend_t::tiny_dnn);
+        nn[i].at<conv_t>(0).set_algorithm(i == 0 ? conv_algorithm::direct
+                                                 : algorithm);
+        nn[i].at<conv_t>(1).set_algorithm(i == 0 ? conv_algorithm::direct
+                                                 : algorithm);
+    }
+    nn[0].init_weight();
+    nn[1].init_weight();
+    for (size_t l = 0; l < nn[0].depth(); l++) {
+        auto w0 = nn[0][l]->weights();
+        auto w1 = nn[1][l]->weights();
+        for (size_t i = 0; i < w0.size(); i++) *w1[i] = *w0[i];
+    }
+
+    std::vector<vec_t> in(5, vec_t(nn[0].in_data_size()));
+    std::vector<vec_t> t(5, vec_t(nn[0].out_data_size()));
+    for (auto& v : in) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+    for (auto& v : t) uniform_rand(v.begin(), v.end(), -0.5, 0.5);
+
+    for (size_t s = 0; s < in.size(); s++) {
+        vec_t out0 = nn[0].predict(in[s]);
+        vec_t out1 = nn[1].predict(in[s]);
+        for (size_t i = 0; i < out0.size(); i++) {
+            EXPECT_NEAR(out0[i], out1[i], 1E-5);
+        }
+    }
+
+    gradient_descent opt[2];
+    nn[0].fit<mse>(opt[0], in, t, 4, 1);
+    nn[1].fit<mse>(opt[1], in, t, 4, 1);
+
+    for (size_t l = 0; l < nn[0].depth(); l++) {
+        auto w0 = nn[0][l]->weights();
+        auto w1 = nn[1][l]->weights();
+        for (size_t i = 0; i < w0.size(); i++) {
+            for (size_t j = 0; j < w0[i]->size(); j++) {
+                EXPECT_NEAR((*w0[i])[j], (*w1[i])[j], 1E-5);
+            }
+        }
+    }
+}
+
+TEST(convolutional, gemm) {
+    check_conv_algorithm(conv_algorithm::gemm, 7, 3, 3, 4, padding::valid, 1, 1);
+    check_conv_algorithm(conv_algorithm::gemm, 9, 5, 2, 7, padding::same, 1, 1);
+    check_conv_algorithm(conv_algorithm::gemm, 8, 3, 3, 2, padding::valid, 2, 1);
+    check_conv_algorithm(conv_algorithm::gemm, 8, 3, 3, 2, padding::valid, 1, 2);
+    check_conv_algorithm(conv_algorithm::gemm, 12, 1, 20, 13, padding::valid, 1, 1);
+}
+
+TEST(convolutional, gemm_connection_tbl) {
+    bool tbl[3 * 4] = {
+        true, false, true, true,
+        false, true, false, false,
+        true, true, false, true };
+
+    check_conv_algorithm(conv_algorithm::gemm, 7, 3, 3, 4, padding::valid, 1, 1,
+                         connection_table(tbl, 3, 4));
+}
+
+TEST(convolutional, winograd) {
+    check_conv_algorithm(conv_algorithm::winograd, 6, 3, 3, 4, padding::valid, 1, 1);
+    check_conv_algorithm(conv_algorithm::winograd, 11, 3, 5, 9, padding::valid, 1, 1);
+    check_conv_algorithm(conv_algorithm::winograd, 10, 3, 8, 8, padding::same, 1, 1);
+    check_conv_algorithm(conv_algorithm::winograd, 3, 3, 2, 3, padding::same, 1, 1);
+    // not applicable, runs gemm
+    check_conv_algorithm(conv_algorithm::winograd, 8, 3, 3, 2, padding::valid, 2, 1);
+}
+
+TEST(convolutional, winograd_connection_tbl) {
+    bool tbl[3 * 4] = {
+        true, false, true, true,
+        false, true, false, false,
+        true, true, false, true };
+
+    check_conv_algorithm(conv_algorithm::winograd, 9, 3, 3, 4, padding::same, 1, 1,
+                         connection_table(tbl, 3, 4));
+}
+
+TEST(convolutional, winograd_selection) {
+    convolutional_layer<relu> l1(16, 16, 3, 16, 16, padding::same);
+    EXPECT_EQ(conv_algorithm::automatic, l1.algorithm());
+
+    conv_params p;
+    p.weight = shape3d(3, 3, 16 * 16);
+    p.in = shape3d(16, 16, 16);
+    p.out = shape3d(16, 16, 16);
+    p.w_stride = p.h_stride = 1;
+    EXPECT_EQ(conv_algorithm::winograd, p.selected_algorithm());
+
+    p.w_stride = 2;
+    EXPECT_EQ(conv_algorithm::gemm, p.selected_algorithm());
+
+    p.w_stride = 1;
+    p.algorithm = conv_algorithm::direct;
+    EXPECT_EQ(conv_algorithm::direct, p.selected_algorithm());
+}
+
+// kernels with a fused epilogue against the unfused activation + add
+template <typename Activation>
+void check_conv_epilogue(conv_algorithm algorithm) {
+    conv_params params;
+    params.in = shape3d(9, 7, 3);
+    params.out = shape3d(9, 7, 5);
+    params.weight = shape3d(3, 3, 3 * 5);
+    params.has_bias = true;
+    params.pad_type = padding::same;
+    params.w_stride = params.h_stride = 1;
+
+    const size_t batch = 3;
+    vec_t W(params.weight.size()), bias(params.out.depth_);
+    tensor_t in(batch, vec_t(params.in.size()));
+    uniform_rand(W.begin(), W.end(), -1.0, 1.0);
+    uniform_rand(bias.begin(), bias.end(), -1.0, 1.0);
+    for (auto& v : in) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+
+    Activation h;
+    tensor_t pre0(batch, vec_t(params.out.size()));
+    tensor_t out0(batch, vec_t(params.out.size()));
+    kernels::conv2d_op_custom(in, W, bias, pre0, params, false);
+    for (size_t s = 0; s < batch; s++) {
+        static_cast<const activation::function&>(h).f(&pre0[s][0], &out0[s][0],
+                                                      params.out.size());
+    }
+
+    tensor_t pre1(batch, vec_t(params.out.size()));
+    tensor_t out1(batch, vec_t(params.out.size()));
+    const kernels::epilogue ep(h, pre1, out1);
+    kernels::winograd_filter filter;
+    if (algorithm == conv_algorithm::winograd) {
+        kernels::conv2d_op_winograd(in, filter, W, bias, pre1, params, true, ep);
+    } else if (algorithm == conv_algorithm::gemm) {
+        kernels::conv2d_op_gemm(in, W, bias, pre1, params, true, ep);
+    } else {
+        kernels::conv2d_op_custom(in, W, bias, pre1, params, true, ep);
+    }
+
+    for (size_t s = 0; s < batch; s++) {
+        for (size_t i = 0; i < out0[s].size(); i++) {
+            EXPECT_NEAR(pre0[s][i], pre1[s][i], 1E-4);
+            EXPECT_NEAR(out0[s][i], out1[s][i], 1E-4);
+        }
+    }
+}
+
+TEST(convolutional, fused_epilogue) {
+    check_conv_epilogue<relu>(conv_algorithm::direct);
+    check_conv_epilogue<relu>(conv_algorithm::gemm);
+    check_conv_epilogue<relu>(conv_algorithm::winograd);
+    // not elementwise, applied per sample after the kernel
+    check_conv_epilogue<softmax>(conv_algorithm::direct);
+    check_conv_epilogue<softmax>(conv_algorithm::gemm);
+    check_conv_epilogue<softmax>(conv_algorithm::winograd);
+}
+
+TEST(convolutional, gradient_check12_gemm) {
+    network<sequential> nn;
+
+    nn << convolutional_layer<sigmoid>(5, 5, 3, 2, 3, padding::same,
+                                       true, 1, 1, core::backend_t::tiny_dnn);
+    nn.at<convolutional_layer<sigmoid>>(0).set_algorithm(conv_algorithm::gemm);
+
+    const auto test_data = generate_gradient_check_data(nn.in_data_size());
+    nn.init_weight();
+    EXPECT_TRUE(nn.gradient_check<mse>(test_data.first,
+                                       test_data.second,
+                                       epsilon<float_t>(), GRAD_CHECK_ALL));
+}
+
+TEST(convolutional, gradient_check13_winograd) {
+    network<sequential> nn;
+
+    nn << convolutional_layer<sigmoid>(6, 6, 3, 2, 3, padding::same,
+                                       true, 1, 1, core::backend_t::tiny_dnn);
+    nn.at<convolutional_layer<sigmoid>>(0).set_algorithm(conv_algorithm::winograd);
+
+    const auto test_data = generate_gradient_check_data(nn.in_data_size());
+    nn.init_weight();
+    EXPECT_TRUE(nn.gradient_check<mse>(test_data.first,
+                                       test_data.second,
+                                       epsilon<float_t>(), GRAD_CHECK_ALL));
+}
+
+TEST(convolutional, winograd_filter_generation) {
+    typedef convolutional_layer<identity> conv_t;
+    conv_t l(6, 6, 3, 2, 3, padding::same, true, 1, 1,
+             core::backend_t::tiny_dnn);
+    l.set_algorithm(conv_algorithm::winograd);
+    l.init_weight();
+    vec_t& W = *l.weights()[0];
+
+    const tensor_t in = { vec_t(6 * 6 * 2, float_t(0.5)) };
+    const vec_t before = l.forward({ in })[0][0];
+
+    // the cached transform is kept while the generation is unchanged
+    const uint64_t generation = l.weight_generation();
+    for (auto& w : W) w *= float_t(2);
+    EXPECT_EQ(generation, l.weight_generation());
+    EXPECT_EQ(before, l.forward({ in })[0][0]);
+
+    // and recomputed for new weights
+    l.weights_changed();
+    const vec_t after = l.forward({ in })[0][0];
+    l.set_algorithm(conv_algorithm::direct);
+    const vec_t expected = l.forward({ in })[0][0];
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_NEAR(expected[i], after[i], 1e-5);
+    }
+
+    // weight init, load and optimizer steps all change the generation
+    l.init_weight();
+    EXPECT_NE(generation, l.weight_generation());
+    const uint64_t initialized = l.weight_generation();
+    std::vector<float_t> data(l.weights()[0]->size() + l.weights()[1]->size());
+    int idx = 0;
+    l.load(data, idx);
+    EXPECT_NE(initialized, l.weight_generation());
+    const uint64_t loaded = l.weight_generation();
+    l.end_update();
+    EXPECT_NE(loaded, l.weight_generation());
+}
+
 TEST(convolutional, read_write)
 {
     convolutional_layer<tan_h> l1(5, 5, 3, 1, 1);
@@ -731,92 +1023,70 @@ TEST(convolutional, read_write2) {
     serialization_test(layer1, layer2);
 }
 
-TEST(convolutional, copy_and_pad_input_same) {
-
-    conv_params params;
-    params.in        = shape3d(5,5,1);
-    params.weight    = shape3d(3,3,2);
-    params.in_padded = shape3d(7,7,1);
-    params.out       = shape3d(3,3,1);
-    params.pad_type  = padding::same; // test target
-    params.w_stride  = 1;
-    params.h_stride  = 1;
-
-    Conv2dPadding conv2d_padding(params);
-
-    auto create_tensor = [](cnn_size_t batch_size,
-                            cnn_size_t vector_size) {
-        return tensor_t(batch_size, vec_t(vector_size));
-    };
-
-    tensor_t in_tensor = create_tensor(1, 1 * 5 * 5), out_tensor;
-
-    fill_tensor(in_tensor, float_t(1));
-
-    /* @in_tensor   --->   @out_tensor
-     *
-     *    1 1 1             0 0 0 0 0
-     *    1 1 1             0 1 1 1 0
-     *    1 1 1             0 1 1 1 0
-     *                      0 1 1 1 0
-     *                      0 0 0 0 0
-     */
-
-    conv2d_padding.copy_and_pad_input(in_tensor, out_tensor);
-
-    EXPECT_EQ(out_tensor[0][7],  float_t(0));
-    EXPECT_EQ(out_tensor[0][8],  float_t(1));
-    EXPECT_EQ(out_tensor[0][9],  float_t(1));
-    EXPECT_EQ(out_tensor[0][10], float_t(1));
-    EXPECT_EQ(out_tensor[0][11], float_t(1));
-    EXPECT_EQ(out_tensor[0][12], float_t(1));
-    EXPECT_EQ(out_tensor[0][13], float_t(0));
+TEST(convolutional, implicit_padding_ranges) {
+    size_t b, e;
+
+    // 3-tap window, pad 1, input of 5: the first / last output are clipped
+    core::conv_tap_range(0, 1, 1, 3, 5, &b, &e);
+    EXPECT_EQ(1u, b); EXPECT_EQ(3u, e);
+    core::conv_tap_range(2, 1, 1, 3, 5, &b, &e);
+    EXPECT_EQ(0u, b); EXPECT_EQ(3u, e);
+    core::conv_tap_range(4, 1, 1, 3, 5, &b, &e);
+    EXPECT_EQ(0u, b); EXPECT_EQ(2u, e);
+
+    // tap 0 reads the padding for output 0 only, tap 2 for output 4 only
+    core::conv_output_range(0, 1, 1, 5, 5, &b, &e);
+    EXPECT_EQ(1u, b); EXPECT_EQ(5u, e);
+    core::conv_output_range(2, 1, 1, 5, 5, &b, &e);
+    EXPECT_EQ(0u, b); EXPECT_EQ(4u, e);
+
+    // stride 2, window 5, pad 2, input of 6 (outputs read -2, 0, 2 + taps)
+    core::conv_output_range(0, 2, 2, 6, 3, &b, &e);
+    EXPECT_EQ(1u, b); EXPECT_EQ(3u, e);
+    core::conv_output_range(4, 2, 2, 6, 3, &b, &e);
+    EXPECT_EQ(0u, b); EXPECT_EQ(2u, e);
+
+    // valid padding never clips
+    core::conv_tap_range(2, 2, 0, 3, 7, &b, &e);
+    EXPECT_EQ(0u, b); EXPECT_EQ(3u, e);
 }
 
-TEST(convolutional, copy_and_unpad_delta_same) {
-
-    conv_params params;
-    params.in        = shape3d(3,3,1);
-    params.weight    = shape3d(2,2,1);
-    params.in_padded = shape3d(5,5,1);
-    params.out       = shape3d(2,2,1);
-    params.pad_type  = padding::same; // test target
-    params.w_stride  = 1;
-    params.h_stride  = 1;
-
-    Conv2dPadding conv2d_padding(params);
-
-    auto create_tensor = [](cnn_size_t batch_size,
-                            cnn_size_t vector_size) {
-        return tensor_t(batch_size, vec_t(vector_size));
+TEST(convolutional, gradient_check14_pad_same_delta) {
+    // the delta of a same-padded layer is checked through the weights of
+    // the layer below it
+    const conv_algorithm algorithms[] = {
+        conv_algorithm::direct, conv_algorithm::gemm, conv_algorithm::winograd
     };
-
-    tensor_t in_tensor = create_tensor(1, 1 * 5 * 5), out_tensor;
-
-    fill_tensor(in_tensor, float_t(0));
-
-    /*
-     * @in_tensor   --->   @out_tensor
-     *
-     * 0 0 0 0 0             1 1 1
-     * 0 1 1 1 0             1 1 1
-     * 0 1 1 1 0             1 1 1
-     * 0 1 1 1 0
-     * 0 0 0 0 0
-     *
-     */
-
-    for (int i = 0; i < 3; ++i) {
-        for (int j = 0; j < 3; ++j) {
-            in_tensor[0][6 + 5*i + j] = float_t(1);
-        }
+    typedef convolutional_layer<sigmoid> conv_t;
+
+    for (auto algorithm : algorithms) {
+        network<sequential> nn;
+
+        nn << conv_t(6, 5, 1, 2, 2, padding::valid,
+                     true, 1, 1, core::backend_t::tiny_dnn)
+           << conv_t(6, 5, 3, 2, 3, padding::same,
+                     true, 1, 1, core::backend_t::tiny_dnn);
+        nn.at<conv_t>(1).set_algorithm(algorithm);
+
+        const auto test_data = generate_gradient_check_data(nn.in_data_size());
+        nn.init_weight();
+        EXPECT_TRUE(nn.gradient_check<mse>(test_data.first,
+                                           test_data.second,
+                                           epsilon<float_t>(), GRAD_CHECK_ALL));
     }
+}
+
+TEST(convolutional, gradient_check15_no_bias) {
+    network<sequential> nn;
 
-    conv2d_padding.copy_and_unpad_delta(in_tensor, out_tensor);
+    nn << convolutional_layer<sigmoid>(5, 5, 3, 2, 2, padding::same,
+                                       false, 2, 1, core::backend_t::tiny_dnn);
 
-    for (cnn_size_t i = 0; i < out_tensor[0].size(); ++i) {
-        EXPECT_EQ(out_tensor[0][i], float_t(1));
-    }
+    const auto test_data = generate_gradient_check_data(nn.in_data_size());
+    nn.init_weight();
+    EXPECT_TRUE(nn.gradient_check<mse>(test_data.first,
+                                       test_data.second,
+                                       epsilon<float_t>(), GRAD_CHECK_ALL));
 }
 
 } // namespace tiny-dnn
@@ -58,6 +58,98 @@ TEST(dropout, randomized) {
     EXPECT_GE(num_units * dropout_rate / margin_factor, num_on2);
 }
 
+TEST(dropout, philox_known_answer) {
+    // test vectors of the Random123 reference implementation
+    const uint32_t ctr[3][4] = {
+        { 0, 0, 0, 0 },
+        { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff },
+        { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 }
+    };
+    const uint32_t key[3][2] = {
+        { 0, 0 },
+        { 0xffffffff, 0xffffffff },
+        { 0xa4093822, 0x299f31d0 }
+    };
+    const uint32_t expected[3][4] = {
+        { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 },
+        { 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd },
+        { 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 }
+    };
+
+    for (int i = 0; i < 3; i++) {
+        uint32_t out[4];
+        philox4x32(ctr[i], key[i], out);
+        for (int k = 0; k < 4; k++) EXPECT_EQ(expected[i][k], out[k]);
+    }
+}
+
+TEST(dropout, mask_layout) {
+    // bit 16h + 4k + l of word w comes from word k of counter 8w + 4h + l
+    const uint32_t key[2] = { 12345, 678 };
+    const float_t p = 0.3f;
+    const uint64_t threshold = core::kernels::dropout_threshold(p);
+
+    for (uint32_t sample = 0; sample < 3; sample++) {
+        for (uint32_t w = 0; w < 5; w++) {
+            const uint32_t word = core::kernels::dropout_mask_word(key, sample, w, threshold);
+            for (uint32_t b = 0; b < 32; b++) {
+                const uint32_t h = b / 16, k = (b / 4) % 4, l = b % 4;
+                const uint32_t ctr[4] = { 8 * w + 4 * h + l, sample, 0, 0 };
+                uint32_t r[4];
+                philox4x32(ctr, key, r);
+                EXPECT_EQ(r[k] < threshold, ((word >> b) & 1) != 0);
+            }
+        }
+    }
+
+    EXPECT_EQ(0u, core::kernels::dropout_mask_word(key, 0, 0, core::kernels::dropout_threshold(0)));
+    EXPECT_EQ(~0u, core::kernels::dropout_mask_word(key, 0, 0, core::kernels::dropout_threshold(1)));
+}
+
+TEST(dropout, thread_count_independent) {
+    const cnn_size_t num_units = 100, batch = 9;
+    dropout_layer l(num_units, 0.5f, net_phase::train);
+
+    tensor_t in(batch, vec_t(num_units));
+    for (auto& v : in) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+
+    set_random_seed(3);
+    l.set_parallelize(true);
+    const tensor_t out1 = l.forward({ in })[0];
+    const auto mask1 = l.get_mask(batch - 1);
+
+    set_random_seed(3);
+    l.set_parallelize(false);
+    const tensor_t out2 = l.forward({ in })[0];
+    const auto mask2 = l.get_mask(batch - 1);
+
+    EXPECT_EQ(mask1, mask2);
+    for (cnn_size_t sample = 0; sample < batch; sample++) {
+        EXPECT_EQ(out1[sample], out2[sample]);
+    }
+}
+
+TEST(dropout, backward) {
+    // more units than one mask word, not a multiple of 32
+    const cnn_size_t num_units = 77;
+    const float_t rate = 0.25f;
+    dropout_layer l(num_units, rate, net_phase::train);
+
+    vec_t in(num_units), delta(num_units);
+    uniform_rand(in.begin(), in.end(), -1.0, 1.0);
+    uniform_rand(delta.begin(), delta.end(), -1.0, 1.0);
+
+    const vec_t out = l.forward({ { in } })[0][0];
+    const auto mask = l.get_mask(0);
+    const vec_t grad = l.backward({ { delta } })[0][0];
+
+    const float_t scale = float_t(1) / (float_t(1) - rate);
+    for (cnn_size_t i = 0; i < num_units; i++) {
+        EXPECT_FLOAT_EQ(mask[i] * scale * in[i], out[i]);
+        EXPECT_FLOAT_EQ(mask[i] * scale * delta[i], grad[i]);
+    }
+}
+
 TEST(dropout, read_write) {
     dropout_layer l1(1024, 0.5, net_phase::test);
     dropout_layer l2(1024, 0.5, net_phase::test);
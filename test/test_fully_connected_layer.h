@@ -113,6 +113,41 @@ TEST(fully_connected, gradient_check) {
     EXPECT_TRUE(nn.gradient_check<mse>(test_data.first, test_data.second, epsilon<float_t>(), GRAD_CHECK_ALL));
 }
 
+TEST(fully_connected, weight_grad_accumulators) {
+    // weight gradients are bounded by the thread count, not the batch size,
+    // and training doesn't depend on how many accumulators were used
+    std::vector<vec_t> data;
+    std::vector<label_t> label;
+    for (int i = 0; i < 64; i++) {
+        vec_t v(10);
+        uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+        data.push_back(v);
+        label.push_back(i % 4);
+    }
+
+    network<sequential> nn1, nn2;
+    nn1 << fully_connected_layer<tan_h>(10, 4);
+    nn2 << fully_connected_layer<tan_h>(10, 4);
+    nn1.init_weight();
+    nn2.init_weight();
+    *nn2[0]->weights()[0] = *nn1[0]->weights()[0];
+    *nn2[0]->weights()[1] = *nn1[0]->weights()[1];
+
+    gradient_descent opt1, opt2;
+    nn1.train<mse>(opt1, data, label, 64, 2, nop, nop, false, 1);
+    nn2.train<mse>(opt2, data, label, 64, 2, nop, nop, false, 0);
+
+    EXPECT_EQ(1u, nn1[0]->weights_grads()[0]->size());
+    EXPECT_LE(nn2[0]->weights_grads()[0]->size(),
+              static_cast<size_t>(max_concurrency()));
+
+    const vec_t& w1 = *nn1[0]->weights()[0];
+    const vec_t& w2 = *nn2[0]->weights()[0];
+    for (size_t i = 0; i < w1.size(); i++) {
+        EXPECT_NEAR(w1[i], w2[i], 1E-5);
+    }
+}
+
 TEST(fully_connected, read_write)
 {
     fully_connected_layer<tan_h> l1(100, 100);
@@ -176,4 +211,123 @@ TEST(fully_connected, forward_nobias)
     }
 }
 
+TEST(fully_connected, gemm_kernel) {
+    // batched gemm against the per-sample reference, with odd sizes
+    // which leave partial register tiles and several dW blocks
+    core::fully_params params;
+    params.in_size_  = 37;
+    params.out_size_ = 23;
+    params.has_bias_ = true;
+
+    const size_t batch = 7, nblocks = 3;
+    vec_t W(params.in_size_ * params.out_size_), bias(params.out_size_);
+    tensor_t in(batch, vec_t(params.in_size_));
+    tensor_t delta(batch, vec_t(params.out_size_));
+    uniform_rand(W.begin(), W.end(), -1.0, 1.0);
+    uniform_rand(bias.begin(), bias.end(), -1.0, 1.0);
+    for (auto& v : in) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+    for (auto& v : delta) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+
+    tensor_t out0(batch, vec_t(params.out_size_));
+    tensor_t out1(batch, vec_t(params.out_size_));
+    kernels::fully_connected_op_custom(in, W, bias, out0, params, true);
+    kernels::fully_connected_op_gemm(in, W, bias, out1, params, true);
+
+    tensor_t dW[2], db[2], prev_delta[2];
+    for (int i = 0; i < 2; i++) {
+        dW[i].assign(nblocks, vec_t(W.size(), float_t(0)));
+        db[i].assign(nblocks, vec_t(bias.size(), float_t(0)));
+        prev_delta[i].assign(batch, vec_t(params.in_size_, float_t(0)));
+    }
+    kernels::fully_connected_op_custom(in, W, dW[0], db[0], delta,
+                                       prev_delta[0], params, true);
+    kernels::fully_connected_op_gemm(in, W, dW[1], db[1], delta,
+                                     prev_delta[1], params, true);
+
+    auto expect_near = [](const tensor_t& a, const tensor_t& b) {
+        for (size_t s = 0; s < a.size(); s++) {
+            for (size_t i = 0; i < a[s].size(); i++) {
+                EXPECT_NEAR(a[s][i], b[s][i], 1E-4);
+            }
+        }
+    };
+    expect_near(out0, out1);
+    expect_near(dW[0], dW[1]);
+    expect_near(db[0], db[1]);
+    expect_near(prev_delta[0], prev_delta[1]);
+}
+
+TEST(fully_connected, fused_epilogue) {
+    core::fully_params params;
+    params.in_size_  = 37;
+    params.out_size_ = 23;
+    params.has_bias_ = true;
+
+    const size_t batch = 7;
+    vec_t W(params.in_size_ * params.out_size_), bias(params.out_size_);
+    tensor_t in(batch, vec_t(params.in_size_));
+    uniform_rand(W.begin(), W.end(), -1.0, 1.0);
+    uniform_rand(bias.begin(), bias.end(), -1.0, 1.0);
+    for (auto& v : in) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+
+    elu h_elu;
+    softmax h_softmax;
+    const activation::function* hs[] = { &h_elu, &h_softmax };
+
+    for (const activation::function* h : hs) {
+        tensor_t pre0(batch, vec_t(params.out_size_));
+        tensor_t out0(batch, vec_t(params.out_size_));
+        kernels::fully_connected_op_custom(in, W, bias, pre0, params, false);
+        for (size_t s = 0; s < batch; s++) {
+            h->f(&pre0[s][0], &out0[s][0], params.out_size_);
+        }
+
+        for (int k = 0; k < 2; k++) {
+            tensor_t pre1(batch, vec_t(params.out_size_));
+            tensor_t out1(batch, vec_t(params.out_size_));
+            const kernels::epilogue ep(*h, pre1, out1);
+            if (k == 0) {
+                kernels::fully_connected_op_custom(in, W, bias, pre1, params, true, ep);
+            } else {
+                kernels::fully_connected_op_gemm(in, W, bias, pre1, params, true, ep);
+            }
+
+            for (size_t s = 0; s < batch; s++) {
+                for (size_t i = 0; i < params.out_size_; i++) {
+                    EXPECT_NEAR(pre0[s][i], pre1[s][i], 1E-4);
+                    EXPECT_NEAR(out0[s][i], out1[s][i], 1E-4);
+                }
+            }
+        }
+    }
+}
+
+TEST(fully_connected, predict_nested_in_parallel_for) {
+    // a thread waiting for the tiles of one network may run the forward
+    // pass of another network in the meantime
+    const int num_nets = 64;
+    std::vector<std::unique_ptr<network<sequential>>> nets;
+    std::vector<vec_t> in(num_nets), expected(num_nets), actual(num_nets);
+
+    for (int i = 0; i < num_nets; i++) {
+        nets.emplace_back(new network<sequential>());
+        // sizes differ, so a shared buffer would also be reallocated
+        *nets[i] << fully_connected_layer<tan_h>(64, 256 + 16 * (i % 4))
+                 << fully_connected_layer<identity>(256 + 16 * (i % 4), 30);
+        in[i].resize(64);
+        uniform_rand(in[i].begin(), in[i].end(), -1.0, 1.0);
+        expected[i] = nets[i]->predict(in[i]);
+    }
+
+    for (int round = 0; round < 4; round++) {
+        for_i(num_nets, [&](int i) {
+            actual[i] = nets[i]->predict(in[i]);
+        }, 1);
+
+        for (int i = 0; i < num_nets; i++) {
+            EXPECT_EQ(expected[i], actual[i]);
+        }
+    }
+}
+
 } // namespace tiny-dnn
@@ -51,6 +51,62 @@ TEST(lrn, cross) {
     EXPECT_NEAR(expected[3], out[3], epsilon<float_t>());
 }
 
+TEST(lrn, cross_large) {
+    // more channels than one block, more pixels than one tile
+    const cnn_size_t w = 17, h = 19, channels = 37, size = 5;
+    const float_t alpha = 0.1f, beta = 0.75f;
+    lrn_layer<identity> lrn(w, h, size, channels, alpha, beta);
+
+    vec_t in(w * h * channels);
+    uniform_rand(in.begin(), in.end(), -3.0, 3.0);
+
+    auto out = lrn.forward({ { in } })[0][0];
+
+    for (cnn_size_t c = 0; c < channels; c++) {
+        for (cnn_size_t i = 0; i < w * h; i++) {
+            double sum = 0.0;
+            for (int j = int(c) - 2; j <= int(c) + 2; j++) {
+                if (j < 0 || j >= int(channels)) continue;
+                sum += double(in[j * w * h + i]) * in[j * w * h + i];
+            }
+            const double expected = in[c * w * h + i] *
+                std::pow(1.0 + alpha / size * sum, -double(beta));
+            EXPECT_NEAR(expected, out[c * w * h + i], 1e-5);
+        }
+    }
+}
+
+TEST(lrn, gradient_check) {
+    typedef mse loss_func;
+    typedef activation::tan_h activation;
+    typedef network<sequential> network;
+
+    // lrn has no weights; checked through the gradients of the fc below it
+    network nn;
+    nn << fully_connected_layer<identity>(4, 3 * 2 * 5)
+       << lrn_layer<activation>(3, 2, 4, 5, 0.8f, 0.75f);
+
+    const auto test_data = generate_gradient_check_data(nn.in_data_size());
+    nn.init_weight();
+
+    EXPECT_TRUE(nn.gradient_check<loss_func>(test_data.first, test_data.second, epsilon<float_t>(), GRAD_CHECK_ALL));
+}
+
+TEST(lrn, gradient_check_odd_size) {
+    typedef mse loss_func;
+    typedef activation::identity activation;
+    typedef network<sequential> network;
+
+    network nn;
+    nn << fully_connected_layer<identity>(2, 20)
+       << lrn_layer<activation>(1, 1, 3, 20, 2.0f, 0.75f);
+
+    const auto test_data = generate_gradient_check_data(nn.in_data_size());
+    nn.init_weight();
+
+    EXPECT_TRUE(nn.gradient_check<loss_func>(test_data.first, test_data.second, epsilon<float_t>(), GRAD_CHECK_ALL));
+}
+
 TEST(lrn, read_write) {
     lrn_layer<identity> l1(10, 10, 3, 4, 1.5f, 2.0f, norm_region::across_channels);
     lrn_layer<identity> l2(10, 10, 3, 4, 1.5f, 2.0f, norm_region::across_channels);
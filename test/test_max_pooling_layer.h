@@ -254,6 +254,79 @@ TEST(max_pool, backward) {
     }
 }
 
+TEST(max_pool, backward_overlapping) {
+    // every window shares the center, which gets the sum of all gradients
+    vec_t in = {
+        1, 2, 3,
+        4, 9, 5,
+        6, 7, 8
+    };
+
+    vec_t out_grad = {
+        1, 2,
+        3, 4
+    };
+
+    vec_t in_grad_expected = {
+        0, 0, 0,
+        0, 10, 0,
+        0, 0, 0
+    };
+
+    for (auto phase : { net_phase::train, net_phase::test }) {
+        // argmax is recorded in train phase and recomputed in test phase
+        max_pooling_layer<identity> l(3, 3, 1, 2, 1);
+        l.set_context(phase);
+
+        l.forward({ {in} });
+        vec_t in_grad = l.backward(std::vector<tensor_t>{ {out_grad}})[0][0];
+
+        for (size_t i = 0; i < in_grad.size(); i++) {
+            EXPECT_FLOAT_EQ(in_grad_expected[i], in_grad[i]);
+        }
+    }
+}
+
+#ifdef CNN_USE_AVX
+TEST(max_pool, avx_kernel) {
+    struct config { cnn_size_t w, h, pool, stride; padding pad; };
+    const config configs[] = {
+        { 32, 9, 2, 2, padding::valid }, { 33, 8, 2, 2, padding::same },
+        { 35, 7, 3, 2, padding::valid }, { 29, 6, 3, 1, padding::valid },
+        { 21, 5, 2, 1, padding::same },  { 40, 9, 3, 3, padding::same }
+    };
+
+    for (const config& c : configs) {
+        core::maxpool_params params;
+        params.in = shape3d(c.w, c.h, 3);
+        params.out = shape3d(conv_out_length(c.w, c.pool, c.stride, c.pad),
+                             conv_out_length(c.h, c.pool, c.stride, c.pad), 3);
+        params.pool_size_x = params.pool_size_y = c.pool;
+        params.stride_x = params.stride_y = c.stride;
+        params.pad_type = c.pad;
+
+        tensor_t in(2, vec_t(params.in.size()));
+        for (auto& v : in) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+
+        tensor_t out_tiny(2, vec_t(params.out.size()));
+        tensor_t out_avx(out_tiny);
+        std::vector<std::vector<uint8_t>> arg_tiny(
+            2, std::vector<uint8_t>(params.out.size()));
+        std::vector<std::vector<uint8_t>> arg_avx(arg_tiny);
+
+        core::kernels::tiny_maxpool_kernel(params, in, out_tiny, &arg_tiny, false);
+        core::kernels::avx_maxpool_kernel(params, in, out_avx, &arg_avx, false);
+
+        EXPECT_EQ(arg_tiny, arg_avx);
+        for (size_t s = 0; s < in.size(); s++) {
+            for (size_t i = 0; i < params.out.size(); i++) {
+                EXPECT_EQ(out_tiny[s][i], out_avx[s][i]);
+            }
+        }
+    }
+}
+#endif
+
 #ifndef CNN_NO_SERIALIZATION
 TEST(max_pool, serialization) {
     max_pooling_layer<identity> src(4, 4, 1, 2);
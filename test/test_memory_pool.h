@@ -0,0 +1,169 @@
+/*
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY 
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY 
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include "gtest/gtest.h"
+#include "testhelper.h"
+#include "tiny_dnn/tiny_dnn.h"
+
+namespace tiny_dnn {
+
+#ifndef CNN_NO_MEMORY_POOL
+
+TEST(memory_pool, reuses_blocks) {
+    memory_pool& pool = memory_pool::get_instance();
+
+    void* p = pool.allocate(1000);
+    ASSERT_NE(nullptr, p);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(p) % memory_pool::alignment);
+    pool.deallocate(p, 1000);
+
+    // same size class is served from the cache
+    auto before = pool.stats();
+    void* q = pool.allocate(1024);
+    auto after = pool.stats();
+    EXPECT_EQ(p, q);
+    EXPECT_EQ(before.system_allocations, after.system_allocations);
+    EXPECT_EQ(before.pool_allocations + 1, after.pool_allocations);
+    pool.deallocate(q, 1024);
+
+    // blocks above max_block_size bypass the pool
+    void* big = pool.allocate(memory_pool::max_block_size + 1);
+    ASSERT_NE(nullptr, big);
+    pool.deallocate(big, memory_pool::max_block_size + 1);
+}
+
+TEST(memory_pool, size_classes) {
+    memory_pool& pool = memory_pool::get_instance();
+
+    // a request one byte above 4096 uses the 5120 byte class, not 8192
+    void* p = pool.allocate(4097);
+    pool.deallocate(p, 4097);
+    void* q = pool.allocate(5120);
+    EXPECT_EQ(p, q);
+    pool.deallocate(q, 5120);
+
+    void* r = pool.allocate(4096);
+    void* s = pool.allocate(5121);
+    EXPECT_NE(p, r);
+    EXPECT_NE(p, s);
+    pool.deallocate(r, 4096);
+    pool.deallocate(s, 5121);
+}
+
+TEST(memory_pool, multiple_threads) {
+    memory_pool& pool = memory_pool::get_instance();
+    const int num_threads = 4;
+    const int iterations = 50;
+    const std::size_t sizes[] = { 64, 200, 1000, 3000, 5000, 20000, 70000 };
+    const int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+    auto before = pool.stats();
+
+    // each thread allocates and frees the same blocks repeatedly; only its
+    // first round may reach the system allocator
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t] {
+            for (int it = 0; it < iterations; it++) {
+                void* blocks[num_sizes];
+                for (int i = 0; i < num_sizes; i++) {
+                    blocks[i] = pool.allocate(sizes[i]);
+                    ASSERT_NE(nullptr, blocks[i]);
+                    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(blocks[i]) %
+                                  memory_pool::alignment);
+                    std::memset(blocks[i], t, sizes[i]);
+                }
+                for (int i = 0; i < num_sizes; i++) {
+                    const unsigned char* b =
+                        static_cast<const unsigned char*>(blocks[i]);
+                    EXPECT_EQ(t, b[0]);
+                    EXPECT_EQ(t, b[sizes[i] - 1]);
+                    pool.deallocate(blocks[i], sizes[i]);
+                }
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    auto after = pool.stats();
+    EXPECT_LE(after.system_allocations - before.system_allocations,
+              uint64_t(num_threads * num_sizes));
+    EXPECT_GE(after.pool_allocations - before.pool_allocations,
+              uint64_t(num_threads * num_sizes * (iterations - 1)));
+
+    // blocks allocated on other threads are freed and reused on this one
+    std::vector<void*> shared(num_threads);
+    std::vector<std::thread> producers;
+    for (int t = 0; t < num_threads; t++) {
+        producers.emplace_back([&, t] { shared[t] = pool.allocate(70000); });
+    }
+    for (auto& th : producers) th.join();
+
+    for (void* p : shared) pool.deallocate(p, 70000);
+    before = pool.stats();
+    for (int t = 0; t < num_threads; t++) {
+        shared[t] = pool.allocate(70000);
+    }
+    after = pool.stats();
+    EXPECT_EQ(before.system_allocations, after.system_allocations);
+    for (void* p : shared) pool.deallocate(p, 70000);
+}
+
+TEST(memory_pool, steady_state_training) {
+    network<sequential> net;
+    net << conv<tan_h>(8, 8, 3, 1, 4, padding::same)
+        << max_pool<relu>(8, 8, 4, 2)
+        << fc<softmax>(4 * 4 * 4, 3);
+
+    std::vector<vec_t> data;
+    std::vector<label_t> labels;
+    for (int i = 0; i < 32; i++) {
+        vec_t v(8 * 8);
+        uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+        data.push_back(v);
+        labels.push_back(i % 3);
+    }
+
+    // single thread: with more threads, blocks freed by one thread can sit
+    // in its cache for a while before another thread can reuse them
+    adagrad optimizer;
+    net.train<cross_entropy_multiclass>(optimizer, data, labels, 8, 2,
+                                        nop, nop, false, 1);
+
+    // after warm-up, a whole epoch runs without touching the system allocator
+    auto before = memory_pool::get_instance().stats();
+    net.train<cross_entropy_multiclass>(optimizer, data, labels, 8, 1,
+                                        nop, nop, false, 1);
+    auto after = memory_pool::get_instance().stats();
+
+    EXPECT_EQ(before.system_allocations, after.system_allocations);
+    EXPECT_GT(after.pool_allocations, before.pool_allocations);
+}
+
+#endif  // CNN_NO_MEMORY_POOL
+
+} // namespace tiny-dnn
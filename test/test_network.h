@@ -259,6 +259,103 @@ TEST(network, train_predict) {
     }
 }
 
+TEST(network, num_threads) {
+    network<sequential> net;
+    adagrad optimizer;
+
+    net << fully_connected_layer<tan_h>(2, 10)
+        << fully_connected_layer<tan_h>(10, 2);
+
+    EXPECT_EQ(0, net.num_threads());
+    net.set_num_threads(1);
+    EXPECT_EQ(1, net.num_threads());
+    EXPECT_EQ(1, net[0]->num_threads());
+    EXPECT_EQ(1, net[1]->num_threads());
+
+    std::vector<vec_t> data{ { 0, 1 }, { 1, 0 } };
+    std::vector<label_t> label{ 1, 1 };
+
+    // training uses its own budget, then inference budget is restored
+    net.train<mse>(optimizer, data, label, 2, 1, nop, nop, false, 2);
+    EXPECT_EQ(1, net[0]->num_threads());
+    EXPECT_EQ(1, net[1]->num_threads());
+
+    // also when training is left by an exception
+    auto abort = [] { throw nn_error("abort"); };
+    EXPECT_THROW(net.train<mse>(optimizer, data, label, 1, 1, abort, nop,
+                                false, 2), nn_error);
+    EXPECT_EQ(1, net[0]->num_threads());
+    EXPECT_EQ(1, net[1]->num_threads());
+}
+
+TEST(network, memory_planning) {
+    network<sequential> net;
+    net << conv<tan_h>(16, 16, 3, 1, 4, padding::same)
+        << max_pool<relu>(16, 16, 4, 2)
+        << conv<tan_h>(8, 8, 3, 4, 8)
+        << fc<tan_h>(6 * 6 * 8, 20)
+        << fc<sigmoid>(20, 10);
+    net.init_weight();
+
+    std::vector<vec_t> in(3, vec_t(16 * 16));
+    for (auto& v : in) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+
+    net.set_netphase(net_phase::test);
+    std::vector<vec_t> expected;
+    for (auto& v : in) expected.push_back(net.predict(v));
+
+    net.set_memory_planning(true);
+    const memory_planner& plan = net.memory_plan();
+    EXPECT_TRUE(plan.planned());
+    EXPECT_GT(plan.num_buffers(), 0u);
+    EXPECT_LT(plan.planned_bytes(), plan.naive_bytes());
+
+    for (size_t i = 0; i < in.size(); i++) {
+        vec_t actual = net.predict(in[i]);
+        for (size_t j = 0; j < actual.size(); j++) {
+            EXPECT_FLOAT_EQ(expected[i][j], actual[j]);
+        }
+    }
+
+    // training gives every edge its own storage back
+    net.set_netphase(net_phase::train);
+    EXPECT_FALSE(plan.planned());
+    EXPECT_TRUE(net.gradient_check<mse>(std::vector<tensor_t>{ { in[0] } },
+        std::vector<std::vector<label_t>>{ { 1 } }, epsilon<float_t>(),
+        GRAD_CHECK_RANDOM));
+
+    net.set_netphase(net_phase::test);
+    EXPECT_TRUE(plan.planned());
+}
+
+TEST(network, predict_bound) {
+    network<sequential> net;
+    net << conv<tan_h>(8, 8, 3, 1, 2) << fc<sigmoid>(6 * 6 * 2, 5);
+    net.init_weight();
+    net.set_netphase(net_phase::test);
+
+    tensor_t in(4, vec_t(8 * 8));
+    for (auto& v : in) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+
+    std::vector<vec_t> expected;
+    for (auto& v : in) expected.push_back(net.predict(v));
+
+    const tensor_t& actual = net.predict_bound(in);
+    ASSERT_EQ(in.size(), actual.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        for (size_t j = 0; j < expected[i].size(); j++) {
+            EXPECT_FLOAT_EQ(expected[i][j], actual[i][j]);
+        }
+    }
+
+    // the input is not retained after the call
+    EXPECT_FALSE(net[0]->inputs()[0]->is_bound());
+    vec_t single = net.predict(in[1]);
+    for (size_t j = 0; j < single.size(); j++) {
+        EXPECT_FLOAT_EQ(expected[1][j], single[j]);
+    }
+}
+
 TEST(network, set_netphase) {
     // TODO: add unit-test for public api
 }
@@ -397,6 +494,35 @@ TEST(network, bias_init_per_layer) {
         EXPECT_NEAR(w2[i], 1.0, 1e-10);
 }
 
+TEST(network, weight_init_thread_count_independent) {
+    // several chunks of random streams per layer
+    network<sequential> net;
+    net << fully_connected_layer<tan_h>(200, 100)
+        << fully_connected_layer<relu>(100, 60);
+    net[1]->weight_init(weight_init::he());
+
+    std::vector<vec_t> weights[2];
+    for (int threads : { 1, 4 }) {
+        thread_budget budget(threads);
+        set_random_seed(5);
+        net.init_weight();
+        for (size_t i = 0; i < 2; i++)
+            weights[threads == 1 ? 0 : 1].push_back(*net[i]->weights()[0]);
+    }
+
+    EXPECT_EQ(weights[0][0], weights[1][0]);
+    EXPECT_EQ(weights[0][1], weights[1][1]);
+
+    // chunks are not copies of each other
+    const vec_t& w = weights[0][0];
+    EXPECT_FALSE(std::equal(w.begin(), w.begin() + 4096, w.begin() + 4096));
+
+    const float_t xavier_base = std::sqrt(float_t(6) / (200 + 100));
+    for (auto v : w) {
+        EXPECT_LE(std::abs(v), xavier_base);
+    }
+}
+
 TEST(network, gradient_check) { // sigmoid - cross-entropy
     typedef cross_entropy loss_func;
     typedef sigmoid activation;
@@ -502,6 +628,77 @@ TEST(network, gradient_check6) { // sigmoid - cross-entropy
                                              epsilon<float_t>(), GRAD_CHECK_ALL));
 }
 
+TEST(network, gradient_check7) { // softmax - multiclass cross-entropy (fused)
+    typedef cross_entropy_multiclass loss_func;
+    typedef network<sequential> network;
+
+    network nn;
+    nn << fully_connected_layer<tan_h>(10, 12)
+       << fully_connected_layer<softmax>(12, 5);
+
+    const auto test_data = generate_gradient_check_data(nn.in_data_size());
+    nn.init_weight();
+    EXPECT_TRUE(nn.gradient_check<loss_func>(test_data.first,
+                                             test_data.second,
+                                             epsilon<float_t>(), GRAD_CHECK_ALL));
+}
+
+// same loss, but a different type, so it takes the unfused path
+class cross_entropy_multiclass_unfused : public cross_entropy_multiclass {};
+
+TEST(network, softmax_cross_entropy_fused) {
+    network<sequential> nn[2];
+    for (int i = 0; i < 2; i++) {
+        nn[i] << fully_connected_layer<tan_h>(6, 8)
+              << fully_connected_layer<softmax>(8, 4);
+    }
+    nn[0].init_weight();
+    nn[1].init_weight();
+    for (size_t l = 0; l < nn[0].depth(); l++) {
+        auto w0 = nn[0][l]->weights();
+        auto w1 = nn[1][l]->weights();
+        for (size_t i = 0; i < w0.size(); i++) *w1[i] = *w0[i];
+    }
+
+    std::vector<vec_t> in(6, vec_t(6));
+    std::vector<label_t> label = { 0, 1, 2, 3, 1, 2 };
+    for (auto& v : in) uniform_rand(v.begin(), v.end(), -1.0, 1.0);
+
+    gradient_descent opt[2];
+    nn[0].train<cross_entropy_multiclass>(opt[0], in, label, 3, 2);
+    nn[1].train<cross_entropy_multiclass_unfused>(opt[1], in, label, 3, 2);
+
+    for (size_t l = 0; l < nn[0].depth(); l++) {
+        auto w0 = nn[0][l]->weights();
+        auto w1 = nn[1][l]->weights();
+        for (size_t i = 0; i < w0.size(); i++) {
+            for (size_t j = 0; j < w0[i]->size(); j++) {
+                EXPECT_NEAR((*w0[i])[j], (*w1[i])[j], 1E-5);
+            }
+        }
+    }
+}
+
+TEST(network, softmax_cross_entropy_loss_stable) {
+    network<sequential> nn;
+    nn << fully_connected_layer<softmax>(2, 3);
+
+    // logits (2000, -2000, 0): y[1] underflows to 0
+    vec_t& w = *nn[0]->weights()[0];
+    vec_t& b = *nn[0]->weights()[1];
+    w = { 1000, -1000, 0,
+          1000, -1000, 0 };
+    b = { 0, 0, 0 };
+
+    std::vector<vec_t> in = { { 1, 1 } };
+    std::vector<vec_t> t = { { 0, 1, 0 } };
+    const float_t loss = nn.get_loss<cross_entropy_multiclass>(in, t);
+    EXPECT_TRUE(std::isfinite(loss));
+    EXPECT_NEAR(4000.0, loss, 1E-3);
+
+    EXPECT_FALSE(std::isfinite(nn.get_loss<cross_entropy_multiclass_unfused>(in, t)));
+}
+
 TEST(network, read_write)
 {
     typedef mse loss_func;
@@ -577,8 +774,15 @@ TEST(network, trainable) {
     std::vector<vec_t> data{ {1,0}, {0,2} };
     std::vector<vec_t> out{ {2}, {1} };
 
+    const uint64_t g0 = net[0]->weight_generation();
+    const uint64_t g1 = net[1]->weight_generation();
+
     net.fit<mse>(a, data, out, 1, 1);
 
+    // weight caches of the frozen layer stay valid
+    EXPECT_NE(g0, net[0]->weight_generation());
+    EXPECT_EQ(g1, net[1]->weight_generation());
+
     auto w0_after_update = *net[0]->weights()[0];
     auto w1_after_update = *net[1]->weights()[0];
     auto w2_after_update = *net[2]->weights()[0];
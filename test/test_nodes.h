@@ -81,6 +81,54 @@ TEST(nodes, graph_branch) {
     EXPECT_FLOAT_EQ(static_cast<float_t>(res[2]), static_cast<float_t>(0.0));
 }
 
+TEST(nodes, graph_memory_planning) {
+    auto in = std::make_shared<input_layer>(shape3d(4, 1, 1));
+    auto fc1 = std::make_shared<fully_connected_layer<tan_h>>(4, 8);
+    auto b1 = std::make_shared<fully_connected_layer<relu>>(8, 8);
+    auto b2 = std::make_shared<fully_connected_layer<tan_h>>(8, 8);
+    auto added = std::make_shared<add>(2, 8);
+    auto out = std::make_shared<fully_connected_layer<identity>>(8, 3);
+
+    // fc1 output is used by both branches
+    in << fc1;
+    fc1 << b1;
+    fc1 << b2;
+    // b1 and b2 differ in type: without the casts, operator, of
+    // shared_ptr<T> can't deduce T and the builtin comma drops b1
+    (std::static_pointer_cast<layer>(b1),
+     std::static_pointer_cast<layer>(b2)) << added;
+    added << out;
+    ASSERT_EQ(b1.get(), added->inputs()[0]->prev());
+    ASSERT_EQ(b2.get(), added->inputs()[1]->prev());
+
+    network<graph> net;
+    construct_graph(net, { in }, { out });
+    net.set_netphase(net_phase::test);
+
+    vec_t x = { 0.5, -1, 2, 0.25 };
+    vec_t expected = net.predict(x);
+
+    net.set_memory_planning(true);
+    EXPECT_TRUE(net.memory_plan().planned());
+
+    // both branches are alive until add runs, and fc1 until b2 runs
+    const edgeptr_t e0 = fc1->outputs()[0];
+    const edgeptr_t e1 = b1->outputs()[0];
+    const edgeptr_t e2 = b2->outputs()[0];
+    EXPECT_TRUE(e0->has_shared_storage());
+    EXPECT_TRUE(e1->has_shared_storage());
+    EXPECT_TRUE(e2->has_shared_storage());
+    EXPECT_NE(e1->get_data(), e2->get_data());
+    EXPECT_NE(e0->get_data(), e1->get_data());
+    EXPECT_NE(e0->get_data(), e2->get_data());
+
+    vec_t actual = net.predict(x);
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_FLOAT_EQ(expected[i], actual[i]);
+    }
+}
+
 TEST(nodes, graph_branch2) {
     // declare nodes
     input_layer in1(shape3d(3, 1, 1));
@@ -103,4 +151,37 @@ TEST(nodes, graph_branch2) {
     EXPECT_FLOAT_EQ(static_cast<float_t>(res[2]), static_cast<float_t>(0.0));
 }
 
+TEST(nodes, graph_predict_bound) {
+    input_layer in1(shape3d(3, 1, 1));
+    input_layer in2(shape3d(3, 1, 1));
+    add added(2, 3);
+    linear_layer<relu> out(3);
+
+    (in1, in2) << added;
+    added << out;
+
+    network<graph> net;
+    construct_graph(net, { &in1, &in2 }, { &out });
+
+    tensor_t x1 = { { 2, 4, 3 }, { 1, 1, 1 } };
+    tensor_t x2 = { { -1, 2, -5 }, { 0, -2, 1 } };
+    std::vector<const tensor_t*> in = { &x1, &x2 };
+    auto res = net.predict_bound(in);
+
+    ASSERT_EQ(1u, res.size());
+    ASSERT_EQ(2u, res[0]->size());
+    // relu({2,4,3} + {-1,2,-5}) = {1,6,0}
+    EXPECT_FLOAT_EQ(static_cast<float_t>(1.0), (*res[0])[0][0]);
+    EXPECT_FLOAT_EQ(static_cast<float_t>(6.0), (*res[0])[0][1]);
+    EXPECT_FLOAT_EQ(static_cast<float_t>(0.0), (*res[0])[0][2]);
+    // relu({1,1,1} + {0,-2,1}) = {1,0,2}
+    EXPECT_FLOAT_EQ(static_cast<float_t>(1.0), (*res[0])[1][0]);
+    EXPECT_FLOAT_EQ(static_cast<float_t>(0.0), (*res[0])[1][1]);
+    EXPECT_FLOAT_EQ(static_cast<float_t>(2.0), (*res[0])[1][2]);
+
+    tensor_t bad = { { 1, 1, 1 } };
+    in[1] = &bad;
+    EXPECT_THROW(net.predict_bound(in), nn_error);
+}
+
 } // namespace tiny-dnn
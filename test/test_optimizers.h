@@ -0,0 +1,170 @@
+/*
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include "gtest/gtest.h"
+#include "testhelper.h"
+#include "tiny_dnn/tiny_dnn.h"
+
+namespace tiny_dnn {
+
+namespace {
+
+// weights of two sizes (several chunks with a SIMD tail, and a short one),
+// gradients with 3 accumulator rows each
+struct optimizer_fixture {
+    optimizer_fixture() : w{ vec_t(5003), vec_t(7) } {
+        for (size_t i = 0; i < 2; i++) {
+            uniform_rand(w[i].begin(), w[i].end(), -1.0, 1.0);
+            grad[i] = tensor_t(3, vec_t(w[i].size()));
+            params.push_back({ &w[i], &grad[i] });
+        }
+    }
+
+    // new gradients, and their average over a batch of 4
+    std::vector<vec_t> next_gradients() {
+        std::vector<vec_t> dW;
+        for (size_t i = 0; i < 2; i++) {
+            dW.push_back(vec_t(w[i].size(), float_t(0)));
+            for (auto& row : grad[i]) {
+                uniform_rand(row.begin(), row.end(), -1.0, 1.0);
+                for (size_t j = 0; j < row.size(); j++) dW[i][j] += row[j];
+            }
+            for (auto& d : dW[i]) d /= 4;
+        }
+        return dW;
+    }
+
+    vec_t w[2];
+    tensor_t grad[2];
+    std::vector<optimizer_parameter> params;
+};
+
+// runs 3 steps of opt and of rule(w, dw, state, t), elementwise
+template <typename Optimizer, typename Rule>
+void check_step(Optimizer& opt, Rule rule) {
+    optimizer_fixture f;
+    vec_t expected[2] = { f.w[0], f.w[1] };
+    std::vector<float_t> state[2][2];
+    for (size_t i = 0; i < 2; i++)
+        for (auto& s : state[i]) s.assign(f.w[i].size(), float_t(0));
+
+    for (int t = 1; t <= 3; t++) {
+        const std::vector<vec_t> dW = f.next_gradients();
+        opt.step(f.params, 4);
+
+        for (size_t i = 0; i < 2; i++) {
+            for (size_t j = 0; j < f.w[i].size(); j++) {
+                rule(expected[i][j], dW[i][j], state[i][0][j], state[i][1][j], t);
+                ASSERT_NEAR(expected[i][j], f.w[i][j], 1e-5) << "step " << t;
+            }
+        }
+    }
+}
+
+} // namespace
+
+TEST(optimizer, gradient_descent_step) {
+    gradient_descent opt;
+    opt.lambda = float_t(0.1);
+    check_step(opt, [&](float_t& w, float_t dw, float_t&, float_t&, int) {
+        w = w - opt.alpha * (dw + opt.lambda * w);
+    });
+}
+
+TEST(optimizer, momentum_step) {
+    momentum opt;
+    opt.lambda = float_t(0.1);
+    check_step(opt, [&](float_t& w, float_t dw, float_t& prev, float_t&, int) {
+        const float_t v = opt.mu * prev - opt.alpha * (dw + w * opt.lambda);
+        w += v;
+        prev = v;
+    });
+}
+
+TEST(optimizer, adagrad_step) {
+    adagrad opt;
+    check_step(opt, [&](float_t& w, float_t dw, float_t& g, float_t&, int) {
+        g += dw * dw;
+        w -= opt.alpha * dw / (std::sqrt(g) + float_t(1e-8));
+    });
+}
+
+TEST(optimizer, RMSprop_step) {
+    RMSprop opt;
+    opt.alpha = float_t(0.01);
+    check_step(opt, [&](float_t& w, float_t dw, float_t& g, float_t&, int) {
+        g = opt.mu * g + (1 - opt.mu) * dw * dw;
+        w -= opt.alpha * dw / std::sqrt(g + float_t(1e-8));
+    });
+}
+
+TEST(optimizer, adam_step) {
+    // the bias correction advances once per step, for all the weights
+    adam opt;
+    const float_t b1 = opt.b1, b2 = opt.b2;
+    check_step(opt, [&](float_t& w, float_t dw, float_t& m, float_t& v, int t) {
+        m = b1 * m + (1 - b1) * dw;
+        v = b2 * v + (1 - b2) * dw * dw;
+        const float_t b1_t = std::pow(b1, float_t(t + 1));
+        const float_t b2_t = std::pow(b2, float_t(t + 1));
+        w -= opt.alpha * (m / (1 - b1_t)) / std::sqrt(v / (1 - b2_t) + float_t(1e-8));
+    });
+}
+
+TEST(optimizer, reset_clears_state) {
+    optimizer_fixture f;
+    momentum opt;
+    f.next_gradients();
+    opt.step(f.params, 4);
+
+    // with no momentum left, a zero gradient doesn't move the weights
+    const vec_t w0 = f.w[0];
+    for (auto& row : f.grad[0]) std::fill(row.begin(), row.end(), float_t(0));
+    for (auto& row : f.grad[1]) std::fill(row.begin(), row.end(), float_t(0));
+    opt.reset();
+    opt.step(f.params, 4);
+    EXPECT_EQ(w0, f.w[0]);
+}
+
+TEST(optimizer, default_step) {
+    // an optimizer with update() only gets the averaged gradients
+    struct record : public optimizer {
+        void update(const vec_t& dW, vec_t& W) override {
+            for (size_t i = 0; i < W.size(); i++) W[i] -= dW[i];
+        }
+    } opt;
+
+    optimizer_fixture f;
+    const vec_t w1 = f.w[1];
+    const std::vector<vec_t> dW = f.next_gradients();
+    opt.step(f.params, 4);
+    for (size_t j = 0; j < w1.size(); j++) {
+        EXPECT_FLOAT_EQ(w1[j] - dW[1][j], f.w[1][j]);
+    }
+}
+
+} // namespace tiny-dnn
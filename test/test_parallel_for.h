@@ -0,0 +1,127 @@
+/*
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+    
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY 
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED 
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY 
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES 
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; 
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND 
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT 
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+#include "gtest/gtest.h"
+#include "testhelper.h"
+#include "tiny_dnn/tiny_dnn.h"
+
+namespace tiny_dnn {
+
+TEST(parallel_for, visits_each_index_once) {
+    const int n = 10007;
+    std::vector<std::atomic<int>> counts(n);
+    for (auto& c : counts) c = 0;
+
+    for_i(n, [&](int i) { counts[i]++; });
+
+    for (int i = 0; i < n; i++) {
+        EXPECT_EQ(1, counts[i].load());
+    }
+}
+
+TEST(parallel_for, honors_grainsize) {
+    const int n = 1000;
+    const int grainsize = 300;
+    std::atomic<int> min_chunk(n);
+
+    parallel_for(0, n, [&](const blocked_range& r) {
+        int len = r.end() - r.begin();
+        int cur = min_chunk.load();
+        while (len < cur && !min_chunk.compare_exchange_weak(cur, len)) {}
+    }, grainsize);
+
+    // tbb may split a range down to grainsize/2
+    EXPECT_GE(min_chunk.load(), grainsize / 2);
+}
+
+TEST(parallel_for, nested) {
+    const int n = 64;
+    std::vector<std::atomic<int>> counts(n * n);
+    for (auto& c : counts) c = 0;
+
+    for_i(n, [&](int i) {
+        for_i(n, [&](int j) { counts[i * n + j]++; }, 1);
+    }, 1);
+
+    for (int i = 0; i < n * n; i++) {
+        EXPECT_EQ(1, counts[i].load());
+    }
+}
+
+TEST(parallel_for, propagates_exception) {
+    EXPECT_THROW(for_i(100, [&](int i) {
+        if (i == 42) throw nn_error("error in task");
+    }, 1), nn_error);
+
+    // pool must stay usable after an exception
+    std::atomic<int> sum(0);
+    for_i(100, [&](int i) { sum += i; }, 1);
+    EXPECT_EQ(4950, sum.load());
+}
+
+TEST(parallel_for, thread_budget) {
+    const int n = 64;
+    std::mutex mtx;
+    std::set<std::thread::id> ids;
+    std::atomic<int> visited(0);
+
+    {
+        thread_budget budget(2);
+        for_i(n, [&](int) {
+            for_i(n, [&](int) {
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    ids.insert(std::this_thread::get_id());
+                }
+                visited++;
+            }, 1);
+        }, 1);
+    }
+
+    EXPECT_EQ(n * n, visited.load());
+#ifndef CNN_USE_TBB
+    EXPECT_LE(ids.size(), 2u);
+#endif
+
+    // budget of 1 runs on the calling thread
+    ids.clear();
+    {
+        thread_budget budget(1);
+        for_i(n, [&](int) {
+            std::lock_guard<std::mutex> lock(mtx);
+            ids.insert(std::this_thread::get_id());
+        }, 1);
+    }
+    EXPECT_EQ(1u, ids.size());
+    EXPECT_EQ(1u, ids.count(std::this_thread::get_id()));
+}
+
+} // namespace tiny-dnn
@@ -26,7 +26,9 @@
 */
 #pragma once
 #include "tiny_dnn/util/util.h"
+#include "tiny_dnn/util/simd_math.h"
 #include <algorithm>
+#include <numeric>
 
 namespace tiny_dnn {
 namespace activation {
@@ -55,31 +57,81 @@ public:
     // return if dfi/dyk is one-hot vector
     virtual bool one_hot() const { return true; }
 
+    /**
+     * y = f(x) for a whole vector of n elements, called once per sample
+     * instead of f(v, i) per element. built-in functions override it with
+     * vectorized code, the default goes through f(v, i)
+     **/
+    virtual void f(const float_t* x, float_t* y, cnn_size_t n) const {
+        const vec_t v(x, x + n);
+        for (cnn_size_t i = 0; i < n; i++) y[i] = f(v, i);
+    }
+
+    /**
+     * dx = dy * df/dx, where y = f(x), for a whole vector of n elements
+     **/
+    virtual void df(const float_t* y, const float_t* dy, float_t* dx,
+                    cnn_size_t n) const {
+        if (one_hot()) {
+            for (cnn_size_t i = 0; i < n; i++) dx[i] = dy[i] * df(y[i]);
+            return;
+        }
+        const vec_t v(y, y + n);
+        for (cnn_size_t i = 0; i < n; i++) {
+            const vec_t d = df(v, i);
+            dx[i] = std::inner_product(dy, dy + n, d.begin(), float_t(0));
+        }
+    }
+
     // target value range for learning
     virtual std::pair<float_t, float_t> scale() const = 0;
 };
 
 class identity : public function {
 public:
+    using function::f;
     using function::df;
     float_t f(const vec_t& v, cnn_size_t i) const override { return v[i]; }
     float_t df(float_t /*y*/) const override { return float_t(1); }
+
+    void f(const float_t* x, float_t* y, cnn_size_t n) const override {
+        std::copy(x, x + n, y);
+    }
+    void df(const float_t*, const float_t* dy, float_t* dx, cnn_size_t n) const override {
+        std::copy(dy, dy + n, dx);
+    }
     std::pair<float_t, float_t> scale() const override { return std::make_pair(float_t(0.1), float_t(0.9)); }
 };
 
 class sigmoid : public function {
 public:
+    using function::f;
     using function::df;
     float_t f(const vec_t& v, cnn_size_t i) const override { return float_t(1) / (float_t(1) + std::exp(-v[i])); }
     float_t df(float_t y) const override { return y * (float_t(1) - y); }
+
+    void f(const float_t* x, float_t* y, cnn_size_t n) const override {
+        vectorize::sigmoid(x, y, n);
+    }
+    void df(const float_t* y, const float_t* dy, float_t* dx, cnn_size_t n) const override {
+        for (cnn_size_t i = 0; i < n; i++) dx[i] = dy[i] * y[i] * (float_t(1) - y[i]);
+    }
     std::pair<float_t, float_t> scale() const override { return std::make_pair(float_t(0.1), float_t(0.9)); }
 };
 
 class relu : public function {
 public:
+    using function::f;
     using function::df;
     float_t f(const vec_t& v, cnn_size_t i) const override { return std::max(float_t(0), v[i]); }
     float_t df(float_t y) const override { return y > float_t(0) ? float_t(1) : float_t(0); }
+
+    void f(const float_t* x, float_t* y, cnn_size_t n) const override {
+        for (cnn_size_t i = 0; i < n; i++) y[i] = std::max(float_t(0), x[i]);
+    }
+    void df(const float_t* y, const float_t* dy, float_t* dx, cnn_size_t n) const override {
+        for (cnn_size_t i = 0; i < n; i++) dx[i] = dy[i] * (y[i] > float_t(0) ? float_t(1) : float_t(0));
+    }
     std::pair<float_t, float_t> scale() const override { return std::make_pair(float_t(0.1), float_t(0.9)); }
 };
 
@@ -87,22 +139,41 @@ typedef relu rectified_linear; // for compatibility
 
 class leaky_relu : public function {
 public:
+    using function::f;
     using function::df;
     float_t f(const vec_t& v, cnn_size_t i) const override { return (v[i] > float_t(0)) ? v[i] : float_t(0.01) * v[i]; }
     float_t df(float_t y) const override { return y > float_t(0) ? float_t(1) : float_t(0.01); }
+
+    void f(const float_t* x, float_t* y, cnn_size_t n) const override {
+        for (cnn_size_t i = 0; i < n; i++) y[i] = x[i] > float_t(0) ? x[i] : float_t(0.01) * x[i];
+    }
+    void df(const float_t* y, const float_t* dy, float_t* dx, cnn_size_t n) const override {
+        for (cnn_size_t i = 0; i < n; i++) dx[i] = y[i] > float_t(0) ? dy[i] : float_t(0.01) * dy[i];
+    }
     std::pair<float_t, float_t> scale() const override { return std::make_pair(float_t(0.1), float_t(0.9)); }
 };
 
 class elu : public function {
 public:
+    using function::f;
     using function::df;
     float_t f(const vec_t& v, cnn_size_t i) const override { return (v[i]<float_t(0) ? (exp(v[i])- float_t(1)) : v[i]); }
     float_t df(float_t y) const override { return (y > float_t(0) ? float_t(1) : (float_t(1)+y)); }
+
+    void f(const float_t* x, float_t* y, cnn_size_t n) const override {
+        vectorize::elu(x, y, n);
+    }
+    void df(const float_t* y, const float_t* dy, float_t* dx, cnn_size_t n) const override {
+        for (cnn_size_t i = 0; i < n; i++) dx[i] = y[i] > float_t(0) ? dy[i] : dy[i] * (float_t(1) + y[i]);
+    }
     std::pair<float_t, float_t> scale() const override { return std::make_pair(float_t(0.1), float_t(0.9)); }
 };
 
 class softmax : public function {
 public:
+    using function::f;
+    using function::df;
+
     float_t f(const vec_t& v, cnn_size_t i) const override {
         float_t alpha = *std::max_element(v.begin(), v.end());
         float_t numer = std::exp(v[i] - alpha);
@@ -126,11 +197,30 @@ public:
 
     virtual bool one_hot() const override { return false; }
 
+    // one max, one exp pass and one normalize, instead of a full
+    // denominator per output element
+    void f(const float_t* x, float_t* y, cnn_size_t n) const override {
+        if (n == 0) return;
+        const float_t alpha = *std::max_element(x, x + n);
+        for (cnn_size_t i = 0; i < n; i++) y[i] = x[i] - alpha;
+        vectorize::exp(y, y, n);
+        const float_t denom = std::accumulate(y, y + n, float_t(0));
+        const float_t inv = float_t(1) / denom;
+        for (cnn_size_t i = 0; i < n; i++) y[i] *= inv;
+    }
+
+    // the jacobian is diag(y) - y*y^T, so J*dy = y * (dy - <dy, y>)
+    void df(const float_t* y, const float_t* dy, float_t* dx, cnn_size_t n) const override {
+        const float_t dot = std::inner_product(dy, dy + n, y, float_t(0));
+        for (cnn_size_t i = 0; i < n; i++) dx[i] = y[i] * (dy[i] - dot);
+    }
+
     std::pair<float_t, float_t> scale() const override { return std::make_pair(float_t(0), float_t(1)); }
 };
 
 class tan_h : public function {
 public:
+    using function::f;
     using function::df;
     float_t f(const vec_t& v, cnn_size_t i) const override {
         return std::tanh(v[i]);
@@ -146,6 +236,13 @@ public:
     float_t df(float_t y) const override { return float_t(1) - sqr(y); }
     std::pair<float_t, float_t> scale() const override { return std::make_pair(float_t(-0.8), float_t(0.8)); }
 
+    void f(const float_t* x, float_t* y, cnn_size_t n) const override {
+        vectorize::tanh(x, y, n);
+    }
+    void df(const float_t* y, const float_t* dy, float_t* dx, cnn_size_t n) const override {
+        for (cnn_size_t i = 0; i < n; i++) dx[i] = dy[i] * (float_t(1) - y[i] * y[i]);
+    }
+
 private:
     /*float invsqrt(float x) const {
         float x2 = x * 0.5f;
@@ -161,6 +258,7 @@ private:
 // s tan_h, but scaled to match the other functions
 class tan_hp1m2 : public function {
 public:
+    using function::f;
     using function::df;
     float_t f(const vec_t& v, cnn_size_t i) const override {
         const float_t ep = std::exp(v[i]);
@@ -169,6 +267,15 @@ public:
 
     float_t df(float_t y) const override { return 2 * y *(float_t(1) - y); }
     std::pair<float_t, float_t> scale() const override { return std::make_pair(float_t(0.1), float_t(0.9)); }
+
+    // e^x / (e^x + e^-x) = sigmoid(2x)
+    void f(const float_t* x, float_t* y, cnn_size_t n) const override {
+        for (cnn_size_t i = 0; i < n; i++) y[i] = x[i] + x[i];
+        vectorize::sigmoid(y, y, n);
+    }
+    void df(const float_t* y, const float_t* dy, float_t* dx, cnn_size_t n) const override {
+        for (cnn_size_t i = 0; i < n; i++) dx[i] = dy[i] * 2 * y[i] * (float_t(1) - y[i]);
+    }
 };
 
 } // namespace activation
@@ -66,8 +66,15 @@
 //#define CNN_NO_SERIALIZATION
 
 /**
- * number of task in batch-gradient-descent.
- * @todo automatic optimization
+ * define to allocate vec_t directly from the system, instead of the
+ * size-class pool in util/memory_pool.h
+ **/
+//#define CNN_NO_MEMORY_POOL
+
+/**
+ * former default max number of threads of network::fit/train.
+ * fit/train now default to n_threads = 0 (no limit); kept for user code
+ * that passes it explicitly.
  */
 #ifdef CNN_USE_OMP
 #define CNN_TASK_SIZE 100
@@ -65,13 +65,11 @@ class avx_backend : public backend {
       , backward_activation(f3) {}
 
     // maxpooling
-    avx_backend(std::vector<std::vector<cnn_size_t>>* out2in,
-                std::vector<cnn_size_t>* in2out,
+    avx_backend(maxpool_params* params,
                 std::function<void(const tensor_t&, const tensor_t&, tensor_t&)> f,
                 max_pooling_layer_worker_specific_storage* ptr)
-      : max_pooling_layer_worker_storage_(ptr)
-      , out2in_(out2in)
-      , in2out_(in2out)
+      : params_m_(params)
+      , max_pooling_layer_worker_storage_(ptr)
       , backward_activation(f) {}
 
     // fully_connected
@@ -213,11 +211,12 @@ class avx_backend : public backend {
                  std::vector<tensor_t*>&       out_data) override {
         const tensor_t& in  = *in_data[0];
         tensor_t&       a   = *out_data[1];
-        std::vector<std::vector<cnn_size_t>>& max_idx =
-            (*max_pooling_layer_worker_storage_).out2inmax_;
+        std::vector<std::vector<uint8_t>>& argmax =
+            (*max_pooling_layer_worker_storage_).argmax_;
 
-        kernels::avx_maxpool_kernel(in, a,
-            max_idx, *out2in_, layer_->parallelize());
+        // the layer sizes argmax only if it has to be recorded
+        kernels::avx_maxpool_kernel(*params_m_, in, a,
+            argmax.empty() ? nullptr : &argmax, layer_->parallelize());
     }
 
     void maxpool(const std::vector<tensor_t*>& in_data,
@@ -226,15 +225,15 @@ class avx_backend : public backend {
                  std::vector<tensor_t*>&       in_grad) override {
         tensor_t&       prev_delta = *in_grad[0];
         tensor_t&       curr_delta = *out_grad[1];
-        std::vector<std::vector<cnn_size_t>>& max_idx =
-            (*max_pooling_layer_worker_storage_).out2inmax_;
-
-        CNN_UNREFERENCED_PARAMETER(in_data);
+        const std::vector<std::vector<uint8_t>>& argmax =
+            (*max_pooling_layer_worker_storage_).argmax_;
 
         backward_activation(*out_grad[0], *out_data[0], curr_delta);
 
-        kernels::avx_maxpool_back_kernel(prev_delta, curr_delta,
-            max_idx, *in2out_,  layer_->parallelize());
+        kernels::avx_maxpool_back_kernel(*params_m_, *in_data[0],
+            prev_delta, curr_delta,
+            argmax.size() == prev_delta.size() ? &argmax : nullptr,
+            layer_->parallelize());
     }
 
     void fully(const std::vector<tensor_t*>& in_data,
@@ -289,13 +288,12 @@ class avx_backend : public backend {
     conv_params* params_c_;
     deconv_params* params_d_;
     fully_params* params_f_;
+    maxpool_params* params_m_;
 
     /* Pointer to the workers */
     conv_layer_worker_specific_storage* conv_layer_worker_storage_;
     deconv_layer_worker_specific_storage* deconv_layer_worker_storage_;
     max_pooling_layer_worker_specific_storage* max_pooling_layer_worker_storage_;
-    std::vector<std::vector<cnn_size_t>>* out2in_;
-    std::vector<cnn_size_t>* in2out_;
 
     /* Pointers to parent class functions */
     std::function<void(const tensor_t&)> copy_and_pad_input;
@@ -71,13 +71,11 @@ class tiny_backend : public backend {
       , backward_activation(f3) {}
 
     // maxpooling
-    tiny_backend(std::vector<std::vector<cnn_size_t>>* out2in,
-                 std::vector<cnn_size_t>* in2out,
+    tiny_backend(maxpool_params* params,
                  std::function<void(const tensor_t&, const tensor_t&, tensor_t&)> f,
                  max_pooling_layer_worker_specific_storage* ptr)
-      : max_pooling_layer_worker_storage_(ptr)
-      , out2in_(out2in)
-      , in2out_(in2out)
+      : params_m_(params)
+      , max_pooling_layer_worker_storage_(ptr)
       , backward_activation(f) {}
 
     // fully_connected
@@ -192,9 +190,10 @@ class tiny_backend : public backend {
 
         fill_tensor(*prev_delta, float_t(0));
 
+        // samples run in order, so a single gradient accumulator is enough
         for (cnn_size_t i = 0; i < prev_out.size(); i++) {
             kernels::tiny_quantized_conv2d_back_kernel(*params_c_,
-                *prev_out[i], W, dW[i], db[i], curr_delta[i], &(*prev_delta)[i]);
+                *prev_out[i], W, dW[0], db[0], curr_delta[i], &(*prev_delta)[i]);
         }
 
         if (params_c_->pad_type == padding::same) {
@@ -315,9 +314,10 @@ class tiny_backend : public backend {
 
         fill_tensor(*prev_delta, float_t(0));
 
+        // samples run in order, so a single gradient accumulator is enough
         for (cnn_size_t i = 0; i < prev_out.size(); i++) {
             kernels::tiny_quantized_deconv2d_back_kernel(*params_d_,
-                prev_out[i], W, dW[i], db[i], curr_delta[i], &(*prev_delta)[i]);
+                prev_out[i], W, dW[0], db[0], curr_delta[i], &(*prev_delta)[i]);
         }
     }
 
@@ -325,11 +325,12 @@ class tiny_backend : public backend {
                  std::vector<tensor_t*>&       out_data) override {
         const tensor_t& in  = *in_data[0];
         tensor_t&       a   = *out_data[1];
-        std::vector<std::vector<cnn_size_t>>& max_idx =
-            (*max_pooling_layer_worker_storage_).out2inmax_;
+        std::vector<std::vector<uint8_t>>& argmax =
+            (*max_pooling_layer_worker_storage_).argmax_;
 
-        kernels::tiny_maxpool_kernel(in, a,
-            max_idx, *out2in_, layer_->parallelize());
+        // the layer sizes argmax only if it has to be recorded
+        kernels::tiny_maxpool_kernel(*params_m_, in, a,
+            argmax.empty() ? nullptr : &argmax, layer_->parallelize());
     }
 
     void maxpool(const std::vector<tensor_t*>& in_data,
@@ -338,13 +339,15 @@ class tiny_backend : public backend {
                  std::vector<tensor_t*>&       in_grad) override {
         tensor_t&       prev_delta = *in_grad[0];
         tensor_t&       curr_delta = *out_grad[1];
-        std::vector<std::vector<cnn_size_t>>& max_idx =
-            (*max_pooling_layer_worker_storage_).out2inmax_;
+        const std::vector<std::vector<uint8_t>>& argmax =
+            (*max_pooling_layer_worker_storage_).argmax_;
 
         backward_activation(*out_grad[0], *out_data[0], curr_delta);
 
-        kernels::tiny_maxpool_back_kernel(prev_delta, curr_delta,
-            max_idx, *in2out_,  layer_->parallelize());
+        kernels::tiny_maxpool_back_kernel(*params_m_, *in_data[0],
+            prev_delta, curr_delta,
+            argmax.size() == prev_delta.size() ? &argmax : nullptr,
+            layer_->parallelize());
     }
 
     void fully(const std::vector<tensor_t*>& in_data,
@@ -427,9 +430,10 @@ class tiny_backend : public backend {
 
         backward_activation(*out_grad[0], *out_data[0], curr_delta);
 
+        // samples run in order, so a single gradient accumulator is enough
         for (cnn_size_t i = 0; i < prev_out.size(); i++) {
             kernels::tiny_quantized_fully_connected_back_kernel(*params_f_, prev_out[i],
-                W, dW[i], prev_delta[i], curr_delta[i], db[i], layer_->parallelize());
+                W, dW[0], prev_delta[i], curr_delta[i], db[0], layer_->parallelize());
         }
 #else
         throw nn_not_implemented_error("quantized fully op requires gemmlowp library. please define CNN_USE_GEMMLOWP");
@@ -443,13 +447,12 @@ class tiny_backend : public backend {
     conv_params* params_c_;
     deconv_params* params_d_;
     fully_params* params_f_;
+    maxpool_params* params_m_;
 
     /* Pointer to the workers */
     conv_layer_worker_specific_storage* conv_layer_worker_storage_;
     deconv_layer_worker_specific_storage* deconv_layer_worker_storage_;
     max_pooling_layer_worker_specific_storage* max_pooling_layer_worker_storage_;
-    std::vector<std::vector<cnn_size_t>>* out2in_;
-    std::vector<cnn_size_t>* in2out_;
 
     /* Pointers to parent class functions */
     std::function<void(const tensor_t&)> copy_and_pad_input;
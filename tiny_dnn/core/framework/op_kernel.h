@@ -48,6 +48,10 @@
 #include "tiny_dnn/core/params/conv_params.h"
 
 namespace tiny_dnn {
+namespace kernels {
+class epilogue;
+}  // namespace kernels
+
 namespace core {
 
 class OpKernel;  // delared below
@@ -88,6 +92,9 @@ class OpKernelContext {
         bool parallelize = false;
 
         backend_t engine = backend_t::tiny_dnn;
+
+        // output stage fused into forward kernels, if any
+        const kernels::epilogue* epilogue_ptr_ = nullptr;
     };
 
     explicit OpKernelContext(const std::vector<tensor_t*>& in_data,
@@ -163,6 +170,14 @@ class OpKernelContext {
         op_params_->engine = engine;
     }
 
+    void setEpilogue(const kernels::epilogue* epilogue) {
+        op_params_->epilogue_ptr_ = epilogue;
+    }
+
+    const kernels::epilogue* epilogue() const {
+        return op_params_->epilogue_ptr_;
+    }
+
  private:
     std::vector<tensor_t*> in_data_;
     std::vector<tensor_t*> out_data_;
@@ -27,24 +27,110 @@
 #pragma once
 #include "tiny_dnn/core/kernels/tiny_maxpool_kernel.h"
 
+#ifdef CNN_USE_AVX
+#include <immintrin.h>
+#endif
+
 namespace tiny_dnn {
 namespace core {
 namespace kernels {
 
-inline void avx_maxpool_kernel(const tensor_t& in_data,
+// other types run the scalar kernel
+template <typename T>
+void avx_maxpool_plane(const maxpool_params& params, const T* in, T* out,
+                       uint8_t* argmax) {
+    maxpool_plane(params, in, out, argmax);
+}
+
+#ifdef CNN_USE_AVX
+
+// p[0], p[2], ..., p[14]
+inline __m256 avx_maxpool_load_stride2(const float* p) {
+    const __m256 a = _mm256_loadu_ps(p);
+    const __m256 b = _mm256_loadu_ps(p + 7);  // p[15] isn't read
+    const __m128 lo = _mm_shuffle_ps(_mm256_castps256_ps128(a),
+                                     _mm256_extractf128_ps(a, 1),
+                                     _MM_SHUFFLE(2, 0, 2, 0));
+    const __m128 hi = _mm_shuffle_ps(_mm256_castps256_ps128(b),
+                                     _mm256_extractf128_ps(b, 1),
+                                     _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+/**
+ * 8 outputs along x at a time, for strides 1 and 2. the window offset of
+ * the max is tracked in a float vector next to the max, ties keep the
+ * first offset like the scalar kernel. outputs with clipped windows at
+ * the right run the scalar kernel
+ **/
+inline void avx_maxpool_plane(const maxpool_params& params, const float* in,
+                              float* out, uint8_t* argmax) {
+    const size_t sx = params.stride_x;
+    const size_t px = params.pool_size_x;
+    const size_t in_width = params.in.width_;
+    const size_t out_width = params.out.width_;
+    const size_t x_full = (sx == 1 || sx == 2)
+        ? maxpool_full_windows(out_width, in_width, px, sx) / 8 * 8 : 0;
+
+    for (size_t y = 0; y < params.out.height_; y++) {
+        const size_t y0 = y * params.stride_y;
+        const size_t h = std::min<size_t>(params.pool_size_y,
+                                          params.in.height_ - y0);
+        const float* in_row = in + y0 * in_width;
+        float* out_row = out + y * out_width;
+
+        for (size_t x = 0; x < x_full; x += 8) {
+            const float* base = in_row + x * sx;
+            __m256 max_value = sx == 1 ? _mm256_loadu_ps(base)
+                                       : avx_maxpool_load_stride2(base);
+            __m256 max_k = _mm256_setzero_ps();
+
+            for (size_t dy = 0; dy < h; dy++) {
+                for (size_t dx = 0; dx < px; dx++) {
+                    const float* p = base + dy * in_width + dx;
+                    const __m256 v = sx == 1 ? _mm256_loadu_ps(p)
+                                             : avx_maxpool_load_stride2(p);
+                    const __m256 gt = _mm256_cmp_ps(v, max_value, _CMP_GT_OQ);
+                    const __m256 k = _mm256_set1_ps(static_cast<float>(dy * px + dx));
+                    max_value = _mm256_blendv_ps(max_value, v, gt);
+                    max_k = _mm256_blendv_ps(max_k, k, gt);
+                }
+            }
+            _mm256_storeu_ps(out_row + x, max_value);
+
+            if (argmax) {
+                alignas(32) int32_t k[8];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(k),
+                                   _mm256_cvttps_epi32(max_k));
+                uint8_t* arg_row = argmax + y * out_width + x;
+                for (size_t i = 0; i < 8; i++) arg_row[i] = static_cast<uint8_t>(k[i]);
+            }
+        }
+
+        maxpool_row(params, in, out, argmax, y, x_full);
+    }
+}
+
+#endif  // CNN_USE_AVX
+
+inline void avx_maxpool_kernel(const maxpool_params& params,
+                               const tensor_t& in_data,
                                tensor_t&       out_data,
-                               std::vector<std::vector<cnn_size_t>>& max_idx,
-                               const std::vector<std::vector<cnn_size_t>>& out2in,
+                               std::vector<std::vector<uint8_t>>* argmax,
                                const bool layer_parallelize) {
-    tiny_maxpool_kernel(in_data, out_data, max_idx, out2in, layer_parallelize);
+    maxpool_kernel(params, in_data, out_data, argmax, layer_parallelize,
+        [](const maxpool_params& p, const float_t* in, float_t* out,
+           uint8_t* arg) { avx_maxpool_plane(p, in, out, arg); });
 }
 
-inline void avx_maxpool_back_kernel(tensor_t& prev_delta,
-                                    const tensor_t&  curr_delta,
-                                    std::vector<std::vector<cnn_size_t>>& max_idx,
-                                    const std::vector<cnn_size_t>& in2out,
+inline void avx_maxpool_back_kernel(const maxpool_params& params,
+                                    const tensor_t& in_data,
+                                    tensor_t&       prev_delta,
+                                    const tensor_t& curr_delta,
+                                    const std::vector<std::vector<uint8_t>>* argmax,
                                     const bool layer_parallelize) {
-    tiny_maxpool_back_kernel(prev_delta, curr_delta, max_idx, in2out, layer_parallelize);
+    tiny_maxpool_back_kernel(params, in_data, prev_delta, curr_delta, argmax,
+                             layer_parallelize);
 }
 
 }  // namespace kernels
@@ -0,0 +1,481 @@
+/*
+    COPYRIGHT
+
+    All contributions by Taiga Nomi
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+
+    All other contributions:
+    Copyright (c) 2013-2016, the respective contributors.
+    All rights reserved.
+
+    Each contributor holds copyright over their respective contributions.
+    The project versioning (Git) records all such contribution source information.
+
+    LICENSE
+
+    The BSD 3-Clause License
+
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of tiny-dnn nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "tiny_dnn/util/blocked_layout.h"
+#include "tiny_dnn/core/params/conv_params.h"
+#include "tiny_dnn/core/kernels/gemm_kernel.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+/*
+ * forward kernels for blocked layouts (see data_layout).
+ *
+ * a pixel of a channel block is one register of B lanes, so every kernel
+ * below works on B channels at once, and loads/stores are contiguous
+ * whatever the spatial shape is. inputs and outputs are tensors of
+ * samples in the same blocked layout.
+ */
+
+// arithmetic on a pixel of a channel block (B lanes)
+template <typename T, size_t B>
+struct blocked_lane_ops {
+    struct reg { T v[B]; };
+
+    static reg set1(T x) {
+        reg r;
+        for (size_t l = 0; l < B; l++) r.v[l] = x;
+        return r;
+    }
+    static reg load(const T* p) {
+        reg r;
+        for (size_t l = 0; l < B; l++) r.v[l] = p[l];
+        return r;
+    }
+    static void store(T* p, const reg& a) {
+        for (size_t l = 0; l < B; l++) p[l] = a.v[l];
+    }
+    // a * b + c
+    static reg madd(const reg& a, const reg& b, const reg& c) {
+        reg r;
+        for (size_t l = 0; l < B; l++) r.v[l] = a.v[l] * b.v[l] + c.v[l];
+        return r;
+    }
+    static reg add(const reg& a, const reg& b) {
+        reg r;
+        for (size_t l = 0; l < B; l++) r.v[l] = a.v[l] + b.v[l];
+        return r;
+    }
+    static reg sub(const reg& a, const reg& b) {
+        reg r;
+        for (size_t l = 0; l < B; l++) r.v[l] = a.v[l] - b.v[l];
+        return r;
+    }
+    static reg mul(const reg& a, const reg& b) {
+        reg r;
+        for (size_t l = 0; l < B; l++) r.v[l] = a.v[l] * b.v[l];
+        return r;
+    }
+    static reg div(const reg& a, const reg& b) {
+        reg r;
+        for (size_t l = 0; l < B; l++) r.v[l] = a.v[l] / b.v[l];
+        return r;
+    }
+    static reg max(const reg& a, const reg& b) {
+        reg r;
+        for (size_t l = 0; l < B; l++) r.v[l] = std::max(a.v[l], b.v[l]);
+        return r;
+    }
+};
+
+#ifdef CNN_USE_AVX
+// a block of B floats is held in B / 8 ymm registers
+template <size_t B>
+struct blocked_lane_ops<float, B> {
+    static const size_t N = B / 8;
+    struct reg { __m256 v[N]; };
+
+    static reg set1(float x) {
+        reg r;
+        for (size_t i = 0; i < N; i++) r.v[i] = _mm256_set1_ps(x);
+        return r;
+    }
+    static reg load(const float* p) {
+        reg r;
+        for (size_t i = 0; i < N; i++) r.v[i] = _mm256_loadu_ps(p + 8 * i);
+        return r;
+    }
+    static void store(float* p, const reg& a) {
+        for (size_t i = 0; i < N; i++) _mm256_storeu_ps(p + 8 * i, a.v[i]);
+    }
+    static reg madd(const reg& a, const reg& b, const reg& c) {
+        reg r;
+        for (size_t i = 0; i < N; i++) {
+            r.v[i] = gemm_madd256_ps(a.v[i], b.v[i], c.v[i]);
+        }
+        return r;
+    }
+    static reg add(const reg& a, const reg& b) {
+        reg r;
+        for (size_t i = 0; i < N; i++) r.v[i] = _mm256_add_ps(a.v[i], b.v[i]);
+        return r;
+    }
+    static reg sub(const reg& a, const reg& b) {
+        reg r;
+        for (size_t i = 0; i < N; i++) r.v[i] = _mm256_sub_ps(a.v[i], b.v[i]);
+        return r;
+    }
+    static reg mul(const reg& a, const reg& b) {
+        reg r;
+        for (size_t i = 0; i < N; i++) r.v[i] = _mm256_mul_ps(a.v[i], b.v[i]);
+        return r;
+    }
+    static reg div(const reg& a, const reg& b) {
+        reg r;
+        for (size_t i = 0; i < N; i++) r.v[i] = _mm256_div_ps(a.v[i], b.v[i]);
+        return r;
+    }
+    static reg max(const reg& a, const reg& b) {
+        reg r;
+        for (size_t i = 0; i < N; i++) r.v[i] = _mm256_max_ps(a.v[i], b.v[i]);
+        return r;
+    }
+};
+#endif
+
+/*
+ * direct convolution, out[ob][y][x][lane] = bias + sum over (c, ky, kx) of
+ * in[c][y * sy + ky - py][x * sx + kx - px] * w[ob][c][ky][kx][lane].
+ * padding is implicit: taps outside of the input are skipped, so the
+ * input is read as is (params.in, not params.in_padded).
+ * a task computes a row of a block of output channels, in tiles of
+ * 4 output pixels which stay in registers over all taps.
+ */
+template <size_t B>
+void conv2d_op_blocked_impl(const tensor_t& in_data,
+                            const vec_t& W,
+                            const vec_t& bias,
+                            tensor_t& out_data,
+                            const core::conv_params& params,
+                            bool parallelize) {
+    typedef blocked_lane_ops<float_t, B> ops;
+    typedef typename ops::reg reg;
+    static const size_t R = 4;
+
+    const size_t C  = params.in.depth_;
+    const size_t M  = params.out.depth_;
+    const size_t iw = params.in.width_;
+    const size_t ih = params.in.height_;
+    const size_t ow = params.out.width_;
+    const size_t oh = params.out.height_;
+    const size_t kw = params.weight.width_;
+    const size_t kh = params.weight.height_;
+    const size_t sx = params.w_stride;
+    const size_t sy = params.h_stride;
+    const bool same = params.pad_type == padding::same;
+    const size_t px = same ? kw / 2 : 0;
+    const size_t py = same ? kh / 2 : 0;
+    const size_t mb = (M + B - 1) / B;
+    const size_t area = kw * kh;
+    const size_t taps = C * area;
+
+    // wpack[ob][c][ky][kx][lane] is the weight of output channel ob * B + lane.
+    // padded and unconnected output channels get zero weights and bias
+    vec_t wpack(mb * taps * B, float_t(0));
+    vec_t bpack(mb * B, float_t(0));
+    for (size_t o = 0; o < M; o++) {
+        for (size_t c = 0; c < C; c++) {
+            if (!params.tbl.is_connected(o, c)) continue;
+            const float_t* w = &W[(o * C + c) * area];
+            float_t* dst = &wpack[((o / B) * taps + c * area) * B + o % B];
+            for (size_t k = 0; k < area; k++) dst[k * B] = w[k];
+        }
+        if (params.has_bias) bpack[o] = bias[o];
+    }
+
+    for_i(parallelize, in_data.size() * mb * oh, [&](int task) {
+        const size_t sample = task / (mb * oh);
+        const size_t ob = (task / oh) % mb;
+        const size_t oy = task % oh;
+        const float_t* in = &in_data[sample][0];
+        float_t* out = &out_data[sample][(ob * oh + oy) * ow * B];
+        const float_t* wp = &wpack[ob * taps * B];
+        const reg b = ops::load(&bpack[ob * B]);
+
+        // rows of the window inside the input: iy = oy * sy + ky - py
+        const size_t ky0 = oy * sy < py ? py - oy * sy : 0;
+        const size_t ky1 = std::min(kh, ih + py - oy * sy);
+
+        for (size_t ox0 = 0; ox0 < ow; ox0 += R) {
+            const size_t n = std::min(R, ow - ox0);
+            const bool inside = n == R && ox0 * sx >= px &&
+                                (ox0 + R - 1) * sx + kw <= iw + px;
+            reg acc[R];
+            for (size_t r = 0; r < R; r++) acc[r] = b;
+
+            for (size_t c = 0; c < C; c++) {
+                const float_t* plane = in + (c / B) * ih * iw * B + c % B;
+                const float_t* wc = wp + c * area * B;
+
+                for (size_t ky = ky0; ky < ky1; ky++) {
+                    const float_t* row = plane + (oy * sy + ky - py) * iw * B;
+                    const float_t* wk = wc + ky * kw * B;
+
+                    if (inside) {
+                        const float_t* p = row + (ox0 * sx - px) * B;
+                        for (size_t kx = 0; kx < kw; kx++) {
+                            const reg w = ops::load(wk + kx * B);
+                            for (size_t r = 0; r < R; r++) {
+                                acc[r] = ops::madd(
+                                    ops::set1(p[(r * sx + kx) * B]), w, acc[r]);
+                            }
+                        }
+                    } else {
+                        for (size_t kx = 0; kx < kw; kx++) {
+                            const reg w = ops::load(wk + kx * B);
+                            for (size_t r = 0; r < n; r++) {
+                                const size_t ix = (ox0 + r) * sx + kx;
+                                if (ix < px || ix >= iw + px) continue;
+                                acc[r] = ops::madd(
+                                    ops::set1(row[(ix - px) * B]), w, acc[r]);
+                            }
+                        }
+                    }
+                }
+            }
+            for (size_t r = 0; r < n; r++) {
+                ops::store(out + (ox0 + r) * B, acc[r]);
+            }
+        }
+    }, 1);
+}
+
+inline void conv2d_op_blocked(data_layout layout,
+                              const tensor_t& in_data,
+                              const vec_t& W,
+                              const vec_t& bias,
+                              tensor_t& out_data,
+                              const core::conv_params& params,
+                              bool parallelize) {
+    if (layout == data_layout::nchw16c) {
+        conv2d_op_blocked_impl<16>(in_data, W, bias, out_data, params, parallelize);
+    } else {
+        conv2d_op_blocked_impl<8>(in_data, W, bias, out_data, params, parallelize);
+    }
+}
+
+/*
+ * max pooling. windows are clipped at the right/bottom border of the input,
+ * like the connection table of max_pooling_layer
+ */
+template <size_t B>
+void maxpool_blocked_impl(const tensor_t& in_data,
+                          const shape3d& in_shape,
+                          tensor_t& out_data,
+                          const shape3d& out_shape,
+                          size_t pool_x, size_t pool_y,
+                          size_t stride_x, size_t stride_y,
+                          bool parallelize) {
+    typedef blocked_lane_ops<float_t, B> ops;
+    typedef typename ops::reg reg;
+
+    const size_t iw = in_shape.width_, ih = in_shape.height_;
+    const size_t ow = out_shape.width_, oh = out_shape.height_;
+    const size_t cb = (in_shape.depth_ + B - 1) / B;
+
+    for_i(parallelize, in_data.size() * cb * oh, [&](int task) {
+        const size_t sample = task / (cb * oh);
+        const size_t c = (task / oh) % cb;
+        const size_t oy = task % oh;
+        const float_t* in = &in_data[sample][c * ih * iw * B];
+        float_t* out = &out_data[sample][(c * oh + oy) * ow * B];
+        const size_t y0 = oy * stride_y;
+        const size_t y1 = std::min(y0 + pool_y, ih);
+
+        for (size_t ox = 0; ox < ow; ox++) {
+            const size_t x0 = ox * stride_x;
+            const size_t x1 = std::min(x0 + pool_x, iw);
+            reg m = ops::set1(std::numeric_limits<float_t>::lowest());
+            for (size_t y = y0; y < y1; y++) {
+                for (size_t x = x0; x < x1; x++) {
+                    m = ops::max(m, ops::load(in + (y * iw + x) * B));
+                }
+            }
+            ops::store(out + ox * B, m);
+        }
+    }, 1);
+}
+
+inline void maxpool_blocked(data_layout layout,
+                            const tensor_t& in_data,
+                            const shape3d& in_shape,
+                            tensor_t& out_data,
+                            const shape3d& out_shape,
+                            size_t pool_x, size_t pool_y,
+                            size_t stride_x, size_t stride_y,
+                            bool parallelize) {
+    if (layout == data_layout::nchw16c) {
+        maxpool_blocked_impl<16>(in_data, in_shape, out_data, out_shape,
+            pool_x, pool_y, stride_x, stride_y, parallelize);
+    } else {
+        maxpool_blocked_impl<8>(in_data, in_shape, out_data, out_shape,
+            pool_x, pool_y, stride_x, stride_y, parallelize);
+    }
+}
+
+/*
+ * average pooling with a trainable scale and bias per channel,
+ * out = sum(window) * W[c] * scale_factor + b[c].
+ * as in average_pooling_layer, only windows inside the input are summed,
+ * other outputs get the bias only
+ */
+template <size_t B>
+void avepool_blocked_impl(const tensor_t& in_data,
+                          const shape3d& in_shape,
+                          const vec_t& W,
+                          const vec_t& bias,
+                          float_t scale_factor,
+                          tensor_t& out_data,
+                          const shape3d& out_shape,
+                          size_t pool_x, size_t pool_y,
+                          size_t stride_x, size_t stride_y,
+                          bool parallelize) {
+    typedef blocked_lane_ops<float_t, B> ops;
+    typedef typename ops::reg reg;
+
+    const size_t iw = in_shape.width_, ih = in_shape.height_;
+    const size_t ow = out_shape.width_, oh = out_shape.height_;
+    const size_t depth = in_shape.depth_;
+    const size_t cb = (depth + B - 1) / B;
+
+    vec_t wpack(cb * B, float_t(0));
+    vec_t bpack(cb * B, float_t(0));
+    for (size_t c = 0; c < depth; c++) {
+        wpack[c] = W[c] * scale_factor;
+        bpack[c] = bias[c];
+    }
+
+    for_i(parallelize, in_data.size() * cb * oh, [&](int task) {
+        const size_t sample = task / (cb * oh);
+        const size_t c = (task / oh) % cb;
+        const size_t oy = task % oh;
+        const float_t* in = &in_data[sample][c * ih * iw * B];
+        float_t* out = &out_data[sample][(c * oh + oy) * ow * B];
+        const reg w = ops::load(&wpack[c * B]);
+        const reg b = ops::load(&bpack[c * B]);
+        const size_t y0 = oy * stride_y;
+
+        for (size_t ox = 0; ox < ow; ox++) {
+            const size_t x0 = ox * stride_x;
+            reg sum = ops::set1(float_t(0));
+            if (x0 + pool_x <= iw && y0 + pool_y <= ih) {
+                for (size_t y = y0; y < y0 + pool_y; y++) {
+                    for (size_t x = x0; x < x0 + pool_x; x++) {
+                        sum = ops::add(sum, ops::load(in + (y * iw + x) * B));
+                    }
+                }
+            }
+            ops::store(out + ox * B, ops::add(ops::mul(sum, w), b));
+        }
+    }, 1);
+}
+
+inline void avepool_blocked(data_layout layout,
+                            const tensor_t& in_data,
+                            const shape3d& in_shape,
+                            const vec_t& W,
+                            const vec_t& bias,
+                            float_t scale_factor,
+                            tensor_t& out_data,
+                            const shape3d& out_shape,
+                            size_t pool_x, size_t pool_y,
+                            size_t stride_x, size_t stride_y,
+                            bool parallelize) {
+    if (layout == data_layout::nchw16c) {
+        avepool_blocked_impl<16>(in_data, in_shape, W, bias, scale_factor,
+            out_data, out_shape, pool_x, pool_y, stride_x, stride_y, parallelize);
+    } else {
+        avepool_blocked_impl<8>(in_data, in_shape, W, bias, scale_factor,
+            out_data, out_shape, pool_x, pool_y, stride_x, stride_y, parallelize);
+    }
+}
+
+/*
+ * batch normalization with fixed statistics, out = (in - mean[c]) / stddev[c]
+ */
+template <size_t B>
+void batchnorm_blocked_impl(const tensor_t& in_data,
+                            const shape3d& shape,
+                            const vec_t& mean,
+                            const vec_t& stddev,
+                            tensor_t& out_data,
+                            bool parallelize) {
+    typedef blocked_lane_ops<float_t, B> ops;
+    typedef typename ops::reg reg;
+
+    const size_t area = shape.area();
+    const size_t cb = (shape.depth_ + B - 1) / B;
+
+    // padded channels: mean 0, stddev 1
+    vec_t mpack(cb * B, float_t(0));
+    vec_t spack(cb * B, float_t(1));
+    std::copy(mean.begin(), mean.begin() + shape.depth_, mpack.begin());
+    std::copy(stddev.begin(), stddev.begin() + shape.depth_, spack.begin());
+
+    for_i(parallelize, in_data.size() * cb, [&](int task) {
+        const size_t sample = task / cb;
+        const size_t c = task % cb;
+        const float_t* in = &in_data[sample][c * area * B];
+        float_t* out = &out_data[sample][c * area * B];
+        const reg m = ops::load(&mpack[c * B]);
+        const reg s = ops::load(&spack[c * B]);
+
+        for (size_t i = 0; i < area; i++) {
+            ops::store(out + i * B, ops::div(ops::sub(ops::load(in + i * B), m), s));
+        }
+    }, 1);
+}
+
+inline void batchnorm_blocked(data_layout layout,
+                              const tensor_t& in_data,
+                              const shape3d& shape,
+                              const vec_t& mean,
+                              const vec_t& stddev,
+                              tensor_t& out_data,
+                              bool parallelize) {
+    if (layout == data_layout::nchw16c) {
+        batchnorm_blocked_impl<16>(in_data, shape, mean, stddev, out_data, parallelize);
+    } else {
+        batchnorm_blocked_impl<8>(in_data, shape, mean, stddev, out_data, parallelize);
+    }
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
@@ -48,6 +48,8 @@
 
 #include "tiny_dnn/core/kernels/conv2d_grad_op_avx.h"
 #include "tiny_dnn/core/kernels/conv2d_op_custom.h"
+#include "tiny_dnn/core/kernels/conv2d_op_gemm.h"
+#include "tiny_dnn/core/kernels/conv2d_op_winograd.h"
 
 namespace tiny_dnn {
 
@@ -63,7 +65,9 @@ class Conv2dGradOp : public core::OpKernel {
         const tensor_t& prev_out = context.input(0);
         const tensor_t&       W  = context.input(1);
         tensor_t&    dW = context.input_grad(1);
-        tensor_t&    db = context.input_grad(2);
+        // layers without bias have no third input, db is then only indexed
+        tensor_t  no_bias(params.has_bias ? 0 : dW.size());
+        tensor_t&    db = params.has_bias ? context.input_grad(2) : no_bias;
         tensor_t&    prev_delta = context.input_grad(0);
         tensor_t&    curr_delta = context.output_grad(1);
 
@@ -74,8 +78,42 @@ class Conv2dGradOp : public core::OpKernel {
         // on the selected engine type
 
         const core::backend_t engine = context.engine();
-        
-        if (engine == core::backend_t::tiny_dnn) {
+        const core::conv_algorithm algorithm = params.selected_algorithm();
+
+        if ((engine == core::backend_t::tiny_dnn ||
+             engine == core::backend_t::avx) &&
+            algorithm == core::conv_algorithm::winograd) {
+            kernels::conv2d_op_gemm(
+                prev_out,
+                W[0],
+                dW,
+                db,
+                curr_delta,
+                prev_delta,
+                params,
+                context.parallelize(),
+                false);
+            kernels::conv2d_op_winograd_delta(
+                curr_delta,
+                filter_,
+                W[0],
+                prev_delta,
+                params,
+                context.parallelize());
+        }
+        else if (engine == core::backend_t::tiny_dnn &&
+                 algorithm == core::conv_algorithm::gemm) {
+            kernels::conv2d_op_gemm(
+                prev_out,
+                W[0],
+                dW,
+                db,
+                curr_delta,
+                prev_delta,
+                params,
+                context.parallelize());
+        }
+        else if (engine == core::backend_t::tiny_dnn) {
             kernels::conv2d_op_custom(
                 prev_out,
                 W[0],
@@ -101,6 +139,10 @@ class Conv2dGradOp : public core::OpKernel {
             throw nn_error("Not supported engine: " + to_string(engine));
         }
     }
+
+ private:
+    // transposed, flipped and transformed weights for the winograd algorithm
+    kernels::winograd_filter filter_;
 };
 
 }  // namespace tiny_dnn
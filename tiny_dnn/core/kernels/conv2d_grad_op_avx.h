@@ -29,6 +29,7 @@
 #include <vector>
 #include "tiny_dnn/core/params/conv_params.h"
 #include "tiny_dnn/core/kernels/conv2d_op_custom.h"
+#include "tiny_dnn/core/kernels/conv2d_op_gemm.h"
 
 #ifdef CNN_USE_AVX
 #include "tiny_dnn/core/kernels/avx_kernel_common.h"
@@ -476,8 +477,8 @@ void avx_conv2d_5x5_back_kernel(const core::conv_params& params,
                                 std::vector<std::vector<float, Allocator>>&       db,
                                 std::vector<std::vector<float, Allocator>>&       curr_delta,
                                 std::vector<std::vector<float, Allocator>>&       prev_delta) {
-    for_i(prev_out.size(), [&](int sample) {
-        avx_conv2d_5x5_back_kernel_one(params, prev_out[sample], W, dW[sample], db[sample],
+    for_each_block(true, prev_out.size(), dW.size(), [&](int block, int sample) {
+        avx_conv2d_5x5_back_kernel_one(params, prev_out[sample], W, dW[block], db[block],
             curr_delta[sample], &prev_delta[sample]);
     });
 } 
@@ -496,7 +497,14 @@ conv2d_grad_op_avx(const tensor_t&        prev_out,
                    const bool    layer_parallelize) {
 #ifdef CNN_USE_AVX
     if (params.weight.height_ == 5 && params.weight.width_ == 5) {
-        avx_conv2d_5x5_back_kernel(params, prev_out, W, dW, db, curr_delta, prev_delta);
+        // the 5x5 kernels read and write whole 8-float rows of the window,
+        // with same padding the implicitly padded gemm is used instead
+        if (params.pad_type == padding::valid) {
+            avx_conv2d_5x5_back_kernel(params, prev_out, W, dW, db, curr_delta, prev_delta);
+        } else {
+            conv2d_op_gemm(prev_out, W, dW, db, curr_delta,
+                           prev_delta, params, layer_parallelize);
+        }
         return;
     }
 #endif
@@ -48,7 +48,9 @@
 
 #include "tiny_dnn/core/kernels/conv2d_op_avx.h"
 #include "tiny_dnn/core/kernels/conv2d_op_custom.h"
+#include "tiny_dnn/core/kernels/conv2d_op_gemm.h"
 #include "tiny_dnn/core/kernels/conv2d_op_nnpack.h"
+#include "tiny_dnn/core/kernels/conv2d_op_winograd.h"
 
 namespace tiny_dnn {
 
@@ -63,8 +65,14 @@ class Conv2dOp : public core::OpKernel {
         // incomimg/outcoming data 
         const tensor_t& in_data = context.input(0);
         const tensor_t&       W = context.input(1);
-        const tensor_t&    bias = context.input(2);
+        // layers without bias have no third input
+        const vec_t no_bias;
+        const vec_t&       bias = params.has_bias ? context.input(2)[0] : no_bias;
         tensor_t&      out_data = context.output(1);
+        // activation etc. fused into the kernel if the layer asks for it
+        const kernels::epilogue no_epilogue;
+        const kernels::epilogue& ep = context.epilogue() ? *context.epilogue()
+                                                          : no_epilogue;
 
         // initialize outputs
         fill_tensor(out_data, float_t(0));
@@ -73,37 +81,99 @@ class Conv2dOp : public core::OpKernel {
         // on the selected engine type
 
         const core::backend_t engine = context.engine();
-
-        if (engine == core::backend_t::tiny_dnn) {
+        const core::conv_algorithm algorithm = params.selected_algorithm();
+
+        // 3x3 stride-1 layers are also taken from the avx engine,
+        // which only has a specialized kernel for 5x5
+        if ((engine == core::backend_t::tiny_dnn ||
+             engine == core::backend_t::avx) &&
+            algorithm == core::conv_algorithm::winograd &&
+            params.weights_bf16) {
+            // bfloat16 weights are widened by the filter transform
+            kernels::conv2d_op_winograd(
+                in_data,
+                filter_,
+                *params.weights_bf16,
+                bias,
+                out_data,
+                params,
+                context.parallelize(),
+                ep);
+        }
+        else if ((engine == core::backend_t::tiny_dnn ||
+                  engine == core::backend_t::avx) &&
+                 algorithm == core::conv_algorithm::winograd) {
+            kernels::conv2d_op_winograd(
+                in_data,
+                filter_,
+                W[0],
+                bias,
+                out_data,
+                params,
+                context.parallelize(),
+                ep);
+        }
+        else if (engine == core::backend_t::tiny_dnn &&
+                 algorithm == core::conv_algorithm::gemm &&
+                 params.weights_bf16) {
+            // bfloat16 weights are widened as they're packed
+            kernels::conv2d_op_gemm(
+                in_data,
+                *params.weights_bf16,
+                bias,
+                out_data,
+                params,
+                context.parallelize(),
+                ep);
+        }
+        else if (engine == core::backend_t::tiny_dnn &&
+                 algorithm == core::conv_algorithm::gemm) {
+            kernels::conv2d_op_gemm(
+                in_data,
+                W[0],
+                bias,
+                out_data,
+                params,
+                context.parallelize(),
+                ep);
+        }
+        else if (engine == core::backend_t::tiny_dnn) {
             kernels::conv2d_op_custom(
                 in_data,
                 W[0],
-                bias[0],
+                bias,
                 out_data,
                 params,
-                context.parallelize());
+                context.parallelize(),
+                ep);
         }
         else if (engine == core::backend_t::nnpack) {
             kernels::conv2d_op_nnpack(
                 in_data,
                 W[0],
-                bias[0],
+                bias,
                 out_data,
                 params);
+            ep.apply_all(context.parallelize());
         }
         else if (engine == core::backend_t::avx) {
             kernels::conv2d_op_avx(
                 in_data,
                 W[0],
-                bias[0],
+                bias,
                 out_data,
                 params,
-                context.parallelize());
+                context.parallelize(),
+                ep);
         }
         else {
             throw nn_error("Not supported engine: " + to_string(engine));
         }
     }
+
+ private:
+    // transformed weights for the winograd algorithm
+    kernels::winograd_filter filter_;
 };
 
 }  // namespace tiny_dnn
@@ -39,6 +39,62 @@ namespace kernels {
 
 #ifdef CNN_USE_AVX
 
+/*
+ * output rows [*y0, *y1) and columns [*x0, *x1) whose 5x5 window lies inside
+ * the input, so the vector loops need no bounds checks. with same padding
+ * the remaining border pixels are computed by avx_conv2d_5x5_border.
+ */
+inline void avx_conv2d_5x5_interior(const core::conv_params& params,
+                                    size_t* x0, size_t* x1,
+                                    size_t* y0, size_t* y1) {
+    size_t unused;
+    core::conv_output_range(0, params.w_stride, params.pad_left(),
+        params.in.width_, params.out.width_, x0, &unused);
+    core::conv_output_range(4, params.w_stride, params.pad_left(),
+        params.in.width_, params.out.width_, &unused, x1);
+    core::conv_output_range(0, params.h_stride, params.pad_top(),
+        params.in.height_, params.out.height_, y0, &unused);
+    core::conv_output_range(4, params.h_stride, params.pad_top(),
+        params.in.height_, params.out.height_, &unused, y1);
+    *x1 = std::max(*x0, *x1);
+    *y1 = std::max(*y0, *y1);
+}
+
+// pa += clipped 5x5 window sums of the output pixels outside the interior
+template <typename T>
+void avx_conv2d_5x5_border(const core::conv_params& params,
+                           const T* pi, const T* pw, T* pa,
+                           size_t x0, size_t x1, size_t y0, size_t y1) {
+    const size_t pad_x = params.pad_left();
+    const size_t pad_y = params.pad_top();
+    const size_t iw = params.in.width_;
+
+    for (size_t y = 0; y < params.out.height_; y++) {
+        size_t ky0, ky1;
+        core::conv_tap_range(y, params.h_stride, pad_y, 5,
+                             params.in.height_, &ky0, &ky1);
+        const bool inner_row = y >= y0 && y < y1;
+
+        for (size_t x = 0; x < params.out.width_; x++) {
+            if (inner_row && x == x0 && x1 > x0) {
+                x = x1 - 1;
+                continue;
+            }
+            size_t kx0, kx1;
+            core::conv_tap_range(x, params.w_stride, pad_x, 5, iw, &kx0, &kx1);
+
+            T sum = T(0);
+            for (size_t wy = ky0; wy < ky1; wy++) {
+                const T* ppi = pi + (y * params.h_stride + wy - pad_y) * iw;
+                for (size_t wx = kx0; wx < kx1; wx++) {
+                    sum += pw[wy * 5 + wx] * ppi[x * params.w_stride + wx - pad_x];
+                }
+            }
+            pa[y * params.out.width_ + x] += sum;
+        }
+    }
+}
+
 // float ver
 template <typename Allocator>
 void avx_conv2d_5x5_kernel(const core::conv_params& params,
@@ -50,21 +106,23 @@ void avx_conv2d_5x5_kernel(const core::conv_params& params,
     assert(params.weight.height_ == 5 && params.weight.width_ == 5);
     
     auto& out       = params.out;
-    auto& in_padded = params.in_padded;
+    auto& in_shape  = params.in;
     auto& tbl       = params.tbl;
     auto  w_stride  = params.w_stride;
     
     const size_t out_area = out.area();
     cnn_size_t oidx = 0;
     float bias_scale = params.has_bias ? 1.0f : 0.0f;
-    const size_t stride = params.h_stride * in_padded.width_;
-    const size_t inarea = in_padded.area();
+    const size_t inarea = in_shape.area();
+    const size_t pad_x = params.pad_left();
+    const size_t pad_y = params.pad_top();
 
     static const __m256i imask = _mm256_setr_epi32(-1, -1, -1, -1, -1, 0, 0, 0);
     // static const __m256 mask = _mm256_castsi256_ps(_mm256_setr_epi32(-1, -1, -1, -1, -1, 0, 0, 0));
 
     const __m128 y_bias_scale = _mm_set_ss(bias_scale);
-    if (out.height_ == 1 && out.width_ == 1) {
+    if (out.height_ == 1 && out.width_ == 1 &&
+        in_shape.height_ == 5 && in_shape.width_ == 5) {
         const float* pw = (const float*)&W[0];
         for (size_t o = 0; o < out.depth_; ++o) {
             __m256 sum0 = _mm256_setzero_ps();
@@ -94,17 +152,21 @@ void avx_conv2d_5x5_kernel(const core::conv_params& params,
                 sum3 = _mm_add_ps(tmp3, sum3);
             }
             __m256 sum = _mm256_add_ps(_mm256_add_ps(sum0, sum1), sum2);
-            __m128 b = _mm_load_ss(&bias[o]);
+            __m128 b = _mm_set_ss(params.has_bias ? bias[o] : 0.0f);
             __m128 hsum = hsum256_ps(sum);
             b = madd128_ss(b, y_bias_scale, sum3);
             _mm_store_ss(&a[o], _mm_add_ss(hsum, b));
         }
     } else {
-        const size_t nblocks = out.width_ / 4;
+        size_t x0, x1, y0, y1;
+        avx_conv2d_5x5_interior(params, &x0, &x1, &y0, &y1);
+        const bool has_border = x0 > 0 || y0 > 0 ||
+                                x1 < out.width_ || y1 < out.height_;
+        const size_t nblocks = (x1 - x0) / 4;
         for (size_t o = 0; o < out.depth_; ++o, oidx += out_area) {
             float* pa = &a[oidx];
             // init to bias value
-            float b = bias[o] * bias_scale;
+            float b = params.has_bias ? bias[o] : 0.0f;
             {
                 size_t headSize = 0;
                 __m256 b2 = _mm256_set1_ps(b);
@@ -129,7 +191,7 @@ void avx_conv2d_5x5_kernel(const core::conv_params& params,
                 if (!tbl.is_connected(o, inc)) continue;
 
                 const float* pw = (const float*) &W[25 * (params.in.depth_ * o + inc)];
-                const float* pi = (const float*) &in[in_padded.get_index(0, 0, inc)];
+                const float* pi = (const float*) &in[in_shape.get_index(0, 0, inc)];
 
                 __m256 w0a = _mm256_maskload_ps(pw+0, imask);
                 __m256 w1a = _mm256_maskload_ps(pw+5, imask);
@@ -151,17 +213,19 @@ void avx_conv2d_5x5_kernel(const core::conv_params& params,
                 __m256 w2d = leftShift<12>(w2a);
                 __m256 w3d = leftShift<12>(w3a);
                 __m256 w4d = leftShift<12>(w4a);
-                float* ppa = pa;
-                for (cnn_size_t y = 0; y < out.height_; y++) {
-                    const float* pi0 = (pi + y * stride);
-                    const float* pi1 = pi0 + 1 * in_padded.width_;
-                    const float* pi2 = pi0 + 2 * in_padded.width_;
-                    const float* pi3 = pi0 + 3 * in_padded.width_;
-                    const float* pi4 = pi0 + 4 * in_padded.width_;
-                    cnn_size_t x = 0;
+                for (cnn_size_t y = y0; y < y1; y++) {
+                    const float* pi0 = pi +
+                        (y * params.h_stride - pad_y) * in_shape.width_ +
+                        (x0 * w_stride - pad_x);
+                    const float* pi1 = pi0 + 1 * in_shape.width_;
+                    const float* pi2 = pi0 + 2 * in_shape.width_;
+                    const float* pi3 = pi0 + 3 * in_shape.width_;
+                    const float* pi4 = pi0 + 4 * in_shape.width_;
+                    float* ppa = pa + y * out.width_;
+                    cnn_size_t x = x0;
                     if (w_stride == 1) {
                         __m256 dst0, dst1, dst2, dst3;
-                        float* ppa2 = ppa;
+                        float* ppa2 = ppa + x0;
                         for (size_t i = 0; i < nblocks; ++i) {
                             __m256 i0 = _mm256_loadu_ps(pi0);
                             __m256 i1 = _mm256_loadu_ps(pi1);
@@ -201,9 +265,9 @@ void avx_conv2d_5x5_kernel(const core::conv_params& params,
                             pi4 += 4;
                             ppa2 += 4;
                         }
-                        x = nblocks * 4;
+                        x = x0 + nblocks * 4;
                     }
-                    for (; x < out.width_; ++x) {
+                    for (; x < x1; ++x) {
                         __m128 sum = _mm_load_ss(&ppa[x]);
                         __m256 i0 = _mm256_loadu_ps(pi0);
                         __m256 i1 = _mm256_loadu_ps(pi1);
@@ -224,8 +288,11 @@ void avx_conv2d_5x5_kernel(const core::conv_params& params,
                         pi3 += w_stride;
                         pi4 += w_stride;
                     } // x loop
-                    ppa += out.width_;
                 } // y loop
+
+                if (has_border) {
+                    avx_conv2d_5x5_border(params, pi, pw, pa, x0, x1, y0, y1);
+                }
             } // in depth loop
         } // out depth loop
     } // else
@@ -242,7 +309,7 @@ void avx_conv2d_5x5_kernel(const core::conv_params& params,
     assert(params.weight.height_ == 5 && params.weight.width_ == 5);
     
     auto& out       = params.out;
-    auto& in_padded = params.in_padded;
+    auto& in_shape  = params.in;
     auto& tbl       = params.tbl;
     auto  w_stride  = params.w_stride;
     
@@ -251,10 +318,12 @@ void avx_conv2d_5x5_kernel(const core::conv_params& params,
     const __m128d y_bias_scale = _mm_set_sd(bias_scale);
     cnn_size_t oidx = 0;
 
-    const size_t in_stride = params.h_stride * in_padded.width_;
-    const size_t in_padded_area = in_padded.area();
+    const size_t in_area = in_shape.area();
+    const size_t pad_x = params.pad_left();
+    const size_t pad_y = params.pad_top();
 
-    if (out.height_ == 1 && out.width_ == 1) {
+    if (out.height_ == 1 && out.width_ == 1 &&
+        in_shape.height_ == 5 && in_shape.width_ == 5) {
         const double* pw = &W[0];
         for (size_t o = 0; o < out.depth_; ++o) {
             __m256d sum0 = _mm256_setzero_pd();
@@ -265,7 +334,7 @@ void avx_conv2d_5x5_kernel(const core::conv_params& params,
             __m256d sum5 = _mm256_setzero_pd();
             __m128d sum6 = _mm_setzero_pd();
             size_t inidx = 0;
-            for (cnn_size_t inc = 0; inc < params.in.depth_; ++inc, pw += 25, inidx += in_padded_area) {
+            for (cnn_size_t inc = 0; inc < params.in.depth_; ++inc, pw += 25, inidx += in_area) {
                 if (!tbl.is_connected(o, inc)) {
                     continue;
                 }
@@ -304,15 +373,19 @@ void avx_conv2d_5x5_kernel(const core::conv_params& params,
             sum4 = _mm256_add_pd(sum4, sum5);
             sum0 = _mm256_add_pd(sum0, sum2);
             __m256d sum = _mm256_add_pd(sum0, sum4);
-            __m128d b = _mm_load_sd(&bias[o]);
+            __m128d b = _mm_set_sd(params.has_bias ? bias[o] : 0.0);
             __m128d hsum = hsum256_pd(sum);
             b = madd128_sd(b, y_bias_scale, sum6);
             _mm_store_sd(&a[o], _mm_add_sd(hsum, b));
         }
     } else {
+        size_t x0, x1, y0, y1;
+        avx_conv2d_5x5_interior(params, &x0, &x1, &y0, &y1);
+        const bool has_border = x0 > 0 || y0 > 0 ||
+                                x1 < out.width_ || y1 < out.height_;
         for (cnn_size_t o = 0; o < out.depth_; ++o, oidx += out_area) {
             double* pa = &a[oidx];
-            double b = bias[o] * bias_scale;
+            double b = params.has_bias ? bias[o] : 0.0;
             {
                 size_t headSize = 0;
                 __m256d b2 = _mm256_set1_pd(b);
@@ -338,7 +411,7 @@ void avx_conv2d_5x5_kernel(const core::conv_params& params,
                 if (!tbl.is_connected(o, inc)) continue;
 
                 const double* pw = (const double*)&W[25 * (params.in.depth_ * o + inc)];
-                const double* pi = &in[in_padded.get_index(0, 0, inc)];
+                const double* pi = &in[in_shape.get_index(0, 0, inc)];
 
                 __m256d w0a = _mm256_loadu_pd(pw+0);
                 __m128d w0b = _mm_load_sd(pw+4);
@@ -351,14 +424,16 @@ void avx_conv2d_5x5_kernel(const core::conv_params& params,
                 __m256d w4a = _mm256_loadu_pd(pw+20);
                 __m128d w4b = _mm_load_sd(pw+24);
 
-                double* ppa = pa;
-                for (cnn_size_t y = 0; y < out.height_; ++y, pi += in_stride, ppa += out.width_) {
-                    const double* pi0 = pi + 0 * in_padded.width_;
-                    const double* pi1 = pi + 1 * in_padded.width_;
-                    const double* pi2 = pi + 2 * in_padded.width_;
-                    const double* pi3 = pi + 3 * in_padded.width_;
-                    const double* pi4 = pi + 4 * in_padded.width_;
-                    for (cnn_size_t x = 0; x < out.width_; ++x) {
+                for (cnn_size_t y = y0; y < y1; ++y) {
+                    const double* pi0 = pi +
+                        (y * params.h_stride - pad_y) * in_shape.width_ +
+                        (x0 * w_stride - pad_x);
+                    const double* pi1 = pi0 + 1 * in_shape.width_;
+                    const double* pi2 = pi0 + 2 * in_shape.width_;
+                    const double* pi3 = pi0 + 3 * in_shape.width_;
+                    const double* pi4 = pi0 + 4 * in_shape.width_;
+                    double* ppa = pa + y * out.width_;
+                    for (cnn_size_t x = x0; x < x1; ++x) {
                         __m128d sum = _mm_load_sd(&ppa[x]);
                         __m256d i0a = _mm256_loadu_pd(pi0);
                         __m128d i0b = _mm_load_sd(pi0 + 4);
@@ -390,6 +465,10 @@ void avx_conv2d_5x5_kernel(const core::conv_params& params,
                         pi4 += w_stride;
                     } // x loop
                 } // y loop
+
+                if (has_border) {
+                    avx_conv2d_5x5_border(params, pi, pw, pa, x0, x1, y0, y1);
+                }
             } // in depth loop
         } // out depth loop
     } // else
@@ -402,17 +481,19 @@ inline void conv2d_op_avx(const tensor_t&         in_data,
                           const vec_t&               bias,
                           tensor_t&              out_data,
                           const core::conv_params& params,
-                          const bool    layer_parallelize) {
+                          const bool    layer_parallelize,
+                          const epilogue&              ep = epilogue()) {
 #ifdef CNN_USE_AVX
     if (params.weight.height_ == 5 && params.weight.width_ == 5) {
         // @todo consider better parallelization
         for_i(layer_parallelize, in_data.size(), [&](int i) {
             avx_conv2d_5x5_kernel(params, in_data[i], W, bias, out_data[i], layer_parallelize);
+            ep.apply(i);
         });
         return;
     }
 #endif
-    conv2d_op_custom(in_data, W, bias, out_data, params, layer_parallelize);
+    conv2d_op_custom(in_data, W, bias, out_data, params, layer_parallelize, ep);
 }
 
 }  // namespace kernels
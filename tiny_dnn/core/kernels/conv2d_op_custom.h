@@ -44,16 +44,43 @@
 */
 #pragma once
 
+#include "tiny_dnn/core/kernels/epilogue.h"
+
 namespace tiny_dnn {
 namespace kernels {
 
+/*
+ * taps of the window which read inside the input, per output position:
+ * [range[2 * pos], range[2 * pos + 1]). positions in the interior get the
+ * full window, border positions a clipped one, so the padded input is never
+ * materialized and the inner loops carry no bounds checks.
+ */
+inline std::vector<size_t> conv2d_tap_ranges(size_t out_len, size_t stride,
+                                             size_t pad, size_t window,
+                                             size_t in_len) {
+    std::vector<size_t> range(2 * out_len);
+    for (size_t pos = 0; pos < out_len; pos++) {
+        core::conv_tap_range(pos, stride, pad, window, in_len,
+                             &range[2 * pos], &range[2 * pos + 1]);
+    }
+    return range;
+}
+
 inline void
 conv2d_op_custom(const tensor_t&         in_data,
                  const vec_t&                  W,
                  const vec_t&               bias,
                  tensor_t&              out_data,
                  const core::conv_params& params,
-                 const bool          parallelize) {
+                 const bool          parallelize,
+                 const epilogue&              ep = epilogue()) {
+    const size_t pad_x = params.pad_left();
+    const size_t pad_y = params.pad_top();
+    const std::vector<size_t> kx = conv2d_tap_ranges(params.out.width_,
+        params.w_stride, pad_x, params.weight.width_, params.in.width_);
+    const std::vector<size_t> ky = conv2d_tap_ranges(params.out.height_,
+        params.h_stride, pad_y, params.weight.height_, params.in.height_);
+
     for_i(parallelize, in_data.size(), [&](int sample) {
         const vec_t& in = in_data[sample];
         vec_t& a = out_data[sample];
@@ -67,7 +94,7 @@ conv2d_op_custom(const tensor_t&         in_data,
                 idx = params.weight.get_index(0, 0, idx);
                 const float_t *pw = &W[idx];
 
-                idx = params.in_padded.get_index(0, 0, inc);
+                idx = params.in.get_index(0, 0, inc);
                 const float_t *pi = &in[idx];
 
                 idx = params.out.get_index(0, 0, o);
@@ -75,17 +102,17 @@ conv2d_op_custom(const tensor_t&         in_data,
 
                 for (cnn_size_t y = 0; y < params.out.height_; y++) {
                     for (cnn_size_t x = 0; x < params.out.width_; x++) {
-                        const float_t * ppw = pw;
-                        const float_t * ppi = pi + params.in_padded.width_ *
-                            (y * params.h_stride) +
-                            x * params.w_stride;
+                        const size_t kx0 = kx[2 * x], kx1 = kx[2 * x + 1];
                         float_t sum = float_t(0);
 
                         // should be optimized for small kernel(3x3,5x5)
-                        for (cnn_size_t wy = 0; wy < params.weight.height_; wy++) {    // NOLINT
-                            for (cnn_size_t wx = 0; wx < params.weight.width_; wx++) { // NOLINT
-                                idx = wy * params.in_padded.width_ + wx;
-                                sum += *ppw++ * ppi[idx];
+                        for (size_t wy = ky[2 * y]; wy < ky[2 * y + 1]; wy++) {
+                            const float_t * ppw = pw + wy * params.weight.width_ + kx0;
+                            const float_t * ppi = pi +
+                                (y * params.h_stride + wy - pad_y) * params.in.width_ +
+                                (x * params.w_stride + kx0 - pad_x);
+                            for (size_t wx = 0; wx < kx1 - kx0; wx++) {
+                                sum += ppw[wx] * ppi[wx];
                             }
                         }
                         pa[y * params.out.width_ + x] += sum;
@@ -98,8 +125,12 @@ conv2d_op_custom(const tensor_t&         in_data,
                 float_t * paa = pa + params.out.width_ * params.out.height_;
                 std::for_each(pa, paa, [&](float_t& f) { f += bias[o]; });
             }
+
+            ep.apply(sample, params.out.get_index(0, 0, o), params.out.area());
         }
     });
+
+    ep.apply_rest(parallelize);
 }
 
 
@@ -119,7 +150,15 @@ conv2d_op_custom(const tensor_t&        prev_out,
 
     typedef typename vec_t::value_type float_t;
 
-    for_i(parallelize, prev_out.size(), [&](int sample) {
+    const size_t pad_x = params.pad_left();
+    const size_t pad_y = params.pad_top();
+    const std::vector<size_t> kx = conv2d_tap_ranges(params.out.width_,
+        params.w_stride, pad_x, params.weight.width_, params.in.width_);
+    const std::vector<size_t> ky = conv2d_tap_ranges(params.out.height_,
+        params.h_stride, pad_y, params.weight.height_, params.in.height_);
+
+    // dW/db hold one accumulator per block of samples (see layer::set_sample_count)
+    for_each_block(parallelize, prev_out.size(), dW.size(), [&](int block, int sample) {
         // propagate delta to previous layer
         for (cnn_size_t inc = 0; inc < params.in.depth_; inc++) {
             for (cnn_size_t outc = 0; outc < params.out.depth_; outc++) {
@@ -133,25 +172,23 @@ conv2d_op_custom(const tensor_t&        prev_out,
                 idx = params.out.get_index(0, 0, outc);
                 const float_t *pdelta_src = &curr_delta[sample][idx];
 
-                idx = params.in_padded.get_index(0, 0, inc);
-                //float_t *pdelta_dst = &(*prev_delta)[sample][idx];
+                idx = params.in.get_index(0, 0, inc);
                 float_t *pdelta_dst = &prev_delta[sample][idx];
 
                 for (cnn_size_t y = 0; y < params.out.height_; y++) {
                     for (cnn_size_t x = 0; x < params.out.width_; x++) {
-                        const float_t * ppw = pw;
+                        const size_t kx0 = kx[2 * x], kx1 = kx[2 * x + 1];
 
                         idx = y * params.out.width_ + x;
                         const float_t ppdelta_src = pdelta_src[idx];
 
-                        float_t * ppdelta_dst = pdelta_dst +
-                                y * params.h_stride * params.in_padded.width_ +
-                                x * params.w_stride;
-
-                        for (cnn_size_t wy = 0; wy < params.weight.height_; wy++) {    // NOLINT
-                            for (cnn_size_t wx = 0; wx < params.weight.width_; wx++) { // NOLINT
-                                idx = wy * params.in_padded.width_ + wx;
-                                ppdelta_dst[idx] += *ppw++ * ppdelta_src;
+                        for (size_t wy = ky[2 * y]; wy < ky[2 * y + 1]; wy++) {
+                            const float_t * ppw = pw + wy * params.weight.width_ + kx0;
+                            float_t * ppdelta_dst = pdelta_dst +
+                                (y * params.h_stride + wy - pad_y) * params.in.width_ +
+                                (x * params.w_stride + kx0 - pad_x);
+                            for (size_t wx = 0; wx < kx1 - kx0; wx++) {
+                                ppdelta_dst[wx] += ppw[wx] * ppdelta_src;
                             }
                         }
                     }
@@ -165,37 +202,42 @@ conv2d_op_custom(const tensor_t&        prev_out,
                 if (!params.tbl.is_connected(outc, inc)) continue;
 
                 for (cnn_size_t wy = 0; wy < params.weight.height_; wy++) {
+                    // output rows / columns for which this tap is inside the input
+                    size_t y0, y1;
+                    core::conv_output_range(wy, params.h_stride, pad_y,
+                        params.in.height_, params.out.height_, &y0, &y1);
+
                     for (cnn_size_t wx = 0; wx < params.weight.width_; wx++) {
+                        size_t x0, x1;
+                        core::conv_output_range(wx, params.w_stride, pad_x,
+                            params.in.width_, params.out.width_, &x0, &x1);
+
                         float_t dst = float_t(0);
 
                         cnn_size_t idx = 0;
-                        idx = params.in_padded.get_index(wx, wy, inc);
+                        idx = params.in.get_index(0, 0, inc);
                         const float_t * prevo = &prev_out[sample][idx];
 
                         idx = params.out.get_index(0, 0, outc);
                         const float_t * delta = &curr_delta[sample][idx];
 
-                        if (params.w_stride > 1) {
-                            for (cnn_size_t y = 0; y < params.out.height_; y++) {
-                                cnn_size_t prevo_idx = y * params.in_padded.width_ * params.h_stride;
-                                cnn_size_t delta_idx = y * params.out.width_;
+                        for (size_t y = y0; y < y1; y++) {
+                            const float_t * pprevo = prevo +
+                                (y * params.h_stride + wy - pad_y) * params.in.width_ +
+                                (x0 * params.w_stride + wx - pad_x);
+                            const float_t * pdelta = delta + y * params.out.width_ + x0;
 
-                                for (cnn_size_t x = 0; x < params.out.width_; x++) {
-                                    dst += prevo[prevo_idx + x * params.w_stride] * delta[delta_idx + x];
+                            if (params.w_stride > 1) {
+                                for (size_t x = 0; x < x1 - x0; x++) {
+                                    dst += pprevo[x * params.w_stride] * pdelta[x];
                                 }
-                            }
-                        } else {
-                            for (cnn_size_t y = 0; y < params.out.height_; y++) {
-                                dst += vectorize::dot(
-                                    prevo + y * params.in_padded.width_ * params.h_stride,
-                                    delta + y * params.out.width_,
-                                    params.out.width_);
+                            } else {
+                                dst += vectorize::dot(pprevo, pdelta, x1 - x0);
                             }
                         }
 
-
                         idx = params.in.depth_ * outc + inc;
-                        dW[sample][params.weight.get_index(wx, wy, idx)] += dst;
+                        dW[block][params.weight.get_index(wx, wy, idx)] += dst;
                     }
                 }
             }
@@ -208,7 +250,7 @@ conv2d_op_custom(const tensor_t&        prev_out,
                 const float_t * delta = &curr_delta[sample][idx];
                 const float_t * deltaa = delta + params.out.width_ *
                     params.out.height_;
-                db[sample][outc] += std::accumulate(delta, deltaa, float_t(0));
+                db[block][outc] += std::accumulate(delta, deltaa, float_t(0));
             }
         }
     });
@@ -0,0 +1,363 @@
+/*
+    COPYRIGHT
+
+    All contributions by Taiga Nomi
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+
+    All other contributions:
+    Copyright (c) 2013-2016, the respective contributors.
+    All rights reserved.
+
+    Each contributor holds copyright over their respective contributions.
+    The project versioning (Git) records all such contribution source information.
+
+    LICENSE
+
+    The BSD 3-Clause License
+
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of tiny-dnn nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <algorithm>
+#include <numeric>
+
+#include "tiny_dnn/core/params/conv_params.h"
+#include "tiny_dnn/core/kernels/gemm_kernel.h"
+#include "tiny_dnn/core/kernels/epilogue.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+/*
+ * convolution as matrix multiplication.
+ *
+ * the im2col matrix has one row per weight tap (in channel, y, x) and one
+ * column per output pixel of the whole batch (column g is pixel g % out.area()
+ * of sample g / out.area()), so small feature maps of a batch are multiplied
+ * at once. the batch is processed in tiles of columns, each tile's im2col
+ * block is built in a per-thread buffer which is reused across calls.
+ *
+ *   forward      : out[M x G]  = W[M x K] * col[K x G]
+ *   delta        : dcol[K x G] = W^T * dout[M x G], then col2im
+ *   weight grad  : dW[M x K]  += dout[M x G] * col^T
+ */
+
+// columns per tile, such that a tile of rows_per_column rows is ~512KB
+inline size_t conv2d_gemm_tile_width(size_t rows_per_column) {
+    const size_t NR = gemm_block_size<float_t>::NR;
+    const size_t budget = (size_t(1) << 17) / std::max<size_t>(rows_per_column, 1);
+    return std::max(NR, std::min<size_t>(512, budget / NR * NR));
+}
+
+// W, or a copy of it in *masked with unconnected (out, in) channel pairs
+// set to zero. W is vec_t or std::vector<bfloat16>
+template <typename Weights>
+const Weights& conv2d_gemm_weight(const core::conv_params& params,
+                                  const Weights& W, Weights* masked) {
+    if (params.tbl.is_empty()) return W;
+
+    *masked = W;
+    const size_t area = params.weight.area();
+    for (cnn_size_t o = 0; o < params.out.depth_; o++) {
+        for (cnn_size_t inc = 0; inc < params.in.depth_; inc++) {
+            if (params.tbl.is_connected(o, inc)) continue;
+            auto p = masked->begin() + (o * params.in.depth_ + inc) * area;
+            std::fill(p, p + area, typename Weights::value_type());
+        }
+    }
+    return *masked;
+}
+
+// consecutive columns [j, j + len) of a tile which lie on output row y of
+// one sample and start at output column x
+struct conv2d_gemm_run {
+    size_t j, len, sample, y, x;
+};
+
+// splits columns [g0, g0 + n) into runs, returns their number
+inline size_t conv2d_gemm_runs(const core::conv_params& params,
+                               size_t g0, size_t n, conv2d_gemm_run* runs) {
+    const size_t out_area = params.out.area();
+    size_t count = 0;
+    for (size_t j = 0; j < n;) {
+        const size_t sample = (g0 + j) / out_area;
+        const size_t pixel  = (g0 + j) % out_area;
+        const size_t y = pixel / params.out.width_;
+        const size_t x = pixel % params.out.width_;
+        const size_t len = std::min(n - j, params.out.width_ - x);
+        runs[count++] = conv2d_gemm_run{ j, len, sample, y, x };
+        j += len;
+    }
+    return count;
+}
+
+/*
+ * visits the im2col row of every tap (c, wy, wx) over columns [g0, g0 + n).
+ * taps outside the input are zero padding which is never materialized: per
+ * run, f(row, j, len, src, stride) is called for the in-bounds interior only
+ * (src = first input element, stride = step between columns), border
+ * columns and rows are passed to pad(row, j, len).
+ */
+template <typename Tensor, typename F, typename Pad>
+void conv2d_gemm_for_each_tap(const core::conv_params& params, Tensor& data,
+                              size_t g0, size_t n, F f, Pad pad) {
+    conv2d_gemm_run* runs = gemm_scratch<conv2d_gemm_run, 5>(n);
+    const size_t nruns = conv2d_gemm_runs(params, g0, n, runs);
+    const size_t pad_x = params.pad_left();
+    const size_t pad_y = params.pad_top();
+    const size_t iw = params.in.width_;
+    const size_t ih = params.in.height_;
+    size_t row = 0;
+
+    for (cnn_size_t c = 0; c < params.in.depth_; c++) {
+        for (cnn_size_t wy = 0; wy < params.weight.height_; wy++) {
+            for (cnn_size_t wx = 0; wx < params.weight.width_; wx++, row++) {
+                size_t x0, x1;
+                core::conv_output_range(wx, params.w_stride, pad_x, iw,
+                                        params.out.width_, &x0, &x1);
+
+                for (size_t r = 0; r < nruns; r++) {
+                    const conv2d_gemm_run& run = runs[r];
+                    const size_t iy = run.y * params.h_stride + wy;
+                    if (iy < pad_y || iy >= ih + pad_y) {
+                        pad(row, run.j, run.len);
+                        continue;
+                    }
+
+                    // [lo, hi): interior of this run, relative to run.x
+                    const size_t end = run.x + run.len;
+                    const size_t lo = std::min(std::max(x0, run.x), end) - run.x;
+                    const size_t hi = std::max(std::min(x1, end), run.x + lo) - run.x;
+
+                    if (lo > 0) pad(row, run.j, lo);
+                    if (hi > lo) {
+                        const size_t ix = (run.x + lo) * params.w_stride + wx - pad_x;
+                        f(row, run.j + lo, hi - lo,
+                          &data[run.sample][(c * ih + iy - pad_y) * iw + ix],
+                          params.w_stride);
+                    }
+                    if (run.len > hi) pad(row, run.j + hi, run.len - hi);
+                }
+            }
+        }
+    }
+}
+
+// col[K x n] = im2col of columns [g0, g0 + n)
+inline void conv2d_im2col(const core::conv_params& params,
+                          const tensor_t& in, size_t g0, size_t n,
+                          float_t* col) {
+    conv2d_gemm_for_each_tap(params, in, g0, n,
+        [&](size_t row, size_t j, size_t len, const float_t* src, size_t stride) {
+            float_t* dst = col + row * n + j;
+            if (stride == 1) {
+                std::copy(src, src + len, dst);
+            } else {
+                for (size_t i = 0; i < len; i++) dst[i] = src[i * stride];
+            }
+        },
+        [&](size_t row, size_t j, size_t len) {
+            std::fill(col + row * n + j, col + row * n + j + len, float_t(0));
+        });
+}
+
+// add col[K x n] back to the input positions of columns [g0, g0 + n),
+// taps on the padding are dropped
+inline void conv2d_col2im(const core::conv_params& params,
+                          const float_t* col, size_t g0, size_t n,
+                          tensor_t& delta) {
+    conv2d_gemm_for_each_tap(params, delta, g0, n,
+        [&](size_t row, size_t j, size_t len, float_t* dst, size_t stride) {
+            const float_t* src = col + row * n + j;
+            for (size_t i = 0; i < len; i++) dst[i * stride] += src[i];
+        },
+        [](size_t, size_t, size_t) {});
+}
+
+// dst[M x n] = columns [g0, g0 + n) of out (M channels of out.area() pixels)
+inline void conv2d_gemm_gather(const core::conv_params& params,
+                               const tensor_t& out, size_t g0, size_t n,
+                               float_t* dst) {
+    const size_t out_area = params.out.area();
+    for (size_t j = 0; j < n;) {
+        const size_t sample = (g0 + j) / out_area;
+        const size_t pixel  = (g0 + j) % out_area;
+        const size_t len = std::min(n - j, out_area - pixel);
+        for (cnn_size_t o = 0; o < params.out.depth_; o++) {
+            const float_t* src = &out[sample][o * out_area + pixel];
+            std::copy(src, src + len, dst + o * n + j);
+        }
+        j += len;
+    }
+}
+
+// columns [g0, g0 + n) of out = src[M x n] + bias, each finished range
+// is passed on to the epilogue
+inline void conv2d_gemm_scatter(const core::conv_params& params,
+                                const float_t* src, const vec_t& bias,
+                                size_t g0, size_t n, tensor_t& out,
+                                const epilogue& ep) {
+    const size_t out_area = params.out.area();
+    for (size_t j = 0; j < n;) {
+        const size_t sample = (g0 + j) / out_area;
+        const size_t pixel  = (g0 + j) % out_area;
+        const size_t len = std::min(n - j, out_area - pixel);
+        for (cnn_size_t o = 0; o < params.out.depth_; o++) {
+            const float_t b = params.has_bias ? bias[o] : float_t(0);
+            const float_t* ps = src + o * n + j;
+            float_t* pd = &out[sample][o * out_area + pixel];
+            for (size_t i = 0; i < len; i++) pd[i] = ps[i] + b;
+            ep.apply(sample, o * out_area + pixel, len);
+        }
+        j += len;
+    }
+}
+
+// W is vec_t, or std::vector<bfloat16> (widened as it's packed)
+template <typename Weights>
+void
+conv2d_op_gemm(const tensor_t&         in_data,
+               const Weights&                W,
+               const vec_t&               bias,
+               tensor_t&              out_data,
+               const core::conv_params& params,
+               const bool          parallelize,
+               const epilogue&              ep = epilogue()) {
+    const size_t M = params.out.depth_;
+    const size_t K = params.in.depth_ * params.weight.area();
+    const size_t G = in_data.size() * params.out.area();
+    if (G == 0) return;
+
+    // weights are packed once and shared by all tiles
+    Weights masked;
+    const Weights& w = conv2d_gemm_weight(params, W, &masked);
+    std::vector<float_t> wpack(gemm_packed_a_size<float_t>(M, K));
+    gemm_pack_a(M, K, &w[0], K, 1, &wpack[0]);
+
+    const size_t nc = conv2d_gemm_tile_width(K + M);
+    const size_t ntiles = (G + nc - 1) / nc;
+
+    for_i(parallelize, ntiles, [&](int tile) {
+        const size_t g0 = tile * nc;
+        const size_t n = std::min(nc, G - g0);
+        float_t* col = gemm_scratch<float_t, 2>(K * nc);
+        float_t* out = gemm_scratch<float_t, 3>(M * nc);
+
+        conv2d_im2col(params, in_data, g0, n, col);
+        std::fill(out, out + M * n, float_t(0));
+        gemm_prepacked(M, n, K, &wpack[0], col, n, 1, out, n);
+        conv2d_gemm_scatter(params, out, bias, g0, n, out_data, ep);
+    }, 1);
+
+    ep.apply_rest(parallelize);
+}
+
+/******************************************************************/
+
+/**
+ * @param propagate_delta false: only accumulate dW/db, prev_delta is
+ *                        computed by another algorithm
+ **/
+inline void
+conv2d_op_gemm(const tensor_t&        prev_out,
+               const vec_t&                  W,
+               tensor_t&                    dW,
+               tensor_t&                    db,
+               tensor_t&            curr_delta,
+               tensor_t&            prev_delta,
+               const core::conv_params& params,
+               const bool          parallelize,
+               const bool      propagate_delta = true) {
+    const size_t M = params.out.depth_;
+    const size_t K = params.in.depth_ * params.weight.area();
+    const size_t out_area = params.out.area();
+    const size_t nblocks = dW.size();
+
+    // W^T, packed once
+    std::vector<float_t> wtpack;
+    if (propagate_delta) {
+        vec_t masked;
+        const vec_t& w = conv2d_gemm_weight(params, W, &masked);
+        wtpack.resize(gemm_packed_a_size<float_t>(K, M));
+        gemm_pack_a(K, M, &w[0], 1, K, &wtpack[0]);
+    }
+
+    const size_t nc = conv2d_gemm_tile_width(2 * K + M);
+
+    // dW/db hold one accumulator per block of samples (see layer::set_sample_count).
+    // a block never shares a sample with another, so col2im needs no locking
+    for_i(parallelize, nblocks, [&](int block) {
+        const size_t g_begin = prev_out.size() * block / nblocks * out_area;
+        const size_t g_end = prev_out.size() * (block + 1) / nblocks * out_area;
+
+        for (size_t g0 = g_begin; g0 < g_end; g0 += nc) {
+            const size_t n = std::min(nc, g_end - g0);
+            float_t* col  = gemm_scratch<float_t, 2>(K * nc);
+            float_t* dout = gemm_scratch<float_t, 3>(M * nc);
+            float_t* dcol = gemm_scratch<float_t, 4>(propagate_delta ? K * nc : 0);
+
+            conv2d_im2col(params, prev_out, g0, n, col);
+            conv2d_gemm_gather(params, curr_delta, g0, n, dout);
+
+            // propagate delta to previous layer
+            if (propagate_delta) {
+                std::fill(dcol, dcol + K * n, float_t(0));
+                gemm_prepacked(K, n, M, &wtpack[0], dout, n, 1, dcol, n);
+                conv2d_col2im(params, dcol, g0, n, prev_delta);
+            }
+
+            // accumulate dw
+            gemm(M, K, n, dout, n, 1, col, 1, n, &dW[block][0], K);
+
+            // accumulate db
+            if (params.has_bias) {
+                for (size_t o = 0; o < M; o++) {
+                    db[block][o] += std::accumulate(dout + o * n,
+                                                    dout + (o + 1) * n,
+                                                    float_t(0));
+                }
+            }
+        }
+
+        // unconnected weights are not trained
+        if (!params.tbl.is_empty()) {
+            const size_t area = params.weight.area();
+            for (cnn_size_t o = 0; o < params.out.depth_; o++) {
+                for (cnn_size_t inc = 0; inc < params.in.depth_; inc++) {
+                    if (params.tbl.is_connected(o, inc)) continue;
+                    float_t* p = &dW[block][(o * params.in.depth_ + inc) * area];
+                    std::fill(p, p + area, float_t(0));
+                }
+            }
+        }
+    }, 1);
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
@@ -45,6 +45,7 @@
 #pragma once
 
 #include "tiny_dnn/core/framework/op_kernel.h"
+#include "tiny_dnn/core/kernels/epilogue.h"
 
 #ifdef CNN_USE_LIBDNN
 #include "libdnn.hpp"
@@ -179,6 +180,10 @@ class Conv2dLibDNNForwardOp : public core::OpKernel {
             std::copy(std::begin(out), std::end(out), std::begin(out_data[i]));
         }
 
+        // no fused output stage, the layer's activation is applied here
+        if (context.epilogue()) {
+            context.epilogue()->apply_all(context.parallelize());
+        }
 #else
         throw nn_error("TinyDNN was not compiled with LibDNN support.");
 #endif
@@ -0,0 +1,447 @@
+/*
+    COPYRIGHT
+
+    All contributions by Taiga Nomi
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+
+    All other contributions:
+    Copyright (c) 2013-2016, the respective contributors.
+    All rights reserved.
+
+    Each contributor holds copyright over their respective contributions.
+    The project versioning (Git) records all such contribution source information.
+
+    LICENSE
+
+    The BSD 3-Clause License
+
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of tiny-dnn nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+#include "tiny_dnn/core/params/conv_params.h"
+#include "tiny_dnn/core/kernels/gemm_kernel.h"
+#include "tiny_dnn/core/kernels/epilogue.h"
+
+#ifdef CNN_USE_AVX
+#include <immintrin.h>
+#endif
+
+namespace tiny_dnn {
+namespace kernels {
+
+/*
+ * Winograd F(4x4, 3x3) convolution for 3x3, stride-1 layers.
+ *
+ * every 4x4 block of output pixels (a tile) is computed from a 6x6 block
+ * of input:
+ *
+ *   Y = A^T [ sum_c (G g_oc G^T) .* (B^T d_c B) ] A
+ *
+ * the sum over input channels is done by 36 matrix multiplications (one per
+ * element of the 6x6 transformed tile) of the transformed filters
+ * [out x in] with the transformed input tiles [in x tiles], which needs
+ * 36 instead of 144 multiplications per 16 outputs and channel pair.
+ *
+ * the delta of the input is the full correlation of the output delta with the
+ * flipped filters, so backward-data runs the same algorithm on the output
+ * delta with 2 pixels of implicit zero-padding and transposed, flipped filters.
+ *
+ * input and output transforms handle 8 tiles at once (one per AVX lane).
+ */
+
+static const size_t winograd_tile  = 4;  // output pixels per tile side
+static const size_t winograd_alpha = 6;  // input pixels per tile side
+static const size_t winograd_lanes = 8;  // tiles transformed at once
+
+/**
+ * transformed filters G g G^T of a layer, packed for gemm_prepacked.
+ * recomputed when params.weight_generation changes (training, loading,
+ * writing the weights) or the weights switch between float_t and
+ * bfloat16, and on every call if the generation is 0.
+ **/
+class winograd_filter {
+ public:
+    winograd_filter()
+        : rows_(0), cols_(0), stride_(0), generation_(0), bf16_(false) {}
+
+    /**
+     * @param W          vec_t or std::vector<bfloat16>
+     * @param transposed false: [out x in] filters for forward,
+     *                   true:  [in x out] flipped filters for backward-data
+     **/
+    template <typename Weights>
+    void update(const core::conv_params& params, const Weights& W,
+                bool transposed) {
+        const bool bf16 =
+            std::is_same<typename Weights::value_type, bfloat16>::value;
+        if (!packed_.empty() && params.weight_generation != 0 &&
+            params.weight_generation == generation_ && bf16 == bf16_) {
+            return;
+        }
+        generation_ = params.weight_generation;
+        bf16_ = bf16;
+
+        const size_t in_depth  = params.in.depth_;
+        const size_t out_depth = params.out.depth_;
+        rows_ = transposed ? in_depth : out_depth;
+        cols_ = transposed ? out_depth : in_depth;
+        stride_ = gemm_packed_a_size<float_t>(rows_, cols_);
+
+        // transformed filters are written to their place in the packed
+        // panels (see gemm_pack_a), padding rows stay zero
+        const size_t MR = gemm_block_size<float_t>::MR;
+        const bool connected_all = params.tbl.is_empty();
+        packed_.assign(36 * stride_, float_t(0));
+
+        for (size_t o = 0; o < out_depth; o++) {
+            for (size_t c = 0; c < in_depth; c++) {
+                if (!connected_all && !params.tbl.is_connected(o, c)) continue;
+
+                float_t g[9];
+                const size_t base = (o * in_depth + c) * 9;
+                for (size_t i = 0; i < 9; i++) {
+                    g[i] = gemm_widen<float_t>(W[base + (transposed ? 8 - i : i)]);
+                }
+
+                float_t t[36];
+                transform_filter(g, t);
+
+                const size_t row = transposed ? c : o;
+                const size_t col = transposed ? o : c;
+                float_t* dst = &packed_[(row / MR * cols_ + col) * MR + row % MR];
+                for (size_t xi = 0; xi < 36; xi++) {
+                    dst[xi * stride_] = t[xi];
+                }
+            }
+        }
+    }
+
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+
+    // packed [rows x cols] matrix for element xi of the 6x6 tile
+    const float_t* at(size_t xi) const { return &packed_[xi * stride_]; }
+
+ private:
+    // G g G^T, g: 3x3, out: 6x6
+    static void transform_filter(const float_t* g, float_t* out) {
+        float_t t[6 * 3];
+        for (size_t j = 0; j < 3; j++) {
+            transform_filter_1d(g[j], g[3 + j], g[6 + j], &t[j], 3);
+        }
+        for (size_t i = 0; i < 6; i++) {
+            transform_filter_1d(t[i * 3], t[i * 3 + 1], t[i * 3 + 2],
+                                &out[i * 6], 1);
+        }
+    }
+
+    static void transform_filter_1d(float_t g0, float_t g1, float_t g2,
+                                    float_t* out, size_t stride) {
+        const float_t r4 = float_t(1) / 4, r6 = float_t(1) / 6;
+        const float_t r12 = float_t(1) / 12, r24 = float_t(1) / 24;
+        const float_t a = g0 * r24 + g2 * r6, b = g1 * r12;
+
+        out[0 * stride] = g0 * r4;
+        out[1 * stride] = -(g0 + g1 + g2) * r6;
+        out[2 * stride] = -(g0 - g1 + g2) * r6;
+        out[3 * stride] = a + b;
+        out[4 * stride] = a - b;
+        out[5 * stride] = g2;
+    }
+
+    size_t rows_;
+    size_t cols_;
+    size_t stride_;
+    std::vector<float_t> packed_;
+    uint64_t generation_;
+    bool bf16_;
+};
+
+// arithmetic on winograd_lanes tiles at once
+template <typename T>
+struct winograd_lane_ops {
+    typedef T reg;
+    static const size_t width = 1;
+    static reg load(const T* p) { return *p; }
+    static void store(T* p, reg v) { *p = v; }
+    static reg add(reg a, reg b) { return a + b; }
+    static reg sub(reg a, reg b) { return a - b; }
+    static reg mul(reg a, T b) { return a * b; }
+};
+
+#ifdef CNN_USE_AVX
+template <>
+struct winograd_lane_ops<float> {
+    typedef __m256 reg;
+    static const size_t width = 8;
+    static reg load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, reg v) { _mm256_storeu_ps(p, v); }
+    static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    static reg mul(reg a, float b) { return _mm256_mul_ps(a, _mm256_set1_ps(b)); }
+};
+#endif
+
+// out[i] = (B^T x)[i] for 6 rows of lanes; x[i] at x + i * xs, out[i] at out + i * os
+template <typename Ops>
+void winograd_input_1d(const float_t* x, size_t xs, float_t* out, size_t os) {
+    typedef typename Ops::reg reg;
+    const reg x0 = Ops::load(x + 0 * xs), x1 = Ops::load(x + 1 * xs);
+    const reg x2 = Ops::load(x + 2 * xs), x3 = Ops::load(x + 3 * xs);
+    const reg x4 = Ops::load(x + 4 * xs), x5 = Ops::load(x + 5 * xs);
+
+    const reg a = Ops::sub(x4, Ops::mul(x2, 4));  // x4 - 4 x2
+    const reg b = Ops::sub(x3, Ops::mul(x1, 4));  // x3 - 4 x1
+    const reg c = Ops::sub(x4, x2);
+    const reg d = Ops::mul(Ops::sub(x3, x1), 2);
+
+    Ops::store(out + 0 * os,
+               Ops::add(Ops::sub(Ops::mul(x0, 4), Ops::mul(x2, 5)), x4));
+    Ops::store(out + 1 * os, Ops::add(a, b));
+    Ops::store(out + 2 * os, Ops::sub(a, b));
+    Ops::store(out + 3 * os, Ops::add(c, d));
+    Ops::store(out + 4 * os, Ops::sub(c, d));
+    Ops::store(out + 5 * os,
+               Ops::add(Ops::sub(Ops::mul(x1, 4), Ops::mul(x3, 5)), x5));
+}
+
+// out[i] = (A^T m)[i] for 4 rows of lanes
+template <typename Ops>
+void winograd_output_1d(const float_t* m, size_t ms, float_t* out, size_t os) {
+    typedef typename Ops::reg reg;
+    const reg m0 = Ops::load(m + 0 * ms), m1 = Ops::load(m + 1 * ms);
+    const reg m2 = Ops::load(m + 2 * ms), m3 = Ops::load(m + 3 * ms);
+    const reg m4 = Ops::load(m + 4 * ms), m5 = Ops::load(m + 5 * ms);
+
+    const reg a = Ops::add(m1, m2), b = Ops::sub(m1, m2);
+    const reg c = Ops::add(m3, m4), d = Ops::sub(m3, m4);
+
+    Ops::store(out + 0 * os, Ops::add(Ops::add(m0, a), c));
+    Ops::store(out + 1 * os, Ops::add(b, Ops::mul(d, 2)));
+    Ops::store(out + 2 * os, Ops::add(a, Ops::mul(c, 4)));
+    Ops::store(out + 3 * os, Ops::add(Ops::add(b, Ops::mul(d, 8)), m5));
+}
+
+// one lane group: x[36][lanes] -> B^T x B, in place
+template <typename Ops>
+void winograd_input_transform(float_t* x) {
+    const size_t L = winograd_lanes;
+    float_t t[36 * winograd_lanes];
+    for (size_t l = 0; l < L; l += Ops::width) {
+        for (size_t j = 0; j < 6; j++) {  // columns
+            winograd_input_1d<Ops>(x + j * L + l, 6 * L, t + j * L + l, 6 * L);
+        }
+        for (size_t i = 0; i < 6; i++) {  // rows
+            winograd_input_1d<Ops>(t + i * 6 * L + l, L, x + i * 6 * L + l, L);
+        }
+    }
+}
+
+// one lane group: m[36][lanes] -> y[16][lanes] = A^T m A
+template <typename Ops>
+void winograd_output_transform(const float_t* m, float_t* y) {
+    const size_t L = winograd_lanes;
+    float_t t[24 * winograd_lanes];
+    for (size_t l = 0; l < L; l += Ops::width) {
+        for (size_t j = 0; j < 6; j++) {  // columns: 6x6 -> 4x6
+            winograd_output_1d<Ops>(m + j * L + l, 6 * L, t + j * L + l, 6 * L);
+        }
+        for (size_t i = 0; i < 4; i++) {  // rows: 4x6 -> 4x4
+            winograd_output_1d<Ops>(t + i * 6 * L + l, L, y + i * 4 * L + l, L);
+        }
+    }
+}
+
+/**
+ * out (+)= conv3x3(in, filter) + bias.
+ *
+ * @param in        in_shape.depth_ planes of in_shape, read with pad pixels
+ *                  of implicit zero-padding on each side
+ * @param filter    [out_shape.depth_ x in_shape.depth_] transformed filters
+ * @param bias      added to each output channel if not null
+ * @param accumulate add to out instead of overwriting it
+ * @param ep         run on each finished output row (not with accumulate)
+ **/
+inline void winograd_f43(const tensor_t& in,
+                         const index3d<cnn_size_t>& in_shape,
+                         size_t pad,
+                         const winograd_filter& filter,
+                         const vec_t* bias,
+                         tensor_t& out,
+                         const index3d<cnn_size_t>& out_shape,
+                         bool accumulate,
+                         bool parallelize,
+                         const epilogue& ep = epilogue()) {
+    typedef winograd_lane_ops<float_t> ops;
+    const size_t L = winograd_lanes;
+    const size_t C = in_shape.depth_;
+    const size_t M = out_shape.depth_;
+    const size_t tiles_x = (out_shape.width_ + winograd_tile - 1) / winograd_tile;
+    const size_t tiles_y = (out_shape.height_ + winograd_tile - 1) / winograd_tile;
+    const size_t tiles_per_sample = tiles_x * tiles_y;
+    const size_t T = in.size() * tiles_per_sample;
+    if (T == 0) return;
+
+    // tiles per task: transformed input and output of a block take ~2MB
+    const size_t budget = (size_t(1) << 19) / (36 * (C + M));
+    const size_t nt = std::max(L, std::min<size_t>(256, budget / L * L));
+    const size_t nblocks = (T + nt - 1) / nt;
+
+    for_i(parallelize, nblocks, [&](int block) {
+        const size_t t0 = block * nt;
+        const size_t n = std::min(nt, T - t0);
+        const size_t n_padded = (n + L - 1) / L * L;
+
+        // v[xi][c][tile], m[xi][o][tile]
+        float_t* v = gemm_scratch<float_t, 7>(36 * C * n_padded);
+        float_t* m = gemm_scratch<float_t, 8>(36 * M * n_padded);
+        float_t buf[36 * winograd_lanes];
+
+        // input transform
+        for (size_t c = 0; c < C; c++) {
+            for (size_t l0 = 0; l0 < n_padded; l0 += L) {
+                for (size_t l = 0; l < L; l++) {
+                    const size_t t = t0 + l0 + l;
+                    if (l0 + l >= n) {
+                        for (size_t k = 0; k < 36; k++) buf[k * L + l] = float_t(0);
+                        continue;
+                    }
+                    const size_t sample = t / tiles_per_sample;
+                    const size_t ty = (t % tiles_per_sample) / tiles_x;
+                    const size_t tx = t % tiles_x;
+                    const float_t* src = &in[sample][in_shape.get_index(0, 0, c)];
+
+                    for (size_t i = 0; i < 6; i++) {
+                        // y, x are shifted by pad to stay unsigned
+                        const size_t y = ty * winograd_tile + i;
+                        const bool row_ok = y >= pad && y - pad < in_shape.height_;
+                        for (size_t j = 0; j < 6; j++) {
+                            const size_t x = tx * winograd_tile + j;
+                            buf[(i * 6 + j) * L + l] =
+                                (row_ok && x >= pad && x - pad < in_shape.width_)
+                                ? src[(y - pad) * in_shape.width_ + (x - pad)]
+                                : float_t(0);
+                        }
+                    }
+                }
+                winograd_input_transform<ops>(buf);
+                for (size_t k = 0; k < 36; k++) {
+                    std::copy(buf + k * L, buf + (k + 1) * L,
+                              v + (k * C + c) * n_padded + l0);
+                }
+            }
+        }
+
+        // element-wise products, summed over input channels
+        std::fill(m, m + 36 * M * n_padded, float_t(0));
+        for (size_t k = 0; k < 36; k++) {
+            gemm_prepacked(M, n_padded, C, filter.at(k),
+                           v + k * C * n_padded, n_padded, 1,
+                           m + k * M * n_padded, n_padded);
+        }
+
+        // output transform
+        float_t y[16 * winograd_lanes];
+        for (size_t o = 0; o < M; o++) {
+            const float_t b = bias ? (*bias)[o] : float_t(0);
+            for (size_t l0 = 0; l0 < n_padded; l0 += L) {
+                for (size_t k = 0; k < 36; k++) {
+                    const float_t* src = m + (k * M + o) * n_padded + l0;
+                    std::copy(src, src + L, buf + k * L);
+                }
+                winograd_output_transform<ops>(buf, y);
+
+                for (size_t l = 0; l < L && l0 + l < n; l++) {
+                    const size_t t = t0 + l0 + l;
+                    const size_t sample = t / tiles_per_sample;
+                    const size_t ty = (t % tiles_per_sample) / tiles_x;
+                    const size_t tx = t % tiles_x;
+                    float_t* dst = &out[sample][out_shape.get_index(0, 0, o)];
+
+                    const size_t h = std::min(winograd_tile,
+                                              out_shape.height_ - ty * winograd_tile);
+                    const size_t w = std::min(winograd_tile,
+                                              out_shape.width_ - tx * winograd_tile);
+                    for (size_t i = 0; i < h; i++) {
+                        float_t* row = dst + (ty * winograd_tile + i) *
+                                       out_shape.width_ + tx * winograd_tile;
+                        for (size_t j = 0; j < w; j++) {
+                            const float_t val = y[(i * 4 + j) * L + l] + b;
+                            row[j] = accumulate ? row[j] + val : val;
+                        }
+                        ep.apply(sample, row - &out[sample][0], w);
+                    }
+                }
+            }
+        }
+    }, 1);
+
+    ep.apply_rest(parallelize);
+}
+
+// W is vec_t, or std::vector<bfloat16> (widened by the filter transform)
+template <typename Weights>
+void
+conv2d_op_winograd(const tensor_t&         in_data,
+                   winograd_filter&         filter,
+                   const Weights&                W,
+                   const vec_t&               bias,
+                   tensor_t&              out_data,
+                   const core::conv_params& params,
+                   const bool          parallelize,
+                   const epilogue&              ep = epilogue()) {
+    filter.update(params, W, false);
+    winograd_f43(in_data, params.in, params.pad_left(), filter,
+                 params.has_bias ? &bias : nullptr,
+                 out_data, params.out, false, parallelize, ep);
+}
+
+/**
+ * delta of the input, prev_delta += conv_full(curr_delta, flip(W)) cropped
+ * to params.in (the full convolution pads by 2, same padding crops 1 of it).
+ * the weight gradients are computed by conv2d_op_gemm
+ **/
+inline void
+conv2d_op_winograd_delta(const tensor_t&        curr_delta,
+                         winograd_filter&           filter,
+                         const vec_t&                    W,
+                         tensor_t&              prev_delta,
+                         const core::conv_params&   params,
+                         const bool            parallelize) {
+    filter.update(params, W, true);
+    winograd_f43(curr_delta, params.out, 2 - params.pad_left(), filter,
+                 nullptr, prev_delta, params.in, true, parallelize);
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
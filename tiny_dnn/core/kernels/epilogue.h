@@ -0,0 +1,124 @@
+/*
+    COPYRIGHT
+
+    All contributions by Taiga Nomi
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+
+    All other contributions:
+    Copyright (c) 2013-2016, the respective contributors.
+    All rights reserved.
+
+    Each contributor holds copyright over their respective contributions.
+    The project versioning (Git) records all such contribution source information.
+
+    LICENSE
+
+    The BSD 3-Clause License
+
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of tiny-dnn nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include "tiny_dnn/util/util.h"
+#include "tiny_dnn/activations/activation_function.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+/**
+ * output stage fused into the forward conv / fully-connected kernels.
+ * as soon as a kernel has written a range of the biased pre-activation
+ * a (out_data[1]) it calls the epilogue, which writes the layer output
+ * (out_data[0]) while the range is still in cache:
+ *
+ *   out[sample][i] = h(a[sample][i])
+ *
+ * a is kept, so backward runs unchanged. only elementwise activations
+ * can be applied to a part of a sample; for the others (softmax) the
+ * range calls are no-ops and apply_rest() finishes whole samples.
+ *
+ * kernels without a fused output stage (nnpack, libdnn)
+ * call apply_all() once the output is written.
+ *
+ * an epilogue made by the default constructor does nothing.
+ **/
+class epilogue {
+ public:
+    epilogue()
+        : h_(nullptr), pre_(nullptr), out_(nullptr), elementwise_(false) {}
+
+    /**
+     * @param h        activation, applied to pre
+     * @param pre      pre-activation written by the kernel
+     * @param out      activated output, same shape as pre
+     **/
+    epilogue(const activation::function& h,
+             const tensor_t& pre,
+             tensor_t& out)
+        : h_(&h), pre_(&pre), out_(&out), elementwise_(h.one_hot()) {}
+
+    bool empty() const { return h_ == nullptr; }
+
+    bool elementwise() const { return elementwise_; }
+
+    // [begin, begin + n) of sample is final; skipped unless elementwise
+    void apply(size_t sample, size_t begin, size_t n) const {
+        if (elementwise_) run(sample, begin, n);
+    }
+
+    // the whole sample is final
+    void apply(size_t sample) const {
+        if (!empty()) run(sample, 0, (*pre_)[sample].size());
+    }
+
+    // after the range calls, finish what they had to skip
+    void apply_rest(bool parallelize) const {
+        if (!empty() && !elementwise_) apply_all(parallelize);
+    }
+
+    // for kernels without a fused output stage
+    void apply_all(bool parallelize) const {
+        if (empty()) return;
+        for_i(parallelize, pre_->size(), [&](int sample) { apply(sample); });
+    }
+
+ private:
+    void run(size_t sample, size_t begin, size_t n) const {
+        const float_t* a = &(*pre_)[sample][begin];
+        float_t* y = &(*out_)[sample][begin];
+        h_->f(a, y, static_cast<cnn_size_t>(n));
+    }
+
+    const activation::function* h_;
+    const tensor_t* pre_;
+    tensor_t* out_;
+    bool elementwise_;
+};
+
+}  // namespace kernels
+}  // namespace tiny_dnn
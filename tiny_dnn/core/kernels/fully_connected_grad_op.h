@@ -48,6 +48,7 @@
 
 #include "tiny_dnn/core/kernels/fully_connected_op_avx.h"
 #include "tiny_dnn/core/kernels/fully_connected_op_custom.h"
+#include "tiny_dnn/core/kernels/fully_connected_op_gemm.h"
 
 namespace tiny_dnn {
 
@@ -81,7 +82,13 @@ class FullyConnectedGradOp : public core::OpKernel {
         const core::backend_t engine = context.engine();
 
         if (engine == core::backend_t::tiny_dnn) {
+            // batched gemm is the default where the packed micro-kernel
+            // is vectorized
+#if defined(CNN_USE_SSE) || defined(CNN_USE_AVX)
+            kernels::fully_connected_op_gemm(
+#else
             kernels::fully_connected_op_custom(
+#endif
                 prev_out,
                 W[0],
                 dW,
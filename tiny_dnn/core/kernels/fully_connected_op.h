@@ -48,6 +48,7 @@
 
 #include "tiny_dnn/core/kernels/fully_connected_op_avx.h"
 #include "tiny_dnn/core/kernels/fully_connected_op_custom.h"
+#include "tiny_dnn/core/kernels/fully_connected_op_gemm.h"
 #include "tiny_dnn/core/kernels/fully_connected_op_nnpack.h"
 
 namespace tiny_dnn {
@@ -65,6 +66,10 @@ class FullyConnectedOp : public core::OpKernel {
         const tensor_t&       W = context.input(1);
         const tensor_t*    bias = params.has_bias_ ? &context.input(2) : nullptr;
         tensor_t&      out_data = context.output(1);
+        // activation etc. fused into the kernel if the layer asks for it
+        const kernels::epilogue no_epilogue;
+        const kernels::epilogue& ep = context.epilogue() ? *context.epilogue()
+                                                          : no_epilogue;
 
         // initialize outputs
         fill_tensor(out_data, float_t(0));
@@ -73,14 +78,33 @@ class FullyConnectedOp : public core::OpKernel {
 
         const core::backend_t engine = context.engine();
 
-        if (engine == core::backend_t::tiny_dnn) {
+        if (params.weights_bf16_ && (engine == core::backend_t::tiny_dnn ||
+                                     engine == core::backend_t::avx)) {
+            // bfloat16 weights are widened as gemm packs them
+            kernels::fully_connected_op_gemm(
+                in_data,
+                *params.weights_bf16_,
+                params.has_bias_ ? (*bias)[0] : vec_t(),
+                out_data,
+                params,
+                context.parallelize(),
+                ep);
+        }
+        else if (engine == core::backend_t::tiny_dnn) {
+            // batched gemm is the default where the packed micro-kernel
+            // is vectorized
+#if defined(CNN_USE_SSE) || defined(CNN_USE_AVX)
+            kernels::fully_connected_op_gemm(
+#else
             kernels::fully_connected_op_custom(
+#endif
                 in_data,
                 W[0],
                 params.has_bias_ ? (*bias)[0] : vec_t(),
                 out_data,
                 params,
-                context.parallelize());
+                context.parallelize(),
+                ep);
         }
         else if (engine == core::backend_t::nnpack) {
             kernels::fully_connected_op_nnpack(
@@ -90,6 +114,7 @@ class FullyConnectedOp : public core::OpKernel {
                 out_data,
                 params,
                 context.parallelize());
+            ep.apply_all(context.parallelize());
         }
         else if (engine == core::backend_t::avx) {
             kernels::fully_connected_op_avx(
@@ -98,7 +123,8 @@ class FullyConnectedOp : public core::OpKernel {
                 params.has_bias_ ? (*bias)[0] : vec_t(),
                 out_data,
                 params,
-                context.parallelize());
+                context.parallelize(),
+                ep);
         }
         else {
             throw nn_error("Not supported engine: " + to_string(engine));
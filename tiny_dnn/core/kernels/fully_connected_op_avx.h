@@ -26,7 +26,7 @@
 */
 #pragma once
 
-#include "tiny_dnn/core/kernels/fully_connected_op_custom.h"
+#include "tiny_dnn/core/kernels/fully_connected_op_gemm.h"
 
 namespace tiny_dnn {
 namespace kernels {
@@ -37,16 +37,17 @@ fully_connected_op_avx(const tensor_t& in_data,
                        const vec_t&    bias,
                        tensor_t&       out_data,
                        const fully_params& params,
-                       const bool      layer_parallelize) {
+                       const bool      layer_parallelize,
+                       const epilogue& ep = epilogue()) {
 #ifdef CNN_USE_AVX
-    // TODO(nyanp/beru): is this really AVX ??
-    fully_connected_op_custom(
+    fully_connected_op_gemm(
         in_data,
         W,
         bias,
         out_data,
         params,
-        layer_parallelize);
+        layer_parallelize,
+        ep);
 #else
     throw nn_error("TinyDNN has not been compiled with AVX support.");
 #endif
@@ -62,8 +63,7 @@ fully_connected_op_avx(const tensor_t& prev_out,
                        const fully_params& params,
                        const bool      layer_parallelize) {
 #ifdef CNN_USE_AVX
-    // TODO(nyanp/beru): is this really AVX ??
-    fully_connected_op_custom(
+    fully_connected_op_gemm(
         prev_out,
         W,
         dW,
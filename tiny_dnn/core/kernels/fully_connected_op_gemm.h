@@ -0,0 +1,211 @@
+/*
+    COPYRIGHT
+
+    All contributions by Taiga Nomi
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+
+    All other contributions:
+    Copyright (c) 2013-2016, the respective contributors.
+    All rights reserved.
+
+    Each contributor holds copyright over their respective contributions.
+    The project versioning (Git) records all such contribution source information.
+
+    LICENSE
+
+    The BSD 3-Clause License
+
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of tiny-dnn nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "tiny_dnn/core/params/fully_params.h"
+#include "tiny_dnn/util/batch_tensor.h"
+#include "tiny_dnn/core/kernels/gemm_kernel.h"
+#include "tiny_dnn/core/kernels/epilogue.h"
+
+namespace tiny_dnn {
+namespace kernels {
+
+/*
+ * fully-connected layer as whole-batch matrix multiplications. with the
+ * batch gathered into a batch_tensor X[B x in] (leading dimension
+ * sample_stride()) and W stored as W[in x out]:
+ *
+ *   forward      : Y[B x out]   = X * W
+ *   delta        : dX[B x in]   = dY * W^T
+ *   weight grad  : dW[in x out] += X^T * dY  (per block of samples)
+ *
+ * the batch-side operand is packed once and shared by all threads, which
+ * work on tiles of columns of the result. in forward, bias and the
+ * epilogue are applied to a tile right after it's computed.
+ */
+
+// columns per tile, a multiple of NR giving at least a few tiles per matrix
+inline size_t fully_connected_gemm_tile_width(size_t cols) {
+    const size_t NR = gemm_block_size<float_t>::NR;
+    const size_t NC = gemm_block_size<float_t>::NC;
+    const size_t target = (cols + 7) / 8;
+    return std::min(NC, std::max(NR, (target + NR - 1) / NR * NR));
+}
+
+// shape of one sample of a batch with cols columns
+inline shape3d fully_connected_gemm_row(size_t cols) {
+    return shape3d(static_cast<cnn_size_t>(cols), 1, 1);
+}
+
+// W is vec_t, or std::vector<bfloat16> (widened as it's packed)
+template <typename Weights>
+void
+fully_connected_op_gemm(const tensor_t&     in_data,
+                        const Weights&      W,
+                        const vec_t&        bias,
+                        tensor_t&           out_data,
+                        const fully_params& params,
+                        const bool          layer_parallelize,
+                        const epilogue&     ep = epilogue()) {
+    const size_t B = in_data.size();
+    const size_t K = params.in_size_;
+    const size_t N = params.out_size_;
+    if (B == 0 || N == 0 || K == 0) return;
+
+    // the buffers are held until return: while this thread waits in for_i,
+    // it may run another layer's forward, which uses buffers of its own
+    const cnn_size_t nb = static_cast<cnn_size_t>(B);
+    batch_scratch x_buf(nb, fully_connected_gemm_row(K));
+    batch_scratch y_buf(nb, fully_connected_gemm_row(N));
+    batch_tensor& x = x_buf.get();
+    batch_tensor& y = y_buf.get();
+    x.from_tensor(in_data);
+    y.fill(float_t(0));  // gemm accumulates into y
+    const size_t ldy = y.sample_stride();
+
+    std::vector<float_t> xpack(gemm_packed_a_size<float_t>(B, K));
+    gemm_pack_a(B, K, x.data(), x.sample_stride(), 1, &xpack[0]);
+
+    const size_t nc = fully_connected_gemm_tile_width(N);
+    const size_t ntiles = (N + nc - 1) / nc;
+
+    for_i(layer_parallelize, ntiles, [&](int tile) {
+        const size_t j0 = tile * nc;
+        const size_t n = std::min(nc, N - j0);
+        gemm_prepacked(B, n, K, &xpack[0], &W[j0], N, 1, y.data() + j0, ldy);
+
+        for (size_t s = 0; s < B; s++) {
+            const float_t* src = y.sample(s) + j0;
+            float_t* out = &out_data[s][j0];
+            for (size_t i = 0; i < n; i++) {
+                out[i] = params.has_bias_ ? src[i] + bias[j0 + i] : src[i];
+            }
+            ep.apply(s, j0, n);
+        }
+    }, 1);
+
+    ep.apply_rest(layer_parallelize);
+}
+
+inline void
+fully_connected_op_gemm(const tensor_t&     prev_out,
+                        const vec_t&        W,
+                        tensor_t&           dW,
+                        tensor_t&           db,
+                        tensor_t&           curr_delta,
+                        tensor_t&           prev_delta,
+                        const fully_params& params,
+                        const bool          layer_parallelize) {
+    const size_t B = prev_out.size();
+    const size_t K = params.in_size_;
+    const size_t N = params.out_size_;
+    const size_t nblocks = dW.size();
+    if (B == 0 || N == 0 || K == 0) return;
+
+    const cnn_size_t nb = static_cast<cnn_size_t>(B);
+    batch_scratch x_buf(nb, fully_connected_gemm_row(K));
+    batch_scratch dy_buf(nb, fully_connected_gemm_row(N));
+    batch_scratch dx_buf(nb, fully_connected_gemm_row(K));
+    batch_tensor& x  = x_buf.get();
+    batch_tensor& dy = dy_buf.get();
+    batch_tensor& dx = dx_buf.get();
+    x.from_tensor(prev_out);
+    dy.from_tensor(curr_delta);
+    dx.fill(float_t(0));  // gemm accumulates into dx
+    const size_t ldx = x.sample_stride();
+    const size_t ldy = dy.sample_stride();
+
+    // propagate delta to previous layer
+    std::vector<float_t> dypack(gemm_packed_a_size<float_t>(B, N));
+    gemm_pack_a(B, N, dy.data(), ldy, 1, &dypack[0]);
+
+    const size_t kc = fully_connected_gemm_tile_width(K);
+    const size_t ktiles = (K + kc - 1) / kc;
+
+    for_i(layer_parallelize, ktiles, [&](int tile) {
+        const size_t j0 = tile * kc;
+        const size_t n = std::min(kc, K - j0);
+        gemm_prepacked(B, n, N, &dypack[0], &W[j0 * N], 1, N,
+                       dx.data() + j0, dx.sample_stride());
+    }, 1);
+
+    for (size_t s = 0; s < B; s++) {
+        const float_t* src = dx.sample(s);
+        vec_t& dst = prev_delta[s];
+        for (size_t c = 0; c < K; c++) dst[c] += src[c];
+    }
+
+    // accumulate dw / db.
+    // dW/db hold one accumulator per block of samples (see layer::set_sample_count),
+    // each (block, column tile) pair is an independent task
+    const size_t nc = fully_connected_gemm_tile_width(N);
+    const size_t ntiles = (N + nc - 1) / nc;
+
+    for_i(layer_parallelize, nblocks * ntiles, [&](int task) {
+        const size_t block = task / ntiles;
+        const size_t j0 = task % ntiles * nc;
+        const size_t n = std::min(nc, N - j0);
+        const size_t s0 = B * block / nblocks;
+        const size_t s1 = B * (block + 1) / nblocks;
+        if (s0 == s1) return;
+
+        gemm(K, n, s1 - s0, x.sample(s0), 1, ldx,
+             dy.sample(s0) + j0, ldy, 1, &dW[block][j0], N);
+
+        if (params.has_bias_) {
+            float_t* pdb = &db[block][j0];
+            for (size_t s = s0; s < s1; s++) {
+                const float_t* pdy = dy.sample(s) + j0;
+                for (size_t i = 0; i < n; i++) pdb[i] += pdy[i];
+            }
+        }
+    }, 1);
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
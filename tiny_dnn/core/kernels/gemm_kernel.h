@@ -0,0 +1,375 @@
+/*
+    COPYRIGHT
+
+    All contributions by Taiga Nomi
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+
+    All other contributions:
+    Copyright (c) 2013-2016, the respective contributors.
+    All rights reserved.
+
+    Each contributor holds copyright over their respective contributions.
+    The project versioning (Git) records all such contribution source information.
+
+    LICENSE
+
+    The BSD 3-Clause License
+
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of tiny-dnn nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "tiny_dnn/util/bfloat16.h"
+
+#if defined(CNN_USE_SSE) || defined(CNN_USE_AVX)
+#include <immintrin.h>
+#endif
+
+namespace tiny_dnn {
+namespace kernels {
+
+/**
+ * packed, cache-blocked matrix multiplication C += A * B
+ *
+ * A is packed into panels of MR rows and B into panels of NR columns, both
+ * stored k-major, so the micro-kernel reads them sequentially and keeps an
+ * MR x NR block of C in registers. K is split into blocks of KC (a B panel
+ * stays in L1) and M into blocks of MC (packed A stays in L2).
+ *
+ * matrices are given as (pointer, row stride, column stride), so transposed
+ * operands are packed without a separate transpose.
+ **/
+template <typename T>
+struct gemm_block_size {
+    static const int MR = 4;
+    static const int NR = 4;
+    static const int KC = 256;
+    static const int MC = 96;
+    static const int NC = 512;
+};
+
+#if defined(CNN_USE_AVX)
+template <>
+struct gemm_block_size<float> {
+    static const int MR = 6;
+    static const int NR = 16;
+    static const int KC = 256;
+    static const int MC = 96;
+    static const int NC = 512;
+};
+#elif defined(CNN_USE_SSE)
+template <>
+struct gemm_block_size<float> {
+    static const int MR = 4;
+    static const int NR = 8;
+    static const int KC = 256;
+    static const int MC = 96;
+    static const int NC = 512;
+};
+#endif
+
+/**
+ * per-thread scratch buffer, reused across calls. Slot distinguishes buffers
+ * which are alive at the same time
+ **/
+template <typename T, int Slot>
+T* gemm_scratch(size_t size) {
+    static thread_local std::vector<T> buf;
+    if (buf.size() < size) buf.resize(size);
+    return buf.data();
+}
+
+/**
+ * size of the buffer required by gemm_pack_a(m, k, ...)
+ **/
+template <typename T>
+size_t gemm_packed_a_size(size_t m, size_t k) {
+    const size_t MR = gemm_block_size<T>::MR;
+    return (m + MR - 1) / MR * MR * k;
+}
+
+// an element of an operand as T: operands are T or bfloat16
+template <typename T>
+inline T gemm_widen(T x) { return x; }
+
+template <typename T>
+inline T gemm_widen(bfloat16 x) { return static_cast<T>(to_float(x)); }
+
+/**
+ * pack m x k matrix a(i, p) = a[i * rs + p * cs] into MR-row panels.
+ * panel i starts at dst + i * k * MR, rows past m are zero-filled.
+ * a is T or bfloat16
+ **/
+template <typename T, typename TA>
+void gemm_pack_a(size_t m, size_t k, const TA* a, size_t rs, size_t cs, T* dst) {
+    const size_t MR = gemm_block_size<T>::MR;
+    for (size_t i0 = 0; i0 < m; i0 += MR) {
+        const size_t mr = std::min(MR, m - i0);
+        for (size_t p = 0; p < k; p++) {
+            for (size_t i = 0; i < mr; i++) {
+                dst[i] = gemm_widen<T>(a[(i0 + i) * rs + p * cs]);
+            }
+            for (size_t i = mr; i < MR; i++) dst[i] = T(0);
+            dst += MR;
+        }
+    }
+}
+
+/**
+ * pack k x n matrix b(p, j) = b[p * rs + j * cs] into NR-column panels.
+ * panel j starts at dst + j * k * NR, columns past n are zero-filled
+ **/
+template <typename T>
+void gemm_pack_b(size_t k, size_t n, const T* b, size_t rs, size_t cs, T* dst) {
+    const size_t NR = gemm_block_size<T>::NR;
+    for (size_t j0 = 0; j0 < n; j0 += NR) {
+        const size_t nr = std::min(NR, n - j0);
+        for (size_t p = 0; p < k; p++) {
+            const T* src = b + p * rs + j0 * cs;
+            if (cs == 1) {
+                std::copy(src, src + nr, dst);
+            } else {
+                for (size_t j = 0; j < nr; j++) dst[j] = src[j * cs];
+            }
+            for (size_t j = nr; j < NR; j++) dst[j] = T(0);
+            dst += NR;
+        }
+    }
+}
+
+/**
+ * gemm_pack_b for a bfloat16 matrix, widened to T while packing:
+ * b is read at half the bandwidth, and the kernels see T as usual
+ **/
+template <typename T>
+void gemm_pack_b(size_t k, size_t n, const bfloat16* b, size_t rs, size_t cs,
+                 T* dst) {
+    const size_t NR = gemm_block_size<T>::NR;
+    for (size_t j0 = 0; j0 < n; j0 += NR) {
+        const size_t nr = std::min(NR, n - j0);
+        for (size_t p = 0; p < k; p++) {
+            const bfloat16* src = b + p * rs + j0 * cs;
+            if (cs == 1) {
+                from_bfloat16(src, dst, nr);
+            } else {
+                for (size_t j = 0; j < nr; j++) dst[j] = to_float(src[j * cs]);
+            }
+            for (size_t j = nr; j < NR; j++) dst[j] = T(0);
+            dst += NR;
+        }
+    }
+}
+
+/**
+ * c[MR x NR] = a[MR x kc] * b[kc x NR] for one pair of packed panels
+ **/
+template <typename T>
+void gemm_micro_kernel(size_t kc, const T* a, const T* b, T* c) {
+    const int MR = gemm_block_size<T>::MR;
+    const int NR = gemm_block_size<T>::NR;
+    T acc[MR * NR] = {};
+    for (size_t p = 0; p < kc; p++) {
+        for (int i = 0; i < MR; i++) {
+            for (int j = 0; j < NR; j++) {
+                acc[i * NR + j] += a[i] * b[j];
+            }
+        }
+        a += MR;
+        b += NR;
+    }
+    std::copy(acc, acc + MR * NR, c);
+}
+
+#if defined(CNN_USE_AVX)
+
+inline __m256 gemm_madd256_ps(__m256 a, __m256 b, __m256 c) {
+#ifdef __FMA__
+    return _mm256_fmadd_ps(a, b, c);
+#else
+    return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+// 6x16: 12 accumulators + 2 panels of B + 1 broadcast of A
+template <>
+inline void gemm_micro_kernel<float>(size_t kc, const float* a,
+                                     const float* b, float* c) {
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+    for (size_t p = 0; p < kc; p++) {
+        const __m256 b0 = _mm256_loadu_ps(b);
+        const __m256 b1 = _mm256_loadu_ps(b + 8);
+        __m256 ai;
+        ai = _mm256_broadcast_ss(a + 0);
+        c00 = gemm_madd256_ps(ai, b0, c00); c01 = gemm_madd256_ps(ai, b1, c01);
+        ai = _mm256_broadcast_ss(a + 1);
+        c10 = gemm_madd256_ps(ai, b0, c10); c11 = gemm_madd256_ps(ai, b1, c11);
+        ai = _mm256_broadcast_ss(a + 2);
+        c20 = gemm_madd256_ps(ai, b0, c20); c21 = gemm_madd256_ps(ai, b1, c21);
+        ai = _mm256_broadcast_ss(a + 3);
+        c30 = gemm_madd256_ps(ai, b0, c30); c31 = gemm_madd256_ps(ai, b1, c31);
+        ai = _mm256_broadcast_ss(a + 4);
+        c40 = gemm_madd256_ps(ai, b0, c40); c41 = gemm_madd256_ps(ai, b1, c41);
+        ai = _mm256_broadcast_ss(a + 5);
+        c50 = gemm_madd256_ps(ai, b0, c50); c51 = gemm_madd256_ps(ai, b1, c51);
+        a += 6;
+        b += 16;
+    }
+
+    _mm256_storeu_ps(c + 0 * 16, c00); _mm256_storeu_ps(c + 0 * 16 + 8, c01);
+    _mm256_storeu_ps(c + 1 * 16, c10); _mm256_storeu_ps(c + 1 * 16 + 8, c11);
+    _mm256_storeu_ps(c + 2 * 16, c20); _mm256_storeu_ps(c + 2 * 16 + 8, c21);
+    _mm256_storeu_ps(c + 3 * 16, c30); _mm256_storeu_ps(c + 3 * 16 + 8, c31);
+    _mm256_storeu_ps(c + 4 * 16, c40); _mm256_storeu_ps(c + 4 * 16 + 8, c41);
+    _mm256_storeu_ps(c + 5 * 16, c50); _mm256_storeu_ps(c + 5 * 16 + 8, c51);
+}
+
+#elif defined(CNN_USE_SSE)
+
+// 4x8: 8 accumulators + 2 panels of B + 1 broadcast of A
+template <>
+inline void gemm_micro_kernel<float>(size_t kc, const float* a,
+                                     const float* b, float* c) {
+    __m128 c00 = _mm_setzero_ps(), c01 = _mm_setzero_ps();
+    __m128 c10 = _mm_setzero_ps(), c11 = _mm_setzero_ps();
+    __m128 c20 = _mm_setzero_ps(), c21 = _mm_setzero_ps();
+    __m128 c30 = _mm_setzero_ps(), c31 = _mm_setzero_ps();
+
+    for (size_t p = 0; p < kc; p++) {
+        const __m128 b0 = _mm_loadu_ps(b);
+        const __m128 b1 = _mm_loadu_ps(b + 4);
+        __m128 ai;
+        ai = _mm_set1_ps(a[0]);
+        c00 = _mm_add_ps(_mm_mul_ps(ai, b0), c00);
+        c01 = _mm_add_ps(_mm_mul_ps(ai, b1), c01);
+        ai = _mm_set1_ps(a[1]);
+        c10 = _mm_add_ps(_mm_mul_ps(ai, b0), c10);
+        c11 = _mm_add_ps(_mm_mul_ps(ai, b1), c11);
+        ai = _mm_set1_ps(a[2]);
+        c20 = _mm_add_ps(_mm_mul_ps(ai, b0), c20);
+        c21 = _mm_add_ps(_mm_mul_ps(ai, b1), c21);
+        ai = _mm_set1_ps(a[3]);
+        c30 = _mm_add_ps(_mm_mul_ps(ai, b0), c30);
+        c31 = _mm_add_ps(_mm_mul_ps(ai, b1), c31);
+        a += 4;
+        b += 8;
+    }
+
+    _mm_storeu_ps(c + 0 * 8, c00); _mm_storeu_ps(c + 0 * 8 + 4, c01);
+    _mm_storeu_ps(c + 1 * 8, c10); _mm_storeu_ps(c + 1 * 8 + 4, c11);
+    _mm_storeu_ps(c + 2 * 8, c20); _mm_storeu_ps(c + 2 * 8 + 4, c21);
+    _mm_storeu_ps(c + 3 * 8, c30); _mm_storeu_ps(c + 3 * 8 + 4, c31);
+}
+
+#endif
+
+/**
+ * C[m x n] += A * B for one kc-block.
+ * @param a packed by gemm_pack_a, panel i at a + i * a_stride
+ * @param b packed by gemm_pack_b(kc, n, ...)
+ **/
+template <typename T>
+void gemm_macro_kernel(size_t m, size_t n, size_t kc,
+                       const T* a, size_t a_stride,
+                       const T* b, T* c, size_t ldc) {
+    const size_t MR = gemm_block_size<T>::MR;
+    const size_t NR = gemm_block_size<T>::NR;
+    const size_t MC = gemm_block_size<T>::MC;
+    T tile[gemm_block_size<T>::MR * gemm_block_size<T>::NR];
+
+    for (size_t i0 = 0; i0 < m; i0 += MC) {
+        const size_t i1 = std::min(m, i0 + MC);
+        for (size_t j = 0; j < n; j += NR) {
+            const T* pb = b + j * kc;
+            const size_t nr = std::min(NR, n - j);
+            for (size_t i = i0; i < i1; i += MR) {
+                const size_t mr = std::min(MR, m - i);
+                gemm_micro_kernel(kc, a + i / MR * a_stride, pb, tile);
+
+                T* pc = c + i * ldc + j;
+                for (size_t r = 0; r < mr; r++) {
+                    const T* pt = tile + r * NR;
+                    for (size_t s = 0; s < nr; s++) pc[s] += pt[s];
+                    pc += ldc;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * C[m x n] += A * B, where A was packed by gemm_pack_a(m, k, ...).
+ * b is T or bfloat16 (see gemm_pack_b)
+ **/
+template <typename T, typename TB>
+void gemm_prepacked(size_t m, size_t n, size_t k, const T* apack,
+                    const TB* b, size_t b_rs, size_t b_cs,
+                    T* c, size_t ldc) {
+    const size_t MR = gemm_block_size<T>::MR;
+    const size_t KC = gemm_block_size<T>::KC;
+    const size_t NC = gemm_block_size<T>::NC;
+
+    T* bpack = gemm_scratch<T, 0>(KC * NC);
+
+    for (size_t j0 = 0; j0 < n; j0 += NC) {
+        const size_t nc = std::min(NC, n - j0);
+        for (size_t k0 = 0; k0 < k; k0 += KC) {
+            const size_t kc = std::min(KC, k - k0);
+            gemm_pack_b(kc, nc, b + k0 * b_rs + j0 * b_cs, b_rs, b_cs, bpack);
+            gemm_macro_kernel(m, nc, kc, apack + k0 * MR, k * MR,
+                              bpack, c + j0, ldc);
+        }
+    }
+}
+
+/**
+ * C[m x n] += A[m x k] * B[k x n]
+ * a(i, p) = a[i * a_rs + p * a_cs], b(p, j) = b[p * b_rs + j * b_cs]
+ **/
+template <typename T>
+void gemm(size_t m, size_t n, size_t k,
+          const T* a, size_t a_rs, size_t a_cs,
+          const T* b, size_t b_rs, size_t b_cs,
+          T* c, size_t ldc) {
+    if (m == 0 || n == 0 || k == 0) return;
+    T* apack = gemm_scratch<T, 1>(gemm_packed_a_size<T>(m, k));
+    gemm_pack_a(m, k, a, a_rs, a_cs, apack);
+    gemm_prepacked(m, n, k, apack, b, b_rs, b_cs, c, ldc);
+}
+
+}  // namespace kernels
+}  // namespace tiny_dnn
@@ -0,0 +1,296 @@
+/*
+    COPYRIGHT
+
+    All contributions by Taiga Nomi
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+
+    All other contributions:
+    Copyright (c) 2013-2016, the respective contributors.
+    All rights reserved.
+
+    Each contributor holds copyright over their respective contributions.
+    The project versioning (Git) records all such contribution source information.
+
+    LICENSE
+
+    The BSD 3-Clause License
+
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of tiny-dnn nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "tiny_dnn/util/util.h"
+#include "tiny_dnn/util/product.h"
+
+namespace tiny_dnn {
+namespace core {
+namespace kernels {
+
+/*
+ * direct average pooling with a trainable scale and bias per channel,
+ * out = sum(window) * W[c] * scale_factor + b[c].
+ *
+ * only windows inside the input are summed (padding::same leaves outputs
+ * at the right and bottom that get the bias only). window sums are
+ * separable: the rows of a window are added first, one vectorized row
+ * at a time, then pool_x consecutive column sums. with stride 1 and a
+ * window larger than avepool_sliding_min the sums slide instead, which
+ * costs two additions per output whatever the window size.
+ */
+
+const size_t avepool_sliding_min = 4;
+
+inline bool avepool_sliding(size_t pool, size_t stride) {
+    return stride == 1 && pool >= avepool_sliding_min;
+}
+
+// number of leading outputs along one axis whose window is inside the input
+inline size_t avepool_full_windows(size_t out_len, size_t in_len,
+                                   size_t window, size_t stride) {
+    if (in_len < window) return 0;
+    return std::min(out_len, (in_len - window) / stride + 1);
+}
+
+// largest number of windows an input element belongs to along one axis
+inline size_t avepool_fan_out(size_t out_len, size_t in_len,
+                              size_t window, size_t stride) {
+    const size_t n = avepool_full_windows(out_len, in_len, window, stride);
+    size_t fan_out = 0;
+    for (size_t x = 0; x < in_len; x++) {
+        const size_t first = x < window ? 0 : (x - window) / stride + 1;
+        const size_t last = std::min(x / stride + 1, n);
+        if (last > first) fan_out = std::max(fan_out, last - first);
+    }
+    return fan_out;
+}
+
+// dst[i] = sum of row[i * stride .. i * stride + window), i < n
+template <typename T>
+void avepool_window_sums(const T* row, size_t n, size_t window, size_t stride,
+                         T* dst) {
+    if (n == 0) return;
+    if (avepool_sliding(window, stride)) {
+        T sum = T(0);
+        for (size_t k = 0; k < window; k++) sum += row[k];
+        dst[0] = sum;
+        for (size_t i = 1; i < n; i++) {
+            sum += row[i + window - 1] - row[i - 1];
+            dst[i] = sum;
+        }
+        return;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const T* p = row + i * stride;
+        T sum = T(0);
+        for (size_t k = 0; k < window; k++) sum += p[k];
+        dst[i] = sum;
+    }
+}
+
+// dst[x] = sum of src[i] over the n windows containing x, x < len
+template <typename T>
+void avepool_window_spread(const T* src, size_t n, size_t window,
+                           size_t stride, size_t len, T* dst) {
+    if (avepool_sliding(window, stride)) {
+        T sum = T(0);
+        for (size_t x = 0; x < len; x++) {
+            if (x < n) sum += src[x];
+            if (x >= window && x - window < n) sum -= src[x - window];
+            dst[x] = sum;
+        }
+        return;
+    }
+    std::fill(dst, dst + len, T(0));
+    for (size_t i = 0; i < n; i++) {
+        T* p = dst + i * stride;
+        for (size_t k = 0; k < window; k++) p[k] += src[i];
+    }
+}
+
+/**
+ * @param weight W[c] * scale_factor of the channel
+ * @param rows   scratch of in.width_ elements
+ **/
+inline void avepool_plane(const shape3d& in_shape, const shape3d& out_shape,
+                          size_t pool_x, size_t pool_y,
+                          size_t stride_x, size_t stride_y,
+                          const float_t* in, float_t weight, float_t bias,
+                          float_t* out, float_t* rows) {
+    const size_t iw = in_shape.width_;
+    const size_t ow = out_shape.width_;
+    const size_t nx = avepool_full_windows(ow, iw, pool_x, stride_x);
+    const size_t ny = avepool_full_windows(out_shape.height_,
+                                           in_shape.height_, pool_y, stride_y);
+    const bool sliding = avepool_sliding(pool_y, stride_y);
+
+    for (size_t oy = 0; oy < out_shape.height_; oy++) {
+        float_t* dst = out + oy * ow;
+        if (oy >= ny) {
+            std::fill(dst, dst + ow, bias);
+            continue;
+        }
+
+        const size_t y0 = oy * stride_y;
+        if (sliding && oy > 0) {
+            vectorize::reduce(in + (y0 + pool_y - 1) * iw, iw, rows);
+            vectorize::muladd(in + (y0 - 1) * iw, float_t(-1), iw, rows);
+        } else {
+            std::copy(in + y0 * iw, in + (y0 + 1) * iw, rows);
+            for (size_t y = y0 + 1; y < y0 + pool_y; y++) {
+                vectorize::reduce(in + y * iw, iw, rows);
+            }
+        }
+
+        avepool_window_sums(rows, nx, pool_x, stride_x, dst);
+        for (size_t ox = 0; ox < nx; ox++) dst[ox] = dst[ox] * weight + bias;
+        std::fill(dst + nx, dst + ow, bias);
+    }
+}
+
+/**
+ * gradient of the window sums: prev[i] = sum of curr over the windows
+ * containing i (unscaled)
+ *
+ * @param rows   scratch of in.width_ elements
+ * @param spread scratch of in.width_ elements
+ **/
+inline void avepool_back_plane(const shape3d& in_shape,
+                               const shape3d& out_shape,
+                               size_t pool_x, size_t pool_y,
+                               size_t stride_x, size_t stride_y,
+                               const float_t* curr, float_t* prev,
+                               float_t* rows, float_t* spread) {
+    const size_t iw = in_shape.width_;
+    const size_t ow = out_shape.width_;
+    const size_t nx = avepool_full_windows(ow, iw, pool_x, stride_x);
+    const size_t ny = avepool_full_windows(out_shape.height_,
+                                           in_shape.height_, pool_y, stride_y);
+
+    if (avepool_sliding(pool_y, stride_y)) {
+        // row y gets the spread rows of outputs y - pool_y + 1 .. y
+        std::fill(rows, rows + iw, float_t(0));
+        for (size_t y = 0; y < in_shape.height_; y++) {
+            if (y < ny) {
+                avepool_window_spread(curr + y * ow, nx, pool_x, stride_x,
+                                      iw, spread);
+                vectorize::reduce(spread, iw, rows);
+            }
+            if (y >= pool_y && y - pool_y < ny) {
+                avepool_window_spread(curr + (y - pool_y) * ow, nx, pool_x,
+                                      stride_x, iw, spread);
+                vectorize::muladd(spread, float_t(-1), iw, rows);
+            }
+            std::copy(rows, rows + iw, prev + y * iw);
+        }
+        return;
+    }
+
+    std::fill(prev, prev + in_shape.area(), float_t(0));
+    for (size_t oy = 0; oy < ny; oy++) {
+        avepool_window_spread(curr + oy * ow, nx, pool_x, stride_x, iw, spread);
+        for (size_t y = oy * stride_y; y < oy * stride_y + pool_y; y++) {
+            vectorize::reduce(spread, iw, prev + y * iw);
+        }
+    }
+}
+
+inline void tiny_avepool_kernel(const tensor_t& in_data,
+                                const shape3d& in_shape,
+                                const vec_t& W,
+                                const vec_t& bias,
+                                float_t scale_factor,
+                                tensor_t& out_data,
+                                const shape3d& out_shape,
+                                size_t pool_x, size_t pool_y,
+                                size_t stride_x, size_t stride_y,
+                                bool parallelize) {
+    const size_t channels = in_shape.depth_;
+
+    for_i(parallelize, in_data.size() * channels, [&](int task) {
+        const size_t sample = task / channels;
+        const size_t c = task % channels;
+        vec_t rows(in_shape.width_);
+
+        avepool_plane(in_shape, out_shape, pool_x, pool_y, stride_x, stride_y,
+                      &in_data[sample][in_shape.get_index(0, 0, c)],
+                      W[c] * scale_factor, bias[c],
+                      &out_data[sample][out_shape.get_index(0, 0, c)],
+                      &rows[0]);
+    });
+}
+
+/**
+ * prev_delta = W[c] * scale_factor * (curr_delta summed over the windows)
+ * dW[c]     += scale_factor * sum(prev_out * curr_delta summed over windows)
+ * db[c]     += sum(curr_delta)
+ *
+ * dW and db hold one row per block of samples (see for_each_block)
+ **/
+inline void tiny_avepool_back_kernel(const tensor_t& prev_out,
+                                     const shape3d& in_shape,
+                                     const vec_t& W,
+                                     float_t scale_factor,
+                                     tensor_t& dW,
+                                     tensor_t& db,
+                                     tensor_t& prev_delta,
+                                     const tensor_t& curr_delta,
+                                     const shape3d& out_shape,
+                                     size_t pool_x, size_t pool_y,
+                                     size_t stride_x, size_t stride_y,
+                                     bool parallelize) {
+    const size_t channels = in_shape.depth_;
+    const size_t in_area = in_shape.area();
+    const size_t out_area = out_shape.area();
+
+    for_each_block(parallelize, prev_out.size(), dW.size(), [&](int block, int sample) {
+        vec_t rows(in_shape.width_), spread(in_shape.width_);
+
+        for (size_t c = 0; c < channels; c++) {
+            const float_t* in = &prev_out[sample][in_shape.get_index(0, 0, c)];
+            const float_t* curr = &curr_delta[sample][out_shape.get_index(0, 0, c)];
+            float_t* prev = &prev_delta[sample][in_shape.get_index(0, 0, c)];
+
+            avepool_back_plane(in_shape, out_shape, pool_x, pool_y,
+                               stride_x, stride_y, curr, prev,
+                               &rows[0], &spread[0]);
+
+            dW[block][c] += scale_factor * vectorize::dot(in, prev, in_area);
+            db[block][c] += std::accumulate(curr, curr + out_area, float_t(0));
+
+            const float_t weight = W[c] * scale_factor;
+            for (size_t i = 0; i < in_area; i++) prev[i] *= weight;
+        }
+    });
+}
+
+}  // namespace kernels
+}  // namespace core
+}  // namespace tiny_dnn
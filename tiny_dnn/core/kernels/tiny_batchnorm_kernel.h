@@ -0,0 +1,178 @@
+/*
+    COPYRIGHT
+
+    All contributions by Taiga Nomi
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+
+    All other contributions:
+    Copyright (c) 2013-2016, the respective contributors.
+    All rights reserved.
+
+    Each contributor holds copyright over their respective contributions.
+    The project versioning (Git) records all such contribution source information.
+
+    LICENSE
+
+    The BSD 3-Clause License
+
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of tiny-dnn nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <algorithm>
+#include <cmath>
+
+#include "tiny_dnn/util/util.h"
+#include "tiny_dnn/util/product.h"
+
+namespace tiny_dnn {
+namespace core {
+namespace kernels {
+
+/*
+ * batch normalization over [sample][channel * spatial_dim] tensors,
+ * y = (x - mean[c]) / stddev[c] with stddev = sqrt(variance + eps).
+ *
+ * every kernel runs one task per channel, which goes over the samples in
+ * order (results don't depend on the number of threads), and works on
+ * the spatial elements of a sample with SIMD.
+ */
+
+// y = (x - mean[c]) * (1 / stddev[c]) for the samples of channel c
+inline void batchnorm_normalize_channel(const tensor_t& in, tensor_t& out,
+                                        size_t spatial_dim, size_t c,
+                                        float_t mean, float_t stddev) {
+    const float_t inv = float_t(1) / stddev;
+    for (size_t sample = 0; sample < in.size(); sample++) {
+        const float_t* x = &in[sample][c * spatial_dim];
+        float_t* y = &out[sample][c * spatial_dim];
+        for (size_t k = 0; k < spatial_dim; k++) y[k] = (x[k] - mean) * inv;
+    }
+}
+
+/**
+ * train phase: statistics of the batch, then normalization with them.
+ *
+ * mean and variance are accumulated in one pass over the input: each
+ * spatial row of a sample is reduced to its mean and sum of squared
+ * deviations, which are merged into the running values as in Welford's
+ * (Chan's) algorithm. variance is unbiased (divided by n - 1).
+ **/
+inline void batchnorm_train_kernel(const tensor_t& in,
+                                   size_t spatial_dim,
+                                   size_t channels,
+                                   float_t eps,
+                                   vec_t& mean,
+                                   vec_t& variance,
+                                   vec_t& stddev,
+                                   tensor_t& out,
+                                   bool parallelize) {
+    mean.resize(channels);
+    variance.resize(channels);
+    stddev.resize(channels);
+
+    for_i(parallelize, channels, [&](int c) {
+        float_t m = float_t(0), m2 = float_t(0);
+        size_t n = 0;
+
+        for (size_t sample = 0; sample < in.size(); sample++) {
+            const float_t* x = &in[sample][c * spatial_dim];
+            const float_t row_mean = vectorize::sum(x, spatial_dim) / spatial_dim;
+            const float_t row_m2 = vectorize::sum_squared_diff(x, row_mean, spatial_dim);
+
+            const float_t delta = row_mean - m;
+            const size_t total = n + spatial_dim;
+            m  += delta * spatial_dim / total;
+            m2 += row_m2 + delta * delta * n * spatial_dim / total;
+            n = total;
+        }
+
+        mean[c] = m;
+        variance[c] = m2 / std::max<float_t>(float_t(1), float_t(n) - 1);
+        stddev[c] = std::sqrt(variance[c] + eps);
+
+        batchnorm_normalize_channel(in, out, spatial_dim, c, mean[c], stddev[c]);
+    }, 1);
+}
+
+/**
+ * test phase: normalization with given statistics
+ **/
+inline void batchnorm_kernel(const tensor_t& in,
+                             size_t spatial_dim,
+                             size_t channels,
+                             const vec_t& mean,
+                             const vec_t& stddev,
+                             tensor_t& out,
+                             bool parallelize) {
+    for_i(parallelize, channels, [&](int c) {
+        batchnorm_normalize_channel(in, out, spatial_dim, c, mean[c], stddev[c]);
+    }, 1);
+}
+
+/**
+ * if y = (x - mean(x)) / stddev, then
+ *   dE/dx = (dE/dy - mean(dE/dy) - mean(dE/dy * y) * y) / stddev
+ *
+ * one reduction pass for both means, one pass to apply them
+ **/
+inline void batchnorm_back_kernel(const tensor_t& curr_out,
+                                  const tensor_t& curr_delta,
+                                  size_t spatial_dim,
+                                  size_t channels,
+                                  const vec_t& stddev,
+                                  tensor_t& prev_delta,
+                                  bool parallelize) {
+    const size_t num = curr_out.size();
+
+    for_i(parallelize, channels, [&](int c) {
+        float_t sum_dy = float_t(0), sum_dy_y = float_t(0);
+        for (size_t sample = 0; sample < num; sample++) {
+            const float_t* dy = &curr_delta[sample][c * spatial_dim];
+            const float_t* y = &curr_out[sample][c * spatial_dim];
+            sum_dy   += vectorize::sum(dy, spatial_dim);
+            sum_dy_y += vectorize::dot(dy, y, spatial_dim);
+        }
+
+        const float_t inv = float_t(1) / stddev[c];
+        const float_t mean_dy = sum_dy / (num * spatial_dim);
+        const float_t mean_dy_y = sum_dy_y / (num * spatial_dim);
+
+        for (size_t sample = 0; sample < num; sample++) {
+            const float_t* dy = &curr_delta[sample][c * spatial_dim];
+            const float_t* y = &curr_out[sample][c * spatial_dim];
+            float_t* dx = &prev_delta[sample][c * spatial_dim];
+            for (size_t k = 0; k < spatial_dim; k++) {
+                dx[k] = (dy[k] - mean_dy - mean_dy_y * y[k]) * inv;
+            }
+        }
+    }, 1);
+}
+
+}  // namespace kernels
+}  // namespace core
+}  // namespace tiny_dnn
@@ -0,0 +1,168 @@
+/*
+    COPYRIGHT
+
+    All contributions by Taiga Nomi
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+
+    All other contributions:
+    Copyright (c) 2013-2016, the respective contributors.
+    All rights reserved.
+
+    Each contributor holds copyright over their respective contributions.
+    The project versioning (Git) records all such contribution source information.
+
+    LICENSE
+
+    The BSD 3-Clause License
+
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of tiny-dnn nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "tiny_dnn/util/util.h"
+#include "tiny_dnn/util/random.h"
+
+namespace tiny_dnn {
+namespace core {
+namespace kernels {
+
+/*
+ * dropout masks, one bit per element, packed into 32-bit words.
+ *
+ * the bits come from philox4x32 with the key drawn for the forward pass:
+ * counter {8w + 4h + l, sample, 0, 0} gives the random words for bits
+ * 16h + 4k + l (k = 0..3) of mask word w. a bit is set if its word is
+ * below threshold = p * 2^32. so the mask of an element depends only on
+ * the key, the sample and the element, not on threads or the SIMD width,
+ * and the SSE version builds 4 bits per compare with movemask.
+ */
+
+inline uint64_t dropout_threshold(float_t p) {
+    if (p <= float_t(0)) return 0;
+    if (p >= float_t(1)) return uint64_t(1) << 32;
+    return uint64_t(double(p) * 4294967296.0);
+}
+
+// mask word w of a sample
+inline uint32_t dropout_mask_word(const uint32_t key[2], uint32_t sample,
+                                  uint32_t w, uint64_t threshold) {
+    uint32_t word = 0;
+
+#if defined(CNN_USE_SSE) || defined(CNN_USE_AVX)
+    if (threshold >= (uint64_t(1) << 32)) return ~uint32_t(0);
+    const __m128i flip = _mm_set1_epi32(int(0x80000000u));
+    const __m128i limit = _mm_xor_si128(_mm_set1_epi32(int(uint32_t(threshold))), flip);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (uint32_t h = 0; h < 2; h++) {
+        const __m128i ctr[4] = {
+            _mm_add_epi32(_mm_set1_epi32(int(8 * w + 4 * h)), _mm_setr_epi32(0, 1, 2, 3)),
+            _mm_set1_epi32(int(sample)), zero, zero
+        };
+        __m128i r[4];
+        philox4x32(ctr, key, r);
+        for (uint32_t k = 0; k < 4; k++) {
+            // unsigned r < threshold by a signed compare
+            const __m128i lt = _mm_cmplt_epi32(_mm_xor_si128(r[k], flip), limit);
+            word |= uint32_t(_mm_movemask_ps(_mm_castsi128_ps(lt))) << (16 * h + 4 * k);
+        }
+    }
+#else
+    for (uint32_t h = 0; h < 2; h++) {
+        for (uint32_t l = 0; l < 4; l++) {
+            const uint32_t ctr[4] = { 8 * w + 4 * h + l, sample, 0, 0 };
+            uint32_t r[4];
+            philox4x32(ctr, key, r);
+            for (uint32_t k = 0; k < 4; k++) {
+                word |= uint32_t(r[k] < threshold) << (16 * h + 4 * k + l);
+            }
+        }
+    }
+#endif
+    return word;
+}
+
+/**
+ * draws the masks, then out = mask * scale * in
+ **/
+inline void dropout_kernel(const tensor_t& in,
+                           const uint32_t key[2],
+                           float_t p,
+                           float_t scale,
+                           std::vector<std::vector<uint32_t>>& mask,
+                           tensor_t& out,
+                           bool parallelize) {
+    const uint64_t threshold = dropout_threshold(p);
+    const float_t factor[2] = { float_t(0), scale };
+
+    for_i(parallelize, in.size(), [&](int sample) {
+        const vec_t& x = in[sample];
+        vec_t& y = out[sample];
+        std::vector<uint32_t>& m = mask[sample];
+        const size_t n = x.size();
+
+        m.resize((n + 31) / 32);
+        for (size_t w = 0; w < m.size(); w++) {
+            const uint32_t bits = m[w] = dropout_mask_word(key, uint32_t(sample),
+                                                           uint32_t(w), threshold);
+            const size_t end = std::min(n, 32 * w + 32);
+            for (size_t i = 32 * w; i < end; i++) {
+                y[i] = x[i] * factor[(bits >> (i & 31)) & 1];
+            }
+        }
+    }, 1);
+}
+
+/**
+ * prev_delta = mask * scale * curr_delta, with the masks of the last
+ * forward pass
+ **/
+inline void dropout_back_kernel(const tensor_t& curr_delta,
+                                const std::vector<std::vector<uint32_t>>& mask,
+                                float_t scale,
+                                tensor_t& prev_delta,
+                                bool parallelize) {
+    const float_t factor[2] = { float_t(0), scale };
+
+    for_i(parallelize, curr_delta.size(), [&](int sample) {
+        const vec_t& dy = curr_delta[sample];
+        vec_t& dx = prev_delta[sample];
+        const std::vector<uint32_t>& m = mask[sample];
+
+        for (size_t i = 0; i < dy.size(); i++) {
+            dx[i] = dy[i] * factor[(m[i / 32] >> (i & 31)) & 1];
+        }
+    }, 1);
+}
+
+}  // namespace kernels
+}  // namespace core
+}  // namespace tiny_dnn
@@ -0,0 +1,237 @@
+/*
+    COPYRIGHT
+
+    All contributions by Taiga Nomi
+    Copyright (c) 2013, Taiga Nomi
+    All rights reserved.
+
+    All other contributions:
+    Copyright (c) 2013-2016, the respective contributors.
+    All rights reserved.
+
+    Each contributor holds copyright over their respective contributions.
+    The project versioning (Git) records all such contribution source information.
+
+    LICENSE
+
+    The BSD 3-Clause License
+
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    * Neither the name of tiny-dnn nor the names of its
+      contributors may be used to endorse or promote products derived from
+      this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <algorithm>
+#include <vector>
+
+#include "tiny_dnn/util/util.h"
+#include "tiny_dnn/util/product.h"
+#include "tiny_dnn/util/simd_math.h"
+
+namespace tiny_dnn {
+namespace core {
+namespace kernels {
+
+/*
+ * local response normalization across channels, as in caffe:
+ *   scale[c] = 1 + alpha / size * sum(x[c']^2),  c' in [c - pre, c + post]
+ *   y[c]     = x[c] * scale[c]^-beta
+ * with pre = (size - 1) / 2, post = size / 2, channels out of range
+ * skipped. scale >= 1 for alpha >= 0, which pow below relies on.
+ *
+ * the work is split into tasks of (sample, channel block, pixel tile),
+ * so small batches still fill the threads. a task slides the window sum
+ * over the channels of its block on a tile of pixels, and both passes
+ * over a channel row (pow, product) run with SIMD. nothing is kept
+ * between forward and backward: backward recomputes the scales it needs.
+ */
+
+// pixels [p, p + n) of channels [c_begin, c_end) of one sample
+struct lrn_task {
+    size_t sample, c_begin, c_end, p, n;
+};
+
+class lrn_partition {
+public:
+    static const size_t channel_block = 16;
+    static const size_t tile = 256;
+
+    lrn_partition(size_t samples, size_t channels, size_t area)
+        : channels_(channels), area_(area),
+          cblocks_((channels + channel_block - 1) / channel_block),
+          tiles_((area + tile - 1) / tile),
+          size_(samples * cblocks_ * tiles_) {}
+
+    size_t size() const { return size_; }
+
+    lrn_task operator[](size_t i) const {
+        lrn_task t;
+        t.sample  = i / (cblocks_ * tiles_);
+        t.c_begin = (i / tiles_ % cblocks_) * channel_block;
+        t.c_end   = std::min(channels_, t.c_begin + channel_block);
+        t.p       = (i % tiles_) * tile;
+        t.n       = std::min(area_, t.p + tile) - t.p;
+        return t;
+    }
+
+private:
+    size_t channels_, area_, cblocks_, tiles_, size_;
+};
+
+/**
+ * scale[(c - c_begin) * n + k] for channels [c_begin, c_end) and pixels
+ * p + k, k < n, of one sample x. acc is n elements of scratch
+ **/
+inline void lrn_scale(const float_t* x, size_t area, size_t channels,
+                      size_t size, float_t alpha,
+                      size_t c_begin, size_t c_end, size_t p, size_t n,
+                      float_t* acc, float_t* scale) {
+    const size_t pre = (size - 1) / 2, post = size / 2;
+    const float_t alpha_div_size = alpha / size;
+
+    std::fill(acc, acc + n, float_t(0));
+    for (size_t c = c_begin - std::min(c_begin, pre);
+         c < std::min(channels, c_begin + post + 1); c++) {
+        vectorize::square_muladd(x + c * area + p, float_t(1), n, acc);
+    }
+
+    for (size_t c = c_begin; c < c_end; c++) {
+        if (c > c_begin) {
+            if (c + post < channels)
+                vectorize::square_muladd(x + (c + post) * area + p, float_t(1), n, acc);
+            if (c > pre)
+                vectorize::square_muladd(x + (c - pre - 1) * area + p, float_t(-1), n, acc);
+        }
+
+        float_t* s = scale + (c - c_begin) * n;
+        for (size_t k = 0; k < n; k++) s[k] = float_t(1) + alpha_div_size * acc[k];
+    }
+}
+
+inline void lrn_across_kernel(const tensor_t& in,
+                              const shape3d& shape,
+                              size_t size,
+                              float_t alpha,
+                              float_t beta,
+                              tensor_t& out,
+                              bool parallelize) {
+    const size_t area = shape.area(), channels = shape.depth_;
+    const lrn_partition tasks(in.size(), channels, area);
+
+    for_i(parallelize, tasks.size(), [&](int i) {
+        const lrn_task t = tasks[i];
+        const size_t rows = t.c_end - t.c_begin;
+        const float_t* x = &in[t.sample][0];
+        float_t* y = &out[t.sample][0];
+
+        std::vector<float_t> buf((rows + 1) * t.n);
+        float_t* scale = &buf[t.n];
+        lrn_scale(x, area, channels, size, alpha, t.c_begin, t.c_end,
+                  t.p, t.n, &buf[0], scale);
+        vectorize::pow(scale, -beta, scale, rows * t.n);
+
+        for (size_t c = t.c_begin; c < t.c_end; c++) {
+            const float_t* xc = x + c * area + t.p;
+            const float_t* s = scale + (c - t.c_begin) * t.n;
+            float_t* yc = y + c * area + t.p;
+            for (size_t k = 0; k < t.n; k++) yc[k] = xc[k] * s[k];
+        }
+    }, 1);
+}
+
+/**
+ * with r[c] = dy[c] * y[c] / scale[c],
+ *   dx[c] = dy[c] * scale[c]^-beta
+ *         - 2 alpha beta / size * x[c] * sum(r[c']),  c' in [c - post, c + pre]
+ * (the channels whose windows contain c). y is the output of
+ * lrn_across_kernel, dy its gradient
+ **/
+inline void lrn_across_back_kernel(const tensor_t& in,
+                                   const tensor_t& out,
+                                   const tensor_t& curr_delta,
+                                   const shape3d& shape,
+                                   size_t size,
+                                   float_t alpha,
+                                   float_t beta,
+                                   tensor_t& prev_delta,
+                                   bool parallelize) {
+    const size_t area = shape.area(), channels = shape.depth_;
+    const size_t pre = (size - 1) / 2, post = size / 2;
+    const float_t factor = float_t(2) * alpha * beta / size;
+    const lrn_partition tasks(in.size(), channels, area);
+
+    for_i(parallelize, tasks.size(), [&](int i) {
+        const lrn_task t = tasks[i];
+        const size_t e_begin = t.c_begin - std::min(t.c_begin, post);
+        const size_t e_end = std::min(channels, t.c_end + pre);
+        const size_t n = t.n;
+        const float_t* x = &in[t.sample][0];
+        const float_t* y = &out[t.sample][0];
+        const float_t* dy = &curr_delta[t.sample][0];
+        float_t* dx = &prev_delta[t.sample][0];
+
+        // acc | scale[e_begin, e_end) | r[e_begin, e_end)
+        std::vector<float_t> buf((2 * (e_end - e_begin) + 1) * n);
+        float_t* acc = &buf[0];
+        float_t* scale = acc + n;
+        float_t* r = scale + (e_end - e_begin) * n;
+        lrn_scale(x, area, channels, size, alpha, e_begin, e_end, t.p, n, acc, scale);
+
+        for (size_t c = e_begin; c < e_end; c++) {
+            const size_t off = c * area + t.p;
+            const float_t* s = scale + (c - e_begin) * n;
+            float_t* rc = r + (c - e_begin) * n;
+            for (size_t k = 0; k < n; k++) rc[k] = dy[off + k] * y[off + k] / s[k];
+        }
+
+        float_t* own_scale = scale + (t.c_begin - e_begin) * n;
+        vectorize::pow(own_scale, -beta, own_scale, (t.c_end - t.c_begin) * n);
+
+        std::fill(acc, acc + n, float_t(0));
+        for (size_t c = t.c_begin - std::min(t.c_begin, post);
+             c < std::min(channels, t.c_begin + pre + 1); c++) {
+            vectorize::reduce(r + (c - e_begin) * n, n, acc);
+        }
+
+        for (size_t c = t.c_begin; c < t.c_end; c++) {
+            if (c > t.c_begin) {
+                if (c + pre < channels)
+                    vectorize::reduce(r + (c + pre - e_begin) * n, n, acc);
+                if (c > post)
+                    vectorize::muladd(r + (c - post - 1 - e_begin) * n, float_t(-1), n, acc);
+            }
+
+            const size_t off = c * area + t.p;
+            const float_t* s = scale + (c - e_begin) * n;
+            for (size_t k = 0; k < n; k++) {
+                dx[off + k] = dy[off + k] * s[k] - factor * x[off + k] * acc[k];
+            }
+        }
+    }, 1);
+}
+
+}  // namespace kernels
+}  // namespace core
+}  // namespace tiny_dnn
@@ -26,54 +26,161 @@
 */
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "tiny_dnn/core/params/maxpool_params.h"
+
 namespace tiny_dnn {
 namespace core {
 namespace kernels {
 
-inline void tiny_maxpool_kernel(const tensor_t& in_data,
-                                tensor_t&       out_data,
-                                std::vector<std::vector<cnn_size_t>>& max_idx,
-                                const std::vector<std::vector<cnn_size_t>>& out2in,
-                                const bool layer_parallelize) {
+/*
+ * direct max-pooling. output (x, y) of a channel is the max over the
+ * window starting at (x * stride_x, y * stride_y), clipped to the input
+ * (padding::same leaves partial windows at the right and bottom).
+ *
+ * in train phase the argmax of each output is recorded as its offset
+ * dy * pool_size_x + dx within the window, in one byte. backward without
+ * a recorded argmax (test-phase forward, windows of more than 256
+ * elements) finds the max in the input again.
+ */
 
-    for_i(layer_parallelize, in_data.size(), [&](int sample) {
-        const vec_t& in = in_data[sample];
-        vec_t& a = out_data[sample];
-        std::vector<cnn_size_t>& max = max_idx[sample];
+// argmax offsets fit in one byte
+inline bool maxpool_argmax_fits(const maxpool_params& params) {
+    return params.pool_size_x * params.pool_size_y <= 256;
+}
 
-        for (cnn_size_t i = 0; i < out2in.size(); i++) {
-            const auto& in_index = out2in[i];
-            float_t max_value = std::numeric_limits<float_t>::lowest();
+// number of leading outputs along one axis whose window isn't clipped
+inline size_t maxpool_full_windows(size_t out_len, size_t in_len,
+                                   size_t window, size_t stride) {
+    if (in_len < window) return 0;
+    return std::min(out_len, (in_len - window) / stride + 1);
+}
 
-            for (auto j : in_index) {
-                if (in[j] > max_value) {
-                    max_value = in[j];
-                    max[i] = j;
-                }
+// max of a w x h window (rows in_width apart), offset of the first max in *k
+template <typename T>
+T maxpool_window(const T* in, size_t in_width, size_t w, size_t h,
+                 size_t pool_size_x, size_t* k) {
+    T max_value = in[0];
+    *k = 0;
+    for (size_t dy = 0; dy < h; dy++) {
+        const T* row = in + dy * in_width;
+        for (size_t dx = 0; dx < w; dx++) {
+            if (row[dx] > max_value) {
+                max_value = row[dx];
+                *k = dy * pool_size_x + dx;
             }
-            a[i] = max_value;
         }
+    }
+    return max_value;
+}
+
+// outputs [x_begin, out.width_) of row y of one channel
+template <typename T>
+void maxpool_row(const maxpool_params& params, const T* in, T* out,
+                 uint8_t* argmax, size_t y, size_t x_begin) {
+    const size_t y0 = y * params.stride_y;
+    const size_t h = std::min<size_t>(params.pool_size_y, params.in.height_ - y0);
+
+    for (size_t x = x_begin; x < params.out.width_; x++) {
+        const size_t x0 = x * params.stride_x;
+        const size_t w = std::min<size_t>(params.pool_size_x, params.in.width_ - x0);
+        size_t k;
+        out[y * params.out.width_ + x] = maxpool_window(
+            in + y0 * params.in.width_ + x0, params.in.width_, w, h,
+            params.pool_size_x, &k);
+        if (argmax) argmax[y * params.out.width_ + x] = static_cast<uint8_t>(k);
+    }
+}
+
+template <typename T>
+void maxpool_plane(const maxpool_params& params, const T* in, T* out,
+                   uint8_t* argmax) {
+    for (size_t y = 0; y < params.out.height_; y++) {
+        maxpool_row(params, in, out, argmax, y, 0);
+    }
+}
+
+/**
+ * @param argmax per-sample offsets of the max to be filled, or null
+ **/
+template <typename Plane>
+void maxpool_kernel(const maxpool_params& params,
+                    const tensor_t& in_data,
+                    tensor_t& out_data,
+                    std::vector<std::vector<uint8_t>>* argmax,
+                    const bool layer_parallelize,
+                    Plane plane) {
+    const size_t channels = params.in.depth_;
+
+    for_i(layer_parallelize, in_data.size() * channels, [&](int task) {
+        const size_t sample = task / channels;
+        const size_t c = task % channels;
+        const size_t out_offset = params.out.get_index(0, 0, c);
+
+        plane(params, &in_data[sample][params.in.get_index(0, 0, c)],
+              &out_data[sample][out_offset],
+              argmax ? &(*argmax)[sample][out_offset] : nullptr);
     });
 }
 
-inline void tiny_maxpool_back_kernel(tensor_t& prev_delta,
-                                     const tensor_t&  curr_delta,
-                                     std::vector<std::vector<cnn_size_t>>& max_idx,
-                                     const std::vector<cnn_size_t>& in2out,
+inline void tiny_maxpool_kernel(const maxpool_params& params,
+                                const tensor_t& in_data,
+                                tensor_t&       out_data,
+                                std::vector<std::vector<uint8_t>>* argmax,
+                                const bool layer_parallelize) {
+    maxpool_kernel(params, in_data, out_data, argmax, layer_parallelize,
+        [](const maxpool_params& p, const float_t* in, float_t* out,
+           uint8_t* arg) { maxpool_plane(p, in, out, arg); });
+}
+
+/**
+ * prev_delta = curr_delta routed to the max of each window (summed where
+ * windows overlap).
+ *
+ * @param argmax offsets recorded by forward, or null to find them in in_data
+ **/
+inline void tiny_maxpool_back_kernel(const maxpool_params& params,
+                                     const tensor_t& in_data,
+                                     tensor_t&       prev_delta,
+                                     const tensor_t& curr_delta,
+                                     const std::vector<std::vector<uint8_t>>* argmax,
                                      const bool layer_parallelize) {
+    const size_t channels = params.in.depth_;
+    const size_t in_width = params.in.width_;
+    const size_t px = params.pool_size_x;
 
-    for_i(layer_parallelize, prev_delta.size(), [&](int sample) {
-        vec_t& prev       = prev_delta[sample];
-        const vec_t& curr = curr_delta[sample];
-        const std::vector<cnn_size_t>& max = max_idx[sample];
+    for_i(layer_parallelize, prev_delta.size() * channels, [&](int task) {
+        const size_t sample = task / channels;
+        const size_t c = task % channels;
+        const float_t* in = &in_data[sample][params.in.get_index(0, 0, c)];
+        float_t* prev = &prev_delta[sample][params.in.get_index(0, 0, c)];
+        const float_t* curr = &curr_delta[sample][params.out.get_index(0, 0, c)];
+        const uint8_t* arg = argmax
+            ? &(*argmax)[sample][params.out.get_index(0, 0, c)] : nullptr;
 
-        for (cnn_size_t i = 0; i < in2out.size(); i++) {
-            cnn_size_t outi = in2out[i];
-            prev[i] = (max[outi] == static_cast<cnn_size_t>(i)) ?
-                       curr[outi] : float_t(0);
+        std::fill(prev, prev + params.in.area(), float_t(0));
+
+        for (size_t y = 0; y < params.out.height_; y++) {
+            const size_t y0 = y * params.stride_y;
+            const size_t h = std::min<size_t>(params.pool_size_y,
+                                              params.in.height_ - y0);
+            for (size_t x = 0; x < params.out.width_; x++) {
+                const size_t x0 = x * params.stride_x;
+                const size_t o = y * params.out.width_ + x;
+                size_t k;
+                if (arg) {
+                    k = arg[o];
+                } else {
+                    const size_t w = std::min<size_t>(px, in_width - x0);
+                    maxpool_window(in + y0 * in_width + x0, in_width, w, h, px, &k);
+                }
+                prev[(y0 + k / px) * in_width + x0 + k % px] += curr[o];
+            }
         }
     });
-    
 }
 
 }  // namespace kernels
@@ -26,7 +26,11 @@
 */
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+
 #include "params.h"
+#include "tiny_dnn/util/bfloat16.h"
 
 namespace tiny_dnn {
 namespace core {
@@ -89,6 +93,16 @@ struct connection_table {
     cnn_size_t cols_;
 };
 
+/**
+ * algorithm used by the tiny_dnn backend to compute a convolution
+ **/
+enum class conv_algorithm {
+    automatic,  ///< selected from the layer shape
+    direct,     ///< loops over the kernel window for each output pixel
+    gemm,       ///< im2col + packed matrix multiplication
+    winograd    ///< winograd F(4x4, 3x3), 3x3 stride-1 layers only
+};
+
 class conv_params : public Params {
  public:
     connection_table tbl;
@@ -100,6 +114,48 @@ class conv_params : public Params {
     padding pad_type;
     size_t w_stride;
     size_t h_stride;
+    conv_algorithm algorithm = conv_algorithm::automatic;
+    // layer::weight_generation() of the weights passed to the kernels,
+    // 0 if unknown (caches of derived weights are then rebuilt per call)
+    uint64_t weight_generation = 0;
+    // if set, the gemm and winograd forward read these instead of
+    // the float_t weights
+    const std::vector<bfloat16>* weights_bf16 = nullptr;
+
+    /**
+     * number of zero columns / rows virtually added in front of the input.
+     * the tiny_dnn kernels never materialize them: taps falling outside
+     * params.in are skipped, in_padded only describes the virtual shape
+     **/
+    cnn_size_t pad_left() const {
+        return pad_type == padding::same ? weight.width_ / 2 : 0;
+    }
+
+    cnn_size_t pad_top() const {
+        return pad_type == padding::same ? weight.height_ / 2 : 0;
+    }
+
+    /**
+     * algorithm which is actually run by the tiny_dnn backend
+     **/
+    conv_algorithm selected_algorithm() const {
+        const bool winograd_ok = weight.width_ == 3 && weight.height_ == 3 &&
+                                 w_stride == 1 && h_stride == 1;
+
+        if (algorithm == conv_algorithm::winograd && !winograd_ok) {
+            return conv_algorithm::gemm;
+        }
+        if (algorithm != conv_algorithm::automatic) return algorithm;
+
+        // transforms cost more than they save for few channels or tiny maps
+        const cnn_size_t min_channels = 8;
+        if (winograd_ok && in.depth_ >= min_channels &&
+            out.depth_ >= min_channels &&
+            out.width_ >= 4 && out.height_ >= 4) {
+            return conv_algorithm::winograd;
+        }
+        return conv_algorithm::gemm;
+    }
 
     friend std::ostream& operator<<(std::ostream &o,
                                     const core::conv_params& param) {
@@ -114,88 +170,35 @@ class conv_params : public Params {
     }
 };
 
-inline conv_params Params::conv() const {
-    return *(static_cast<const conv_params*>(this));
+/**
+ * taps [*begin, *end) of a window of size `window` placed at output position
+ * `pos` whose input position pos * stride + tap - pad lies in [0, in_len)
+ **/
+inline void conv_tap_range(size_t pos, size_t stride, size_t pad,
+                           size_t window, size_t in_len,
+                           size_t* begin, size_t* end) {
+    const size_t origin = pos * stride;
+    *begin = pad > origin ? std::min(window, pad - origin) : 0;
+    *end = in_len + pad > origin ? std::min(window, in_len + pad - origin) : 0;
+    *end = std::max(*begin, *end);
 }
 
-class Conv2dPadding {
- public:
-    Conv2dPadding() {}
-    Conv2dPadding(const conv_params& params) : params_(params) {}
-
-    /* Applies padding to an input tensor given the convolution parameters
-     *
-     * @param in The input tensor
-     * @param out The output tensor with padding applied
-     */
-    void copy_and_pad_input(const tensor_t& in, tensor_t& out) {
-        if (params_.pad_type == padding::valid) {
-            return;
-        }
-
-        tensor_t buf(in.size());
-
-        for_i(true, buf.size(), [&](int sample) {
-            // alloc temporary buffer.
-            buf[sample].resize(params_.in_padded.size());
-
-            // make padded version in order to avoid corner-case in fprop/bprop
-            for (cnn_size_t c = 0; c < params_.in.depth_; c++) {
-                float_t* pimg = &buf[sample][params_.in_padded.get_index(
-                                             params_.weight.width_  / 2,
-                                             params_.weight.height_ / 2, c)];
-                const float_t* pin = &in[sample][params_.in.get_index(0, 0, c)];
-
-                for (cnn_size_t y = 0; y < params_.in.height_; y++) {
-                    std::copy(pin, pin + params_.in.width_, pimg);
-                    pin  += params_.in.width_;
-                    pimg += params_.in_padded.width_;
-                }
-            }
-        });
-
-        // shrink buffer to output
-        out = buf;
-    }
-
-    /* Applies unpadding to an input tensor given the convolution parameters
-     *
-     * @param in The input tensor
-     * @param out The output tensor with unpadding applied
-     */
-    void copy_and_unpad_delta(const tensor_t& delta, tensor_t& delta_unpadded) {
-        if (params_.pad_type == padding::valid) {
-            return;
-        }
-
-        tensor_t buf(delta.size());
-
-        for_i(true, buf.size(), [&](int sample) {
-            // alloc temporary buffer.
-            buf[sample].resize(params_.in.size());
-
-            for (cnn_size_t c = 0; c < params_.in.depth_; c++) {
-                const float_t *pin =
-                    &delta[sample][params_.in_padded.get_index(
-                                   params_.weight.width_  / 2,
-                                   params_.weight.height_ / 2, c)];
-                float_t *pdst = &buf[sample][params_.in.get_index(0, 0, c)];
-
-                for (cnn_size_t y = 0; y < params_.in.height_; y++) {
-                    std::copy(pin, pin + params_.in.width_, pdst);
-                    pdst += params_.in.width_;
-                    pin  += params_.in_padded.width_;
-                }
-            }
-        });
-
-        // shrink buffer to output
-        delta_unpadded = buf;
-    }
+/**
+ * output positions [*begin, *end) for which tap `tap` reads input position
+ * pos * stride + tap - pad inside [0, in_len)
+ **/
+inline void conv_output_range(size_t tap, size_t stride, size_t pad,
+                              size_t in_len, size_t out_len,
+                              size_t* begin, size_t* end) {
+    *begin = tap >= pad ? 0 : (pad - tap + stride - 1) / stride;
+    *end = in_len + pad > tap ? (in_len + pad - tap + stride - 1) / stride : 0;
+    *end = std::min(*end, out_len);
+    *begin = std::min(*begin, *end);
+}
 
- private:
-    conv_params params_;
-};
+inline conv_params Params::conv() const {
+    return *(static_cast<const conv_params*>(this));
+}
 
 }  // namespace core
 }  // namespace tiny_dnn
@@ -26,7 +26,10 @@
 */
 #pragma once
 
+#include <vector>
+
 #include "params.h"
+#include "tiny_dnn/util/bfloat16.h"
 
 namespace tiny_dnn {
 namespace core {
@@ -36,6 +39,8 @@ class fully_params : public Params {
     cnn_size_t in_size_;
     cnn_size_t out_size_;
     bool has_bias_;
+    // if set, forward reads these instead of the float_t weights
+    const std::vector<bfloat16>* weights_bf16_ = nullptr;
 };
 
 // TODO(nyanp): can we do better here?
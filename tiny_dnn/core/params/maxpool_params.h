@@ -25,6 +25,9 @@
     SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #pragma once
+#include <cstdint>
+#include <vector>
+
 #include "tiny_dnn/core/params/params.h"
 
 namespace tiny_dnn {
@@ -41,8 +44,8 @@ struct maxpool_params {
 };
 
 struct max_pooling_layer_worker_specific_storage {
-    /* mapping out => max_index(in) (1:1) */
-    std::vector<std::vector<cnn_size_t>> out2inmax_;
+    /* offset of the max within the window, per output (train phase only) */
+    std::vector<std::vector<uint8_t>> argmax_;
 };
 
 }  // namespace core
@@ -33,104 +33,17 @@
 #include "tiny_dnn/util/util.h"
 #include "tiny_dnn/util/image.h"
 #include "tiny_dnn/layers/partial_connected_layer.h"
+#include "tiny_dnn/core/kernels/blocked_kernels.h"
+#include "tiny_dnn/core/kernels/tiny_avepool_kernel.h"
 #include "tiny_dnn/activations/activation_function.h"
 
 namespace tiny_dnn {
 
-// forward_propagation
-template <typename Activation>
-void tiny_average_pooling_kernel(bool parallelize,
-                                 const std::vector<tensor_t*>& in_data,
-                                 std::vector<tensor_t*>&       out_data,
-                                 const shape3d&                out_dim,
-                                 float_t                       scale_factor,
-                                 std::vector<typename partial_connected_layer<Activation>::wi_connections>& out2wi,
-                                 Activation&                   h) {
- 
-    for_i(in_data[0]->size(), [&](size_t sample) {
-        const vec_t& in = (*in_data[0])[sample];
-        const vec_t& W = (*in_data[1])[0];
-        const vec_t& b = (*in_data[2])[0];
-        vec_t&       out = (*out_data[0])[sample];
-        vec_t&       a = (*out_data[1])[sample];
-
-        auto oarea = out_dim.area();
-        size_t idx = 0;
-        for (size_t d = 0; d < out_dim.depth_; ++d) {
-            float_t weight = W[d] * scale_factor;
-            float_t bias = b[d];
-            for (size_t i = 0; i < oarea; ++i, ++idx) {
-                const auto& connections = out2wi[idx];
-                float_t value = float_t(0);
-                for (auto connection : connections)// 13.1%
-                    value += in[connection.second]; // 3.2%
-                value *= weight;
-                value += bias;
-                a[idx] = value;
-            }
-        }
-
-        assert(out.size() == out2wi.size());
-        for (size_t i = 0; i < out2wi.size(); i++) {
-            out[i] = h.f(a, i);
-        }
-    });
-}
-
-// back_propagation
-template<typename Activation>
-void tiny_average_pooling_back_kernel(const std::vector<tensor_t*>&   in_data,
-                                      const std::vector<tensor_t*>&   out_data,
-                                      std::vector<tensor_t*>&         out_grad,
-                                      std::vector<tensor_t*>&         in_grad,
-                                      const shape3d&                  in_dim,
-                                      float_t                         scale_factor,
-                                      std::vector<typename partial_connected_layer<Activation>::io_connections>& weight2io,
-                                      std::vector<typename partial_connected_layer<Activation>::wo_connections>& in2wo,
-                                      std::vector<std::vector<cnn_size_t>>& bias2out) {
-
-    for_i(in_data[0]->size(), [&](size_t sample) {
-        const vec_t& prev_out   = (*in_data[0])[sample];
-        const vec_t& W          = (*in_data[1])[0];
-        vec_t&       dW         = (*in_grad[1])[sample];
-        vec_t&       db         = (*in_grad[2])[sample];
-        vec_t&       prev_delta = (*in_grad[0])[sample];
-        vec_t&       curr_delta = (*out_grad[0])[sample];
-
-        auto inarea = in_dim.area();
-        size_t idx = 0;
-        for (size_t i = 0; i < in_dim.depth_; ++i) {
-            float_t weight = W[i] * scale_factor;
-            for (size_t j = 0; j < inarea; ++j, ++idx) {
-                prev_delta[idx] = weight * curr_delta[in2wo[idx][0].second];
-            }
-        }
-
-        for (size_t i = 0; i < weight2io.size(); ++i) {
-            const auto& connections = weight2io[i];
-            float_t diff = float_t(0);
-
-            for (auto connection : connections)
-                diff += prev_out[connection.first] * curr_delta[connection.second];
-
-            dW[i] += diff * scale_factor;
-        }
-
-        for (size_t i = 0; i < bias2out.size(); i++) {
-            const std::vector<cnn_size_t>& outs = bias2out[i];
-            float_t diff = float_t(0);
-
-            for (auto o : outs)
-                diff += curr_delta[o];
-
-            db[i] += diff;
-        }
-    });
-}
-
-
 /**
  * average pooling with trainable weights
+ *
+ * windows are summed directly by the kernels in tiny_avepool_kernel.h,
+ * the connection tables of partial_connected_layer are left empty
  **/
 template<typename Activation = activation::identity>
 class average_pooling_layer : public partial_connected_layer<Activation> {
@@ -190,10 +103,7 @@ class average_pooling_layer : public partial_connected_layer<Activation> {
                           cnn_size_t     stride_x,
                           cnn_size_t     stride_y,
                           padding        pad_type = padding::valid)
-        : Base(in_width * in_height * in_channels,
-            conv_out_length(in_width, pool_size_x, stride_x, pad_type) *
-            conv_out_length(in_height, pool_size_y, stride_y, pad_type) * in_channels,
-            in_channels, in_channels, float_t(1) / (pool_size_x * pool_size_y)),
+        : Base(0, 0, 0, in_channels, float_t(1) / (pool_size_x * pool_size_y)),
         stride_x_(stride_x),
         stride_y_(stride_y),
         pool_size_x_(pool_size_x),
@@ -206,8 +116,17 @@ class average_pooling_layer : public partial_connected_layer<Activation> {
         if ((in_width % pool_size_x) || (in_height % pool_size_y)) {
             pooling_size_mismatch(in_width, in_height, pool_size_x, pool_size_y);
         }
+    }
 
-        init_connection(pool_size_x, pool_size_y);
+    size_t fan_in_size() const override {
+        return pool_size_x_ * pool_size_y_;
+    }
+
+    size_t fan_out_size() const override {
+        return core::kernels::avepool_fan_out(out_.width_, in_.width_,
+                                              pool_size_x_, stride_x_) *
+               core::kernels::avepool_fan_out(out_.height_, in_.height_,
+                                              pool_size_y_, stride_y_);
     }
     std::vector<index3d<cnn_size_t>> in_shape() const override {
         return { in_, w_, index3d<cnn_size_t>(1, 1, out_.depth_) };
@@ -219,18 +138,26 @@ class average_pooling_layer : public partial_connected_layer<Activation> {
 
     std::string layer_type() const override { return "ave-pool"; }
 
+    bool supports_blocked_layout() const override {
+        return this->h_.one_hot();
+    }
+
     void forward_propagation(const std::vector<tensor_t*>& in_data,
                              std::vector<tensor_t*>& out_data) override {
+        if (layer::layout() != data_layout::nchw) {
+            kernels::avepool_blocked(layer::layout(), *in_data[0], in_,
+                (*in_data[1])[0], (*in_data[2])[0], Base::scale_factor_,
+                *out_data[1], out_, pool_size_x_, pool_size_y_,
+                stride_x_, stride_y_, parallelize_);
+            this->forward_activation(*out_data[0], *out_data[1]);
+            return;
+        }
 
-        tiny_average_pooling_kernel<Activation>(
-            parallelize_,
-            in_data,
-            out_data,
-            out_,
-            Base::scale_factor_,
-            Base::out2wi_,
-            Base::h_);
-        
+        core::kernels::tiny_avepool_kernel(*in_data[0], in_,
+            (*in_data[1])[0], (*in_data[2])[0], Base::scale_factor_,
+            *out_data[1], out_, pool_size_x_, pool_size_y_,
+            stride_x_, stride_y_, parallelize_);
+        this->forward_activation(*out_data[0], *out_data[1]);
     }
 
     void back_propagation(const std::vector<tensor_t*>& in_data,
@@ -241,16 +168,10 @@ class average_pooling_layer : public partial_connected_layer<Activation> {
         tensor_t& curr_delta = *out_grad[0];
         this->backward_activation(*out_grad[0], *out_data[0], curr_delta);
 
-        tiny_average_pooling_back_kernel<Activation>(
-            in_data,
-            out_data,
-            out_grad,
-            in_grad,
-            in_,
-            Base::scale_factor_,
-            Base::weight2io_,
-            Base::in2wo_,
-            Base::bias2out_);
+        core::kernels::tiny_avepool_back_kernel(*in_data[0], in_,
+            (*in_data[1])[0], Base::scale_factor_, *in_grad[1], *in_grad[2],
+            *in_grad[0], curr_delta, out_, pool_size_x_, pool_size_y_,
+            stride_x_, stride_y_, parallelize_);
     }
 
     template <class Archive>
@@ -292,51 +213,6 @@ class average_pooling_layer : public partial_connected_layer<Activation> {
     shape3d in_;
     shape3d out_;
     shape3d w_;
-
-    static cnn_size_t pool_out_dim(cnn_size_t in_size,
-                                   cnn_size_t pooling_size,
-                                   cnn_size_t stride) {
-        return static_cast<int>(std::ceil((
-            static_cast<float_t>(in_size) - pooling_size) / stride) + 1);
-    }
-
-    void init_connection(cnn_size_t pooling_size_x, cnn_size_t pooling_size_y) {
-        for (cnn_size_t c = 0; c < in_.depth_; ++c) {
-            for (cnn_size_t y = 0; y < in_.height_ - pooling_size_y + 1; y += stride_y_) {
-                for (cnn_size_t x = 0; x < in_.width_ - pooling_size_x + 1; x += stride_x_) {
-                    connect_kernel(pooling_size_x, pooling_size_y, x, y, c);
-                }
-            }
-        }
-
-        for (cnn_size_t c = 0; c < in_.depth_; ++c) {
-            for (cnn_size_t y = 0; y < out_.height_; ++y) {
-                for (cnn_size_t x = 0; x < out_.width_; ++x) {
-                    this->connect_bias(c, out_.get_index(x, y, c));
-                }
-            }
-        }
-    }
-
-    void connect_kernel(cnn_size_t pooling_size_x,
-                        cnn_size_t pooling_size_y,
-                        cnn_size_t x,
-                        cnn_size_t y,
-                        cnn_size_t inc) {
-        cnn_size_t dymax = std::min(pooling_size_y, in_.height_ - y);
-        cnn_size_t dxmax = std::min(pooling_size_x, in_.width_ - x);
-        cnn_size_t dstx = x / stride_x_;
-        cnn_size_t dsty = y / stride_y_;
-        cnn_size_t outidx = out_.get_index(dstx, dsty, inc);
-        for (cnn_size_t dy = 0; dy < dymax; ++dy) {
-            for (cnn_size_t dx = 0; dx < dxmax; ++dx) {
-                this->connect_weight(
-                    in_.get_index(x + dx, y + dy, inc),
-                    outidx,
-                    inc);
-            }
-        }
-    }
 };
 
 }  // namespace tiny_dnn
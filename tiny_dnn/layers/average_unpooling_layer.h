@@ -70,9 +70,7 @@ void tiny_average_unpooling_kernel(bool parallelize,
         }
 
         assert(out.size() == out2wi.size());
-        for_i(parallelize, out2wi.size(), [&](int i) {
-            out[i] = h.f(a, i);
-        });
+        static_cast<const activation::function&>(h).f(&a[0], &out[0], out.size());
     }
 }
 
@@ -91,8 +89,8 @@ void tiny_average_unpooling_back_kernel(const std::vector<tensor_t*>&   in_data,
     for (size_t sample = 0; sample < in_data[0]->size(); sample++) {
         const vec_t& prev_out   = (*in_data[0])[sample];
         const vec_t& W          = (*in_data[1])[0];
-        vec_t&       dW         = (*in_grad[1])[sample];
-        vec_t&       db         = (*in_grad[2])[sample];
+        vec_t&       dW         = (*in_grad[1])[0];
+        vec_t&       db         = (*in_grad[2])[0];
         vec_t&       prev_delta = (*in_grad[0])[sample];
         vec_t&       curr_delta = (*out_grad[0])[sample];
 
@@ -28,6 +28,8 @@
 #include "tiny_dnn/util/util.h"
 #include "tiny_dnn/util/math_functions.h"
 #include "tiny_dnn/layers/layer.h"
+#include "tiny_dnn/core/kernels/blocked_kernels.h"
+#include "tiny_dnn/core/kernels/tiny_batchnorm_kernel.h"
 
 #include <algorithm>
 
@@ -111,79 +113,38 @@ public:
                           const std::vector<tensor_t*>& out_data,
                           std::vector<tensor_t*>&       out_grad,
                           std::vector<tensor_t*>&       in_grad) override {
-        tensor_t& prev_delta     = *in_grad[0];
-        tensor_t& curr_delta     = *out_grad[0];
-        const tensor_t& curr_out = *out_data[0];
-        cnn_size_t num_samples   = curr_out.size();
-
         CNN_UNREFERENCED_PARAMETER(in_data);
 
-        tensor_t delta_dot_y = curr_out;
-        vec_t mean_delta_dot_y, mean_delta, mean_Y;
-
-        for (cnn_size_t i = 0; i < num_samples; i++) {
-            for (cnn_size_t j = 0; j < curr_out[0].size(); j++) {
-                delta_dot_y[i][j] *= curr_delta[i][j];
-            }
-        }
-        moments(delta_dot_y, in_spatial_size_, in_channels_, &mean_delta_dot_y, nullptr);
-        moments(curr_delta, in_spatial_size_, in_channels_, &mean_delta, nullptr);
- 
-        // if Y = (X-mean(X))/(sqrt(var(X)+eps)), then
-        //
-        // dE(Y)/dX =
-        //   (dE/dY - mean(dE/dY) - mean(dE/dY \cdot Y) \cdot Y)
-        //     ./ sqrt(var(X) + eps)
-        //
-        for_i(num_samples, [&](int i) {
-            for (cnn_size_t j = 0; j < in_channels_; j++) {
-                for (cnn_size_t k = 0; k < in_spatial_size_; k++) {
-                    cnn_size_t index = j*in_spatial_size_ + k;
-
-                    prev_delta[i][index]
-                        = curr_delta[i][index] - mean_delta[j] - mean_delta_dot_y[j] * curr_out[i][index];
-
-                    // stddev_ is calculated in the forward pass 
-                    prev_delta[i][index] /= stddev_[j];
-                }            
-            }
-        });
+        // stddev_ is calculated in the forward pass
+        core::kernels::batchnorm_back_kernel(*out_data[0], *out_grad[0],
+            in_spatial_size_, in_channels_, stddev_, *in_grad[0],
+            parallelize_);
     }
 
     void forward_propagation(const std::vector<tensor_t*>& in_data,
         std::vector<tensor_t*>& out_data) override {
-        vec_t* mean = nullptr;
-        vec_t* variance = nullptr;
         tensor_t& in = *in_data[0];
         tensor_t& out = *out_data[0];
 
-        if (phase_ == net_phase::train) {
-            // calculate mean/variance from this batch in train phase
-            mean = &mean_current_;
-            variance = &variance_current_;
-            moments(*in_data[0], in_spatial_size_, in_channels_, mean, variance);
+        if (layout() != data_layout::nchw) {
+            // statistics are fixed in test phase (see supports_blocked_layout)
+            calc_stddev(variance_);
+            kernels::batchnorm_blocked(layout(), in, in_shape()[0],
+                mean_, stddev_, out, parallelize_);
+            return;
         }
-        else {
-            // use stored mean/variance in test phase
-            mean = &mean_;
-            variance = &variance_;
-        }
-
-        // y = (x - mean) ./ sqrt(variance + eps)
-        calc_stddev(*variance);
-
-        for_i(parallelize_, in_data[0]->size(), [&](int i) {
-            const float_t* inptr  = &in[i][0];
-            float_t*       outptr = &out[i][0];
-
-            for (cnn_size_t j = 0; j < in_channels_; j++) {
-                float_t m = (*mean)[j];
 
-                for (cnn_size_t k = 0; k < in_spatial_size_; k++) {
-                    *outptr++ = (*inptr++ - m) / stddev_[j];
-                }
-            }
-        });
+        if (phase_ == net_phase::train) {
+            // mean/variance of this batch in train phase
+            core::kernels::batchnorm_train_kernel(in, in_spatial_size_,
+                in_channels_, eps_, mean_current_, variance_current_,
+                stddev_, out, parallelize_);
+        } else {
+            // stored mean/variance in test phase
+            calc_stddev(variance_);
+            core::kernels::batchnorm_kernel(in, in_spatial_size_,
+                in_channels_, mean_, stddev_, out, parallelize_);
+        }
 
         if (phase_ == net_phase::train && update_immidiately_) {
             mean_ = mean_current_;
@@ -198,6 +159,24 @@ public:
 
     std::string layer_type() const override { return "batch-norm"; }
 
+    bool inference_affine(vec_t* scale, vec_t* shift) const override {
+        scale->resize(in_channels_ * in_spatial_size_);
+        shift->resize(in_channels_ * in_spatial_size_);
+
+        for (cnn_size_t j = 0; j < in_channels_; j++) {
+            const float_t s = float_t(1) / sqrt(variance_[j] + eps_);
+            std::fill_n(scale->begin() + j * in_spatial_size_,
+                        in_spatial_size_, s);
+            std::fill_n(shift->begin() + j * in_spatial_size_,
+                        in_spatial_size_, -mean_[j] * s);
+        }
+        return true;
+    }
+
+    bool supports_blocked_layout() const override {
+        return phase_ == net_phase::test;
+    }
+
     virtual void post_update() override {
         for (cnn_size_t i = 0; i < mean_.size(); i++) {
             mean_[i] = momentum_ * mean_[i] + (1 - momentum_) * mean_current_[i];
@@ -34,6 +34,7 @@
 #include "tiny_dnn/core/kernels/conv2d_grad_op.h"
 #include "tiny_dnn/core/kernels/conv2d_op_opencl.h"
 #include "tiny_dnn/core/kernels/conv2d_op_libdnn.h"
+#include "tiny_dnn/core/kernels/blocked_kernels.h"
 
 #include "tiny_dnn/util/util.h"
 #include "tiny_dnn/util/image.h"
@@ -191,13 +192,70 @@ class convolutional_layer : public feedforward_layer<Activation> {
     convolutional_layer(convolutional_layer&& other)  // NOLINT
             : Base(std::move(other))
             , params_(std::move(other.params_))
-            , padding_op_(std::move(other.padding_op_))
             , kernel_fwd_(std::move(other.kernel_fwd_))
-            , kernel_back_(std::move(other.kernel_back_))
-            , cws_(std::move(other.cws_)) {
+            , kernel_back_(std::move(other.kernel_back_)) {
         init_backend(std::move(other.engine()));
     }
 
+    /**
+     * select the algorithm used by the tiny_dnn backend
+     * (automatic by default)
+     **/
+    void set_algorithm(conv_algorithm algorithm) {
+        params_.algorithm = algorithm;
+    }
+
+    conv_algorithm algorithm() const {
+        return params_.algorithm;
+    }
+
+    // the gemm and winograd algorithms read bfloat16 weights
+    bool supports_bf16_weights() const override {
+        const conv_algorithm algorithm = params_.selected_algorithm();
+        return (algorithm == conv_algorithm::winograd &&
+                (layer::engine() == backend_t::tiny_dnn ||
+                 layer::engine() == backend_t::avx)) ||
+               (algorithm == conv_algorithm::gemm &&
+                layer::engine() == backend_t::tiny_dnn);
+    }
+
+    bool supports_blocked_layout() const override {
+        return this->h_.one_hot() &&
+               (layer::engine() == backend_t::tiny_dnn ||
+                layer::engine() == backend_t::avx);
+    }
+
+    /**
+     * possible with identity activation and bias, if scale/shift are
+     * constant over each output channel
+     **/
+    bool fold_output_affine(const vec_t& scale, const vec_t& shift) override {
+        if (!std::is_same<Activation, activation::identity>::value ||
+            !params_.has_bias) {
+            return false;
+        }
+
+        const cnn_size_t area = params_.out.area();
+        const cnn_size_t depth = params_.out.depth_;
+        for (cnn_size_t i = 0; i < depth * area; i++) {
+            const cnn_size_t first = i - i % area;
+            if (scale[i] != scale[first] || shift[i] != shift[first]) {
+                return false;
+            }
+        }
+
+        // the filters of output channel o are contiguous
+        vec_t& W = *this->weights()[0];
+        vec_t& b = *this->weights()[1];
+        const size_t filter = W.size() / depth;
+        for (cnn_size_t o = 0; o < depth; o++) {
+            const float_t s = scale[o * area];
+            for (size_t k = 0; k < filter; k++) W[o * filter + k] *= s;
+            b[o] = b[o] * s + shift[o * area];
+        }
+        return true;
+    }
+
     ///< number of incoming connections for each output unit
     size_t fan_in_size() const override {
         return params_.weight.width_  *
@@ -217,27 +275,31 @@ class convolutional_layer : public feedforward_layer<Activation> {
      **/
     void forward_propagation(const std::vector<tensor_t*>& in_data,
                              std::vector<tensor_t*>&       out_data) override { 
-        // apply padding to the input tensor
-        padding_op_.copy_and_pad_input(*in_data[0], cws_.prev_out_padded_);
-
-        std::vector<tensor_t*> in_data_;
-        in_data_.push_back(in_data_padded(in_data));
-
-        for (cnn_size_t i = 1; i < in_data.size(); ++i) {
-            in_data_.push_back(in_data[i]);
+        if (layer::layout() != data_layout::nchw) {
+            // blocked kernel pads implicitly
+            kernels::conv2d_op_blocked(layer::layout(), *in_data[0],
+                (*in_data[1])[0],
+                params_.has_bias ? (*in_data[2])[0] : vec_t(),
+                *out_data[1], params_, layer::parallelize());
+            this->forward_activation(*out_data[0], *out_data[1]);
+            return;
         }
 
-        // forward convolutional op context
-        auto ctx = OpKernelContext(in_data_, out_data);
+        // activations are applied by the kernel as the output is written,
+        // out_data[1] still gets the pre-activation for backward
+        const kernels::epilogue ep(this->h_, *out_data[1], *out_data[0]);
+        params_.weight_generation = layer::weight_generation();
+        params_.weights_bf16 = layer::bf16_weights();
+
+        // forward convolutional op context.
+        // kernels pad the input implicitly, no padded copy is made
+        auto ctx = OpKernelContext(in_data, out_data);
              ctx.setParallelize(layer::parallelize());
              ctx.setEngine(layer::engine());
+             ctx.setEpilogue(&ep);
 
         // launch convolutional kernel
         kernel_fwd_->compute(ctx);
-
-        // activations
-        // TODO(edgar/nyanp): refactor and move activations outside
-        this->forward_activation(*out_data[0], *out_data[1]);
     }
 
     /**
@@ -255,39 +317,16 @@ class convolutional_layer : public feedforward_layer<Activation> {
         // TODO(edgar/nyanp): refactor and move activations outside
         this->backward_activation(*out_grad[0], *out_data[0], *out_grad[1]);
 
-        std::vector<tensor_t*> in_data_;
-        in_data_.push_back(in_data_padded(in_data));
-
-        for (cnn_size_t i = 1; i < in_data.size(); ++i) {
-            in_data_.push_back(in_data[i]);
-        }
-
-        std::vector<tensor_t*> in_grad_;
-        for (cnn_size_t i = 0; i < in_grad.size(); ++i) {
-            in_grad_.push_back(in_grad[i]);
-        }
-
-        if (params_.pad_type == padding::same) {
-            *in_grad_[0] = cws_.prev_delta_padded_;
-        }
+        params_.weight_generation = layer::weight_generation();
 
-        auto ctx = OpKernelContext(in_data_, out_data, out_grad, in_grad_);
+        // deltas are written to the unpadded input gradient directly
+        auto ctx = OpKernelContext(in_data, out_data, out_grad, in_grad);
              ctx.setParams(&params_);
              ctx.setParallelize(layer::parallelize());
              ctx.setEngine(layer::engine());
 
         // launch convolutional kernel
         kernel_back_->compute(ctx);
-
-        // unpad deltas
-        padding_op_.copy_and_unpad_delta(cws_.prev_delta_padded_, *in_grad[0]);
-    }
-
-    void set_sample_count(cnn_size_t sample_count) override {
-        Base::set_sample_count(sample_count);
-        cws_.prev_delta_padded_.resize(
-            sample_count,
-            vec_t(params_.in_padded.size(), float_t(0)));
     }
 
     std::vector<index3d<cnn_size_t>> in_shape() const override {
@@ -409,11 +448,6 @@ class convolutional_layer : public feedforward_layer<Activation> {
     }
 
 private:
-    tensor_t* in_data_padded(const std::vector<tensor_t*>& in) {
-        return (params_.pad_type == padding::valid) ?
-            in[0] : &cws_.prev_out_padded_;
-    }
-
     void conv_set_params(const shape3d& in,
                          cnn_size_t     w_width,
                          cnn_size_t     w_height,
@@ -437,14 +471,6 @@ private:
         params_.w_stride = w_stride;
         params_.h_stride = h_stride;
         params_.tbl      = tbl;
-
-        // init padding buffer
-        if (params_.pad_type == padding::same) {
-            cws_.prev_delta_padded_.resize(1, vec_t(params_.in_padded.size(), float_t(0)));
-        }
-
-        // set parameters to padding operation
-        padding_op_ = Conv2dPadding(params_);
     }
 
     cnn_size_t in_length(cnn_size_t in_length,
@@ -512,18 +538,9 @@ private:
     /* The convolution parameters */
     conv_params params_;
 
-    /* Padding operation */
-    Conv2dPadding padding_op_;
-
     /* Forward and backward ops */
     std::shared_ptr<core::OpKernel> kernel_fwd_;
     std::shared_ptr<core::OpKernel> kernel_back_;
-
-    /* Buffer to store padded data */
-    struct conv_layer_worker_specific_storage {
-        tensor_t prev_out_padded_;
-        tensor_t prev_delta_padded_;
-    } cws_;
 };
 
 }  // namespace tiny_dnn
@@ -27,6 +27,7 @@
 #pragma once
 #include "tiny_dnn/util/util.h"
 #include "tiny_dnn/layers/layer.h"
+#include "tiny_dnn/core/kernels/tiny_dropout_kernel.h"
 #include <algorithm>
 
 namespace tiny_dnn {
@@ -51,8 +52,7 @@ public:
           scale_(float_t(1) / (float_t(1) - dropout_rate_)),
           in_size_(in_dim)
     {
-		mask_.resize(1, std::vector<uint8_t>(in_dim));
-        clear_mask();
+        mask_.resize(1, std::vector<uint32_t>((in_dim + 31) / 32));
     }
 
     dropout_layer(const dropout_layer& obj) = default;
@@ -104,11 +104,8 @@ public:
         CNN_UNREFERENCED_PARAMETER(in_data);
         CNN_UNREFERENCED_PARAMETER(out_data);
 
-        for (cnn_size_t sample = 0, sample_count = prev_delta.size(); sample < sample_count; ++sample) {
-            for (size_t i = 0; i < curr_delta.size(); i++) {
-                prev_delta[sample][i] = mask_[sample][i] * curr_delta[sample][i];
-            }
-        }
+        core::kernels::dropout_back_kernel(curr_delta, mask_, scale_,
+                                           prev_delta, parallelize_);
     }
 
     void forward_propagation(const std::vector<tensor_t*>& in_data,
@@ -116,30 +113,21 @@ public:
         const tensor_t& in  = *in_data[0];
         tensor_t&       out = *out_data[0];
 
-        const cnn_size_t sample_count = in.size();
-
-        if (mask_.size() < sample_count) {
-            mask_.resize(sample_count, mask_[0]);
-        }
-
-        for (size_t sample = 0, sample_count = in.size(); sample < sample_count; ++sample) {
-
-            std::vector<uint8_t>& mask = mask_[sample];
+        mask_.resize(in.size(), std::vector<uint32_t>((in_size_ + 31) / 32));
 
-            const vec_t& in_vec = in[sample];
-            vec_t& out_vec = out[sample];
+        if (phase_ == net_phase::train) {
+            // one key per pass; the masks are a function of it, so they
+            // follow set_random_seed() whatever the number of threads
+            const uint64_t seed = random_stream_key();
+            const uint32_t key[2] = { uint32_t(seed), uint32_t(seed >> 32) };
 
-            if (phase_ == net_phase::train) {
-                for (size_t i = 0; i < in_vec.size(); i++)
-                    mask[i] = bernoulli(dropout_rate_);
-
-                for (size_t i = 0; i < in_vec.size(); i++)
-                    out_vec[i] = mask[i] * scale_ * in_vec[i];
-            }
-            else {
-                for (size_t i = 0, end = in_vec.size(); i < end; i++)
-                    out_vec[i] = in_vec[i];
-            }
+            core::kernels::dropout_kernel(in, key, dropout_rate_, scale_,
+                                          mask_, out, parallelize_);
+        }
+        else {
+            for_i(parallelize_, in.size(), [&](int sample) {
+                std::copy(in[sample].begin(), in[sample].end(), out[sample].begin());
+            });
         }
     }
 
@@ -154,14 +142,19 @@ public:
     std::string layer_type() const override { return "dropout"; }
 
     // currently used by tests only
-    const std::vector<uint8_t>& get_mask(cnn_size_t sample_index) const {
-        return mask_[sample_index];
+    std::vector<uint8_t> get_mask(cnn_size_t sample_index) const {
+        const std::vector<uint32_t>& bits = mask_[sample_index];
+        std::vector<uint8_t> mask(in_size_);
+        for (cnn_size_t i = 0; i < in_size_; i++) {
+            mask[i] = (bits[i / 32] >> (i % 32)) & 1;
+        }
+        return mask;
     }
 
     void clear_mask() {
-		for (cnn_size_t sample = 0, sample_count = mask_.size(); sample < sample_count; ++sample) {
-			std::fill(mask_[sample].begin(), mask_[sample].end(), 0);
-		}
+        for (auto& bits : mask_) {
+            std::fill(bits.begin(), bits.end(), 0);
+        }
     }
 
     template <class Archive>
@@ -185,7 +178,7 @@ private:
     float_t dropout_rate_;
     float_t scale_;
     cnn_size_t in_size_;
-	std::vector<std::vector<uint8_t>> mask_;
+    std::vector<std::vector<uint32_t>> mask_; // one bit per element
 };
 
 } // namespace tiny_dnn
@@ -42,8 +42,14 @@ public:
     std::pair<float_t, float_t> out_value_range() const override { return h_.scale(); }
 
 public:
+    /**
+     * elementwise activations don't care about the order of elements,
+     * so they run on blocked layouts as is (padded channels included).
+     * the activation is dispatched once per sample, not per element
+     **/
     void forward_activation(tensor_t& a_tensor, tensor_t& out_tensor) {
-        cnn_size_t out_dim = out_shape()[0].size();
+        cnn_size_t out_dim = layout_size(out_shape()[0], layout());
+        const activation::function& h = h_;
 
         for_i(a_tensor.size(), [&](int sample) {
             vec_t& out = a_tensor[sample];
@@ -51,37 +57,43 @@ public:
             out.resize(out_dim);
             a.resize(out_dim);
 
-            for (cnn_size_t i = 0; i < out_dim; i++) {
-                out[i] = this->h_.f(a, i);
-            }
+            h.f(&a[0], &out[0], out_dim);
         });
     }
 
+    /**
+     * while set, backward gets dE/da of the pre-activation in out_grad[0]
+     * and skips the activation. network sets it around a backward pass
+     * whose output gradient was computed together with the activation
+     * (softmax_cross_entropy_multiclass)
+     **/
+    void set_fused_output_grad(bool fused) { fused_output_grad_ = fused; }
+
     void backward_activation(const tensor_t& prev_delta, const tensor_t& this_out, tensor_t& curr_delta) {
+        const activation::function& h = h_;
+
+        if (fused_output_grad_) {
+            for_i(this_out.size(), [&](cnn_size_t sample) {
+                std::copy(prev_delta[sample].begin(), prev_delta[sample].end(),
+                          curr_delta[sample].begin());
+            });
+            return;
+        }
 
-        // @todo consider parallelism
         for_i(this_out.size(), [&](cnn_size_t sample) {
             const vec_t& out_vec = this_out[sample];
             const vec_t& prev_delta_vec = prev_delta[sample];
             vec_t& curr_delta_vec = curr_delta[sample];
 
-            const cnn_size_t len = prev_delta_vec.size();
-            
-            if (h_.one_hot()) {
-                for (cnn_size_t c = 0; c < len; c++) {
-                    curr_delta_vec[c] = prev_delta_vec[c] * h_.df(out_vec[c]);
-                }
-            }
-            else {
-                for (cnn_size_t c = 0; c < len; c++) {
-                    vec_t df = h_.df(out_vec, c);
-                    curr_delta_vec[c] = vectorize::dot(&prev_delta_vec[0], &df[0], len);
-                }
-            }
+            h.df(&out_vec[0], &prev_delta_vec[0], &curr_delta_vec[0],
+                 static_cast<cnn_size_t>(prev_delta_vec.size()));
         });
     }
 
     Activation h_;
+
+private:
+    bool fused_output_grad_ = false;
 };
 
 } // namespace tiny_dnn
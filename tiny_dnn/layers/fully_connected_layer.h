@@ -93,16 +93,19 @@ public:
 
     void forward_propagation(const std::vector<tensor_t*>& in_data,
                              std::vector<tensor_t*>&       out_data) override {
+        // activations are applied by the kernel as the output is written,
+        // out_data[1] still gets the pre-activation for backward
+        const kernels::epilogue ep(this->h_, *out_data[1], *out_data[0]);
+        params_.weights_bf16_ = layer::bf16_weights();
+
         // forward convolutional op context
         auto ctx = OpKernelContext(in_data, out_data);
              ctx.setParallelize(layer::parallelize());
              ctx.setEngine(layer::engine());
+             ctx.setEpilogue(&ep);
 
         // launch convolutional kernel
         kernel_fwd_->compute(ctx);
-
-        // activations
-        this->forward_activation(*out_data[0], *out_data[1]);
     }
 
     void back_propagation(const std::vector<tensor_t*>& in_data,
@@ -124,6 +127,32 @@ public:
 
     std::string layer_type() const override { return "fully-connected"; }
 
+    bool supports_bf16_weights() const override {
+        return layer::engine() == backend_t::tiny_dnn ||
+               layer::engine() == backend_t::avx;
+    }
+
+    // possible with identity activation and bias
+    bool fold_output_affine(const vec_t& scale, const vec_t& shift) override {
+        if (!std::is_same<Activation, activation::identity>::value ||
+            !params_.has_bias_) {
+            return false;
+        }
+
+        // W[c * out_size + i] connects input c to output i
+        vec_t& W = *this->weights()[0];
+        vec_t& b = *this->weights()[1];
+        for (cnn_size_t c = 0; c < params_.in_size_; c++) {
+            for (cnn_size_t i = 0; i < params_.out_size_; i++) {
+                W[c * params_.out_size_ + i] *= scale[i];
+            }
+        }
+        for (cnn_size_t i = 0; i < params_.out_size_; i++) {
+            b[i] = b[i] * scale[i] + shift[i];
+        }
+        return true;
+    }
+
     template <class Archive>
     static void load_and_construct(Archive & ar, cereal::construct<fully_connected_layer> & construct) {
         size_t in_dim, out_dim;
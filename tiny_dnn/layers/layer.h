@@ -34,6 +34,8 @@
 #include <string>
 #include <utility>
 #include <queue>
+#include <atomic>
+#include <cstdint>
 
 #include "tiny_dnn/node.h"
 #include "tiny_dnn/core/backend.h"
@@ -76,6 +78,8 @@ class layer : public node {
             : node(in_type.size(), out_type.size()),
               initialized_(false),
               parallelize_(true),
+              num_threads_(0),
+              layout_(data_layout::nchw),
               in_channels_(in_type.size()),
               out_channels_(out_type.size()),
               in_type_(in_type),
@@ -83,6 +87,11 @@ class layer : public node {
         weight_init_ = std::make_shared<weight_init::xavier>();
         bias_init_ = std::make_shared<weight_init::constant>();
         trainable_ = true;
+        bf16_enabled_ = false;
+        bf16_release_float_ = false;
+        float_released_ = false;
+        bf16_generation_ = 0;
+        weight_generation_ = next_weight_generation();
     }
 
     layer(const layer&) = default;
@@ -97,6 +106,59 @@ class layer : public node {
         parallelize_ = parallelize;
     }
 
+    /**
+     * set the max number of threads used by this layer's kernels
+     * (forward, backward and weight update). 0 means no limit.
+     * ignored if parallelize is false (then the layer runs single-threaded).
+     **/
+    void set_num_threads(int num_threads) {
+        num_threads_ = num_threads;
+    }
+
+    /**
+     * run forward in the given data layout. inputs and outputs whose edges
+     * are stored in another layout are reordered at the layer boundary.
+     * aux outputs (e.g. pre-activation values) follow the layer's layout.
+     * only layers with supports_blocked_layout() accept a blocked layout.
+     **/
+    void set_layout(data_layout layout) {
+        if (layout != data_layout::nchw && !supports_blocked_layout()) {
+            throw nn_error(layer_type() + " doesn't support blocked layout");
+        }
+        layout_ = layout;
+        for (cnn_size_t i = 0; i < out_channels_; i++) {
+            if (out_type_[i] != vector_type::data) {
+                ith_out_node(i)->set_layout(layout);
+            }
+        }
+        if (layout == data_layout::nchw) {
+            std::vector<tensor_t>().swap(layout_buffers_);
+        }
+    }
+
+    /**
+     * run forward with a bfloat16 copy of the weights (the first weight
+     * input): kernels widen them to float_t as they're read and accumulate
+     * in float_t. the copy is retaken before forward whenever
+     * weight_generation() has changed. the float_t weights stay the
+     * master copy for backward, updates and serialization.
+     *
+     * with keep_float = false (inference only), the float_t weights are
+     * released once the copy is made, so the weights take half the memory.
+     * weights(), init_weight() and disabling widen them back from bfloat16
+     * (i.e. rounded to bfloat16), and the next forward releases them again.
+     * ignored unless supports_bf16_weights().
+     **/
+    void set_bf16_weights(bool enable, bool keep_float = true) {
+        restore_float_weights();
+        bf16_enabled_ = enable && supports_bf16_weights();
+        bf16_release_float_ = bf16_enabled_ && !keep_float;
+        bf16_generation_ = 0;
+        std::vector<bfloat16>().swap(bf16_weights_);
+        if (bf16_enabled_) update_bf16_weights();
+        if (bf16_release_float_) release_float_weights();
+    }
+
     void set_backend(std::shared_ptr<core::backend> backend) {
         backend_ = backend;
     }
@@ -110,6 +172,40 @@ class layer : public node {
 
     bool parallelize() const { return parallelize_; }
 
+    int num_threads() const { return num_threads_; }
+
+    data_layout layout() const { return layout_; }
+
+    /**
+     * true if forward_propagation can run in a blocked layout
+     * (see data_layout) with the current settings. backward always
+     * runs in nchw.
+     **/
+    virtual bool supports_blocked_layout() const { return false; }
+
+    /**
+     * true if forward_propagation can read its weights in bfloat16
+     * (see set_bf16_weights)
+     **/
+    virtual bool supports_bf16_weights() const { return false; }
+
+    // weights for forward in bfloat16, nullptr if not enabled
+    const std::vector<bfloat16>* bf16_weights() const {
+        return bf16_weights_.empty() ? nullptr : &bf16_weights_;
+    }
+
+    /**
+     * identifies the current weights: it changes on init_weight, optimizer
+     * steps, load and mutable weights() access, and is unique among all
+     * layers. kernels key data derived from the weights on it (e.g. the
+     * winograd filter transform) instead of comparing the weights.
+     * writes through a pointer kept from an earlier weights() call must
+     * be followed by weights_changed()
+     **/
+    uint64_t weight_generation() const { return weight_generation_; }
+
+    void weights_changed() { weight_generation_ = next_weight_generation(); }
+
     // TODO(edgar): Deprecated: use the below method 
     core::backend_t backend_type() const {
         return backend_->type();
@@ -181,6 +277,7 @@ class layer : public node {
     }
 
     std::vector<const vec_t*> weights() const {
+        const_cast<layer*>(this)->restore_float_weights();
         std::vector<const vec_t*> v;
         for (cnn_size_t i = 0; i < in_channels_; i++) {
             if (is_trainable_weight(in_type_[i])) {
@@ -190,7 +287,13 @@ class layer : public node {
         return v;
     }
 
+    /**
+     * mutable access counts as a change of the weights
+     * (see weight_generation)
+     **/
     std::vector<vec_t*> weights() {
+        restore_float_weights();
+        weights_changed();
         std::vector<vec_t*> v;
         for (cnn_size_t i = 0; i < in_channels_; i++) {
             if (is_trainable_weight(in_type_[i])) {
@@ -249,10 +352,48 @@ class layer : public node {
         for (cnn_size_t i = 0; i < in_channels_; i++) {
             if (in_type_[i] != vector_type::data) continue;
             assert(j < data.size());
+            ith_in_node(i)->bind_data(nullptr);
             *ith_in_node(i)->get_data() = data[j++];
         }
     }
 
+    /**
+     * use caller-owned tensors as input data, without copying them.
+     * they must stay alive until unbind_in_data or set_in_data is called.
+     * all tensors must have the same number of samples
+     **/
+    void bind_in_data(const std::vector<const tensor_t*>& data) {
+        cnn_size_t j = 0;
+        for (cnn_size_t i = 0; i < in_channels_; i++) {
+            if (in_type_[i] != vector_type::data) continue;
+            assert(j < data.size());
+            if (data[j]->size() != data[0]->size()) {
+                throw nn_error("bound inputs must have the same sample count");
+            }
+            ith_in_node(i)->bind_data(data[j++]);
+        }
+    }
+
+    void unbind_in_data() {
+        for (cnn_size_t i = 0; i < in_channels_; i++) {
+            ith_in_node(i)->bind_data(nullptr);
+        }
+    }
+
+    /**
+     * output data of this layer, without copying. valid until the next forward
+     **/
+    std::vector<const tensor_t*> output_data() const {
+        std::vector<const tensor_t*> out;
+        for (cnn_size_t i = 0; i < out_channels_; i++) {
+            if (out_type_[i] == vector_type::data) {
+                out.push_back(const_cast<layerptr_t>(this)
+                    ->ith_out_node(i)->get_data());
+            }
+        }
+        return out;
+    }
+
     std::vector<tensor_t> output() const {
         std::vector<tensor_t> out;
         for (cnn_size_t i = 0; i < out_channels_; i++) {
@@ -426,6 +567,28 @@ class layer : public node {
         CNN_UNREFERENCED_PARAMETER(ctx);
     }
 
+    /**
+     * if this layer maps its input to out = in * scale + shift elementwise
+     * in test phase, fill scale/shift (one element per input) and return
+     * true. used to fold such layers into the previous one for inference
+     **/
+    virtual bool inference_affine(vec_t* scale, vec_t* shift) const {
+        CNN_UNREFERENCED_PARAMETER(scale);
+        CNN_UNREFERENCED_PARAMETER(shift);
+        return false;
+    }
+
+    /**
+     * change weights and bias so that the output becomes
+     * out * scale + shift (elementwise, in nchw order).
+     * returns false, leaving the layer unchanged, if it can't be expressed
+     **/
+    virtual bool fold_output_affine(const vec_t& scale, const vec_t& shift) {
+        CNN_UNREFERENCED_PARAMETER(scale);
+        CNN_UNREFERENCED_PARAMETER(shift);
+        return false;
+    }
+
     std::vector<tensor_t> forward(const std::vector<tensor_t>& input) {   // for test
         setup(false);
         set_in_data(input);
@@ -454,11 +617,24 @@ class layer : public node {
         set_sample_count(in_data[0]->size());
 
         for (cnn_size_t i = 0; i < out_channels_; i++) {
+            ith_out_node(i)->fit_shared_storage();
             out_data.push_back(ith_out_node(i)->get_data());
             ith_out_node(i)->clear_grads();
         }
 
-        forward_propagation(in_data, out_data);
+        if (bf16_enabled_ && bf16_generation_ != weight_generation_) {
+            update_bf16_weights();
+        }
+        if (bf16_release_float_) release_float_weights();
+
+        thread_budget budget(thread_limit());
+        if (layout_ == data_layout::nchw) {
+            forward_propagation(in_data, out_data);
+        } else {
+            reorder_in_layout(in_data, out_data);
+            forward_propagation(in_data, out_data);
+            reorder_out_layout(out_data);
+        }
     }
 
     void backward() {
@@ -477,6 +653,8 @@ class layer : public node {
         for (cnn_size_t i = 0; i < out_channels_; i++) {
             out_grad.push_back(ith_out_node(i)->get_gradient());
         }
+
+        thread_budget budget(thread_limit());
         back_propagation(in_data, out_data, out_grad, in_grad);
     }
 
@@ -505,6 +683,8 @@ class layer : public node {
             return;
         }
 
+        restore_float_weights();
+
         for (cnn_size_t i = 0; i < in_channels_; i++) {
             switch (in_type_[i]) {
                 case vector_type::weight:
@@ -519,6 +699,7 @@ class layer : public node {
                     break;
             }
         }
+        weights_changed();
         initialized_ = true;
     }
 
@@ -529,19 +710,31 @@ class layer : public node {
     }
 
     void update_weight(optimizer *o, cnn_size_t batch_size) {
-        float_t rcp_batch_size = float_t(1) / float_t(batch_size);
+        thread_budget budget(thread_limit());
+        std::vector<optimizer_parameter> params;
+        append_parameters(&params);
+        if (!params.empty()) o->step(params, batch_size);
+        end_update();
+    }
+
+    /**
+     * add the trainable weights of this layer and their gradients to
+     * params, for an optimizer::step over several layers
+     **/
+    void append_parameters(std::vector<optimizer_parameter>* params) {
+        if (!trainable()) return;
         for (size_t i = 0; i < in_type_.size(); i++) {
-            if (trainable() && is_trainable_weight(in_type_[i])) {
-                vec_t diff;
-                vec_t& target = *get_weight_data(i);
-
-                ith_in_node(i)->merge_grads(&diff);
-                std::transform(diff.begin(), diff.end(),
-                               diff.begin(), [&](float_t x) { // NOLINT
-                                  return x * rcp_batch_size; });
-                o->update(diff, target);
+            if (is_trainable_weight(in_type_[i])) {
+                params->push_back({ get_weight_data(i),
+                                    ith_in_node(i)->get_gradient() });
             }
         }
+    }
+
+    // clear gradients after the weights were updated. frozen layers keep
+    // their generation, so caches built from their weights stay valid
+    void end_update() {
+        if (trainable() && !weights_grads().empty()) weights_changed();
         clear_grads();
         post_update();
     }
@@ -568,11 +761,24 @@ class layer : public node {
             tensor->resize(sample_count, (*tensor)[0]);
         };
 
+        // weight gradients are accumulated per block of samples rather than
+        // per sample, so their size is bounded by the thread count
+        const cnn_size_t accumulators = grad_accumulator_count(sample_count);
+        auto resize_accumulators = [accumulators](tensor_t* tensor) {
+            tensor->resize(accumulators,
+                           vec_t((*tensor)[0].size(), float_t(0)));
+        };
+
         for (cnn_size_t i = 0; i < in_channels_; i++) {
             if (!is_trainable_weight(in_type_[i])) {
-                resize(ith_in_node(i)->get_data());
+                // bound input is read-only and already has sample_count rows
+                if (!ith_in_node(i)->is_bound()) {
+                    resize(ith_in_node(i)->get_data());
+                }
+                resize(ith_in_node(i)->get_gradient());
+            } else {
+                resize_accumulators(ith_in_node(i)->get_gradient());
             }
-            resize(ith_in_node(i)->get_gradient());
         }
 
         for (cnn_size_t i = 0; i < out_channels_; i++) {
@@ -598,6 +804,8 @@ class layer : public node {
  protected:
     bool initialized_;
     bool parallelize_;
+    int num_threads_;
+    data_layout layout_;
     cnn_size_t in_channels_;   // number of input vectors
     cnn_size_t out_channels_;  // number of output vectors
     std::vector<vector_type> in_type_;
@@ -609,10 +817,114 @@ class layer : public node {
     Device* device_ptr_ = nullptr;
 
  private:
+    int thread_limit() const {
+        return parallelize_ ? num_threads_ : 1;
+    }
+
+    /**
+     * number of buffers used to accumulate weight gradients in a batch.
+     * kernels split the samples into this many contiguous blocks
+     * (see for_each_block), and merge_grads sums the buffers in order.
+     **/
+    cnn_size_t grad_accumulator_count(cnn_size_t sample_count) const {
+        int n = parallelize_ ? max_concurrency() : 1;
+        if (num_threads_ > 0) n = std::min(n, num_threads_);
+        return std::max(cnn_size_t(1),
+                        std::min(sample_count, static_cast<cnn_size_t>(n)));
+    }
+
+    /**
+     * point data inputs and outputs whose edges are in another layout
+     * than layout_ at layer-owned buffers. inputs are reordered now,
+     * outputs by reorder_out_layout after forward_propagation
+     **/
+    void reorder_in_layout(std::vector<tensor_t*>& in_data,
+                           std::vector<tensor_t*>& out_data) {
+        layout_buffers_.resize(in_channels_ + out_channels_);
+        const std::vector<shape3d> in_shapes = in_shape();
+        const std::vector<shape3d> out_shapes = out_shape();
+
+        for (cnn_size_t i = 0; i < in_channels_; i++) {
+            const data_layout l = ith_in_node(i)->layout();
+            if (is_trainable_weight(in_type_[i]) || l == layout_) continue;
+            tensor_t& buf = layout_buffers_[i];
+            reorder_layout(in_shapes[i], *in_data[i], l, buf, layout_,
+                           parallelize_);
+            in_data[i] = &buf;
+        }
+        for (cnn_size_t i = 0; i < out_channels_; i++) {
+            if (ith_out_node(i)->layout() == layout_) continue;
+            tensor_t& buf = layout_buffers_[in_channels_ + i];
+            buf.resize(out_data[i]->size());
+            for (auto& sample : buf) {
+                sample.resize(layout_size(out_shapes[i], layout_));
+            }
+            out_data[i] = &buf;
+        }
+    }
+
+    void reorder_out_layout(const std::vector<tensor_t*>& out_data) {
+        const std::vector<shape3d> out_shapes = out_shape();
+
+        for (cnn_size_t i = 0; i < out_channels_; i++) {
+            edgeptr_t e = ith_out_node(i);
+            if (e->layout() == layout_) continue;
+            reorder_layout(out_shapes[i], *out_data[i], layout_,
+                           *e->get_data(), e->layout(), parallelize_);
+        }
+    }
+
+    std::vector<tensor_t> layout_buffers_;
+    std::vector<bfloat16> bf16_weights_;
+    bool bf16_enabled_;
+    bool bf16_release_float_;  // set_bf16_weights(true, false)
+    bool float_released_;      // the weights are only in bf16_weights_
+    uint64_t bf16_generation_;  // weight_generation_ of bf16_weights_
+    uint64_t weight_generation_;
     bool trainable_;
     std::shared_ptr<weight_init::function> weight_init_;
     std::shared_ptr<weight_init::function> bias_init_;
 
+    // the weight input converted by update_bf16_weights, -1 if none
+    int bf16_weight_index() {
+        for (cnn_size_t i = 0; i < in_channels_; i++) {
+            if (in_type_[i] != vector_type::weight) continue;
+            if (ith_in_node(i)->get_data()->empty()) return -1;
+            return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    void update_bf16_weights() {
+        const int i = bf16_weight_index();
+        if (i < 0 || float_released_) return;
+        const vec_t& w = *get_weight_data(i);
+        bf16_weights_.resize(w.size());
+        to_bfloat16(w.data(), bf16_weights_.data(), w.size());
+        bf16_generation_ = weight_generation_;
+    }
+
+    void release_float_weights() {
+        const int i = bf16_weight_index();
+        if (i < 0 || float_released_ || bf16_weights_.empty()) return;
+        vec_t().swap(*get_weight_data(i));
+        float_released_ = true;
+    }
+
+    // widen the bfloat16 copy back into the released float_t weights
+    void restore_float_weights() {
+        if (!float_released_) return;
+        vec_t& w = *get_weight_data(bf16_weight_index());
+        w.resize(bf16_weights_.size());
+        from_bfloat16(bf16_weights_.data(), w.data(), w.size());
+        float_released_ = false;
+    }
+
+    static uint64_t next_weight_generation() {
+        static std::atomic<uint64_t> generation(0);
+        return ++generation;
+    }
+
     void alloc_input(cnn_size_t i) const {
         // TODO(nyanp): refactoring
         // which type of refactoring do you have in mind for that?
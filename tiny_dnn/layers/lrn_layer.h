@@ -26,7 +26,7 @@
 */
 #pragma once
 #include "tiny_dnn/util/util.h"
-#include <algorithm>
+#include "tiny_dnn/core/kernels/tiny_lrn_kernel.h"
 
 namespace tiny_dnn {
 
@@ -55,8 +55,7 @@ public:
         size_(local_size),
         alpha_(alpha),
         beta_(beta),
-        region_(region),
-        in_square_(in_shape_.area()) {
+        region_(region) {
     }
 
     /**
@@ -110,35 +109,30 @@ public:
 
     void forward_propagation(const std::vector<tensor_t*>& in_data,
                              std::vector<tensor_t*>& out_data) override {
-
-        // @todo revise the parallelism strategy
-        for (size_t sample = 0, sample_count = in_data[0]->size(); sample < sample_count; ++sample) {
-            vec_t& in  = (*in_data[0])[sample];
-            vec_t& out = (*out_data[0])[sample];
-            vec_t& a   = (*out_data[1])[sample];
-
-            if (region_ == norm_region::across_channels) {
-                forward_across(in, a);
-            }
-            else {
-                forward_within(in, a);
-            }
-
-            for_i(parallelize_, out.size(), [&](int i) {
-                out[i] = h_.f(a, i);
-            });
+        if (region_ != norm_region::across_channels) {
+            throw nn_error("not implemented");
         }
+
+        core::kernels::lrn_across_kernel(*in_data[0], in_shape_, size_,
+            alpha_, beta_, *out_data[1], parallelize_);
+
+        this->forward_activation(*out_data[0], *out_data[1]);
     }
 
     void back_propagation(const std::vector<tensor_t*>& in_data,
                           const std::vector<tensor_t*>& out_data,
                           std::vector<tensor_t*>&       out_grad,
                           std::vector<tensor_t*>&       in_grad) override {
-        CNN_UNREFERENCED_PARAMETER(in_data);
-        CNN_UNREFERENCED_PARAMETER(out_data);
-        CNN_UNREFERENCED_PARAMETER(out_grad);
-        CNN_UNREFERENCED_PARAMETER(in_grad);
-        throw nn_error("not implemented");
+        if (region_ != norm_region::across_channels) {
+            throw nn_error("not implemented");
+        }
+
+        tensor_t& curr_delta = *out_grad[1];
+        this->backward_activation(*out_grad[0], *out_data[0], curr_delta);
+
+        core::kernels::lrn_across_back_kernel(*in_data[0], *out_data[1],
+            curr_delta, in_shape_, size_, alpha_, beta_, *in_grad[0],
+            parallelize_);
     }
 
     template <class Archive>
@@ -167,57 +161,11 @@ public:
     }
 
 private:
-    void forward_across(const vec_t& in, vec_t& out) {
-        std::fill(in_square_.begin(), in_square_.end(), float_t(0));
-
-        for (cnn_size_t i = 0; i < size_ / 2; i++) {
-            cnn_size_t idx = in_shape_.get_index(0, 0, i);
-            add_square_sum(&in[idx], in_shape_.area(), &in_square_[0]);
-        }
-
-        cnn_size_t head = size_ / 2;
-        long tail = static_cast<long>(head) - static_cast<long>(size_);
-        cnn_size_t channels = in_shape_.depth_;
-        const cnn_size_t wxh = in_shape_.area();
-        const float_t alpha_div_size = alpha_ / size_;
-
-        for (cnn_size_t i = 0; i < channels; i++, head++, tail++) {
-            if (head < channels)
-                add_square_sum(&in[in_shape_.get_index(0, 0, head)], wxh, &in_square_[0]);
-
-            if (tail >= 0)
-                sub_square_sum(&in[in_shape_.get_index(0, 0, tail)], wxh, &in_square_[0]);
-
-            float_t *dst = &out[in_shape_.get_index(0, 0, i)];
-            const float_t *src = &in[in_shape_.get_index(0, 0, i)];
-            for (cnn_size_t j = 0; j < wxh; j++)
-                dst[j] = src[j] * std::pow(float_t(1) + alpha_div_size * in_square_[j], -beta_);
-        }
-    }
-
-    void forward_within(const vec_t& in, vec_t& out) {
-        CNN_UNREFERENCED_PARAMETER(in);
-        CNN_UNREFERENCED_PARAMETER(out);
-        throw nn_error("not implemented");
-    }
-
-    void add_square_sum(const float_t *src, cnn_size_t size, float_t *dst) {
-        for (cnn_size_t i = 0; i < size; i++)
-            dst[i] += src[i] * src[i];
-    }
-
-    void sub_square_sum(const float_t *src, cnn_size_t size, float_t *dst) {
-        for (cnn_size_t i = 0; i < size; i++)
-            dst[i] -= src[i] * src[i];
-    }
-
     shape3d in_shape_;
 
     cnn_size_t size_;
     float_t alpha_, beta_;
     norm_region region_;
-
-    vec_t in_square_;
 };
 
 } // namespace tiny_dnn
@@ -37,6 +37,8 @@
 #include "tiny_dnn/core/backend_avx.h"
 #endif
 
+#include "tiny_dnn/core/kernels/blocked_kernels.h"
+
 #include "tiny_dnn/util/util.h"
 #include "tiny_dnn/util/image.h"
 #include "tiny_dnn/activations/activation_function.h"
@@ -110,7 +112,6 @@ class max_pooling_layer : public feedforward_layer<Activation> {
                     in_channels),
             pooling_size_x, pooling_size_y, stride_x, stride_y, pad_type);
 
-        init_connection();
         init_backend(backend_type);
         Base::set_backend_type(backend_type);
     }
@@ -119,16 +120,14 @@ class max_pooling_layer : public feedforward_layer<Activation> {
     max_pooling_layer(max_pooling_layer&& other)  // NOLINT
             : Base(std::move(other))
             , params_(std::move(other.params_))
-            , out2in_(std::move(other.out2in_))
-            , in2out_(std::move(other.in2out_))
             , max_pooling_layer_worker_storage_(
-                std::move(other.max_pooling_layer_worker_storage_)) {
-        init_connection();
+                std::move(other.max_pooling_layer_worker_storage_))
+            , phase_(other.phase_) {
         init_backend(std::move(Base::backend_type()));
     }
 
     size_t fan_in_size() const override {
-        return out2in_[0].size();
+        return params_.pool_size_x * params_.pool_size_y;
     }
 
     size_t fan_out_size() const override {
@@ -137,6 +136,29 @@ class max_pooling_layer : public feedforward_layer<Activation> {
 
     void forward_propagation(const std::vector<tensor_t*>& in_data,
                              std::vector<tensor_t*>&       out_data) override {
+        // the argmax is recorded for backward in train phase only,
+        // otherwise backward finds the max in the input again
+        std::vector<std::vector<uint8_t>>& argmax =
+            max_pooling_layer_worker_storage_.argmax_;
+        if (phase_ == net_phase::train &&
+            layer::layout() == data_layout::nchw &&
+            core::kernels::maxpool_argmax_fits(params_)) {
+            argmax.resize(in_data[0]->size(),
+                          std::vector<uint8_t>(params_.out.size()));
+        } else {
+            argmax.clear();
+        }
+
+        if (layer::layout() != data_layout::nchw) {
+            // argmax isn't recorded, backward always runs in nchw
+            kernels::maxpool_blocked(layer::layout(), *in_data[0], params_.in,
+                *out_data[1], params_.out,
+                params_.pool_size_x, params_.pool_size_y,
+                params_.stride_x, params_.stride_y, layer::parallelize());
+            this->forward_activation(*out_data[0], *out_data[1]);
+            return;
+        }
+
         // launch maxpool kernel
         Base::backend_->maxpool(in_data, out_data);
 
@@ -162,15 +184,20 @@ class max_pooling_layer : public feedforward_layer<Activation> {
         return std::string("max-pool");
     }
 
+    bool supports_blocked_layout() const override {
+        return this->h_.one_hot() &&
+               (layer::engine() == backend_t::tiny_dnn ||
+                layer::engine() == backend_t::avx);
+    }
+
     std::string kernel_file() const override {
         return std::string("../tiny_cnn/core/kernels/cl_kernels/pooling.cl");
     }
 
     std::pair<cnn_size_t, cnn_size_t> pool_size() const { return std::make_pair(params_.pool_size_x, params_.pool_size_y); }
 
-    void set_sample_count(cnn_size_t sample_count) override {
-        Base::set_sample_count(sample_count);
-        max_pooling_layer_worker_storage_.out2inmax_.resize(sample_count, std::vector<cnn_size_t>(params_.out.size()));
+    void set_context(net_phase ctx) override {
+        phase_ = ctx;
     }
 
 
@@ -203,60 +230,10 @@ class max_pooling_layer : public feedforward_layer<Activation> {
 private:
     maxpool_params params_;
 
-    /* mapping out => in (1:N) */
-    std::vector<std::vector<cnn_size_t> > out2in_;
-    /* mapping in => out (N:1) */
-    std::vector<cnn_size_t> in2out_;
-
     max_pooling_layer_worker_specific_storage
     max_pooling_layer_worker_storage_;
 
-    void connect_kernel(cnn_size_t pooling_size_x,
-                        cnn_size_t pooling_size_y,
-                        cnn_size_t outx,
-                        cnn_size_t outy,
-                        cnn_size_t c) {
-        cnn_size_t dxmax = static_cast<cnn_size_t>(
-            std::min(static_cast<size_t>(pooling_size_x),
-                     params_.in.width_ - outx * params_.stride_x));
-
-        cnn_size_t dymax = static_cast<cnn_size_t>(
-            std::min(static_cast<size_t>(pooling_size_y),
-                     params_.in.height_ - outy * params_.stride_y));
-
-        for (cnn_size_t dy = 0; dy < dymax; dy++) {
-            for (cnn_size_t dx = 0; dx < dxmax; dx++) {
-                cnn_size_t in_index = params_.in.get_index(
-                    static_cast<cnn_size_t>(outx * params_.stride_x + dx),
-                    static_cast<cnn_size_t>(outy * params_.stride_y + dy), c);
-                cnn_size_t out_index = params_.out.get_index(outx, outy, c);
-
-                if (in_index >= in2out_.size()) {
-                    throw nn_error("index overflow");
-                }
-                if (out_index >= out2in_.size()) {
-                    throw nn_error("index overflow");
-                }
-                in2out_[in_index] = out_index;
-                out2in_[out_index].push_back(in_index);
-            }
-        }
-    }
-
-    void init_connection() {
-        in2out_.resize(params_.in.size());
-        out2in_.resize(params_.out.size());
-
-        for (cnn_size_t c = 0; c < params_.in.depth_; ++c) {
-            for (cnn_size_t y = 0; y < params_.out.height_; ++y) {
-                for (cnn_size_t x = 0; x < params_.out.width_; ++x) {
-                    connect_kernel(params_.pool_size_x,
-                                   params_.pool_size_y,
-                                   x, y, c);
-                }
-            }
-        }
-    }
+    net_phase phase_ = net_phase::train;
 
     void init_backend(backend_t backend_type) {
         std::shared_ptr<core::backend> backend = nullptr;
@@ -264,8 +241,7 @@ private:
         // allocate new backend
         if (backend_type == backend_t::tiny_dnn) {
             backend = std::make_shared<core::tiny_backend>(
-                &out2in_,
-                &in2out_,
+                &params_,
                 [this](const tensor_t& p_delta,
                        const tensor_t& out, tensor_t& c_delta) {
                     return Base::backward_activation(p_delta, out, c_delta);
@@ -278,8 +254,7 @@ private:
 #ifdef CNN_USE_AVX
         } else if (backend_type == backend_t::avx) {
             backend = std::make_shared<core::avx_backend>(
-                &out2in_,
-                &in2out_,
+                &params_,
                 [this](const tensor_t& p_delta,
                        const tensor_t& out, tensor_t& c_delta) {
                     return Base::backward_activation(p_delta, out, c_delta);
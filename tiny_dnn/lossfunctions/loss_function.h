@@ -26,6 +26,8 @@
 */
 #pragma once
 #include "tiny_dnn/util/util.h"
+#include <algorithm>
+#include <numeric>
 
 namespace tiny_dnn {
 
@@ -171,6 +173,47 @@ public:
     }
 };
 
+/**
+ * cross_entropy_multiclass of y = softmax(a), computed together with the
+ * softmax. network uses it in place of cross_entropy_multiclass when an
+ * output layer has a softmax activation (see network::bprop).
+ *
+ * f takes the logits a: sum t[i] * (log(sum exp(a)) - a[i]), with the
+ * log-sum-exp taken around max(a), so it stays finite where log(y[i])
+ * would underflow.
+ * df takes y and returns dE/da = y * sum(t) - t (y - t for a one-hot t),
+ * which replaces dE/dy = -t / y followed by the softmax jacobian.
+ **/
+class softmax_cross_entropy_multiclass {
+public:
+    static float_t f(const vec_t& a, const vec_t& t) {
+        assert(a.size() == t.size());
+        if (a.empty()) return float_t(0);
+
+        const float_t alpha = *std::max_element(a.begin(), a.end());
+        float_t sum = float_t(0);
+        for (auto x : a) sum += std::exp(x - alpha);
+        const float_t lse = alpha + std::log(sum);
+
+        float_t d = float_t(0);
+        for (cnn_size_t i = 0; i < a.size(); ++i)
+            d += t[i] * (lse - a[i]);
+
+        return d;
+    }
+
+    static vec_t df(const vec_t& y, const vec_t& t) {
+        assert(y.size() == t.size());
+        vec_t d(t.size());
+        const float_t t_sum = std::accumulate(t.begin(), t.end(), float_t(0));
+
+        for (cnn_size_t i = 0; i < y.size(); ++i)
+            d[i] = y[i] * t_sum - t[i];
+
+        return d;
+    }
+};
+
 template <typename E>
 vec_t gradient(const vec_t& y, const vec_t& t) {
     assert(y.size() == t.size());
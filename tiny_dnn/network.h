@@ -40,6 +40,7 @@
 #include "tiny_dnn/util/util.h"
 #include "tiny_dnn/lossfunctions/loss_function.h"
 #include "tiny_dnn/activations/activation_function.h"
+#include "tiny_dnn/layers/feedforward_layer.h"
 
 namespace tiny_dnn {
 
@@ -159,7 +160,8 @@ class network {
     typedef typename std::vector<layerptr_t>::iterator iterator;
     typedef typename std::vector<layerptr_t>::const_iterator const_iterator;
 
-    explicit network(const std::string& name = "") : name_(name) {}
+    explicit network(const std::string& name = "")
+        : name_(name), num_threads_(0) {}
 
     /**
      * name of the network
@@ -181,6 +183,30 @@ class network {
      **/
     tensor_t predict(const tensor_t& in) { return fprop(in); }
 
+    /**
+     * executes forward-propagation on caller-owned samples ([sample][feature])
+     * without copying them, and returns the output samples without copying.
+     * the returned tensor is owned by the network, and valid until the
+     * network runs again. for single-input, single-output networks
+     **/
+    const tensor_t& predict_bound(const tensor_t& in) {
+        const tensor_t& out = *net_.forward_bound({ &in })[0];
+        net_.unbind_inputs();
+        return out;
+    }
+
+    /**
+     * zero-copy forward-propagation for multi-input/multi-output networks.
+     * in[i] holds the samples of the i-th input, and the i-th returned tensor
+     * holds the samples of the i-th output. see predict_bound(const tensor_t&)
+     **/
+    std::vector<const tensor_t*> predict_bound(
+        const std::vector<const tensor_t*>& in) {
+        std::vector<const tensor_t*> out = net_.forward_bound(in);
+        net_.unbind_inputs();
+        return out;
+    }
+
     /**
      * executes forward-propagation and returns maximum output
      **/
@@ -224,7 +250,7 @@ class network {
      * @param on_batch_enumerate callback for each mini-batch enumerate
      * @param on_epoch_enumerate callback for each epoch
      * @param reset_weights      set true if reset current network weights
-     * @param n_threads          number of tasks
+     * @param n_threads          max number of threads used for training (0: no limit)
      * @param t_cost             target costs (leave to nullptr in order to assume equal cost for every target)
      */
     template <typename Error, typename Optimizer,
@@ -237,7 +263,7 @@ class network {
                OnBatchEnumerate            on_batch_enumerate,
                OnEpochEnumerate            on_epoch_enumerate,
                const bool                  reset_weights = false,
-               const int                   n_threads = CNN_TASK_SIZE,
+               const int                   n_threads = 0,
                const std::vector<vec_t>&   t_cost = std::vector<vec_t>()) {
         std::vector<tensor_t> input_tensor, output_tensor, t_cost_tensor;
         normalize_tensor(inputs, input_tensor);
@@ -288,7 +314,7 @@ class network {
     * @param on_batch_enumerate callback for each mini-batch enumerate
     * @param on_epoch_enumerate callback for each epoch
     * @param reset_weights      set true if reset current network weights
-    * @param n_threads          number of tasks
+    * @param n_threads          max number of threads used for training (0: no limit)
     * @param t_cost             target costs (leave to nullptr in order to assume equal cost for every target)
     */
     template <typename Error, typename Optimizer,
@@ -302,7 +328,7 @@ class network {
              OnBatchEnumerate      on_batch_enumerate,
              OnEpochEnumerate      on_epoch_enumerate,
              const bool            reset_weights = false,
-             const int             n_threads = CNN_TASK_SIZE,
+             const int             n_threads = 0,
              const std::vector<U>& t_cost = std::vector<U>()) {
         std::vector<tensor_t> input_tensor, output_tensor, t_cost_tensor;
         normalize_tensor(inputs, input_tensor);
@@ -360,14 +386,135 @@ class network {
         return fit<Error>(optimizer, in, t, batch_size, epoch, nop, nop);
     }
 
+    /**
+     * set the max number of threads used by forward/backward propagation
+     * outside of training (predict, test, ...). 0 means no limit.
+     * training uses the n_threads argument of fit/train instead.
+     * call this after all layers are added to the network.
+     **/
+    void set_num_threads(int num_threads) {
+        num_threads_ = num_threads;
+        net_.set_num_threads(num_threads);
+    }
+
+    int num_threads() const { return num_threads_; }
+
     /**
      * set the netphase to train or test
      * @param phase phase of network, could be train or test
      */
     void set_netphase(net_phase phase) {
-        for (auto n : net_) {
-            n->set_context(phase);
+        net_.set_context(phase);
+    }
+
+    /**
+     * reuse activation buffers between layers in test phase.
+     * reduces memory of inference, but outputs of intermediate layers
+     * are overwritten by later layers. see memory_planner
+     **/
+    void set_memory_planning(bool enable) {
+        net_.set_memory_planning(enable);
+    }
+
+    /**
+     * run conv, pooling and batch-norm layers on channel-blocked data
+     * (nchw8c, or nchw16c with AVX-512) in test phase.
+     * results are the same up to rounding. see nodes::set_blocked_layout
+     **/
+    void set_blocked_layout(bool enable) {
+        net_.set_blocked_layout(enable);
+    }
+
+    /**
+     * keep the weights of fully-connected layers, and conv layers running
+     * the gemm or winograd algorithm, in bfloat16 for test phase. kernels
+     * widen them to float_t as they pack (or transform) them. outputs
+     * differ from float_t weights by about 2^-8 relative.
+     *
+     * by default the float_t weights are kept for training and saving,
+     * next to the copies. pass keep_float = false for inference only: the
+     * float_t weights of these layers are released, which halves their
+     * weight memory. they're widened back from bfloat16 when accessed,
+     * saved, or on switching to train phase.
+     * see nodes::set_bf16_weights
+     **/
+    void set_bf16_weights(bool enable, bool keep_float = true) {
+        net_.set_bf16_weights(enable, keep_float);
+    }
+
+    const memory_planner& memory_plan() const {
+        return net_.memory_plan();
+    }
+
+    /**
+     * inference optimization: fold every layer which is an elementwise
+     * affine map in test phase (batch normalization) into the layer before
+     * it, if that layer can absorb it into its weights and bias
+     * (convolutional/fully-connected layers with identity activation and
+     * bias), and remove it from the network. the previous layer must not
+     * feed other layers, nor be a network output.
+     *
+     * statistics of test phase are folded, so the network is switched to
+     * test phase. each fold is checked on a random input: a fold which
+     * moves any output by more than tolerance * max(1, max |output|)
+     * is undone.
+     *
+     * @return number of removed layers
+     **/
+    size_t fold_batch_normalization(float_t tolerance = float_t(1e-4)) {
+        nodes& net = net_;
+        set_netphase(net_phase::test);
+
+        // probe input from a local generator, the global one isn't touched
+        std::mt19937 gen(0);
+        std::uniform_real_distribution<float_t> dist(float_t(-1), float_t(1));
+        std::vector<tensor_t> probe(1);
+        for (auto l : net.input_layers()) {
+            vec_t v(l->in_shape()[0].size());
+            for (auto& e : v) e = dist(gen);
+            probe[0].push_back(v);
         }
+        const std::vector<tensor_t> expected = net.forward(probe);
+
+        const std::vector<layerptr_t> candidates = net.nodes_;
+        const std::vector<layerptr_t> outputs = net.output_layers();
+        size_t folded = 0;
+
+        for (layerptr_t l : candidates) {
+            vec_t scale, shift;
+            if (l->in_channels() != 1 || l->out_channels() != 1 ||
+                !l->inference_affine(&scale, &shift)) {
+                continue;
+            }
+
+            edgeptr_t in = l->inputs()[0];
+            layerptr_t producer = dynamic_cast<layerptr_t>(in->prev());
+            if (!producer || in->next().size() != 1 ||
+                std::find(outputs.begin(), outputs.end(), producer) != outputs.end()) {
+                continue;
+            }
+
+            std::vector<vec_t> saved;
+            for (auto w : producer->weights()) saved.push_back(*w);
+            if (!producer->fold_output_affine(scale, shift)) continue;
+
+            const size_t position = net.bypass_layer(l);
+            set_netphase(net_phase::test);
+
+            if (same_outputs(expected, net.forward(probe), tolerance)) {
+                auto& own = net.own_nodes_;
+                own.erase(std::remove_if(own.begin(), own.end(),
+                    [l](const std::shared_ptr<layer>& p) { return p.get() == l; }),
+                    own.end());
+                folded++;
+            } else {
+                net.restore_layer(l, position);
+                std::vector<vec_t*> w = producer->weights();
+                for (size_t i = 0; i < w.size(); i++) *w[i] = saved[i];
+                set_netphase(net_phase::test);
+            }
+        }
+        return folded;
     }
 
     /**
@@ -406,10 +553,12 @@ class network {
     float_t get_loss(const std::vector<vec_t>& in,
                      const std::vector<vec_t>& t) {
         float_t sum_loss = float_t(0);
+        const std::vector<softmax_output_layer*> fused =
+            fused_softmax_outputs<E>(std::vector<tensor_t>());
 
         for (size_t i = 0; i < in.size(); i++) {
             const vec_t predicted = predict(in[i]);
-            sum_loss += E::f(predicted, t[i]);
+            sum_loss += output_loss<E>(fused, 0, predicted, t[i]);
         }
         return sum_loss;
     }
@@ -422,11 +571,13 @@ class network {
         float_t sum_loss = float_t(0);
         std::vector<tensor_t> in_tensor;
         normalize_tensor(in, in_tensor);
+        const std::vector<softmax_output_layer*> fused =
+            fused_softmax_outputs<E>(std::vector<tensor_t>());
 
         for (size_t i = 0; i < in.size(); i++) {
             const tensor_t predicted = predict(in_tensor[i]);
             for (size_t j = 0; j < predicted.size(); j++) {
-                sum_loss += E::f(predicted[j], t[i][j]);
+                sum_loss += output_loss<E>(fused, j, predicted[j], t[i][j]);
             }
         }
         return sum_loss;
@@ -463,21 +614,21 @@ class network {
             switch (mode) {
             case GRAD_CHECK_ALL:
                 for (int i = 0; i < static_cast<int>(w.size()); i++)
-                    if (!calc_delta<E>(in, v, w, dw, i, eps)) {
+                    if (!calc_delta<E>(in, v, current, w, dw, i, eps)) {
                         return false;
                     }
                 for (int i = 0; i < static_cast<int>(b.size()); i++)
-                    if (!calc_delta<E>(in, v, b, db, i, eps)) {
+                    if (!calc_delta<E>(in, v, current, b, db, i, eps)) {
                         return false;
                     }
                 break;
             case GRAD_CHECK_RANDOM:
                 for (int i = 0; i < 10; i++)
-                    if (!calc_delta<E>(in, v, w, dw, uniform_idx(w), eps)) {
+                    if (!calc_delta<E>(in, v, current, w, dw, uniform_idx(w), eps)) {
                         return false;
                     }
                 for (int i = 0; i < 10; i++)
-                    if (!calc_delta<E>(in, v, b, db, uniform_idx(b), eps)) {
+                    if (!calc_delta<E>(in, v, current, b, db, uniform_idx(b), eps)) {
                         return false;
                     }
                 break;
@@ -743,7 +894,7 @@ class network {
         OnBatchEnumerate             on_batch_enumerate,
         OnEpochEnumerate             on_epoch_enumerate,
         const bool                   reset_weights = false,
-        const int                    n_threads = CNN_TASK_SIZE,
+        const int                    n_threads = 0,
         const std::vector<tensor_t>& t_cost = std::vector<tensor_t>()) {
         // check_training_data(in, t);
         check_target_cost_matrix(desired_outputs, t_cost);
@@ -752,12 +903,24 @@ class network {
 
         for (auto n : net_)
             n->set_parallelize(true);
+
+        // the limit of set_num_threads is restored when training ends,
+        // also by an exception
+        struct training_threads {
+            training_threads(network& net, int n) : net_(net) {
+                net_.net_.set_num_threads(n);
+            }
+            ~training_threads() {
+                net_.net_.set_num_threads(net_.num_threads_);
+            }
+            network& net_;
+        } threads(*this, n_threads);
+
         optimizer.reset();
         for (int iter = 0; iter < epoch; iter++) {
             for (size_t i = 0; i < inputs.size(); i += batch_size) {
                 train_once<Error>(optimizer, &inputs[i], &desired_outputs[i],
                     static_cast<int>(std::min(batch_size, inputs.size() - i)),
-                    n_threads,
                     get_target_cost_sample_pointer(t_cost, i));
                 on_batch_enumerate();
 
@@ -782,13 +945,12 @@ class network {
                     const tensor_t* in,
                     const tensor_t* t,
                     int size,
-                    const int nbThreads,
                     const tensor_t* t_cost) {
         if (size == 1) {
             bprop<E>(fprop(in[0]), t[0], t_cost ? t_cost[0] : tensor_t());
             net_.update_weights(&optimizer, 1);
         } else {
-            train_onebatch<E>(optimizer, in, t, size, nbThreads, t_cost);
+            train_onebatch<E>(optimizer, in, t, size, t_cost);
         }
     }
 
@@ -804,15 +966,34 @@ class network {
                         const tensor_t* in,
                         const tensor_t* t,
                         int             batch_size,
-                        const int       num_tasks,
                         const tensor_t* t_cost) {
-        std::vector<tensor_t> in_batch(&in[0], &in[0] + batch_size);
+        // copy the batch once, directly in [channel][sample] order,
+        // and bind it to the input layers
+        const cnn_size_t channel_count = in[0].size();
+        std::vector<tensor_t> in_batch(channel_count, tensor_t(batch_size));
+        std::vector<const tensor_t*> in_ptrs(channel_count);
+        for (cnn_size_t c = 0; c < channel_count; c++) {
+            for (int sample = 0; sample < batch_size; sample++) {
+                in_batch[c][sample] = in[sample][c];
+            }
+            in_ptrs[c] = &in_batch[c];
+        }
+
         std::vector<tensor_t> t_batch(&t[0], &t[0] + batch_size);
         std::vector<tensor_t> t_cost_batch = t_cost
             ? std::vector<tensor_t>(&t_cost[0], &t_cost[0] + batch_size)
             : std::vector<tensor_t>();
 
-        bprop<E>(fprop(in_batch), t_batch, t_cost_batch);
+        const std::vector<const tensor_t*> out = net_.forward_bound(in_ptrs);
+        std::vector<tensor_t> out_batch(batch_size, tensor_t(out.size()));
+        for (cnn_size_t c = 0; c < out.size(); c++) {
+            for (int sample = 0; sample < batch_size; sample++) {
+                out_batch[sample][c] = (*out[c])[sample];
+            }
+        }
+
+        bprop<E>(out_batch, t_batch, t_cost_batch);
+        net_.unbind_inputs();
         net_.update_weights(&optimizer, batch_size);
     }
 
@@ -840,7 +1021,7 @@ class network {
 
     template <typename E>
     bool calc_delta(const std::vector<tensor_t>& in,
-                    const std::vector<tensor_t>& v,
+                    const std::vector<tensor_t>& v, layer* owner,
                     vec_t& w, tensor_t& dw, int check_index, double eps) {
         static const float_t delta = std::sqrt(
             std::numeric_limits<float_t>::epsilon());
@@ -865,25 +1046,28 @@ class network {
 
         float_t f_p = float_t(0);
         w[check_index] = prev_w + delta;
+        owner->weights_changed();
         for (cnn_size_t i = 0; i < sample_count; i++) {
             f_p += get_loss<E>(in[i], v[i]);
         }
 
         float_t f_m = float_t(0);
         w[check_index] = prev_w - delta;
+        owner->weights_changed();
         for (cnn_size_t i = 0; i < sample_count; i++) {
             f_m += get_loss<E>(in[i], v[i]);
         }
 
         float_t delta_by_numerical = (f_p - f_m) / (float_t(2) * delta);
         w[check_index] = prev_w;
+        owner->weights_changed();
 
         // calculate dw/dE by bprop
         bprop<E>(fprop(in), v, std::vector<tensor_t>());
 
         float_t delta_by_bprop = 0;
-        for (cnn_size_t sample = 0; sample < sample_count; ++sample) {
-            delta_by_bprop += dw[sample][check_index];
+        for (const vec_t& dw_accumulator : dw) {
+            delta_by_bprop += dw_accumulator[check_index];
         }
         net_.clear_grads();
 
@@ -902,8 +1086,83 @@ class network {
     void bprop(const std::vector<tensor_t>& out,
                const std::vector<tensor_t>& t,
                const std::vector<tensor_t>& t_cost) {
-        std::vector<tensor_t> delta = gradient<E>(out, t, t_cost);
+        const std::vector<softmax_output_layer*> fused =
+            fused_softmax_outputs<E>(t_cost);
+
+        if (std::none_of(fused.begin(), fused.end(),
+                         [](softmax_output_layer* l) { return l != nullptr; })) {
+            std::vector<tensor_t> delta = gradient<E>(out, t, t_cost);
+            net_.backward(delta);
+            return;
+        }
+
+        // softmax outputs get dE/da = y - t, without the jacobian
+        std::vector<tensor_t> delta(out.size());
+        for (cnn_size_t sample = 0; sample < out.size(); sample++) {
+            delta[sample].resize(out[sample].size());
+            for (cnn_size_t c = 0; c < out[sample].size(); c++) {
+                delta[sample][c] = fused[c]
+                    ? softmax_cross_entropy_multiclass::df(out[sample][c], t[sample][c])
+                    : gradient<E>(out[sample][c], t[sample][c]);
+            }
+        }
+
+        for (auto l : fused) if (l) l->set_fused_output_grad(true);
         net_.backward(delta);
+        for (auto l : fused) if (l) l->set_fused_output_grad(false);
+    }
+
+    typedef feedforward_layer<activation::softmax> softmax_output_layer;
+
+    /**
+     * output layers whose softmax can be fused with the gradient of
+     * the loss E, null for the others. only cross_entropy_multiclass
+     * without per-element target costs has a fused form
+     **/
+    template <typename E>
+    std::vector<softmax_output_layer*>
+    fused_softmax_outputs(const std::vector<tensor_t>& t_cost) const {
+        const std::vector<layerptr_t> outs =
+            static_cast<const nodes&>(net_).output_layers();
+        std::vector<softmax_output_layer*> fused(outs.size(), nullptr);
+
+        if (!std::is_same<E, cross_entropy_multiclass>::value) return fused;
+        for (const tensor_t& cost : t_cost) {
+            if (!cost.empty()) return fused;
+        }
+
+        for (size_t i = 0; i < outs.size(); i++) {
+            fused[i] = dynamic_cast<softmax_output_layer*>(outs[i]);
+        }
+        return fused;
+    }
+
+    // |a - b| <= tolerance * max(1, max |a|) for all outputs
+    static bool same_outputs(const std::vector<tensor_t>& a,
+                             const std::vector<tensor_t>& b,
+                             float_t tolerance) {
+        float_t range = float_t(1), diff = float_t(0);
+        for (size_t i = 0; i < a.size(); i++) {
+            for (size_t j = 0; j < a[i].size(); j++) {
+                for (size_t k = 0; k < a[i][j].size(); k++) {
+                    const float_t d = std::abs(a[i][j][k] - b[i][j][k]);
+                    if (std::isnan(d)) return false;
+                    range = std::max(range, std::abs(a[i][j][k]));
+                    diff = std::max(diff, d);
+                }
+            }
+        }
+        return diff <= tolerance * range;
+    }
+
+    // loss of output channel c after predict. softmax outputs are
+    // evaluated from the logits left in the pre-activation of the layer
+    template <typename E>
+    float_t output_loss(const std::vector<softmax_output_layer*>& fused,
+                        size_t c, const vec_t& y, const vec_t& t) const {
+        if (c >= fused.size() || !fused[c]) return E::f(y, t);
+        const vec_t& a = (*fused[c]->outputs()[1]->get_data())[0];
+        return softmax_cross_entropy_multiclass::f(a, t);
     }
 
     void check_t(size_t i, label_t t, cnn_size_t dim_out) {
@@ -1013,6 +1272,7 @@ class network {
 
     std::string name_;
     NetType net_;
+    int num_threads_;
 };
 
 /**
@@ -35,6 +35,7 @@
 #include <unordered_set>
 
 #include "tiny_dnn/util/util.h"
+#include "tiny_dnn/util/blocked_layout.h"
 #include "tiny_dnn/util/product.h"
 #include "tiny_dnn/util/image.h"
 #include "tiny_dnn/util/weight_init.h"
@@ -99,40 +100,112 @@ class edge {
           vtype_(vtype),
           data_({vec_t(shape.size())}),
           grad_({vec_t(shape.size())}),
+          shared_data_(nullptr),
+          shared_grad_(nullptr),
+          bound_data_(nullptr),
+          layout_(data_layout::nchw),
           prev_(prev) {}
 
     void merge_grads(vec_t *dst) {
-        dst->resize(grad_[0].size());
+        const tensor_t& grad = *get_gradient();
+        dst->resize(grad[0].size());
         std::fill(dst->begin(), dst->end(), static_cast<float_t>(0));
 
-        // @todo consider adding parallelism
-		for (cnn_size_t sample = 0, sample_count = grad_.size(); sample < sample_count; ++sample) {
-			vectorize::reduce<float_t>(&grad_[sample][0], dst->size(), &(*dst)[0]);
+        // for weights, grad holds one accumulator per block of samples.
+        // summing them in order keeps the result independent of scheduling
+		for (cnn_size_t i = 0, count = grad.size(); i < count; ++i) {
+			vectorize::reduce<float_t>(&grad[i][0], dst->size(), &(*dst)[0]);
 		}
     }
 
     void clear_grads() {
-		for (cnn_size_t sample = 0, sample_count = grad_.size(); sample < sample_count; ++sample) {
-			std::fill(grad_[sample].begin(), grad_[sample].end(), (float_t)0);
+        tensor_t& grad = *get_gradient();
+		for (cnn_size_t sample = 0, sample_count = grad.size(); sample < sample_count; ++sample) {
+			std::fill(grad[sample].begin(), grad[sample].end(), (float_t)0);
 		}
     }
 
     tensor_t* get_data() {
-        return &data_;
+        if (bound_data_) return const_cast<tensor_t*>(bound_data_);
+        return shared_data_ ? shared_data_ : &data_;
     }
 
     const tensor_t* get_data() const {
-        return &data_;
+        if (bound_data_) return bound_data_;
+        return shared_data_ ? shared_data_ : &data_;
     }
 
     tensor_t* get_gradient() {
-        return &grad_;
+        return shared_grad_ ? shared_grad_ : &grad_;
     }
 
     const tensor_t* get_gradient() const {
-        return &grad_;
+        return shared_grad_ ? shared_grad_ : &grad_;
     }
 
+    /**
+     * store data/gradient in external tensors owned by a memory_planner,
+     * which may be shared with other edges. the own storage is released.
+     * pass nullptr to go back to own storage.
+     **/
+    void set_shared_storage(tensor_t* data, tensor_t* grad) {
+        if (data) {
+            tensor_t().swap(data_);
+        } else if (data_.empty()) {
+            data_.assign(1, vec_t(storage_size()));
+        }
+        if (grad) {
+            tensor_t().swap(grad_);
+        } else if (grad_.empty()) {
+            grad_.assign(1, vec_t(storage_size()));
+        }
+        shared_data_ = data;
+        shared_grad_ = grad;
+    }
+
+    bool has_shared_storage() const { return shared_data_ != nullptr; }
+
+    /**
+     * read data from caller-owned samples instead of own storage, without
+     * copying them (zero-copy input). layers never write to their input
+     * data, so the tensor isn't modified. nullptr goes back to own storage.
+     **/
+    void bind_data(const tensor_t* data) {
+        bound_data_ = data;
+    }
+
+    bool is_bound() const { return bound_data_ != nullptr; }
+
+    /**
+     * shared storage may have been used by an edge of another shape.
+     * make every sample match the shape of this edge
+     **/
+    void fit_shared_storage() {
+        if (!shared_data_) return;
+        for (auto& sample : *shared_data_) {
+            sample.resize(storage_size());
+        }
+    }
+
+    /**
+     * layout of the data stored in this edge (see data_layout).
+     * producer and consumers must agree on it, which nodes takes care of.
+     * own storage is resized to fit, its content is undefined afterwards.
+     **/
+    void set_layout(data_layout layout) {
+        if (layout == layout_) return;
+        layout_ = layout;
+        for (auto& sample : data_) {
+            sample.resize(storage_size());
+        }
+    }
+    data_layout layout() const { return layout_; }
+
+    /**
+     * number of elements of a sample in the current layout
+     **/
+    cnn_size_t storage_size() const { return layout_size(shape_, layout_); }
+
     const std::vector<node*>& next() const { return next_; }
     node* prev() { return prev_; }
     const node* prev() const { return prev_; }
@@ -140,12 +213,19 @@ class edge {
     const shape3d& shape() const { return shape_; }
     vector_type vtype() const { return vtype_; }
     void add_next_node(node* next) { next_.push_back(next); }
+    void remove_next_node(node* next) {
+        next_.erase(std::remove(next_.begin(), next_.end(), next), next_.end());
+    }
 
  private:
     shape3d shape_;
     vector_type vtype_;
     tensor_t data_;
     tensor_t grad_;
+    tensor_t* shared_data_;
+    tensor_t* shared_grad_;
+    const tensor_t* bound_data_;
+    data_layout layout_;
     node* prev_;               // previous node, "producer" of this tensor
     std::vector<node*> next_;  // next nodes, "consumers" of this tensor
 };
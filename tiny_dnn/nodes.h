@@ -33,6 +33,7 @@
 #include <cereal/types/tuple.hpp>
 
 #include "tiny_dnn/util/util.h"
+#include "tiny_dnn/util/memory_planner.h"
 #include "tiny_dnn/layers/layer.h"
 #include "tiny_dnn/optimizers/optimizer.h"
 
@@ -82,11 +83,22 @@ namespace tiny_dnn {
  *     s.add(out);                                   // lvalue, hold raw-pointer only
  *
  **/
+template <typename NetType>
+class network;
+
 class nodes {
  public:
      typedef std::vector<layerptr_t>::iterator iterator;
      typedef std::vector<layerptr_t>::const_iterator const_iterator;
 
+    nodes()
+        : phase_(net_phase::train),
+          num_threads_(0),
+          memory_planning_(false),
+          blocked_layout_(false),
+          bf16_weights_(false),
+          bf16_keep_float_(true) {}
+
     /**
      * propagate gradient
      * @param first        : gradient of cost function(dE/dy)
@@ -103,12 +115,73 @@ class nodes {
     std::vector<tensor_t> forward(const std::vector<tensor_t>& first) = 0; // NOLINT
 
     /**
-     * update weights and clear all gradients
+     * forward propagation without copying inputs and outputs.
+     *
+     * @param inputs samples of each input channel ([sample][feature]).
+     *               they are bound to the input layers, and must stay alive
+     *               and unchanged until unbind_inputs (backward reads them too)
+     * @return output of each output channel, owned by the network and
+     *         valid until the next forward
+     **/
+    std::vector<const tensor_t*> forward_bound(
+        const std::vector<const tensor_t*>& inputs) {
+        const std::vector<layerptr_t> in_layers = input_layers();
+
+        if (inputs.size() != in_layers.size()) {
+            throw nn_error("input size mismatch");
+        }
+        for (auto in : inputs) {
+            if (in->size() != inputs[0]->size()) {
+                throw nn_error("all inputs must have the same number of samples");
+            }
+        }
+        for (cnn_size_t i = 0; i < in_layers.size(); i++) {
+            in_layers[i]->bind_in_data({ inputs[i] });
+        }
+
+        try {
+            for (auto l : nodes_) {
+                l->forward();
+            }
+        } catch (...) {
+            unbind_inputs();
+            throw;
+        }
+
+        std::vector<const tensor_t*> out;
+        for (auto l : output_layers()) {
+            out.push_back(l->output_data()[0]);
+        }
+        return out;
+    }
+
+    /**
+     * stop using inputs given to forward_bound
+     **/
+    void unbind_inputs() {
+        for (auto l : input_layers()) {
+            l->unbind_in_data();
+        }
+    }
+
+    /**
+     * update weights and clear all gradients.
+     * the weights of all the layers go to the optimizer in one step
      **/
     virtual
     void update_weights(optimizer *opt, int batch_size) {
+        std::vector<optimizer_parameter> params;
         for (auto l : nodes_) {
-            l->update_weight(opt, batch_size);
+            l->append_parameters(&params);
+        }
+
+        if (!params.empty()) {
+            thread_budget budget(num_threads_);
+            opt->step(params, batch_size);
+        }
+
+        for (auto l : nodes_) {
+            l->end_update();
         }
     }
 
@@ -119,14 +192,87 @@ class nodes {
         for (auto l : nodes_) {
             l->setup(reset_weight);
         }
+        update_layouts();
+        update_memory_plan();
+        update_bf16_weights();
     }
 
+    /**
+     * notify changing context (train <=> test) to all layers
+     **/
+    void set_context(net_phase phase) {
+        phase_ = phase;
+        for (auto l : nodes_) {
+            l->set_context(phase);
+        }
+        update_layouts();
+        update_memory_plan();
+        update_bf16_weights();
+    }
+
+    /**
+     * share activation buffers between layers whose outputs are not alive
+     * at the same time (see memory_planner). the plan is made at setup and
+     * on switching to test phase, and released in train phase.
+     **/
+    void set_memory_planning(bool enable) {
+        memory_planning_ = enable;
+        update_memory_plan();
+    }
+
+    const memory_planner& memory_plan() const { return planner_; }
+
+    /**
+     * run layers which support it in the blocked layout of the target
+     * (native_blocked_layout) in test phase. layouts are assigned at setup
+     * and on phase changes; train phase always runs in nchw.
+     *
+     * data passed between two blocked layers stays blocked. reorders
+     * only happen at the boundary with a layer which needs nchw, and
+     * network inputs/outputs are always nchw. outputs of other
+     * intermediate layers may be blocked (see edge::layout).
+     **/
+    void set_blocked_layout(bool enable) {
+        blocked_layout_ = enable;
+        update_layouts();
+        update_memory_plan();
+    }
+
+    bool blocked_layout() const { return blocked_layout_; }
+
+    /**
+     * in test phase, run forward of layers which support it with bfloat16
+     * copies of their weights (see layer::set_bf16_weights). copies are
+     * made on switching to test phase and dropped in train phase; loading
+     * or editing weights in test phase changes layer::weight_generation(),
+     * and the copy is retaken before the next forward.
+     * with keep_float = false, the float_t weights of these layers are
+     * released while in test phase (see layer::set_bf16_weights).
+     **/
+    void set_bf16_weights(bool enable, bool keep_float = true) {
+        bf16_weights_ = enable;
+        bf16_keep_float_ = keep_float;
+        update_bf16_weights();
+    }
+
+    bool bf16_weights() const { return bf16_weights_; }
+
     void clear_grads() {
         for (auto l : nodes_) {
             l->clear_grads();
         }
     }
 
+    /**
+     * set the max number of threads used by each layer (0: no limit)
+     **/
+    void set_num_threads(int num_threads) {
+        num_threads_ = num_threads;
+        for (auto l : nodes_) {
+            l->set_num_threads(num_threads);
+        }
+    }
+
     size_t size() const { return nodes_.size(); }
     iterator begin() { return nodes_.begin(); }
     iterator end() { return nodes_.end(); }
@@ -216,6 +362,134 @@ class nodes {
     }
 
  protected:
+    // network::bprop looks at the output layers
+    template <typename NetType>
+    friend class network;
+
+    /**
+     * layers which receive the network input
+     **/
+    virtual std::vector<layerptr_t> input_layers() const {
+        if (nodes_.empty()) return std::vector<layerptr_t>();
+        return std::vector<layerptr_t>{ nodes_.front() };
+    }
+
+    /**
+     * layers whose outputs are read after forward
+     **/
+    virtual std::vector<layerptr_t> output_layers() const {
+        if (nodes_.empty()) return std::vector<layerptr_t>();
+        return std::vector<layerptr_t>{ nodes_.back() };
+    }
+
+    /**
+     * take l, a layer with one input and one output, out of the graph:
+     * its consumers read the input of l instead, which must have no
+     * other consumer. l keeps its own edges, so that restore_layer can
+     * put it back. returns the former position of l
+     **/
+    size_t bypass_layer(layerptr_t l) {
+        edgeptr_t in = l->inputs()[0];
+        edgeptr_t out = l->outputs()[0];
+        layerptr_t producer = dynamic_cast<layerptr_t>(in->prev());
+        const cnn_size_t head = producer->next_port(*in);
+
+        in->remove_next_node(l);
+        for (node* n : out->next()) {
+            layerptr_t consumer = dynamic_cast<layerptr_t>(n);
+            connect(producer, consumer, head, consumer->prev_port(*out));
+        }
+        replace_output_layer(l, producer);
+
+        auto it = std::find(nodes_.begin(), nodes_.end(), l);
+        const size_t position = it - nodes_.begin();
+        nodes_.erase(it);
+        return position;
+    }
+
+    /**
+     * undo bypass_layer
+     **/
+    void restore_layer(layerptr_t l, size_t position) {
+        edgeptr_t in = l->inputs()[0];
+        edgeptr_t out = l->outputs()[0];
+        layerptr_t producer = dynamic_cast<layerptr_t>(in->prev());
+        const std::vector<node*> consumers = out->next();
+
+        for (node* n : consumers) {
+            layerptr_t consumer = dynamic_cast<layerptr_t>(n);
+            const cnn_size_t tail = consumer->prev_port(*in);
+            in->remove_next_node(n);
+            out->remove_next_node(n);
+            connect(l, consumer, 0, tail);
+        }
+        in->add_next_node(l);
+        replace_output_layer(producer, l);
+
+        nodes_.insert(nodes_.begin() + position, l);
+    }
+
+    /**
+     * make the network output read from another layer
+     **/
+    virtual void replace_output_layer(layerptr_t from, layerptr_t to) {
+        CNN_UNREFERENCED_PARAMETER(from);
+        CNN_UNREFERENCED_PARAMETER(to);
+    }
+
+    /**
+     * assign a layout to every layer, then to every data edge:
+     * an edge is blocked only if its producer and all of its consumers run
+     * in the same blocked layout and read it with the same channel/pixel
+     * shape. other edges are nchw, and blocked layers reorder at the boundary
+     **/
+    void update_layouts() {
+        const bool enable = blocked_layout_ && phase_ == net_phase::test;
+        const data_layout blocked = native_blocked_layout();
+
+        for (auto l : nodes_) {
+            l->set_layout(enable && l->supports_blocked_layout() ?
+                          blocked : data_layout::nchw);
+        }
+
+        const std::vector<layerptr_t> outs = output_layers();
+        for (auto l : nodes_) {
+            for (auto& e : l->outputs()) {
+                if (e->vtype() != vector_type::data) continue;
+
+                bool is_blocked = l->layout() != data_layout::nchw &&
+                    !e->next().empty() &&
+                    std::find(outs.begin(), outs.end(), l) == outs.end();
+
+                for (auto n : e->next()) {
+                    if (!is_blocked) break;
+                    layerptr_t c = dynamic_cast<layerptr_t>(n);
+                    is_blocked = c &&
+                        std::find(nodes_.begin(), nodes_.end(), c) != nodes_.end() &&
+                        c->layout() == l->layout() &&
+                        same_blocking(e->shape(), c->in_shape()[c->prev_port(*e)]);
+                }
+                e->set_layout(is_blocked ? l->layout() : data_layout::nchw);
+            }
+        }
+    }
+
+    // weight copies are only kept while in test phase
+    void update_bf16_weights() {
+        const bool enable = bf16_weights_ && phase_ == net_phase::test;
+        for (auto l : nodes_) {
+            l->set_bf16_weights(enable, bf16_keep_float_);
+        }
+    }
+
+    void update_memory_plan() {
+        if (memory_planning_ && phase_ == net_phase::test && !nodes_.empty()) {
+            planner_.plan(nodes_, output_layers());
+        } else {
+            planner_.release();
+        }
+    }
+
     template <typename T>
     void push_back(T&& node) {
         push_back_impl(std::forward<T>(node),
@@ -264,6 +538,20 @@ class nodes {
     std::vector<std::shared_ptr<layer>> own_nodes_;
     /* List of all nodes which includes own_nodes */
     std::vector<layerptr_t> nodes_;
+
+    net_phase phase_;
+    int num_threads_;
+    bool memory_planning_;
+    bool blocked_layout_;
+    bool bf16_weights_;
+    bool bf16_keep_float_;
+    memory_planner planner_;
+
+ private:
+    // blocked layouts only depend on the channel count and the pixel count
+    static bool same_blocking(const shape3d& a, const shape3d& b) {
+        return a.depth_ == b.depth_ && a.area() == b.area();
+    }
 };
 
 /**
@@ -518,6 +806,18 @@ private:
         }
     }
 
+    std::vector<layerptr_t> input_layers() const override {
+        return input_layers_;
+    }
+
+    std::vector<layerptr_t> output_layers() const override {
+        return output_layers_;
+    }
+
+    void replace_output_layer(layerptr_t from, layerptr_t to) override {
+        std::replace(output_layers_.begin(), output_layers_.end(), from, to);
+    }
+
      // normalize indexing back to [sample][layer][feature]
      std::vector<tensor_t> merge_outs() {
          std::vector<tensor_t> merged;
@@ -26,10 +26,23 @@
 */
 #pragma once
 #include "tiny_dnn/util/util.h"
+#include "tiny_dnn/util/product.h"
+#include "tiny_dnn/util/simd_math.h"
+#include <array>
 #include <unordered_map>
 
 namespace tiny_dnn {
 
+/**
+ * a trainable weight vector and its gradient for optimizer::step.
+ * the gradient is the sum of the rows of grad (the per-block
+ * accumulators of an edge, see node::merge_grads) over the batch size
+ **/
+struct optimizer_parameter {
+    vec_t*          weight;
+    const tensor_t* grad;
+};
+
 /**
  * base class of optimizer
  * usesHessian : true if an optimizer uses hessian (2nd order derivative of loss function)
@@ -47,26 +60,177 @@ struct optimizer {
     virtual ~optimizer() = default;
     virtual void update(const vec_t& dW, vec_t &W) = 0;
     virtual void reset() {} // override to implement pre-learning action
+
+    /**
+     * one update of all the parameters of a model (or a layer).
+     * the default merges each gradient and calls update(dW, W) with it
+     **/
+    virtual void step(const std::vector<optimizer_parameter>& params,
+                      cnn_size_t batch_size) {
+        const float_t rcp_batch_size = float_t(1) / float_t(batch_size);
+        vec_t diff;
+        for (const auto& p : params) {
+            const tensor_t& grad = *p.grad;
+            diff.assign(grad[0].begin(), grad[0].end());
+            for (size_t i = 1; i < grad.size(); i++) {
+                vectorize::reduce<float_t>(&grad[i][0], diff.size(), &diff[0]);
+            }
+            for (auto& d : diff) d *= rcp_batch_size;
+            update(diff, *p.weight);
+        }
+    }
 };
 
-// helper class to hold N values for each weight
+/**
+ * helper class to hold N values for each weight.
+ *
+ * the values of all the weights live in N flat buffers: a weight vector
+ * gets a range of them the first time it is updated, and keeps it until
+ * reset(). step() goes over all the parameters in one parallel pass of
+ * fixed-size chunks, which merges the gradient of a chunk, averages it
+ * and applies the rule (update_range) with SIMD.
+ **/
 template <int N>
 struct stateful_optimizer : public optimizer {
     void reset() override {
         for (auto& e : E_) e.clear();
+        state_size_ = 0;
+        offsets_.clear();
+        step_weights_.clear();
+        step_offsets_.clear();
+    }
+
+    void update(const vec_t& dW, vec_t& W) override {
+        const size_t at = offset(W);
+        const size_t nchunks = (W.size() + chunk_size - 1) / chunk_size;
+
+        begin_step();
+        for_i(nchunks > 1, nchunks, [&](int c) {
+            const size_t begin = c * chunk_size;
+            const size_t n = std::min(W.size() - begin, chunk_size);
+            update_range(&dW[begin], &W[begin], at + begin, n);
+        }, 1);
+    }
+
+    void step(const std::vector<optimizer_parameter>& params,
+              cnn_size_t batch_size) override {
+        layout(params);
+
+        // (parameter, first element) of each chunk
+        std::vector<std::pair<size_t, size_t>> chunks;
+        for (size_t i = 0; i < params.size(); i++) {
+            for (size_t b = 0; b < params[i].weight->size(); b += chunk_size) {
+                chunks.emplace_back(i, b);
+            }
+        }
+
+        const float_t rcp_batch_size = float_t(1) / float_t(batch_size);
+
+        begin_step();
+        for_i(chunks.size() > 1, chunks.size(), [&](int c) {
+            const optimizer_parameter& p = params[chunks[c].first];
+            const tensor_t& grad = *p.grad;
+            const size_t begin = chunks[c].second;
+            const size_t n = std::min(p.weight->size() - begin, chunk_size);
+
+            float_t dW[chunk_size];
+            std::copy(&grad[0][begin], &grad[0][begin] + n, dW);
+            for (size_t i = 1; i < grad.size(); i++) {
+                vectorize::reduce<float_t>(&grad[i][begin], n, dW);
+            }
+            for (size_t i = 0; i < n; i++) dW[i] *= rcp_batch_size;
+
+            update_range(dW, &(*p.weight)[begin], step_offsets_[chunks[c].first] + begin, n);
+        }, 1);
     }
 
 protected:
-    template <int Index>
-    vec_t& get(const vec_t& key) {
-        static_assert(Index < N, "index out of range");
-        if (E_[Index][&key].empty())
-            E_[Index][&key].resize(key.size(), float_t());
-        return E_[Index][&key];
+    static const size_t chunk_size = 2048;
+
+    // called once per update() or step(), before the weights change
+    virtual void begin_step() {}
+
+    // the rule for W[i], dW[i] and E_[k][at + i], i < n
+    virtual void update_range(const float_t* dW, float_t* W, size_t at, size_t n) = 0;
+
+    /**
+     * runs rule.apply<Ops>(w, dw, s) over the n elements, with s[k] the
+     * values of E_[k]: full SIMD registers of float, then one at a time
+     **/
+    template <typename Rule>
+    void map_update(const float_t* dW, float_t* W, size_t at, size_t n,
+                    const Rule& rule) {
+        const Rule r = rule;  // a local copy, so its constants stay in registers
+        float_t* state[N + 1];
+        for (int k = 0; k < N; k++) state[k] = &E_[k][at];
+
+        size_t i = 0;
+#if (defined(CNN_USE_SSE) || defined(CNN_USE_AVX)) && !defined(CNN_USE_DOUBLE)
+        i = map_update_range<vectorize::detail::simd_float>(dW, W, state, 0, n, r);
+#endif
+        map_update_range<vectorize::detail::simd_scalar<float_t>>(dW, W, state, i, n, r);
+    }
+
+    std::array<vec_t, N> E_;
+
+private:
+    // processes whole registers in [begin, end), returns where it stopped
+    template <typename Ops, typename Rule>
+    static size_t map_update_range(const float_t* dW, float_t* W, float_t* const* state,
+                                   size_t begin, size_t end, const Rule& rule) {
+        typedef typename Ops::reg reg;
+        size_t i = begin;
+        for (; i + Ops::width <= end; i += Ops::width) {
+            reg s[N + 1];
+            for (int k = 0; k < N; k++) s[k] = Ops::load(state[k] + i);
+            reg w = Ops::load(W + i);
+            rule.template apply<Ops>(w, Ops::load(dW + i), s);
+            Ops::store(W + i, w);
+            for (int k = 0; k < N; k++) Ops::store(state[k] + i, s[k]);
+        }
+        return i;
+    }
+
+    // first state index of W, allocated on first use
+    size_t offset(const vec_t& W) {
+        auto it = offsets_.find(&W);
+        if (it != offsets_.end() && it->second.second == W.size()) {
+            return it->second.first;
+        }
+        const size_t at = state_size_;
+        state_size_ += W.size();
+        for (auto& e : E_) e.resize(state_size_, float_t(0));
+        offsets_[&W] = std::make_pair(at, W.size());
+        return at;
     }
-    std::unordered_map<const vec_t*, vec_t> E_[N];
+
+    // offsets for the parameters of step(), looked up when they change
+    void layout(const std::vector<optimizer_parameter>& params) {
+        bool same = step_weights_.size() == params.size();
+        for (size_t i = 0; same && i < params.size(); i++) {
+            same = step_weights_[i].first == params[i].weight &&
+                   step_weights_[i].second == params[i].weight->size();
+        }
+        if (same) return;
+
+        step_weights_.clear();
+        step_offsets_.clear();
+        for (const auto& p : params) {
+            step_weights_.emplace_back(p.weight, p.weight->size());
+            step_offsets_.push_back(offset(*p.weight));
+        }
+    }
+
+    size_t state_size_ = 0;
+    // weight -> (first state index, size)
+    std::unordered_map<const vec_t*, std::pair<size_t, size_t>> offsets_;
+    std::vector<std::pair<const vec_t*, size_t>> step_weights_;
+    std::vector<size_t> step_offsets_;
 };
 
+template <int N>
+const size_t stateful_optimizer<N>::chunk_size;
+
 /**
  * adaptive gradient method
  *
@@ -77,17 +241,23 @@ protected:
 struct adagrad : public stateful_optimizer<1> {
     adagrad() : alpha(float_t(0.01)), eps(float_t(1e-8)) {}
 
-    void update(const vec_t& dW, vec_t &W) {
-        vec_t& g = get<0>(W);
+    float_t alpha; // learning rate
+private:
+    struct rule {
+        float_t alpha, eps;
+
+        template <typename Ops>
+        void apply(typename Ops::reg& w, typename Ops::reg dw, typename Ops::reg* g) const {
+            g[0] = Ops::madd(dw, dw, g[0]);
+            const typename Ops::reg d = Ops::add(Ops::sqrt(g[0]), Ops::set1(eps));
+            w = Ops::sub(w, Ops::div(Ops::mul(Ops::set1(alpha), dw), d));
+        }
+    };
 
-        for_i(static_cast<int>(W.size()), [&](int i) {
-            g[i] += dW[i] * dW[i];
-            W[i] -= alpha * dW[i] / (std::sqrt(g[i]) + eps);
-        });
+    void update_range(const float_t* dW, float_t* W, size_t at, size_t n) override {
+        map_update(dW, W, at, n, rule{ alpha, eps });
     }
 
-    float_t alpha; // learning rate
-private:
     float_t eps;
 };
 
@@ -100,19 +270,25 @@ private:
 struct RMSprop : public stateful_optimizer<1> {
     RMSprop() : alpha(float_t(0.0001)), mu(float_t(0.99)), eps(float_t(1e-8)) {}
 
-    void update(const vec_t& dW, vec_t& W) {
-        vec_t& g = get<0>(W);
-
-        for_i(static_cast<int>(W.size()), [&](int i)
-        {
-            g[i] = mu * g[i] + (1 - mu) * dW[i] * dW[i];
-            W[i] -= alpha * dW[i] / std::sqrt(g[i] + eps);
-        });
-    }
-
     float_t alpha; // learning rate
     float_t mu; // decay term
 private:
+    struct rule {
+        float_t alpha, mu, eps;
+
+        template <typename Ops>
+        void apply(typename Ops::reg& w, typename Ops::reg dw, typename Ops::reg* g) const {
+            g[0] = Ops::madd(Ops::set1(mu), g[0],
+                             Ops::mul(Ops::set1(1 - mu), Ops::mul(dw, dw)));
+            const typename Ops::reg d = Ops::sqrt(Ops::add(g[0], Ops::set1(eps)));
+            w = Ops::sub(w, Ops::div(Ops::mul(Ops::set1(alpha), dw), d));
+        }
+    };
+
+    void update_range(const float_t* dW, float_t* W, size_t at, size_t n) override {
+        map_update(dW, W, at, n, rule{ alpha, mu, eps });
+    }
+
     float_t eps; // constant value to avoid zero-division
 };
 
@@ -126,26 +302,35 @@ private:
 struct adam : public stateful_optimizer<2> {
     adam() : alpha(float_t(0.001)), b1(float_t(0.9)), b2(float_t(0.999)), b1_t(float_t(0.9)), b2_t(float_t(0.999)), eps(float_t(1e-8)) {}
 
-    void update(const vec_t& dW, vec_t& W) {
-        vec_t& mt = get<0>(W);
-        vec_t& vt = get<1>(W);
-
-        b1_t*=b1;b2_t*=b2;
-
-        for_i(static_cast<int>(W.size()), [&](int i){
-            mt[i] = b1 * mt[i] + (float_t(1) - b1) * dW[i];
-            vt[i] = b2 * vt[i] + (float_t(1) - b2) * dW[i] * dW[i];
-
-            W[i] -= alpha * ( mt[i]/(float_t(1) -b1_t) ) / std::sqrt( (vt[i]/(float_t(1)-b2_t)) + eps);
-        });
-    }
-
     float_t alpha; // learning rate
     float_t b1; // decay term
     float_t b2; // decay term
     float_t b1_t; // decay term power t
     float_t b2_t; // decay term power t   
 private:
+    struct rule {
+        float_t alpha, b1, b2, rcp_1_b1_t, rcp_1_b2_t, eps;
+
+        template <typename Ops>
+        void apply(typename Ops::reg& w, typename Ops::reg dw, typename Ops::reg* s) const {
+            typedef typename Ops::reg reg;
+            s[0] = Ops::madd(Ops::set1(b1), s[0], Ops::mul(Ops::set1(1 - b1), dw));
+            s[1] = Ops::madd(Ops::set1(b2), s[1],
+                             Ops::mul(Ops::set1(1 - b2), Ops::mul(dw, dw)));
+            const reg m = Ops::mul(s[0], Ops::set1(alpha * rcp_1_b1_t));
+            const reg v = Ops::madd(s[1], Ops::set1(rcp_1_b2_t), Ops::set1(eps));
+            w = Ops::sub(w, Ops::div(m, Ops::sqrt(v)));
+        }
+    };
+
+    // the bias correction advances once per step
+    void begin_step() override { b1_t *= b1; b2_t *= b2; }
+
+    void update_range(const float_t* dW, float_t* W, size_t at, size_t n) override {
+        map_update(dW, W, at, n, rule{ alpha, b1, b2,
+            float_t(1) / (float_t(1) - b1_t), float_t(1) / (float_t(1) - b2_t), eps });
+    }
+
     float_t eps; // constant value to avoid zero-division
 };
 
@@ -156,17 +341,25 @@ private:
  *
  * slightly faster than tiny_dnn::momentum
  **/
-struct gradient_descent : public optimizer {
+struct gradient_descent : public stateful_optimizer<0> {
     gradient_descent() : alpha(float_t(0.01)), lambda(float_t(0)) {}
 
-    void update(const vec_t& dW, vec_t& W) {
-        for_i(static_cast<int>(W.size()), [&](int i){
-            W[i] = W[i] - alpha * (dW[i] + lambda * W[i]);
-        });
-    }
-
     float_t alpha; // learning rate
     float_t lambda; // weight decay
+private:
+    struct rule {
+        float_t alpha, lambda;
+
+        template <typename Ops>
+        void apply(typename Ops::reg& w, typename Ops::reg dw, typename Ops::reg*) const {
+            const typename Ops::reg d = Ops::madd(Ops::set1(lambda), w, dw);
+            w = Ops::sub(w, Ops::mul(Ops::set1(alpha), d));
+        }
+    };
+
+    void update_range(const float_t* dW, float_t* W, size_t at, size_t n) override {
+        map_update(dW, W, at, n, rule{ alpha, lambda });
+    }
 };
 
 /**
@@ -180,19 +373,26 @@ struct momentum : public stateful_optimizer<1> {
 public:
     momentum() : alpha(float_t(0.01)), lambda(float_t(0)), mu(float_t(0.9)) {}
 
-    void update(const vec_t& dW, vec_t& W) {
-        vec_t& dWprev = get<0>(W);
-
-        for_i(static_cast<int>(W.size()), [&](int i){
-            float_t V = mu * dWprev[i] - alpha * (dW[i] + W[i] * lambda);
-            W[i]      += V;
-            dWprev[i] =  V;
-        });
-    }
-
     float_t alpha; // learning rate
     float_t lambda; // weight decay
     float_t mu; // momentum
+private:
+    struct rule {
+        float_t alpha, lambda, mu;
+
+        template <typename Ops>
+        void apply(typename Ops::reg& w, typename Ops::reg dw, typename Ops::reg* prev) const {
+            const typename Ops::reg d = Ops::madd(Ops::set1(lambda), w, dw);
+            const typename Ops::reg v = Ops::sub(Ops::mul(Ops::set1(mu), prev[0]),
+                                                 Ops::mul(Ops::set1(alpha), d));
+            w = Ops::add(w, v);
+            prev[0] = v;
+        }
+    };
+
+    void update_range(const float_t* dW, float_t* W, size_t at, size_t n) override {
+        map_update(dW, W, at, n, rule{ alpha, lambda, mu });
+    }
 };
 
 } // namespace tiny_dnn
@@ -63,6 +63,7 @@
 #include "tiny_dnn/util/deform.h"
 #include "tiny_dnn/util/product.h"
 #include "tiny_dnn/util/graph_visualizer.h"
+#include "tiny_dnn/util/batch_tensor.h"
 
 #include "tiny_dnn/io/mnist_parser.h"
 #include "tiny_dnn/io/cifar10_parser.h"
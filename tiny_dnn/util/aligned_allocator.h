@@ -25,14 +25,9 @@
     SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #pragma once
-#include <stdlib.h>
-#ifdef _WIN32
-#include <malloc.h>
-#endif
-#ifdef __MINGW32__
-#include <mm_malloc.h>
-#endif
 #include "nn_error.h"
+#include "memory_pool.h"
+#include "tiny_dnn/config.h"
 
 namespace tiny_dnn {
 
@@ -66,7 +61,13 @@ public:
     }
 
     pointer allocate(size_type size, const void* = nullptr) {
-        void* p = aligned_alloc(alignment, sizeof(T) * size);
+#ifndef CNN_NO_MEMORY_POOL
+        void* p = alignment <= memory_pool::alignment ?
+            memory_pool::get_instance().allocate(sizeof(T) * size) :
+            aligned_malloc(alignment, sizeof(T) * size);
+#else
+        void* p = aligned_malloc(alignment, sizeof(T) * size);
+#endif
         if (!p && size > 0)
             throw nn_error("failed to allocate");
         return static_cast<pointer>(p);
@@ -76,7 +77,13 @@ public:
         return ~static_cast<std::size_t>(0) / sizeof(T);
     }
 
-    void deallocate(pointer ptr, size_type) {
+    void deallocate(pointer ptr, size_type size) {
+#ifndef CNN_NO_MEMORY_POOL
+        if (alignment <= memory_pool::alignment) {
+            memory_pool::get_instance().deallocate(ptr, sizeof(T) * size);
+            return;
+        }
+#endif
         aligned_free(ptr);
     }
 
@@ -106,33 +113,6 @@ public:
     void destroy(U* ptr) {
         ptr->~U();
     }
-
-private:
-    void* aligned_alloc(size_type align, size_type size) const {
-#if defined(_MSC_VER)
-        return ::_aligned_malloc(size, align);
-#elif defined (__ANDROID__)
-        return ::memalign(align, size);
-#elif defined (__MINGW32__)
-        return _mm_malloc(size, align);
-#else // posix assumed
-        void* p;
-        if (::posix_memalign(&p, align, size) != 0) {
-            p = 0;
-        }
-        return p;
-#endif
-    }
-
-    void aligned_free(pointer ptr) {
-#if defined(_MSC_VER)
-        ::_aligned_free(ptr);
-#elif defined(__MINGW32__)
-        ::free(ptr);
-#else
-        ::free(ptr);
-#endif
-    }
 };
 
 template<typename T1, typename T2, std::size_t alignment>
@@ -0,0 +1,258 @@
+/*
+    Copyright (c) 2016, Taiga Nomi
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "tiny_dnn/util/util.h"
+
+namespace tiny_dnn {
+
+/**
+ * non-owning view of one sample in a batch_tensor.
+ * indexes like vec_t, so code written against tensor_t rows
+ * (t[sample][i], range-for, size()) works on either storage.
+ **/
+template <typename T>
+class sample_view {
+ public:
+    typedef T value_type;
+    typedef T* iterator;
+    typedef T* const_iterator;
+
+    sample_view(T* ptr, cnn_size_t size) : ptr_(ptr), size_(size) {}
+
+    T& operator[] (cnn_size_t i) const { return ptr_[i]; }
+    T* data() const { return ptr_; }
+    cnn_size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T* begin() const { return ptr_; }
+    T* end() const { return ptr_ + size_; }
+
+ private:
+    T* ptr_;
+    cnn_size_t size_;
+};
+
+/**
+ * contiguous storage of a mini-batch, shape N x C x H x W.
+ *
+ * all samples live in one 64-byte aligned buffer. the sample stride is
+ * rounded up to a multiple of 64 bytes, so every sample also starts at an
+ * aligned address (the padding is kept zero). unlike tensor_t, a whole batch
+ * can be handed to a GEMM as a single matrix with leading dimension
+ * sample_stride().
+ *
+ * layers and edges keep their data in tensor_t. kernels which work on the
+ * whole batch (the fully-connected gemm path) gather it with from_tensor and
+ * scatter results with to_tensor or per sample.
+ **/
+class batch_tensor {
+ public:
+    batch_tensor() : num_(0), stride_(0) {}
+
+    batch_tensor(cnn_size_t num, const shape3d& shape)
+        : num_(0), shape_(shape), stride_(aligned_stride(shape.size())) {
+        resize(num);
+    }
+
+    batch_tensor(cnn_size_t num, cnn_size_t channels,
+                 cnn_size_t height, cnn_size_t width)
+        : batch_tensor(num, shape3d(width, height, channels)) {}
+
+    cnn_size_t num() const { return num_; }
+    cnn_size_t channels() const { return shape_.depth_; }
+    cnn_size_t height() const { return shape_.height_; }
+    cnn_size_t width() const { return shape_.width_; }
+    const shape3d& shape() const { return shape_; }
+
+    /**
+     * number of valid elements per sample (C*H*W)
+     **/
+    cnn_size_t sample_size() const { return shape_.size(); }
+
+    /**
+     * distance between two samples, in elements
+     **/
+    cnn_size_t sample_stride() const { return stride_; }
+
+    /**
+     * strides of the N, C, H and W axes, in elements
+     **/
+    cnn_size_t stride(int axis) const {
+        switch (axis) {
+            case 0: return stride_;
+            case 1: return shape_.area();
+            case 2: return shape_.width_;
+            case 3: return 1;
+            default: throw nn_error("batch_tensor: axis out of range");
+        }
+    }
+
+    float_t* data() { return data_.data(); }
+    const float_t* data() const { return data_.data(); }
+
+    float_t* sample(cnn_size_t n) { return &data_[n * stride_]; }
+    const float_t* sample(cnn_size_t n) const { return &data_[n * stride_]; }
+
+    sample_view<float_t> operator[] (cnn_size_t n) {
+        return sample_view<float_t>(sample(n), sample_size());
+    }
+
+    sample_view<const float_t> operator[] (cnn_size_t n) const {
+        return sample_view<const float_t>(sample(n), sample_size());
+    }
+
+    float_t& at(cnn_size_t n, cnn_size_t c, cnn_size_t h, cnn_size_t w) {
+        return data_[index(n, c, h, w)];
+    }
+
+    float_t at(cnn_size_t n, cnn_size_t c,
+               cnn_size_t h, cnn_size_t w) const {
+        return data_[index(n, c, h, w)];
+    }
+
+    /**
+     * change the number of samples. existing samples are kept,
+     * new samples are zero-filled
+     **/
+    void resize(cnn_size_t num) {
+        data_.resize(static_cast<size_t>(num) * stride_, float_t(0));
+        num_ = num;
+    }
+
+    /**
+     * change the shape and the number of samples. the values of the samples
+     * are unspecified afterwards (only the padding is zeroed), callers fill
+     * or zero what they use. the buffer is kept, so a batch_tensor reused for
+     * batches of the same or smaller size doesn't allocate
+     **/
+    void reshape(cnn_size_t num, const shape3d& shape) {
+        shape_ = shape;
+        stride_ = aligned_stride(shape.size());
+        data_.resize(static_cast<size_t>(num) * stride_, float_t(0));
+        num_ = num;
+        if (stride_ > sample_size()) {
+            for (cnn_size_t n = 0; n < num_; n++) {
+                std::fill(sample(n) + sample_size(), sample(n) + stride_,
+                          float_t(0));
+            }
+        }
+    }
+
+    void fill(float_t value) {
+        for (cnn_size_t n = 0; n < num_; n++) {
+            std::fill(sample(n), sample(n) + sample_size(), value);
+        }
+    }
+
+    /**
+     * copy samples from tensor_t. every sample must have sample_size() elements
+     **/
+    void from_tensor(const tensor_t& src) {
+        resize(static_cast<cnn_size_t>(src.size()));
+        for (cnn_size_t n = 0; n < num_; n++) {
+            if (src[n].size() != sample_size())
+                throw nn_error("batch_tensor: sample size mismatch");
+            std::copy(src[n].begin(), src[n].end(), sample(n));
+        }
+    }
+
+    /**
+     * copy samples into tensor_t, reusing the rows already allocated in dst
+     **/
+    void to_tensor(tensor_t& dst) const {
+        dst.resize(num_);
+        for (cnn_size_t n = 0; n < num_; n++) {
+            dst[n].assign(sample(n), sample(n) + sample_size());
+        }
+    }
+
+ private:
+    static cnn_size_t aligned_stride(cnn_size_t size) {
+        const cnn_size_t align = 64 / sizeof(float_t);
+        return (size + align - 1) / align * align;
+    }
+
+    size_t index(cnn_size_t n, cnn_size_t c, cnn_size_t h, cnn_size_t w) const {
+        assert(n < num_);
+        return static_cast<size_t>(n) * stride_ + shape_.get_index(w, h, c);
+    }
+
+    cnn_size_t num_;
+    shape3d shape_;
+    cnn_size_t stride_;
+    vec_t data_;
+};
+
+/**
+ * scratch batch_tensor for kernels (see batch_tensor::reshape for the
+ * contents of a new one), taken from a per-thread free list and
+ * given back when the batch_scratch is destroyed, so the buffer is reused
+ * across calls.
+ *
+ * a buffer belongs to one batch_scratch for its whole lifetime. a thread
+ * waiting in for_i may run an unrelated task (e.g. the forward pass of
+ * another network), which then gets buffers of its own.
+ **/
+class batch_scratch {
+ public:
+    batch_scratch(cnn_size_t num, const shape3d& shape) : tensor_(acquire()) {
+        tensor_->reshape(num, shape);
+    }
+
+    ~batch_scratch() {
+        free_list().push_back(std::move(tensor_));
+    }
+
+    batch_scratch(const batch_scratch&) = delete;
+    batch_scratch& operator = (const batch_scratch&) = delete;
+
+    batch_tensor& get() { return *tensor_; }
+
+ private:
+    typedef std::vector<std::unique_ptr<batch_tensor>> tensor_list;
+
+    static tensor_list& free_list() {
+        static thread_local tensor_list list;
+        return list;
+    }
+
+    static std::unique_ptr<batch_tensor> acquire() {
+        tensor_list& list = free_list();
+        if (list.empty()) {
+            return std::unique_ptr<batch_tensor>(new batch_tensor());
+        }
+        std::unique_ptr<batch_tensor> t = std::move(list.back());
+        list.pop_back();
+        return t;
+    }
+
+    std::unique_ptr<batch_tensor> tensor_;
+};
+
+}  // namespace tiny_dnn
@@ -0,0 +1,107 @@
+/*
+    Copyright (c) 2016, Taiga Nomi
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(CNN_USE_SSE) || defined(CNN_USE_AVX)
+#include <immintrin.h>
+#endif
+
+namespace tiny_dnn {
+
+/**
+ * bfloat16: the upper 16 bits of an IEEE single, i.e. the same exponent
+ * range as float with an 8-bit significand (relative step 2^-8).
+ * storage only - values are widened to float to compute
+ **/
+struct bfloat16 {
+    uint16_t bits;
+};
+
+/**
+ * round to nearest, ties to even. NaN stays NaN (made quiet), overflow
+ * rounds to infinity like any other float narrowing
+ **/
+inline bfloat16 to_bfloat16(float x) {
+    uint32_t u;
+    std::memcpy(&u, &x, sizeof(u));
+    bfloat16 r;
+    if ((u & 0x7fffffffu) > 0x7f800000u) {
+        r.bits = static_cast<uint16_t>((u >> 16) | 0x40);
+    } else {
+        u += 0x7fffu + ((u >> 16) & 1u);
+        r.bits = static_cast<uint16_t>(u >> 16);
+    }
+    return r;
+}
+
+inline float to_float(bfloat16 x) {
+    const uint32_t u = static_cast<uint32_t>(x.bits) << 16;
+    float r;
+    std::memcpy(&r, &u, sizeof(r));
+    return r;
+}
+
+/**
+ * dst[i] = to_bfloat16(src[i]). double is narrowed through float
+ **/
+template <typename T>
+void to_bfloat16(const T* src, bfloat16* dst, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        dst[i] = to_bfloat16(static_cast<float>(src[i]));
+    }
+}
+
+/**
+ * dst[i] = to_float(src[i]). widening is exact, so the SSE2 path
+ * (8 values per step: interleave with zero halves) gives the same result
+ **/
+template <typename T>
+void from_bfloat16(const bfloat16* src, T* dst, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = static_cast<T>(to_float(src[i]));
+}
+
+#if defined(CNN_USE_SSE) || defined(CNN_USE_AVX)
+template <>
+inline void from_bfloat16<float>(const bfloat16* src, float* dst, size_t n) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_ps(dst + i,
+                      _mm_castsi128_ps(_mm_unpacklo_epi16(zero, v)));
+        _mm_storeu_ps(dst + i + 4,
+                      _mm_castsi128_ps(_mm_unpackhi_epi16(zero, v)));
+    }
+    for (; i < n; i++) dst[i] = to_float(src[i]);
+}
+#endif
+
+}  // namespace tiny_dnn
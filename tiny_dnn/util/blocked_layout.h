@@ -0,0 +1,139 @@
+/*
+    Copyright (c) 2016, Taiga Nomi
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <algorithm>
+#include <vector>
+
+#include "tiny_dnn/util/util.h"
+
+namespace tiny_dnn {
+
+/**
+ * memory layout of a data tensor (per sample)
+ *
+ * nchw     planar, index = (c * height + y) * width + x.
+ *          every layer understands this layout.
+ * nchw8c   channels split into blocks of 8 (nchw16c: 16), with the channels
+ *          of a block interleaved per pixel:
+ *          index = ((c / 8 * height + y) * width + x) * 8 + c % 8.
+ *          the last block is padded up to 8 channels.
+ *
+ * blocked layouts put one vector register of channels at every pixel,
+ * so kernels can vectorize over channels whatever the spatial shape is.
+ * values of padded channels are unspecified, but always finite; kernels
+ * must not mix them into real channels.
+ **/
+enum class data_layout {
+    nchw,
+    nchw8c,
+    nchw16c
+};
+
+/**
+ * number of channels in a block (1 for planar)
+ **/
+inline cnn_size_t layout_block(data_layout layout) {
+    switch (layout) {
+        case data_layout::nchw8c:  return 8;
+        case data_layout::nchw16c: return 16;
+        default:                   return 1;
+    }
+}
+
+/**
+ * blocked layout matching the widest vector register of the target
+ **/
+inline data_layout native_blocked_layout() {
+#ifdef __AVX512F__
+    return data_layout::nchw16c;
+#else
+    return data_layout::nchw8c;
+#endif
+}
+
+/**
+ * number of elements of a sample of the given shape, padded channels included
+ **/
+inline cnn_size_t layout_size(const shape3d& shape, data_layout layout) {
+    const cnn_size_t b = layout_block(layout);
+    return (shape.depth_ + b - 1) / b * b * shape.area();
+}
+
+inline cnn_size_t layout_index(const shape3d& shape, data_layout layout,
+                               cnn_size_t x, cnn_size_t y, cnn_size_t c) {
+    const cnn_size_t b = layout_block(layout);
+    return ((c / b * shape.height_ + y) * shape.width_ + x) * b + c % b;
+}
+
+/**
+ * copy a sample of the given shape from one layout to another.
+ * padded channels of dst are set to zero
+ **/
+inline void reorder_layout(const shape3d& shape,
+                           const float_t* src, data_layout src_layout,
+                           float_t* dst, data_layout dst_layout) {
+    const cnn_size_t area = shape.area();
+
+    if (src_layout == dst_layout) {
+        std::copy(src, src + layout_size(shape, src_layout), dst);
+        return;
+    }
+
+    const cnn_size_t sb = layout_block(src_layout);
+    const cnn_size_t db = layout_block(dst_layout);
+    const cnn_size_t dst_depth = layout_size(shape, dst_layout) / area;
+
+    // walk dst in order, so writes are sequential and padding is covered
+    for (cnn_size_t c0 = 0; c0 < dst_depth; c0 += db) {
+        float_t* d = dst + c0 * area;
+        for (cnn_size_t i = 0; i < area; i++) {
+            for (cnn_size_t l = 0; l < db; l++) {
+                const cnn_size_t c = c0 + l;
+                *d++ = c < shape.depth_ ?
+                    src[(c / sb * area + i) * sb + c % sb] : float_t(0);
+            }
+        }
+    }
+}
+
+/**
+ * reorder every sample of src into dst (resized to fit)
+ **/
+inline void reorder_layout(const shape3d& shape,
+                           const tensor_t& src, data_layout src_layout,
+                           tensor_t& dst, data_layout dst_layout,
+                           bool parallelize = true) {
+    const cnn_size_t size = layout_size(shape, dst_layout);
+    dst.resize(src.size());
+    for_i(parallelize, src.size(), [&](int sample) {
+        dst[sample].resize(size);
+        reorder_layout(shape, &src[sample][0], src_layout,
+                       &dst[sample][0], dst_layout);
+    }, 1);
+}
+
+}  // namespace tiny_dnn
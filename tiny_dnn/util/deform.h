@@ -30,9 +30,11 @@
 namespace tiny_dnn {
 
 inline vec_t corrupt(vec_t&& in, float_t corruption_level, float_t min_value) {
-    for (size_t i = 0; i < in.size(); i++)
-        if (bernoulli(corruption_level))
-            in[i] = min_value;
+    parallel_rand(in.size(), [&](philox_engine& gen, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            if (bernoulli(gen, corruption_level))
+                in[i] = min_value;
+    });
     return in;
 }
 
@@ -0,0 +1,203 @@
+/*
+    Copyright (c) 2016, Taiga Nomi
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "tiny_dnn/node.h"
+#include "tiny_dnn/layers/layer.h"
+
+namespace tiny_dnn {
+
+/**
+ * liveness-based activation memory planner for inference.
+ *
+ * given layers in execution (topological) order, the planner computes the
+ * lifetime [producer, last consumer] of every layer output, and assigns
+ * outputs whose lifetimes don't overlap to the same arena buffer.
+ * gradients aren't needed in inference, so all planned edges share one empty
+ * gradient tensor.
+ *
+ * outputs of the network (and edges without consumers) keep their own
+ * storage. after planning, intermediate layer outputs are only valid until
+ * the next layer using the same buffer runs, and backward must not be
+ * called until release().
+ **/
+class memory_planner {
+ public:
+    memory_planner()
+        : empty_grad_(1), naive_bytes_(0), planned_bytes_(0) {}
+
+    // edges point into our buffers, so copies start unplanned
+    memory_planner(const memory_planner&) : memory_planner() {}
+
+    memory_planner& operator = (const memory_planner&) {
+        release();
+        return *this;
+    }
+
+    ~memory_planner() {
+        release();
+    }
+
+    /**
+     * @param order   layers in execution order
+     * @param outputs layers whose outputs are read after forward
+     **/
+    void plan(const std::vector<layerptr_t>& order,
+              const std::vector<layerptr_t>& outputs) {
+        release();
+
+        std::unordered_map<const node*, size_t> step;
+        for (size_t i = 0; i < order.size(); i++) {
+            step[order[i]] = i;
+        }
+        std::unordered_set<const node*> pinned_layers(outputs.begin(),
+                                                      outputs.end());
+
+        struct lifetime {
+            edgeptr_t edge;
+            size_t first;
+            size_t last;
+        };
+        std::vector<lifetime> lifetimes;
+
+        for (size_t s = 0; s < order.size(); s++) {
+            for (auto& e : order[s]->outputs()) {
+                const size_t bytes = e->storage_size() * sizeof(float_t);
+                naive_bytes_ += 2 * bytes;  // data + gradient
+
+                bool pinned = pinned_layers.count(order[s]) > 0 ||
+                    (e->vtype() == vector_type::data && e->next().empty());
+                size_t last = s;
+
+                for (auto n : e->next()) {
+                    auto it = step.find(n);
+                    if (it == step.end()) {
+                        pinned = true;
+                        break;
+                    }
+                    last = std::max(last, it->second);
+                }
+
+                if (pinned) {
+                    planned_bytes_ += 2 * bytes;
+                } else {
+                    lifetimes.push_back(lifetime{ e, s, last });
+                }
+            }
+        }
+
+        // lifetimes are ordered by producer, so a buffer whose last user
+        // ran before the current producer is free. prefer the smallest free
+        // buffer that fits, otherwise grow the largest free one
+        std::vector<size_t> buffer_size, buffer_last;
+        std::vector<size_t> assignment;
+
+        for (auto& l : lifetimes) {
+            const size_t need = l.edge->storage_size();
+            size_t best = buffer_size.size();
+
+            for (size_t b = 0; b < buffer_size.size(); b++) {
+                if (buffer_last[b] >= l.first) continue;
+                if (best == buffer_size.size()) {
+                    best = b;
+                    continue;
+                }
+                const bool fits = buffer_size[b] >= need;
+                const bool best_fits = buffer_size[best] >= need;
+                if ((fits && (!best_fits || buffer_size[b] < buffer_size[best])) ||
+                    (!fits && !best_fits && buffer_size[b] > buffer_size[best])) {
+                    best = b;
+                }
+            }
+
+            if (best == buffer_size.size()) {
+                buffer_size.push_back(need);
+                buffer_last.push_back(l.last);
+            } else {
+                buffer_size[best] = std::max(buffer_size[best], need);
+                buffer_last[best] = l.last;
+            }
+            assignment.push_back(best);
+        }
+
+        for (auto size : buffer_size) {
+            buffers_.emplace_back(new tensor_t(1, vec_t(size)));
+            planned_bytes_ += size * sizeof(float_t);
+        }
+
+        for (size_t i = 0; i < lifetimes.size(); i++) {
+            lifetimes[i].edge->set_shared_storage(
+                buffers_[assignment[i]].get(), &empty_grad_);
+            planned_edges_.push_back(lifetimes[i].edge);
+        }
+    }
+
+    /**
+     * give every planned edge its own storage back
+     **/
+    void release() {
+        for (auto& e : planned_edges_) {
+            e->set_shared_storage(nullptr, nullptr);
+        }
+        planned_edges_.clear();
+        buffers_.clear();
+        empty_grad_.assign(1, vec_t());
+        naive_bytes_ = planned_bytes_ = 0;
+    }
+
+    bool planned() const { return !planned_edges_.empty(); }
+
+    /**
+     * number of arena buffers shared by planned edges
+     **/
+    size_t num_buffers() const { return buffers_.size(); }
+
+    /**
+     * bytes per sample for all layer outputs (data + gradient),
+     * if every edge had its own storage
+     **/
+    size_t naive_bytes() const { return naive_bytes_; }
+
+    /**
+     * bytes per sample after planning (arena buffers + pinned edges)
+     **/
+    size_t planned_bytes() const { return planned_bytes_; }
+
+ private:
+    std::vector<std::unique_ptr<tensor_t>> buffers_;
+    std::vector<edgeptr_t> planned_edges_;
+    tensor_t empty_grad_;
+    size_t naive_bytes_;
+    size_t planned_bytes_;
+};
+
+}  // namespace tiny_dnn
@@ -0,0 +1,272 @@
+/*
+    Copyright (c) 2016, Taiga Nomi
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+#ifdef __MINGW32__
+#include <mm_malloc.h>
+#endif
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace tiny_dnn {
+
+inline void* aligned_malloc(std::size_t align, std::size_t size) {
+#if defined(_MSC_VER)
+    return ::_aligned_malloc(size, align);
+#elif defined (__ANDROID__)
+    return ::memalign(align, size);
+#elif defined (__MINGW32__)
+    return _mm_malloc(size, align);
+#else // posix assumed
+    void* p;
+    if (::posix_memalign(&p, align, size) != 0) {
+        p = 0;
+    }
+    return p;
+#endif
+}
+
+inline void aligned_free(void* ptr) {
+#if defined(_MSC_VER)
+    ::_aligned_free(ptr);
+#elif defined(__MINGW32__)
+    ::_mm_free(ptr);
+#else
+    ::free(ptr);
+#endif
+}
+
+/**
+ * size-class pool of 64-byte aligned blocks.
+ *
+ * requests are rounded up to a size class: multiples of 64 bytes up to 256,
+ * then four classes per power of two, so a block wastes at most 25% of its
+ * size. freed blocks go to a small per-thread cache first, and overflow to a
+ * global free list shared by all threads. only a miss in both hits the system
+ * allocator. blocks larger than max_block_size bypass the pool, so the large
+ * buffers of big layers are returned to the system as soon as they are freed.
+ *
+ * other memory kept by the pool is returned to the system only by release().
+ * with a stable batch size, training reaches a steady state where every
+ * pooled allocation is served from the pool (see stats()).
+ **/
+class memory_pool {
+ public:
+    static const std::size_t alignment = 64;
+    static const std::size_t max_block_size = std::size_t(1) << 22;
+
+    struct statistics {
+        uint64_t system_allocations;  ///< blocks taken from the system allocator
+        uint64_t pool_allocations;    ///< blocks served from a cache/free list
+        uint64_t system_bytes;        ///< total bytes taken from the system
+    };
+
+    // intentionally leaked: static objects may free blocks after exit()
+    static memory_pool& get_instance() {
+        static memory_pool* instance = new memory_pool();
+        return *instance;
+    }
+
+    memory_pool(const memory_pool&) = delete;
+    memory_pool& operator = (const memory_pool&) = delete;
+
+    void* allocate(std::size_t bytes) {
+        if (bytes > max_block_size) {
+            return system_allocate(bytes);
+        }
+
+        const int c = size_class(bytes);
+        thread_cache* cache = local_cache();
+
+        if (cache && !cache->blocks[c].empty()) {
+            void* p = cache->blocks[c].back();
+            cache->blocks[c].pop_back();
+            pool_allocations_.fetch_add(1, std::memory_order_relaxed);
+            return p;
+        }
+
+        {
+            free_list& list = global_[c];
+            std::lock_guard<std::mutex> lock(list.mutex);
+            if (!list.blocks.empty()) {
+                void* p = list.blocks.back();
+                list.blocks.pop_back();
+                pool_allocations_.fetch_add(1, std::memory_order_relaxed);
+                return p;
+            }
+        }
+
+        return system_allocate(class_size(c));
+    }
+
+    void deallocate(void* p, std::size_t bytes) {
+        if (!p) return;
+        if (bytes > max_block_size) {
+            aligned_free(p);
+            return;
+        }
+
+        const int c = size_class(bytes);
+        thread_cache* cache = local_cache();
+
+        if (cache) {
+            std::vector<void*>& blocks = cache->blocks[c];
+            blocks.push_back(p);
+            if (blocks.size() > cache_limit(c)) {
+                // move the older half to the global list
+                const std::size_t n = blocks.size() / 2;
+                free_list& list = global_[c];
+                std::lock_guard<std::mutex> lock(list.mutex);
+                list.blocks.insert(list.blocks.end(),
+                                   blocks.begin(), blocks.begin() + n);
+                blocks.erase(blocks.begin(), blocks.begin() + n);
+            }
+            return;
+        }
+
+        free_list& list = global_[c];
+        std::lock_guard<std::mutex> lock(list.mutex);
+        list.blocks.push_back(p);
+    }
+
+    statistics stats() const {
+        statistics s;
+        s.system_allocations = system_allocations_.load(std::memory_order_relaxed);
+        s.pool_allocations = pool_allocations_.load(std::memory_order_relaxed);
+        s.system_bytes = system_bytes_.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    /**
+     * return blocks in the global free list to the system.
+     * blocks in per-thread caches are kept.
+     **/
+    void release() {
+        for (auto& list : global_) {
+            std::lock_guard<std::mutex> lock(list.mutex);
+            for (void* p : list.blocks) aligned_free(p);
+            list.blocks.clear();
+        }
+    }
+
+ private:
+    // 64, 128, 192, 256, then 4 classes per power of two up to max_block_size
+    static const int num_classes = 4 + 4 * 14;
+
+    struct free_list {
+        std::mutex mutex;
+        std::vector<void*> blocks;
+    };
+
+    struct thread_cache {
+        std::vector<void*> blocks[num_classes];
+    };
+
+    // flushes the cache of an exiting thread into the global lists
+    struct cache_guard {
+        cache_guard() : cache(new thread_cache()) {}
+        ~cache_guard() {
+            memory_pool& pool = get_instance();
+            for (int c = 0; c < num_classes; c++) {
+                free_list& list = pool.global_[c];
+                std::lock_guard<std::mutex> lock(list.mutex);
+                list.blocks.insert(list.blocks.end(),
+                                   cache->blocks[c].begin(),
+                                   cache->blocks[c].end());
+            }
+            delete cache;
+            cache = nullptr;
+            cache_state() = state::destroyed;
+        }
+        thread_cache* cache;
+    };
+
+    enum class state { uninitialized, alive, destroyed };
+
+    memory_pool()
+        : system_allocations_(0), pool_allocations_(0), system_bytes_(0) {}
+
+    static state& cache_state() {
+        static thread_local state s = state::uninitialized;
+        return s;
+    }
+
+    // nullptr while the calling thread is being torn down
+    static thread_cache* local_cache() {
+        if (cache_state() == state::destroyed) return nullptr;
+        static thread_local cache_guard guard;
+        cache_state() = state::alive;
+        return guard.cache;
+    }
+
+    static int size_class(std::size_t bytes) {
+        if (bytes <= 4 * alignment) {
+            return bytes == 0 ? 0 : static_cast<int>((bytes - 1) / alignment);
+        }
+        // 2^k < bytes <= 2^(k+1), split into 4 steps of 2^(k-2)
+        int k = 8;
+        while ((std::size_t(1) << (k + 1)) < bytes) k++;
+        const std::size_t step = std::size_t(1) << (k - 2);
+        const std::size_t i = (bytes - (std::size_t(1) << k) + step - 1) / step;
+        return 3 + (k - 8) * 4 + static_cast<int>(i);
+    }
+
+    static std::size_t class_size(int c) {
+        if (c < 4) return alignment * (c + 1);
+        const int k = 8 + (c - 4) / 4;
+        const std::size_t i = (c - 4) % 4 + 1;
+        return (std::size_t(1) << k) + i * (std::size_t(1) << (k - 2));
+    }
+
+    // blocks kept per size class in each thread: 4..32 blocks, ~64KB.
+    // kept small so blocks freed by other threads reach the global list soon
+    static std::size_t cache_limit(int c) {
+        const std::size_t n = (std::size_t(1) << 16) / class_size(c);
+        return n < 4 ? 4 : (n > 32 ? 32 : n);
+    }
+
+    void* system_allocate(std::size_t bytes) {
+        void* p = aligned_malloc(alignment, bytes);
+        if (p) {
+            system_allocations_.fetch_add(1, std::memory_order_relaxed);
+            system_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+        }
+        return p;
+    }
+
+    free_list global_[num_classes];
+    std::atomic<uint64_t> system_allocations_;
+    std::atomic<uint64_t> pool_allocations_;
+    std::atomic<uint64_t> system_bytes_;
+};
+
+}  // namespace tiny_dnn
@@ -25,6 +25,7 @@
     SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #pragma once
+#include <algorithm>
 #include <vector>
 #include <type_traits>
 #include <limits>
@@ -43,9 +44,12 @@
 #include <tbb/task_group.h>
 #endif
 
-#ifndef CNN_USE_OMP
-#include <thread>
-#include <future>
+#ifdef CNN_USE_OMP
+#include <omp.h>
+#endif
+
+#if !defined(CNN_USE_TBB) && !defined(CNN_USE_OMP) && !defined(CNN_SINGLE_THREAD)
+#include "thread_pool.h"
 #endif
 
 namespace tiny_dnn {
@@ -89,10 +93,14 @@ void xparallel_for(size_t begin, size_t end, const Func& f) {
 #if defined(CNN_USE_OMP)
 
 template<typename Func>
-void parallel_for(int begin, int end, const Func& f, int /*grainsize*/) {
+void parallel_for(int begin, int end, const Func& f, int grainsize) {
+    const int n = end - begin;
+    const int nblocks = n > grainsize ? n / std::max(grainsize, 1) : n;
     #pragma omp parallel for
-    for (int i=begin; i<end; ++i)
-        f(blocked_range(i,i+1));
+    for (int i = 0; i < nblocks; ++i) {
+        f(blocked_range(begin + static_cast<int>(static_cast<long long>(n) * i / nblocks),
+                        begin + static_cast<int>(static_cast<long long>(n) * (i + 1) / nblocks)));
+    }
 }
 
 #elif defined(CNN_SINGLE_THREAD)
@@ -104,38 +112,72 @@ void parallel_for(int begin, int end, const Func& f, int /*grainsize*/) {
 
 #else
 
+/**
+ * dispatch blocked ranges into the process-wide thread_pool.
+ * chunks are never smaller than grainsize, unless the whole range is
+ * not larger than grainsize (then it is split freely, as in the tbb path).
+ **/
 template<typename Func>
-void parallel_for(int start, int end, const Func &f, int /*grainsize*/) {
-    int nthreads = std::thread::hardware_concurrency();
-    int blockSize = (end - start) / nthreads;
-    if (blockSize*nthreads < end - start)
-        blockSize++;
-
-    std::vector<std::future<void>> futures;
-
-    int blockStart = start;
-    int blockEnd = blockStart + blockSize;
-    if (blockEnd > end) blockEnd = end;
-
-    for (int i = 0; i < nthreads; i++) {
-        futures.push_back(std::move(std::async(std::launch::async, [blockStart, blockEnd, &f] {
-            f(blocked_range(blockStart, blockEnd));
-        })));
-
-        blockStart += blockSize;
-        blockEnd = blockStart + blockSize;
-        if (blockStart >= end) break;
-        if (blockEnd > end) blockEnd = end;
-    }
-
-    for (auto &future : futures)
-        future.wait();
+void parallel_for(int begin, int end, const Func& f, int grainsize) {
+    thread_pool::get_instance().run(begin, end, grainsize,
+        [&f](int b, int e) { f(blocked_range(b, e)); });
 }
 
 #endif
 
 #endif // CNN_USE_TBB
 
+/**
+ * max number of threads parallel_for can run at the same time
+ **/
+inline int max_concurrency() {
+#if defined(CNN_USE_TBB)
+    return tbb::task_scheduler_init::default_num_threads();
+#elif defined(CNN_USE_OMP)
+    return omp_get_max_threads();
+#elif defined(CNN_SINGLE_THREAD)
+    return 1;
+#else
+    return thread_pool::get_instance().num_threads();
+#endif
+}
+
+/**
+ * limit the number of threads used by parallel_for/for_i called from the
+ * current thread, while this object is alive. nested calls share the same
+ * budget. num_threads <= 0 means no limit.
+ *
+ * with CNN_USE_TBB the budget is ignored and tbb's scheduler decides.
+ **/
+class thread_budget {
+ public:
+    explicit thread_budget(int num_threads) {
+#if defined(CNN_USE_OMP)
+        prev_ = omp_get_max_threads();
+        if (num_threads > 0) omp_set_num_threads(num_threads);
+#elif !defined(CNN_USE_TBB) && !defined(CNN_SINGLE_THREAD)
+        prev_ = thread_pool::current_budget();
+        thread_pool::current_budget() = num_threads;
+#else
+        prev_ = num_threads;
+#endif
+    }
+
+    ~thread_budget() {
+#if defined(CNN_USE_OMP)
+        omp_set_num_threads(prev_);
+#elif !defined(CNN_USE_TBB) && !defined(CNN_SINGLE_THREAD)
+        thread_pool::current_budget() = prev_;
+#endif
+    }
+
+    thread_budget(const thread_budget&) = delete;
+    thread_budget& operator = (const thread_budget&) = delete;
+
+ private:
+    int prev_;
+};
+
 template<typename T, typename U>
 bool value_representation(U const &value) {
     return static_cast<U>(static_cast<T>(value)) == value;
@@ -179,4 +221,22 @@ void for_i(T size, Func f, int grainsize = 100) {
     for_i(true, size, f, grainsize);
 }
 
+/**
+ * split [0, size) into nblocks contiguous blocks and call f(block, i) for
+ * every i. each block is processed in order by a single task, so f can
+ * accumulate into a per-block buffer without locking, and the partition
+ * only depends on size and nblocks.
+ **/
+template <typename T, typename Func>
+void for_each_block(bool parallelize, T size, size_t nblocks, Func f) {
+    if (nblocks == 0) return;
+    for_i(parallelize, nblocks, [&](int block) {
+        const size_t begin = static_cast<size_t>(size) * block / nblocks;
+        const size_t end = static_cast<size_t>(size) * (block + 1) / nblocks;
+        for (size_t i = begin; i < end; i++) {
+            f(block, static_cast<int>(i));
+        }
+    }, 1);
+}
+
 } // namespace tiny_dnn
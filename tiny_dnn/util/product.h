@@ -67,6 +67,7 @@ struct generic_vec_type {
     static register_type zero() { return register_type(0); }
     static register_type mul(const register_type& v1, const register_type& v2) { return v1 * v2; }
     static register_type add(const register_type& v1, const register_type& v2) { return v1 + v2; }
+    static register_type sub(const register_type& v1, const register_type& v2) { return v1 - v2; }
     static register_type load(const value_type* px) { return *px; }
     static register_type loadu(const value_type* px) { return *px; }
     static void store(value_type* px, const register_type& v) { *px = v; }
@@ -86,6 +87,7 @@ struct float_sse {
     static register_type zero() { register_type v = {}; return v; }
     static register_type mul(const register_type& v1, const register_type& v2) { return _mm_mul_ps(v1, v2); }
     static register_type add(const register_type& v1, const register_type& v2) { return _mm_add_ps(v1, v2); }
+    static register_type sub(const register_type& v1, const register_type& v2) { return _mm_sub_ps(v1, v2); }
     static register_type load(const value_type* px) { return _mm_load_ps(px); }
     static register_type loadu(const value_type* px) { return _mm_loadu_ps(px); }
     static void store(value_type* px, const register_type& v) { _mm_store_ps(px, v); }
@@ -107,6 +109,7 @@ struct double_sse {
     static register_type zero() { register_type v = {}; return v; }
     static register_type mul(const register_type& v1, const register_type& v2) { return _mm_mul_pd(v1, v2); }
     static register_type add(const register_type& v1, const register_type& v2) { return _mm_add_pd(v1, v2); }
+    static register_type sub(const register_type& v1, const register_type& v2) { return _mm_sub_pd(v1, v2); }
     static register_type load(const value_type* px) { return _mm_load_pd(px); }
     static register_type loadu(const value_type* px) { return _mm_loadu_pd(px); }
     static void store(value_type* px, const register_type& v) { _mm_store_pd(px, v); }
@@ -144,6 +147,7 @@ struct float_avx {
     static register_type zero() { register_type v = {}; return v; }
     static register_type mul(const register_type& v1, const register_type& v2) { return _mm256_mul_ps(v1, v2); }
     static register_type add(const register_type& v1, const register_type& v2) { return _mm256_add_ps(v1, v2); }
+    static register_type sub(const register_type& v1, const register_type& v2) { return _mm256_sub_ps(v1, v2); }
     static register_type load(const value_type* px) { return _mm256_load_ps(px); }
     static register_type loadu(const value_type* px) { return _mm256_loadu_ps(px); }
     static void store(value_type* px, const register_type& v) { _mm256_store_ps(px, v); }
@@ -165,6 +169,7 @@ struct double_avx {
     static register_type zero() { register_type v = {}; return v; }
     static register_type mul(const register_type& v1, const register_type& v2) { return _mm256_mul_pd(v1, v2); }
     static register_type add(const register_type& v1, const register_type& v2) { return _mm256_add_pd(v1, v2); }
+    static register_type sub(const register_type& v1, const register_type& v2) { return _mm256_sub_pd(v1, v2); }
     static register_type load(const value_type* px) { return _mm256_load_pd(px); }
     static register_type loadu(const value_type* px) { return _mm256_loadu_pd(px); }
     static void store(value_type* px, const register_type& v) { _mm256_store_pd(px, v); }
@@ -278,6 +283,53 @@ inline void reduce_aligned(const typename T::value_type* src, std::size_t  size,
         dst[i] += src[i];
 }
 
+template<typename T>
+inline typename T::value_type sum_nonaligned(const typename T::value_type* src, std::size_t  size) {
+    typename T::register_type result = T::zero();
+
+    for (std::size_t i = 0; i < size/T::unroll_size; i++)
+        result = T::add(result, T::loadu(&src[i*T::unroll_size]));
+
+    typename T::value_type sum = T::resemble(result);
+
+    for (std::size_t i = (size/T::unroll_size)*T::unroll_size; i < size; i++)
+        sum += src[i];
+
+    return sum;
+}
+
+template<typename T>
+inline typename T::value_type sum_squared_diff_nonaligned(const typename T::value_type* src, typename T::value_type c, std::size_t  size) {
+    typename T::register_type result = T::zero();
+    typename T::register_type center = T::set1(c);
+
+    for (std::size_t i = 0; i < size/T::unroll_size; i++) {
+        typename T::register_type d = T::sub(T::loadu(&src[i*T::unroll_size]), center);
+        result = T::add(result, T::mul(d, d));
+    }
+
+    typename T::value_type sum = T::resemble(result);
+
+    for (std::size_t i = (size/T::unroll_size)*T::unroll_size; i < size; i++)
+        sum += (src[i] - c) * (src[i] - c);
+
+    return sum;
+}
+
+template<typename T>
+inline void square_muladd_nonaligned(const typename T::value_type* src, typename T::value_type c, std::size_t  size, typename T::value_type* dst) {
+    typename T::register_type factor = T::set1(c);
+
+    for (std::size_t i = 0; i < size/T::unroll_size; i++) {
+        typename T::register_type d = T::loadu(&dst[i*T::unroll_size]);
+        typename T::register_type s = T::loadu(&src[i*T::unroll_size]);
+        T::storeu(&dst[i*T::unroll_size], T::add(d, T::mul(T::mul(s, s), factor)));
+    }
+
+    for (std::size_t i = (size/T::unroll_size)*T::unroll_size; i < size; i++)
+        dst[i] += src[i] * src[i] * c;
+}
+
 } // namespace detail
 
 #if defined(CNN_USE_AVX)
@@ -306,6 +358,24 @@ T dot(const T* s1, const T* s2, std::size_t  size) {
         return detail::dot_product_nonaligned<VECTORIZE_TYPE(T)>(s1, s2, size);
 }
 
+// sum(src[i])
+template<typename T>
+T sum(const T* src, std::size_t  size) {
+    return detail::sum_nonaligned<VECTORIZE_TYPE(T)>(src, size);
+}
+
+// sum((src[i] - c)^2)
+template<typename T>
+T sum_squared_diff(const T* src, T c, std::size_t  size) {
+    return detail::sum_squared_diff_nonaligned<VECTORIZE_TYPE(T)>(src, c, size);
+}
+
+// dst[i] += c * src[i]^2
+template<typename T>
+void square_muladd(const T* src, T c, std::size_t  size, T* dst) {
+    detail::square_muladd_nonaligned<VECTORIZE_TYPE(T)>(src, c, size, dst);
+}
+
 /// dst[i] += src[i]
 template<typename T>
 void reduce(const T* src, std::size_t  size, T* dst) {
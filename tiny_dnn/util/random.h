@@ -25,14 +25,25 @@
     SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 #pragma once
+#include <cstdint>
 #include <random>
 #include <type_traits>
 #include <limits>
 #include "nn_error.h"
 #include "tiny_dnn/config.h"
+#include "tiny_dnn/util/parallel_for.h"
+
+#if defined(CNN_USE_SSE) || defined(CNN_USE_AVX)
+#include <immintrin.h>
+#endif
 
 namespace tiny_dnn {
 
+/**
+ * the process-wide root generator, seeded by set_random_seed().
+ * it is not synchronized: draw from it on one thread only, and give
+ * parallel work its own streams (philox_engine, parallel_rand)
+ **/
 class random_generator {
 public:
     static random_generator& get_instance() {
@@ -100,4 +111,171 @@ void gaussian_rand(Iter begin, Iter end, float_t mean, float_t sigma) {
         *it = gaussian_rand(mean, sigma);
 }
 
+/**
+ * Philox4x32-10 counter-based generator (Salmon et al., "Parallel random
+ * numbers: as easy as 1, 2, 3", SC'11).
+ *
+ * maps a 128-bit counter and a 64-bit key to 4 random words. there is no
+ * state, so any thread can produce the numbers for any counter, and the
+ * result doesn't depend on which thread or in which order it does.
+ **/
+inline void philox4x32(const uint32_t ctr[4], const uint32_t key[2], uint32_t out[4]) {
+    uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for (int round = 0; round < 10; round++) {
+        const uint64_t p0 = uint64_t(0xD2511F53u) * c0;
+        const uint64_t p1 = uint64_t(0xCD9E8D57u) * c2;
+        c0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+        c1 = uint32_t(p1);
+        c2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+        c3 = uint32_t(p0);
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+#if defined(CNN_USE_SSE) || defined(CNN_USE_AVX)
+
+namespace detail {
+
+// (hi, lo) halves of the 64-bit products a[i] * m, for 4 lanes
+inline void mulhilo_epu32(__m128i a, __m128i m, __m128i* hi, __m128i* lo) {
+    // [lo0 hi0 lo2 hi2] and [lo1 hi1 lo3 hi3] into [lo0 lo2 hi0 hi2] ...
+    const __m128i even = _mm_shuffle_epi32(_mm_mul_epu32(a, m), _MM_SHUFFLE(3, 1, 2, 0));
+    const __m128i odd = _mm_shuffle_epi32(_mm_mul_epu32(_mm_srli_epi64(a, 32), m),
+                                          _MM_SHUFFLE(3, 1, 2, 0));
+    *lo = _mm_unpacklo_epi32(even, odd);
+    *hi = _mm_unpackhi_epi32(even, odd);
+}
+
+} // namespace detail
+
+/**
+ * philox4x32 for 4 counters at once: lane i of ctr[0..3] is the i-th
+ * counter, and lane i of out[0..3] its result.
+ **/
+inline void philox4x32(const __m128i ctr[4], const uint32_t key[2], __m128i out[4]) {
+    const __m128i m0 = _mm_set1_epi32(int(0xD2511F53u));
+    const __m128i m1 = _mm_set1_epi32(int(0xCD9E8D57u));
+    __m128i c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for (int round = 0; round < 10; round++) {
+        __m128i hi0, lo0, hi1, lo1;
+        detail::mulhilo_epu32(c0, m0, &hi0, &lo0);
+        detail::mulhilo_epu32(c2, m1, &hi1, &lo1);
+        c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32(int(k0)));
+        c1 = lo1;
+        c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32(int(k1)));
+        c3 = lo0;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+#endif // CNN_USE_SSE || CNN_USE_AVX
+
+/**
+ * random stream on philox4x32, usable with the std distributions.
+ * word i of stream s under key k is word i % 4 of
+ * philox4x32({i / 4, (i / 4) >> 32, s, s >> 32}, k); streams with
+ * different ids don't overlap, and none of them has state to share.
+ **/
+class philox_engine {
+public:
+    typedef uint32_t result_type;
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return 0xffffffffu; }
+
+    philox_engine(uint64_t key, uint64_t stream)
+        : key_{ uint32_t(key), uint32_t(key >> 32) },
+          ctr_{ 0, 0, uint32_t(stream), uint32_t(stream >> 32) },
+          pos_(4) {}
+
+    result_type operator()() {
+        if (pos_ == 4) {
+            philox4x32(ctr_, key_, buf_);
+            if (++ctr_[0] == 0) ++ctr_[1];
+            pos_ = 0;
+        }
+        return buf_[pos_++];
+    }
+
+private:
+    uint32_t key_[2];
+    uint32_t ctr_[4];
+    uint32_t buf_[4];
+    int pos_;
+};
+
+/**
+ * key for a set of philox streams, drawn from the root generator, so
+ * the streams follow set_random_seed()
+ **/
+inline uint64_t random_stream_key() {
+    std::mt19937& gen = random_generator::get_instance()();
+    const uint64_t lo = gen();
+    return (uint64_t(gen()) << 32) | lo;
+}
+
+/**
+ * calls f(gen, begin, end) for the chunks of [0, size), in parallel. the
+ * i-th chunk gets stream i of a fresh key. chunks have a fixed length,
+ * so the numbers don't depend on the number of threads
+ **/
+template <typename Func>
+void parallel_rand(size_t size, Func f) {
+    const size_t chunk = 4096;
+    const size_t nchunks = (size + chunk - 1) / chunk;
+    const uint64_t key = random_stream_key();
+
+    for_i(nchunks > 1, nchunks, [&](int i) {
+        philox_engine gen(key, uint64_t(i));
+        f(gen, i * chunk, std::min(size, (i + 1) * chunk));
+    }, 1);
+}
+
+template<typename Engine>
+inline bool bernoulli(Engine& gen, float_t p) {
+    return std::uniform_real_distribution<float_t>(float_t(0), float_t(1))(gen) <= p;
+}
+
+template<typename Engine, typename Iter>
+void uniform_rand(Engine& gen, Iter begin, Iter end, float_t min, float_t max) {
+    std::uniform_real_distribution<float_t> dst(min, max);
+    for (Iter it = begin; it != end; ++it)
+        *it = dst(gen);
+}
+
+template<typename Engine, typename Iter>
+void gaussian_rand(Engine& gen, Iter begin, Iter end, float_t mean, float_t sigma) {
+    std::normal_distribution<float_t> dst(mean, sigma);
+    for (Iter it = begin; it != end; ++it)
+        *it = dst(gen);
+}
+
+// uniform_rand(begin, end, min, max) on parallel streams
+template<typename Iter>
+void parallel_uniform_rand(Iter begin, Iter end, float_t min, float_t max) {
+    parallel_rand(static_cast<size_t>(end - begin),
+                  [&](philox_engine& gen, size_t first, size_t last) {
+        uniform_rand(gen, begin + first, begin + last, min, max);
+    });
+}
+
+// gaussian_rand(begin, end, mean, sigma) on parallel streams
+template<typename Iter>
+void parallel_gaussian_rand(Iter begin, Iter end, float_t mean, float_t sigma) {
+    parallel_rand(static_cast<size_t>(end - begin),
+                  [&](philox_engine& gen, size_t first, size_t last) {
+        gaussian_rand(gen, begin + first, begin + last, mean, sigma);
+    });
+}
+
 } // namespace tiny_dnn
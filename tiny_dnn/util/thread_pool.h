@@ -0,0 +1,279 @@
+/*
+    Copyright (c) 2016, Taiga Nomi
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+    notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+    notice, this list of conditions and the following disclaimer in the
+    documentation and/or other materials provided with the distribution.
+    * Neither the name of the <organization> nor the
+    names of its contributors may be used to endorse or promote products
+    derived from this software without specific prior written permission.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+    EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tiny_dnn {
+
+/**
+ * process-wide pool of persistent worker threads, used by parallel_for
+ *
+ * Each worker owns a task deque. The owner pushes and pops tasks at the back,
+ * idle threads steal from the front of other deques. A thread waiting for
+ * its own tasks keeps executing queued tasks instead of blocking, so nested
+ * parallel_for calls cannot deadlock the pool.
+ * Threads which don't belong to the pool submit to a shared deque (index 0).
+ *
+ * The number of threads used by a call can be limited per calling thread by
+ * current_budget(). Tasks inherit their share of the caller's budget, so
+ * nested calls stay within the limit.
+ **/
+class thread_pool {
+ public:
+    static thread_pool& get_instance() {
+        static thread_pool instance;
+        return instance;
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator = (const thread_pool&) = delete;
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stop_ = true;
+        }
+        sleep_cv_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+
+    /**
+     * number of threads which can run tasks at the same time
+     * (worker threads + the calling thread)
+     **/
+    int num_threads() const {
+        return static_cast<int>(workers_.size()) + 1;
+    }
+
+    /**
+     * max number of threads used by run() called from this thread (0: no limit)
+     **/
+    static int& current_budget() {
+        static thread_local int budget = 0;
+        return budget;
+    }
+
+    /**
+     * split [begin, end) into chunks and run f(chunk_begin, chunk_end) on the
+     * pool. returns after all chunks are finished, and rethrows the first
+     * exception thrown by f.
+     *
+     * @param grainsize minimum number of iterations per chunk.
+     *                  ignored if the whole range is not larger than grainsize
+     **/
+    template <typename Func>
+    void run(int begin, int end, int grainsize, const Func& f) {
+        const int n = end - begin;
+        if (n <= 0) return;
+
+        const int budget = current_budget();
+        const bool limited = budget > 0 && budget < num_threads();
+        const int grain = n > grainsize ? std::max(grainsize, 1) : 1;
+        const int nthreads = limited ? budget : num_threads();
+        // without a budget, a few chunks per thread to balance load between
+        // thieves. with a budget, one chunk per thread keeps the limit strict
+        const int max_chunks = limited ? nthreads : nthreads * 4;
+        const int nchunks = std::min(n / grain, max_chunks);
+
+        if (nthreads <= 1 || nchunks <= 1) {
+            f(begin, end);
+            return;
+        }
+
+        const int child_budget = limited ? std::max(1, nthreads / nchunks) : 0;
+        task_group group(nchunks);
+        queue& q = *queues_[current_index()];
+
+        auto chunk_begin = [&](int i) {
+            return begin + static_cast<int>(static_cast<int64_t>(n) * i / nchunks);
+        };
+
+        {
+            std::lock_guard<std::mutex> lock(q.mutex);
+            for (int i = nchunks - 1; i >= 1; i--) {
+                q.tasks.push_back(task{ &invoke<Func>, &f,
+                                        chunk_begin(i), chunk_begin(i + 1),
+                                        child_budget, &group });
+            }
+            queued_.fetch_add(nchunks - 1, std::memory_order_release);
+        }
+        wake_workers();
+
+        // first chunk runs on the calling thread
+        execute(task{ &invoke<Func>, &f, chunk_begin(0), chunk_begin(1),
+                      child_budget, &group });
+
+        // help with the remaining tasks until our own group is done
+        while (group.pending.load(std::memory_order_acquire) > 0) {
+            task t;
+            if (try_acquire(t)) {
+                execute(t);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+
+        if (group.error) std::rethrow_exception(group.error);
+    }
+
+ private:
+    struct task_group {
+        explicit task_group(int n) : pending(n) {}
+
+        void set_error(std::exception_ptr e) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) error = e;
+        }
+
+        std::atomic<int> pending;
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    struct task {
+        void (*fn)(const void*, int, int);
+        const void* arg;
+        int begin;
+        int end;
+        int budget;
+        task_group* group;
+    };
+
+    struct queue {
+        std::mutex mutex;
+        std::deque<task> tasks;
+    };
+
+    thread_pool() : stop_(false), queued_(0) {
+        int hw = static_cast<int>(std::thread::hardware_concurrency());
+        int nworkers = std::max(hw, 1) - 1;
+
+        for (int i = 0; i <= nworkers; i++) {
+            queues_.emplace_back(new queue());
+        }
+        for (int i = 1; i <= nworkers; i++) {
+            workers_.emplace_back([this, i] { worker_loop(i); });
+        }
+    }
+
+    template <typename Func>
+    static void invoke(const void* f, int begin, int end) {
+        (*static_cast<const Func*>(f))(begin, end);
+    }
+
+    // index of the deque owned by the calling thread (0 for non-pool threads)
+    static int& current_index() {
+        static thread_local int index = 0;
+        return index;
+    }
+
+    void execute(const task& t) {
+        const int prev_budget = current_budget();
+        current_budget() = t.budget;
+        try {
+            t.fn(t.arg, t.begin, t.end);
+        } catch (...) {
+            t.group->set_error(std::current_exception());
+        }
+        current_budget() = prev_budget;
+        t.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    // pop from own deque (LIFO), otherwise steal from others (FIFO)
+    bool try_acquire(task& t) {
+        if (queued_.load(std::memory_order_acquire) <= 0) return false;
+
+        const int self = current_index();
+        const int n = static_cast<int>(queues_.size());
+
+        {
+            queue& q = *queues_[self];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.tasks.empty()) {
+                t = q.tasks.back();
+                q.tasks.pop_back();
+                queued_.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+
+        for (int i = 1; i < n; i++) {
+            queue& q = *queues_[(self + i) % n];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.tasks.empty()) {
+                t = q.tasks.front();
+                q.tasks.pop_front();
+                queued_.fetch_sub(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void wake_workers() {
+        // taking the lock orders this notification after a sleeper's
+        // predicate check, so the wake-up can't be lost
+        { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+        sleep_cv_.notify_all();
+    }
+
+    void worker_loop(int index) {
+        current_index() = index;
+
+        for (;;) {
+            task t;
+            if (try_acquire(t)) {
+                execute(t);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            sleep_cv_.wait(lock, [this] {
+                return stop_ || queued_.load(std::memory_order_acquire) > 0;
+            });
+            if (stop_) return;
+        }
+    }
+
+    bool stop_;
+    std::atomic<int> queued_;
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    std::vector<std::unique_ptr<queue>> queues_;
+    std::vector<std::thread> workers_;
+};
+
+}  // namespace tiny_dnn
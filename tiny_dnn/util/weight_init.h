@@ -30,6 +30,11 @@
 namespace tiny_dnn {
 namespace weight_init {
 
+/**
+ * random initializers fill in parallel, each chunk of the weights from its
+ * own stream (parallel_rand), so a network of a given seed gets the same
+ * weights whatever the number of threads
+ **/
 class function {
 public:
     virtual void fill(vec_t *weight, cnn_size_t fan_in, cnn_size_t fan_out) = 0;
@@ -61,7 +66,7 @@ public:
     void fill(vec_t *weight, cnn_size_t fan_in, cnn_size_t fan_out) override {
         const float_t weight_base = std::sqrt(scale_ / (fan_in + fan_out));
 
-        uniform_rand(weight->begin(), weight->end(), -weight_base, weight_base);     
+        parallel_uniform_rand(weight->begin(), weight->end(), -weight_base, weight_base);     
     }
 };
 
@@ -82,7 +87,7 @@ public:
 
         const float_t weight_base = scale_ / std::sqrt(float_t(fan_in));
 
-        uniform_rand(weight->begin(), weight->end(), -weight_base, weight_base);
+        parallel_uniform_rand(weight->begin(), weight->end(), -weight_base, weight_base);
     }
 };
 
@@ -95,7 +100,7 @@ public:
         CNN_UNREFERENCED_PARAMETER(fan_in);
         CNN_UNREFERENCED_PARAMETER(fan_out);
 
-        gaussian_rand(weight->begin(), weight->end(), float_t(0), scale_);
+        parallel_gaussian_rand(weight->begin(), weight->end(), float_t(0), scale_);
     }
 };
 
@@ -122,7 +127,7 @@ public:
 
         const float_t sigma = std::sqrt(scale_ /fan_in);
 
-        gaussian_rand(weight->begin(), weight->end(), float_t(0), sigma);
+        parallel_gaussian_rand(weight->begin(), weight->end(), float_t(0), sigma);
     }
 };
 